@@ -0,0 +1,171 @@
+#include "DataDefs.h"
+#include "TileTypes.h"
+
+#include "modules/BlockMasks.h"
+
+#include "df/map_block.h"
+#include "df/tile_building_occ.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace DFHack;
+using namespace df::enums;
+
+// These compare every mask against a per-tile loop over the block. The
+// kernels under test are the SSE2 ones on x86 builds and the scalar ones
+// elsewhere, or when the library is built with BLOCKMASKS_NO_SIMD defined;
+// the designation and occupancy masks go through transpose either way.
+
+template<typename F>
+static df::tile_bitmask perTile(F pred) {
+    df::tile_bitmask out;
+    out.clear();
+    for (int x = 0; x < 16; x++)
+        for (int y = 0; y < 16; y++)
+            out.setassignment(x, y, pred(x, y));
+    return out;
+}
+
+static void expectSame(const df::tile_bitmask &actual, const df::tile_bitmask &expected, const char *what) {
+    for (int y = 0; y < 16; y++)
+        EXPECT_EQ(actual.bits[y], expected.bits[y]) << what << " row " << y;
+}
+
+// a block with random tiletypes, designations and occupancy
+static std::unique_ptr<df::map_block> randomBlock(uint32_t seed) {
+    static std::vector<df::tiletype> tiletypes;
+    if (tiletypes.empty()) {
+        FOR_ENUM_ITEMS(tiletype, tt)
+            tiletypes.push_back(tt);
+    }
+
+    std::mt19937 rng(seed);
+    std::unique_ptr<df::map_block> block(new df::map_block());
+    for (int x = 0; x < 16; x++) {
+        for (int y = 0; y < 16; y++) {
+            block->tiletype[x][y] = tiletypes[rng() % tiletypes.size()];
+            block->designation[x][y].whole = rng();
+            block->occupancy[x][y].whole = rng();
+        }
+    }
+    return block;
+}
+
+TEST(BlockMasks, tiletype_masks_match_per_tile) {
+    for (uint32_t seed = 1; seed <= 8; seed++) {
+        auto block = randomBlock(seed);
+        auto tt = [&](int x, int y) { return block->tiletype[x][y]; };
+
+        FOR_ENUM_ITEMS(tiletype_shape, shape) {
+            expectSame(BlockMasks::byShape(block.get(), shape),
+                       perTile([&](int x, int y) { return tileShape(tt(x, y)) == shape; }),
+                       ENUM_KEY_STR(tiletype_shape, shape).c_str());
+        }
+        FOR_ENUM_ITEMS(tiletype_shape_basic, basic) {
+            expectSame(BlockMasks::byShapeBasic(block.get(), basic),
+                       perTile([&](int x, int y) { return tileShapeBasic(tileShape(tt(x, y))) == basic; }),
+                       ENUM_KEY_STR(tiletype_shape_basic, basic).c_str());
+        }
+        FOR_ENUM_ITEMS(tiletype_material, material) {
+            expectSame(BlockMasks::byMaterial(block.get(), material),
+                       perTile([&](int x, int y) { return tileMaterial(tt(x, y)) == material; }),
+                       ENUM_KEY_STR(tiletype_material, material).c_str());
+        }
+        expectSame(BlockMasks::nonEmpty(block.get()), perTile([&](int x, int y) {
+            auto basic = tileShapeBasic(tileShape(tt(x, y)));
+            return basic != tiletype_shape_basic::None && basic != tiletype_shape_basic::Open;
+        }), "nonEmpty");
+    }
+}
+
+TEST(BlockMasks, designation_masks_match_per_tile) {
+    std::mt19937 rng(42);
+    for (uint32_t seed = 1; seed <= 8; seed++) {
+        auto block = randomBlock(seed);
+        auto word = [&](int x, int y) { return block->designation[x][y].whole; };
+
+        // every single bit, then random combinations of a few bits
+        std::vector<uint32_t> masks;
+        for (int bit = 0; bit < 32; bit++)
+            masks.push_back(1u << bit);
+        for (int i = 0; i < 16; i++)
+            masks.push_back(rng() & rng() & rng());
+        for (uint32_t bits : masks) {
+            df::tile_designation mask;
+            mask.whole = bits;
+            expectSame(BlockMasks::byDesignation(block.get(), mask),
+                       perTile([&](int x, int y) { return (word(x, y) & bits) != 0; }), "byDesignation");
+
+            // take the value from one of the tiles so that some tiles match
+            df::tile_designation value;
+            value.whole = word(rng() % 16, rng() % 16) ^ (rng() % 4 ? 0 : rng());
+            expectSame(BlockMasks::byDesignationValue(block.get(), mask, value),
+                       perTile([&](int x, int y) { return (word(x, y) & bits) == (value.whole & bits); }),
+                       "byDesignationValue");
+        }
+
+        expectSame(BlockMasks::hidden(block.get()),
+                   perTile([&](int x, int y) { return bool(block->designation[x][y].bits.hidden); }), "hidden");
+        expectSame(BlockMasks::liquid(block.get()),
+                   perTile([&](int x, int y) { return block->designation[x][y].bits.flow_size > 0; }), "liquid");
+        expectSame(BlockMasks::building(block.get()), perTile([&](int x, int y) {
+            return block->occupancy[x][y].bits.building != tile_building_occ::None;
+        }), "building");
+
+        df::tile_occupancy occ;
+        occ.whole = 0;
+        occ.bits.unit = true;
+        occ.bits.item = true;
+        expectSame(BlockMasks::byOccupancy(block.get(), occ), perTile([&](int x, int y) {
+            return block->occupancy[x][y].bits.unit || block->occupancy[x][y].bits.item;
+        }), "byOccupancy");
+    }
+}
+
+TEST(BlockMasks, single_tiles_land_on_their_bit) {
+    // one designated tile at a time catches any mixup of x and y in the
+    // transpose
+    std::unique_ptr<df::map_block> block(new df::map_block());
+    df::tile_designation mask;
+    mask.whole = 0;
+    mask.bits.dig = tile_dig_designation::Default;
+    for (int x = 0; x < 16; x++) {
+        for (int y = 0; y < 16; y++) {
+            for (int i = 0; i < 16; i++)
+                for (int j = 0; j < 16; j++)
+                    block->designation[i][j].whole = 0;
+            block->designation[x][y].bits.dig = tile_dig_designation::Default;
+
+            auto any = BlockMasks::byDesignation(block.get(), mask);
+            auto value = BlockMasks::byDesignationValue(block.get(), mask, mask);
+            EXPECT_EQ(BlockMasks::count(any), 1) << x << "," << y;
+            EXPECT_TRUE(any.getassignment(x, y)) << x << "," << y;
+            expectSame(value, any, "byDesignationValue");
+        }
+    }
+}
+
+TEST(BlockMasks, empty_and_full_blocks) {
+    std::unique_ptr<df::map_block> block(new df::map_block());
+    df::tile_designation mask;
+    mask.whole = 0;
+    mask.bits.hidden = true;
+
+    for (int x = 0; x < 16; x++)
+        for (int y = 0; y < 16; y++)
+            block->designation[x][y].whole = 0;
+    EXPECT_TRUE(BlockMasks::isEmpty(BlockMasks::hidden(block.get())));
+    df::tile_designation none;
+    none.whole = 0;
+    EXPECT_TRUE(BlockMasks::isFull(BlockMasks::byDesignationValue(block.get(), mask, none)));
+
+    for (int x = 0; x < 16; x++)
+        for (int y = 0; y < 16; y++)
+            block->designation[x][y].whole = 0xFFFFFFFF;
+    EXPECT_TRUE(BlockMasks::isFull(BlockMasks::hidden(block.get())));
+    EXPECT_EQ(BlockMasks::count(BlockMasks::liquid(block.get())), 256);
+}
@@ -38,6 +38,7 @@ distribution.
 #include "ModuleFactory.h"
 #include "RemoteServer.h"
 #include "RemoteTools.h"
+#include "TimeSlicing.h"
 #include "LuaTools.h"
 #include "DFHackVersion.h"
 #include "md5wrapper.h"
@@ -66,6 +67,8 @@ distribution.
 #include "df/world_data.h"
 
 #include <stdio.h>
+#include <bit>
+#include <cmath>
 #include <iomanip>
 #include <stdlib.h>
 #include <fstream>
@@ -135,6 +138,44 @@ struct Core::Private
     bool was_load_save{false};
 };
 
+size_t PerfHistogram::getBucket(uint64_t value_ns) {
+    if (value_ns < SUB_BUCKET_COUNT)
+        return value_ns;
+    int exponent = std::min<int>(std::bit_width(value_ns) - 1, MAX_EXPONENT);
+    int shift = exponent - SUB_BUCKET_BITS;
+    size_t sub_bucket = std::min<uint64_t>(value_ns >> shift, 2 * SUB_BUCKET_COUNT - 1) - SUB_BUCKET_COUNT;
+    return SUB_BUCKET_COUNT * (shift + 1) + sub_bucket;
+}
+
+uint64_t PerfHistogram::getBucketValue(size_t bucket) {
+    if (bucket < SUB_BUCKET_COUNT)
+        return bucket;
+    int shift = bucket / SUB_BUCKET_COUNT - 1;
+    uint64_t low = uint64_t(SUB_BUCKET_COUNT + bucket % SUB_BUCKET_COUNT) << shift;
+    // report the middle of the bucket's range
+    return low + ((uint64_t(1) << shift) >> 1);
+}
+
+void PerfHistogram::record(uint64_t value_ns) {
+    ++buckets[getBucket(value_ns)];
+    ++count;
+    total_ns += value_ns;
+    max_ns = std::max(max_ns, value_ns);
+}
+
+uint64_t PerfHistogram::getPercentile(double fraction) const {
+    if (count == 0)
+        return 0;
+    uint64_t target = std::max<uint64_t>(1, uint64_t(std::ceil(fraction * count)));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= target)
+            return std::min(getBucketValue(bucket), max_ns);
+    }
+    return max_ns;
+}
+
 void PerfCounters::reset(bool ignorePauseState) {
     *this = {};
     ignore_pause_state = ignorePauseState;
@@ -147,6 +188,30 @@ void PerfCounters::incCounter(uint32_t &counter, uint32_t baseline_ms) {
     counter += Core::getInstance().p->getTickCount() - baseline_ms;
 }
 
+uint64_t PerfCounters::getTimestampNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PerfCounters::addFrameTime(PerfHistogram &hist, uint64_t baseline_ns) {
+    hist.frame_ns += getTimestampNs() - baseline_ns;
+    if (!hist.frame_pending) {
+        hist.frame_pending = true;
+        frame_pending.push_back(&hist);
+    }
+}
+
+void PerfCounters::endFrame() {
+    bool record = ignore_pause_state || (World::isFortressMode() && !World::ReadPauseState());
+    for (auto hist : frame_pending) {
+        if (record)
+            hist->record(hist->frame_ns);
+        hist->frame_ns = 0;
+        hist->frame_pending = false;
+    }
+    frame_pending.clear();
+}
+
 bool PerfCounters::getIgnorePauseState() {
     return ignore_pause_state;
 }
@@ -1285,6 +1350,55 @@ command_result Core::runCommand(color_ostream &con, const std::string &first_, s
             return CR_WRONG_USAGE;
         }
     }
+    else if (first == "devel/trace")
+    {
+        if (parts.size() >= 1 && parts.size() <= 2 && parts[0] == "start")
+        {
+            size_t capacity = Tracing::DEFAULT_CAPACITY;
+            if (parts.size() == 2)
+            {
+                char *end = nullptr;
+                capacity = strtoul(parts[1].c_str(), &end, 10);
+                if (!capacity || *end)
+                {
+                    con.printerr("Invalid capacity: %s\n", parts[1].c_str());
+                    return CR_WRONG_USAGE;
+                }
+            }
+            Tracing::start(capacity);
+            con.print("Tracing started, keeping the most recent %zu spans.\n", Tracing::getCapacity());
+        }
+        else if (parts.size() == 1 && parts[0] == "stop")
+        {
+            Tracing::stop();
+            con.print("Tracing stopped.\n");
+        }
+        else if (parts.size() == 1 && parts[0] == "status")
+        {
+            con.print("Tracing is %s; %zu of %zu spans recorded.\n",
+                Tracing::isEnabled() ? "enabled" : "disabled",
+                Tracing::getCount(), Tracing::getCapacity());
+        }
+        else if (parts.size() == 2 && parts[0] == "dump")
+        {
+            int64_t count = Tracing::dump(parts[1]);
+            if (count < 0)
+            {
+                con.printerr("Could not write trace file: %s\n", parts[1].c_str());
+                return CR_FAILURE;
+            }
+            con.print("Wrote %lld spans to %s\n", (long long)count, parts[1].c_str());
+        }
+        else
+        {
+            con << "Usage:" << std::endl
+                << "  devel/trace start [<capacity>]" << std::endl
+                << "  devel/trace stop" << std::endl
+                << "  devel/trace status" << std::endl
+                << "  devel/trace dump <filename>" << std::endl;
+            return CR_WRONG_USAGE;
+        }
+    }
     else if (RunAlias(con, first, parts, res))
     {
         return res;
@@ -1500,7 +1614,8 @@ Core::Core() :
     CoreSuspendMutex{},
     CoreWakeup{},
     ownerThread{},
-    toolCount{0}
+    toolCount{0},
+    sharedReaders{0}
 {
     // init the console. This must be always the first step!
     plug_mgr = 0;
@@ -1727,6 +1842,7 @@ bool Core::InitSimulationThread()
     df_simulation_thread = std::this_thread::get_id();
     if(started)
         return true;
+    Tracing::setThreadName("simulation");
     if(errorstate)
         return false;
 
@@ -2022,13 +2138,76 @@ Core& Core::getInstance() {
     return instance;
 }
 
+// number of SharedCoreSuspenders held by the current thread
+static thread_local int shared_suspend_depth = 0;
+
 bool Core::isSuspended(void)
 {
-    return ownerThread.load() == std::this_thread::get_id();
+    return shared_suspend_depth > 0 || ownerThread.load() == std::this_thread::get_id();
+}
+
+bool Core::isSharedSuspended(void)
+{
+    return shared_suspend_depth > 0;
+}
+
+bool Core::waitForSharedReaders(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(SharedReaderMutex);
+    auto done = [this]() -> bool { return sharedReaders == 0; };
+    if (timeout == std::chrono::milliseconds::max())
+    {
+        SharedReadersDone.wait(lock, done);
+        return true;
+    }
+    return SharedReadersDone.wait_for(lock, timeout, done);
+}
+
+SharedCoreSuspender::SharedCoreSuspender(Core& core) : core{core}
+{
+    if (core.isSuspended())
+        return;
+
+    core.toolCount.fetch_add(1, std::memory_order_relaxed);
+    uint64_t wait_begin_ns = Tracing::isEnabled() ? Tracing::getTimestampNs() : 0;
+    {
+        // taking the suspend mutex guarantees that the simulation thread is
+        // parked in Core::Update and that no exclusive holder is active.
+        // the mutex is only held long enough to register as a reader.
+        std::lock_guard<decltype(core.CoreSuspendMutex)> suspend_lock(core.CoreSuspendMutex);
+        std::lock_guard<std::mutex> readers_lock(core.SharedReaderMutex);
+        ++core.sharedReaders;
+    }
+    if (wait_begin_ns)
+    {
+        hold_begin_ns = Tracing::getTimestampNs();
+        Tracing::addSpan("suspend", "SharedCoreSuspender wait", wait_begin_ns, hold_begin_ns);
+    }
+    owns_shared = true;
+    ++shared_suspend_depth;
+}
+
+SharedCoreSuspender::~SharedCoreSuspender()
+{
+    if (!owns_shared)
+        return;
+
+    --shared_suspend_depth;
+    if (hold_begin_ns)
+        Tracing::addSpan("suspend", "SharedCoreSuspender hold", hold_begin_ns, Tracing::getTimestampNs());
+    {
+        std::lock_guard<std::mutex> readers_lock(core.SharedReaderMutex);
+        if (--core.sharedReaders == 0)
+            core.SharedReadersDone.notify_all();
+    }
+    if (core.toolCount.fetch_add(-1, std::memory_order_relaxed) == 1)
+        core.CoreWakeup.notify_one();
 }
 
 void Core::doUpdate(color_ostream &out)
 {
+    Tracing::Span span("core", "Core::doUpdate");
+
     Lua::Core::Reset(out, "DF code execution");
 
     // find the current viewscreen
@@ -2144,6 +2323,8 @@ int Core::Update()
     // Pretend this thread has suspended the core in the usual way,
     // and run various processing hooks.
     {
+        Tracing::Span span("core", "Core::Update");
+
         if(!started)
         {
             // Initialize the core
@@ -2153,20 +2334,31 @@ int Core::Update()
         }
 
         uint32_t start_ms = p->getTickCount();
+        uint64_t start_ns = PerfCounters::getTimestampNs();
         unpaused_ms += perf_counters.registerTick(start_ms);
+        ++update_count;
         doUpdate(out);
         perf_counters.incCounter(perf_counters.total_update_ms, start_ms);
+        perf_counters.addFrameTime(perf_counters.frame_total_update, start_ns);
+        perf_counters.endFrame();
     }
 
     // Let all commands run that require CoreSuspender
-    CoreWakeup.wait(MainThread::suspend(),
-            [this]() -> bool {return this->toolCount.load() == 0;});
+    {
+        Tracing::Span span("core", "CoreWakeup.wait");
+        CoreWakeup.wait(MainThread::suspend(),
+                [this]() -> bool {return this->toolCount.load() == 0;});
+    }
 
     return 0;
 };
 
 extern bool buildings_do_onupdate;
 void buildings_onStateChange(color_ostream &out, state_change_event event);
+void maps_onStateChange(color_ostream &out, state_change_event event);
+void items_onStateChange(color_ostream &out, state_change_event event);
+void connectivity_onStateChange(color_ostream &out, state_change_event event);
+void mapjournal_onStateChange(color_ostream &out, state_change_event event);
 void buildings_onUpdate(color_ostream &out);
 
 static int buildings_timer = 0;
@@ -2176,8 +2368,10 @@ void Core::onUpdate(color_ostream &out)
     Gui::clearFocusStringCache();
 
     uint32_t step_start_ms = p->getTickCount();
+    uint64_t step_start_ns = PerfCounters::getTimestampNs();
     EventManager::manageEvents(out);
     perf_counters.incCounter(perf_counters.update_event_manager_ms, step_start_ms);
+    perf_counters.addFrameTime(perf_counters.frame_event_manager, step_start_ns);
 
     // convert building reagents
     if (buildings_do_onupdate && (++buildings_timer & 1))
@@ -2185,13 +2379,18 @@ void Core::onUpdate(color_ostream &out)
 
     // notify all the plugins that a game tick is finished
     step_start_ms = p->getTickCount();
+    step_start_ns = PerfCounters::getTimestampNs();
     plug_mgr->OnUpdate(out);
+    TimeSlicing::onUpdate(out);
     perf_counters.incCounter(perf_counters.update_plugin_ms, step_start_ms);
+    perf_counters.addFrameTime(perf_counters.frame_plugin, step_start_ns);
 
     // process timers in lua
     step_start_ms = p->getTickCount();
+    step_start_ns = PerfCounters::getTimestampNs();
     Lua::Core::onUpdate(out);
     perf_counters.incCounter(perf_counters.update_lua_ms, step_start_ms);
+    perf_counters.addFrameTime(perf_counters.frame_lua, step_start_ns);
 }
 
 void getFilesWithPrefixAndSuffix(const std::filesystem::path& folder, const std::string& prefix, const std::string& suffix, std::vector<std::filesystem::path>& result) {
@@ -2384,6 +2583,10 @@ void Core::onStateChange(color_ostream &out, state_change_event event)
         if (World::IsSiteLoaded())
             plug_mgr->doLoadSiteData(out);
         break;
+    case SC_MAP_UNLOADED:
+    case SC_WORLD_UNLOADED:
+        TimeSlicing::onMapUnloaded();
+        break;
     case SC_PAUSED:
         if (!perf_counters.getIgnorePauseState()) {
             perf_counters.elapsed_ms += p->getTickCount() - perf_counters.baseline_elapsed_ms;
@@ -2402,6 +2605,14 @@ void Core::onStateChange(color_ostream &out, state_change_event event)
 
     buildings_onStateChange(out, event);
 
+    maps_onStateChange(out, event);
+
+    items_onStateChange(out, event);
+
+    connectivity_onStateChange(out, event);
+
+    mapjournal_onStateChange(out, event);
+
     plug_mgr->OnStateChange(out, event);
 
     Lua::Core::onStateChange(out, event);
@@ -0,0 +1,40 @@
+#include "Core.h"
+#include <gtest/gtest.h>
+
+using namespace DFHack;
+
+TEST(PerfHistogram, empty) {
+    PerfHistogram hist;
+    ASSERT_EQ(hist.getCount(), 0);
+    ASSERT_EQ(hist.getMax(), 0);
+    ASSERT_EQ(hist.getPercentile(0.5), 0);
+}
+
+TEST(PerfHistogram, exact_small_values) {
+    PerfHistogram hist;
+    for (uint64_t i = 1; i <= 10; ++i)
+        hist.record(i);
+    ASSERT_EQ(hist.getCount(), 10);
+    ASSERT_EQ(hist.getTotal(), 55);
+    ASSERT_EQ(hist.getMax(), 10);
+    ASSERT_EQ(hist.getPercentile(0.5), 5);
+    ASSERT_EQ(hist.getPercentile(1.0), 10);
+}
+
+TEST(PerfHistogram, percentile_precision) {
+    PerfHistogram hist;
+    for (uint64_t i = 1; i <= 100000; ++i)
+        hist.record(i * 1000);
+    ASSERT_EQ(hist.getMax(), 100000000);
+    ASSERT_NEAR(double(hist.getPercentile(0.50)), 50000000.0, 50000000.0 * 0.07);
+    ASSERT_NEAR(double(hist.getPercentile(0.99)), 99000000.0, 99000000.0 * 0.07);
+    ASSERT_LE(hist.getPercentile(1.0), hist.getMax());
+}
+
+TEST(PerfHistogram, huge_values_are_clamped) {
+    PerfHistogram hist;
+    hist.record(UINT64_MAX);
+    ASSERT_EQ(hist.getCount(), 1);
+    ASSERT_EQ(hist.getMax(), UINT64_MAX);
+    ASSERT_GT(hist.getPercentile(0.5), 0);
+}
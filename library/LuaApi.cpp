@@ -38,9 +38,11 @@ distribution.
 #include "md5wrapper.h"
 #include "MiscUtils.h"
 #include "PluginManager.h"
+#include "TimeSlicing.h"
 
 #include "modules/Buildings.h"
 #include "modules/Burrows.h"
+#include "modules/Connectivity.h"
 #include "modules/Constructions.h"
 #include "modules/Designations.h"
 #include "modules/DFSDL.h"
@@ -50,6 +52,7 @@ distribution.
 #include "modules/Items.h"
 #include "modules/Job.h"
 #include "modules/Kitchen.h"
+#include "modules/MapJournal.h"
 #include "modules/Maps.h"
 #include "modules/Materials.h"
 #include "modules/Military.h"
@@ -2243,6 +2246,41 @@ static int units_getUnitsInBox(lua_State *state) {
     return 2;
 }
 
+// wraps the optional Lua filter function at the given stack index
+static std::function<bool(df::unit *)> get_unit_filter(lua_State *state, int fn_arg) {
+    if (lua_gettop(state) < fn_arg || lua_isnil(state, fn_arg))
+        return [](df::unit *) { return true; };
+    luaL_checktype(state, fn_arg, LUA_TFUNCTION);
+    if (lua_gettop(state) > fn_arg)
+        luaL_argerror(state, fn_arg+1, "too many arguments!");
+    return [state](df::unit *unit) {
+        lua_dup(state); // Copy function
+        Lua::PushDFObject(state, unit);
+        lua_call(state, 1, 1);
+        bool ret = lua_toboolean(state, -1);
+        lua_pop(state, 1); // Remove return value
+        return ret;
+    };
+}
+
+static int units_getUnitsInRadius(lua_State *state) {
+    df::coord pos;
+    Lua::CheckDFAssign(state, &pos, 1);
+    int radius = luaL_checkint(state, 2);
+    vector<df::unit *> units;
+    Units::getUnitsInRadius(units, pos, radius, get_unit_filter(state, 3));
+    Lua::PushVector(state, units);
+    return 1;
+}
+
+static int units_getNearestUnit(lua_State *state) {
+    df::coord pos;
+    Lua::CheckDFAssign(state, &pos, 1);
+    int max_radius = luaL_checkint(state, 2);
+    Lua::PushDFObject(state, Units::getNearestUnit(pos, max_radius, get_unit_filter(state, 3)));
+    return 1;
+}
+
 static int units_getCitizens(lua_State *L) {
     bool exclude_residents = lua_toboolean(L, 1); // defaults to false
     bool include_insane = lua_toboolean(L, 2); // defaults to false
@@ -2326,6 +2364,8 @@ static const luaL_Reg dfhack_units_funcs[] = {
     { "getNoblePositions", units_getNoblePositions },
     { "isUnitInBox", units_isUnitInBox },
     { "getUnitsInBox", units_getUnitsInBox },
+    { "getUnitsInRadius", units_getUnitsInRadius },
+    { "getNearestUnit", units_getNearestUnit },
     { "getCitizens", units_getCitizens },
     { "getUnitsByNobleRole", units_getUnitsByNobleRole},
     { "getCasteRaw", units_getCasteRaw},
@@ -2466,6 +2506,31 @@ static int items_createItem(lua_State *state)
     return 1;
 }
 
+static void push_census_counts(lua_State *state, const Items::ItemCensus::Counts &counts, const char *name) {
+    lua_createtable(state, 0, 2);
+    lua_pushinteger(state, counts.items);
+    lua_setfield(state, -2, "items");
+    lua_pushinteger(state, counts.stack);
+    lua_setfield(state, -2, "stack");
+    lua_setfield(state, -2, name);
+}
+
+static int items_getCensus(lua_State *state) {
+    auto type = (df::item_type)luaL_checkint(state, 1);
+    int16_t subtype = luaL_optint(state, 2, -1);
+    int16_t mat_type = luaL_optint(state, 3, -1);
+    int32_t mat_index = luaL_optint(state, 4, -1);
+    auto census = Items::getCensus(luaL_optint(state, 5, 100));
+    auto entry = census->get(type, subtype, mat_type, mat_index);
+    lua_createtable(state, 0, 4);
+    push_census_counts(state, entry.all, "all");
+    push_census_counts(state, entry.usable, "usable");
+    push_census_counts(state, entry.accessible, "accessible");
+    lua_pushinteger(state, census->frame);
+    lua_setfield(state, -2, "frame");
+    return 1;
+}
+
 static const luaL_Reg dfhack_items_funcs[] = {
     { "getOuterContainerRef", items_getOuterContainerRef },
     { "getContainedItems", items_getContainedItems },
@@ -2473,6 +2538,7 @@ static const luaL_Reg dfhack_items_funcs[] = {
     { "moveToBuilding", items_moveToBuilding },
     { "moveToInventory", items_moveToInventory },
     { "createItem", items_createItem },
+    { "getCensus", items_getCensus },
     { NULL, NULL }
 };
 
@@ -2576,6 +2642,60 @@ static int maps_getPlantAtTile(lua_State *L)
     return 1;
 }
 
+static int maps_canReach(lua_State *L)
+{
+    df::coord from, to;
+    Lua::CheckDFAssign(L, &from, 1);
+    Lua::CheckDFAssign(L, &to, 2);
+    auto mover = lua_toboolean(L, 3) ? Connectivity::WAGON : Connectivity::WALKER;
+    lua_pushboolean(L, Connectivity::canReach(from, to, mover));
+    return 1;
+}
+
+static int maps_getConnectedComponent(lua_State *L)
+{
+    df::coord pos;
+    Lua::CheckDFAssign(L, &pos, 1);
+    auto mover = lua_toboolean(L, 2) ? Connectivity::WAGON : Connectivity::WALKER;
+    lua_pushinteger(L, Connectivity::getComponent(pos, mover));
+    return 1;
+}
+
+static int maps_findPath(lua_State *L)
+{
+    df::coord from, to;
+    Lua::CheckDFAssign(L, &from, 1);
+    Lua::CheckDFAssign(L, &to, 2);
+    static const char *const movers[] = { "walker", "wagon", "flier", NULL };
+    Maps::PathMover mover;
+    switch (luaL_checkoption(L, 3, "walker", movers)) {
+    case 1: mover = Maps::PathMover::wagon(); break;
+    case 2: mover = Maps::PathMover::flier(); break;
+    default: mover = Maps::PathMover::walker(); break;
+    }
+    vector<df::coord> path;
+    if (!Maps::findPath(from, to, path, mover))
+        return 0;
+    Lua::PushVector(L, path);
+    return 1;
+}
+
+static int maps_getChangedBlocks(lua_State *L)
+{
+    auto since = (uint32_t)luaL_optinteger(L, 1, 0);
+    static const char *const aspects[] = {
+        "tiletypes", "designations", "liquids", "spatter", "items", "buildings", NULL
+    };
+    uint32_t mask = 0;
+    for (int i = 2; i <= lua_gettop(L); i++)
+        mask |= 1 << luaL_checkoption(L, i, NULL, aspects);
+    vector<df::coord> blocks;
+    uint32_t generation = MapJournal::getChangedBlocks(&blocks, since, mask ? mask : MapJournal::ALL);
+    Lua::PushVector(L, blocks);
+    lua_pushinteger(L, generation);
+    return 2;
+}
+
 static int maps_getBiomeType(lua_State *L)
 {
     auto pos = CheckCoordXY(L, 1, true);
@@ -2641,6 +2761,10 @@ static const luaL_Reg dfhack_maps_funcs[] = {
     { "getRegionBiome", maps_getRegionBiome },
     { "getTileBiomeRgn", maps_getTileBiomeRgn },
     { "getPlantAtTile", maps_getPlantAtTile },
+    { "canReach", maps_canReach },
+    { "getConnectedComponent", maps_getConnectedComponent },
+    { "findPath", maps_findPath },
+    { "getChangedBlocks", maps_getChangedBlocks },
     { "getBiomeType", maps_getBiomeType },
     { "isTileAquifer", maps_isTileAquifer },
     { "isTileHeavyAquifer", maps_isTileHeavyAquifer },
@@ -2711,6 +2835,11 @@ static const LuaWrapper::FunctionReg dfhack_burrows_module[] = {
     WRAPN(setAssignedBlockTile, burrows_setAssignedBlockTile),
     WRAPM(Burrows, isAssignedTile),
     WRAPM(Burrows, setAssignedTile),
+    WRAPM(Burrows, unionTiles),
+    WRAPM(Burrows, intersectTiles),
+    WRAPM(Burrows, subtractTiles),
+    WRAPM(Burrows, copyTiles),
+    WRAPM(Burrows, setTilesInBox),
     { NULL, NULL }
 };
 
@@ -2777,6 +2906,26 @@ static int buildings_findCivzonesAt(lua_State *L)
     return 1;
 }
 
+static int buildings_findAllAtTile(lua_State *L)
+{
+    auto pos = CheckCoordXYZ(L, 1, true);
+    vector<df::building*> pvec;
+    Buildings::findAllAtTile(&pvec, pos);
+    Lua::PushVector(L, pvec);
+    return 1;
+}
+
+static int buildings_findInBox(lua_State *L)
+{
+    df::coord p1, p2;
+    Lua::CheckDFAssign(L, &p1, 1);
+    Lua::CheckDFAssign(L, &p2, 2);
+    vector<df::building*> pvec;
+    Buildings::findInBox(&pvec, p1, p2);
+    Lua::PushVector(L, pvec);
+    return 1;
+}
+
 static int buildings_findPenPitAt(lua_State *L)
 {
     auto pos = CheckCoordXYZ(L, 1, true);
@@ -2848,6 +2997,8 @@ static int buildings_getCageOccupants(lua_State *state)
 static const luaL_Reg dfhack_buildings_funcs[] = {
     { "findAtTile", buildings_findAtTile },
     { "findCivzonesAt", buildings_findCivzonesAt },
+    { "findAllAtTile", buildings_findAllAtTile },
+    { "findInBox", buildings_findInBox },
     { "getCorrectSize", buildings_getCorrectSize },
     CWRAP(setSize, buildings_setSize),
     CWRAP(getStockpileContents, buildings_getStockpileContents),
@@ -3517,6 +3668,8 @@ static const LuaWrapper::FunctionReg dfhack_internal_module[] = {
     WRAPN(getAddressSizeInHeap, get_address_size_in_heap),
     WRAPN(getRootAddressOfHeapObject, get_root_address_of_heap_object),
     WRAPN(msizeAddress, msize_address),
+    WRAPN(getTimeSliceBudgetUs, TimeSlicing::getFrameBudgetUs),
+    WRAPN(setTimeSliceBudgetUs, TimeSlicing::setFrameBudgetUs),
     WRAP(getClipboardTextCp437),
     WRAP(setClipboardTextCp437),
     WRAP(setClipboardTextCp437Multiline),
@@ -4192,6 +4345,8 @@ static int internal_getPerfCounters(lua_State *L) {
     summary["update_lua_ms"] = counters.update_lua_ms;
     summary["total_keybinding_ms"] = counters.total_keybinding_ms;
     summary["total_overlay_ms"] = counters.total_overlay_ms;
+    summary["event_manager_job_clones"] = counters.event_manager_job_clones;
+    summary["event_manager_job_clones_avoided"] = counters.event_manager_job_clones_avoided;
     summary["total_zscreen_ms"] = std::accumulate(
         std::begin(counters.zscreen_per_focus), std::end(counters.zscreen_per_focus), 0,
         [](const uint32_t prev, const std::pair<const string, uint32_t>& p){ return prev + p.second; });
@@ -4206,6 +4361,68 @@ static int internal_getPerfCounters(lua_State *L) {
     return 8;
 }
 
+static std::map<const char *, uint64_t> summarize_histogram(const PerfHistogram & hist) {
+    std::map<const char *, uint64_t> stats;
+    stats["frames"] = hist.getCount();
+    stats["total_ns"] = hist.getTotal();
+    stats["p50_ns"] = hist.getPercentile(0.50);
+    stats["p95_ns"] = hist.getPercentile(0.95);
+    stats["p99_ns"] = hist.getPercentile(0.99);
+    stats["max_ns"] = hist.getMax();
+    return stats;
+}
+
+template<typename T_Key>
+static std::map<T_Key, std::map<const char *, uint64_t>> summarize_histograms(const std::unordered_map<T_Key, PerfHistogram> & in_map) {
+    std::map<T_Key, std::map<const char *, uint64_t>> out_map;
+    for (auto & [k, v] : in_map)
+        out_map[k] = summarize_histogram(v);
+    return out_map;
+}
+
+static int internal_getFrameProfile(lua_State *L) {
+    auto & counters = Core::getInstance().perf_counters;
+
+    std::map<const char *, std::map<const char *, uint64_t>> summary;
+    summary["update"] = summarize_histogram(counters.frame_total_update);
+    summary["event_manager"] = summarize_histogram(counters.frame_event_manager);
+    summary["plugin"] = summarize_histogram(counters.frame_plugin);
+    summary["lua"] = summarize_histogram(counters.frame_lua);
+    Lua::Push(L, summary);
+    Lua::Push(L, translate_event_types(summarize_histograms(counters.frame_per_event)));
+    Lua::Push(L, summarize_histograms(counters.frame_per_plugin));
+    Lua::Push(L, summarize_histograms(counters.frame_per_widget));
+    return 4;
+}
+
+static int internal_getTimeSliceStats(lua_State *L) {
+    auto stats = TimeSlicing::getStats();
+    lua_pushinteger(L, TimeSlicing::getOverrunFrames());
+    lua_createtable(L, stats.size(), 0);
+    int idx = 1;
+    for (auto &task : stats) {
+        lua_createtable(L, 0, 11);
+        Lua::TableInsert(L, "plugin", task.plugin);
+        Lua::TableInsert(L, "name", task.name);
+        Lua::TableInsert(L, "running", task.running);
+        Lua::TableInsert(L, "completed", task.completed);
+        Lua::TableInsert(L, "cancelled", task.cancelled);
+        Lua::TableInsert(L, "steps", task.steps);
+        Lua::TableInsert(L, "frames", task.frames);
+        Lua::TableInsert(L, "overruns", task.overruns);
+        Lua::TableInsert(L, "total_ns", task.total_ns);
+        Lua::TableInsert(L, "max_step_ns", task.max_step_ns);
+        Lua::TableInsert(L, "last_run_frames", task.last_run_frames);
+        lua_rawseti(L, -2, idx++);
+    }
+    return 2;
+}
+
+static int internal_getTimestampNs(lua_State *L) {
+    lua_pushinteger(L, PerfCounters::getTimestampNs());
+    return 1;
+}
+
 static int internal_getClipboardTextCp437Multiline(lua_State *L) {
     vector<string> lines;
     getClipboardTextCp437Multiline(&lines);
@@ -4246,6 +4463,9 @@ static const luaL_Reg dfhack_internal_funcs[] = {
     { "setMortalMode", internal_setMortalMode },
     { "setArmokTools", internal_setArmokTools },
     { "getPerfCounters", internal_getPerfCounters },
+    { "getFrameProfile", internal_getFrameProfile },
+    { "getTimestampNs", internal_getTimestampNs },
+    { "getTimeSliceStats", internal_getTimeSliceStats },
     { "getPreferredNumberFormat", internal_getPreferredNumberFormat },
     { "getClipboardTextCp437Multiline", internal_getClipboardTextCp437Multiline },
     { NULL, NULL }
@@ -36,6 +36,7 @@ distribution.
 #include "MiscUtils.h"
 #include "DFHackVersion.h"
 #include "PluginManager.h"
+#include "TimerWheel.h"
 
 #include "modules/World.h"
 #include "modules/Gui.h"
@@ -66,6 +67,7 @@ distribution.
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 
 using namespace DFHack;
 using namespace DFHack::LuaWrapper;
@@ -1937,10 +1939,15 @@ lua_State *DFHack::Lua::Open(color_ostream &out, lua_State *state)
     return state;
 }
 
+typedef TimerWheel<int> LuaTimers;
+
 static int next_timeout_id = 0;
 static int frame_idx = 0;
-static std::multimap<int,int> frame_timers;
-static std::multimap<int,int> tick_timers;
+static LuaTimers frame_timers;
+static LuaTimers tick_timers;
+// pending timeout id -> wheel entry, so that cancelled timeouts are removed
+// from the wheels right away
+static std::unordered_map<int, std::pair<LuaTimers *, LuaTimers::handle_t>> timer_handles;
 
 int DFHACK_TIMEOUTS_TOKEN = 0;
 
@@ -1988,9 +1995,14 @@ int dfhack_timeout(lua_State *L)
     // Queue the timeout
     int id = next_timeout_id++;
     if (mode)
-        tick_timers.insert(std::pair<int,int>(world->frame_counter+delta, id));
+    {
+        // the frame counter restarts when a different save is loaded
+        if (tick_timers.empty())
+            tick_timers.setTime(world->frame_counter);
+        timer_handles[id] = std::make_pair(&tick_timers, tick_timers.schedule(world->frame_counter+delta, id));
+    }
     else
-        frame_timers.insert(std::pair<int,int>(frame_idx+delta, id));
+        timer_handles[id] = std::make_pair(&frame_timers, frame_timers.schedule(frame_idx+delta, id));
 
     lua_rawgetp(L, LUA_REGISTRYINDEX, &DFHACK_TIMEOUTS_TOKEN);
     lua_swap(L);
@@ -2020,22 +2032,32 @@ int dfhack_timeout_active(lua_State *L)
     {
         lua_pushvalue(L, 2);
         lua_rawseti(L, 3, id);
+
+        if (lua_isnil(L, 2))
+        {
+            auto it = timer_handles.find(id);
+            if (it != timer_handles.end())
+            {
+                it->second.first->cancel(it->second.second);
+                timer_handles.erase(it);
+            }
+        }
     }
     return 1;
 }
 
-static void cancel_timers(std::multimap<int,int> &timers)
+static void cancel_timers(LuaTimers &timers)
 {
     auto State = DFHack::Core::getInstance().getLuaState();
 
     Lua::StackUnwinder frame(State);
     lua_rawgetp(State, LUA_REGISTRYINDEX, &DFHACK_TIMEOUTS_TOKEN);
 
-    for (auto it = timers.begin(); it != timers.end(); ++it)
-    {
+    timers.forEach([&](LuaTimers::handle_t, int id) {
         lua_pushnil(State);
-        lua_rawseti(State, frame[1], it->second);
-    }
+        lua_rawseti(State, frame[1], id);
+        timer_handles.erase(id);
+    });
 
     timers.clear();
 }
@@ -2059,12 +2081,11 @@ void DFHack::Lua::Core::onStateChange(color_ostream &out, int code) {
 }
 
 static void run_timers(color_ostream &out, lua_State *L,
-                       std::multimap<int,int> &timers, int table, int bound)
+                       LuaTimers &timers, int table, int bound)
 {
-    while (!timers.empty() && timers.begin()->first <= bound)
+    timers.advance(bound, [&](LuaTimers::handle_t, int id)
     {
-        int id = timers.begin()->second;
-        timers.erase(timers.begin());
+        timer_handles.erase(id);
 
         lua_rawgeti(L, table, id);
 
@@ -2075,9 +2096,18 @@ static void run_timers(color_ostream &out, lua_State *L,
             lua_pushnil(L);
             lua_rawseti(L, table, id);
 
+            char name[Tracing::MAX_NAME_LEN + 1] = "lua timer";
+            if (Tracing::isEnabled())
+            {
+                lua_Debug ar;
+                lua_pushvalue(L, -1);
+                if (lua_getinfo(L, ">S", &ar))
+                    snprintf(name, sizeof(name), "%s:%d", ar.short_src, ar.linedefined);
+            }
+            Tracing::Span span("lua", name);
             Lua::SafeCall(out, L, 0, 0);
         }
-    }
+    });
 }
 
 void DFHack::Lua::Core::onUpdate(color_ostream &out)
@@ -0,0 +1,134 @@
+#include "modules/MapSnapshot.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace DFHack;
+using namespace DFHack::MapSnapshot;
+
+// a 4x4x2 block map with some blocks missing; changed adds differences to
+// the designations of one block and to the building records
+static std::string writeMap(const std::string &name, const Options &options, bool changed) {
+    std::string path = testing::TempDir() + name;
+    Writer writer(options);
+    EXPECT_TRUE(writer.open(path));
+    writer.setMap(df::coord(4, 4, 2), df::coord(1, 2, 3));
+    int tiletype = writer.addColumn("tiletype", TILES, sizeof(int16_t));
+    int designation = writer.addColumn("designation", TILES, sizeof(uint32_t));
+    for (int z = 0; z < 2; z++) {
+        for (int y = 0; y < 4; y++) {
+            for (int x = 0; x < 4; x++) {
+                if ((x + y) % 3 == 0)
+                    continue;
+                writer.addBlock(df::coord(x, y, z));
+                int16_t tiles[256];
+                uint32_t designations[256];
+                for (int i = 0; i < 256; i++) {
+                    tiles[i] = int16_t(x * 100 + y * 10 + z + i % 5);
+                    designations[i] = changed && x == 1 && y == 1 && z == 1 && i < 10 ? 99 : i / 16;
+                }
+                writer.append(tiletype, tiles, 256);
+                writer.append(designation, designations, 256);
+            }
+        }
+    }
+    std::vector<int32_t> ids;
+    std::vector<int16_t> xs;
+    for (int i = 0; i < 12; i++) {
+        if (changed && i == 3)
+            continue;
+        ids.push_back(i);
+        xs.push_back(int16_t(changed && i == 7 ? 70 : i));
+    }
+    if (changed) {
+        ids.push_back(100);
+        xs.push_back(1);
+    }
+    writer.append(writer.addColumn("building_id", RECORDS, sizeof(int32_t)), ids.data(), ids.size());
+    writer.append(writer.addColumn("building_x1", RECORDS, sizeof(int16_t)), xs.data(), xs.size());
+    EXPECT_TRUE(writer.finish());
+    return path;
+}
+
+static void checkRoundTrip(const Options &options) {
+    Snapshot snapshot;
+    std::string error;
+    ASSERT_TRUE(snapshot.open(writeMap("snapshot-roundtrip.dat", options, false), &error)) << error;
+    EXPECT_EQ(snapshot.header().x_count_block, 4);
+    EXPECT_EQ(snapshot.header().region_z, 3);
+    EXPECT_EQ(snapshot.blockCount(), 20u);
+    EXPECT_EQ(snapshot.findBlock(df::coord(0, 0, 0)), -1);
+
+    int tiletype = snapshot.findColumn("tiletype");
+    ASSERT_GE(tiletype, 0);
+    EXPECT_EQ(snapshot.tiles<int32_t>(tiletype, 0), nullptr);
+    for (size_t block = 0; block < snapshot.blockCount(); block++) {
+        df::coord pos = snapshot.block(block);
+        EXPECT_EQ(snapshot.findBlock(pos), int(block));
+        auto tiles = snapshot.tiles<int16_t>(tiletype, block);
+        ASSERT_NE(tiles, nullptr);
+        for (int i = 0; i < 256; i++)
+            ASSERT_EQ(tiles[i], pos.x * 100 + pos.y * 10 + pos.z + i % 5);
+    }
+
+    std::vector<uint8_t> ids;
+    ASSERT_TRUE(snapshot.readColumn(snapshot.findColumn("building_id"), ids));
+    ASSERT_EQ(ids.size(), 12 * sizeof(int32_t));
+    EXPECT_EQ(((const int32_t *)ids.data())[11], 11);
+}
+
+TEST(MapSnapshot, round_trip_raw) {
+    Options options;
+    options.compress = false;
+    options.chunk_blocks = 3;
+    options.chunk_records = 5;
+    checkRoundTrip(options);
+}
+
+TEST(MapSnapshot, round_trip_compressed) {
+    Options options;
+    options.chunk_blocks = 3;
+    options.chunk_records = 5;
+    checkRoundTrip(options);
+}
+
+TEST(MapSnapshot, diff) {
+    Options options;
+    options.chunk_blocks = 3;
+    Snapshot a, b;
+    ASSERT_TRUE(a.open(writeMap("snapshot-a.dat", options, false)));
+    ASSERT_TRUE(b.open(writeMap("snapshot-b.dat", options, true)));
+
+    std::vector<ColumnDiff> columns;
+    std::vector<TableDiff> tables;
+    ASSERT_TRUE(MapSnapshot::diff(a, b, columns, tables));
+    ASSERT_EQ(columns.size(), 2u);
+    EXPECT_EQ(columns[0].name, "tiletype");
+    EXPECT_EQ(columns[0].changed_tiles, 0u);
+    EXPECT_EQ(columns[1].name, "designation");
+    EXPECT_EQ(columns[1].changed_tiles, 10u);
+    EXPECT_EQ(columns[1].changed_blocks, 1u);
+    ASSERT_EQ(tables.size(), 1u);
+    EXPECT_EQ(tables[0].name, "building");
+    EXPECT_EQ(tables[0].added, 1u);
+    EXPECT_EQ(tables[0].removed, 1u);
+    EXPECT_EQ(tables[0].changed, 1u);
+}
+
+TEST(MapSnapshot, rejects_other_files) {
+    std::string path = testing::TempDir() + "snapshot-garbage.dat";
+    FILE *f = fopen(path.c_str(), "wb");
+    ASSERT_NE(f, nullptr);
+    fputs("this is not a map snapshot, but it is long enough to hold a header", f);
+    fclose(f);
+
+    Snapshot snapshot;
+    std::string error;
+    EXPECT_FALSE(snapshot.open(path, &error));
+    EXPECT_FALSE(snapshot.isOpen());
+    EXPECT_FALSE(error.empty());
+    EXPECT_FALSE(snapshot.open(testing::TempDir() + "snapshot-missing.dat"));
+}
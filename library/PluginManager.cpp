@@ -31,6 +31,7 @@ distribution.
 #include "MemAccess.h"
 #include "PluginManager.h"
 #include "RemoteServer.h"
+#include "TimeSlicing.h"
 #include "Console.h"
 #include "Types.h"
 #include "VersionInfo.h"
@@ -44,6 +45,8 @@ distribution.
 
 using namespace DFHack;
 
+#include <algorithm>
+#include <cmath>
 #include <condition_variable>
 #include <string>
 #include <vector>
@@ -196,6 +199,7 @@ Plugin::Plugin(Core * core, const std::filesystem::path& path,
     plugin_save_site_data = 0;
     plugin_load_world_data = 0;
     plugin_load_site_data = 0;
+    plugin_update_cadence = 0;
     state = PS_UNLOADED;
     access = new RefLock();
 }
@@ -355,6 +359,7 @@ bool Plugin::load(color_ostream &con)
     plugin_save_site_data = (command_result (*)(color_ostream &)) LookupPlugin(plug, "plugin_save_site_data");
     plugin_load_world_data = (command_result (*)(color_ostream &)) LookupPlugin(plug, "plugin_load_world_data");
     plugin_load_site_data = (command_result (*)(color_ostream &)) LookupPlugin(plug, "plugin_load_site_data");
+    plugin_update_cadence = (PluginUpdateCadence *) LookupPlugin(plug, "plugin_update_cadence");
     index_lua(plug);
     plugin_lib = plug;
     commands.clear();
@@ -363,6 +368,7 @@ bool Plugin::load(color_ostream &con)
         RefAutolock lock(access);
         state = PS_LOADED;
         parent->registerCommands(this);
+        parent->update_schedule_dirty = true;
         if ((plugin_onupdate || plugin_enable) && !plugin_is_enabled)
             con.printerr("Plugin %s has no enabled var!\n", name.c_str());
         if (Core::getInstance().isWorldLoaded() && plugin_load_world_data && plugin_load_world_data(con) != CR_OK)
@@ -378,6 +384,7 @@ bool Plugin::load(color_ostream &con)
         con.printerr("Plugin %s has failed to initialize properly.\n", name.c_str());
         plugin_is_enabled = 0;
         plugin_onupdate = 0;
+        plugin_update_cadence = 0;
         reset_lua();
         plugin_abort_load;
         return false;
@@ -408,6 +415,7 @@ bool Plugin::unload(color_ostream &con)
         }
         // wait for all calls to finish
         access->wait();
+        TimeSlicing::cancelAll(this);
         state = PS_UNLOADING;
         // only attempt to unload site or world data if the core is in a valid state
         if (Core::getInstance().isValid())
@@ -433,6 +441,8 @@ bool Plugin::unload(color_ostream &con)
         // cleanup...
         plugin_is_enabled = 0;
         plugin_onupdate = 0;
+        plugin_update_cadence = 0;
+        parent->update_schedule_dirty = true;
         plugin_save_world_data = 0;
         plugin_save_site_data = 0;
         plugin_load_world_data = 0;
@@ -1033,21 +1043,102 @@ bool PluginManager::CanInvokeHotkey(const std::string &command, df::viewscreen *
     return plugin ? plugin->can_invoke_hotkey(command, top) : true;
 }
 
+void PluginManager::rebuildUpdateSchedule()
+{
+    std::map<Plugin *, ScheduledUpdate> old_schedule;
+    for (auto &entry : update_schedule)
+        old_schedule.emplace(entry.plugin, entry);
+    update_schedule.clear();
+
+    // spread the first run of each tick-cadence plugin over its period using
+    // the golden ratio sequence, which keeps any number of phases well apart
+    int num_ticked = 0;
+    for (auto it = begin(); it != end(); ++it) {
+        auto plugin = it->second;
+        if (plugin->getState() != Plugin::PS_LOADED || !plugin->plugin_onupdate)
+            continue;
+
+        ScheduledUpdate entry{plugin, {0, 0}, 0, -1, -1};
+        if (plugin->plugin_update_cadence)
+            entry.cadence = *plugin->plugin_update_cadence;
+        if (entry.cadence.ticks > 0) {
+            double frac = std::fmod(num_ticked++ * 0.6180339887498949, 1.0);
+            entry.phase = 1 + int32_t(frac * (entry.cadence.ticks - 1));
+        }
+
+        auto old = old_schedule.find(plugin);
+        if (old != old_schedule.end() && old->second.cadence.ticks == entry.cadence.ticks) {
+            entry.next_tick = old->second.next_tick;
+            entry.last_tick = old->second.last_tick;
+        }
+        update_schedule.push_back(entry);
+    }
+}
+
+void PluginManager::resetUpdateSchedule(const std::string &name)
+{
+    int32_t tick = df::global::world ? df::global::world->frame_counter : -1;
+    for (auto &entry : update_schedule) {
+        // a run started by the schedule keeps its phase
+        if (entry.cadence.ticks <= 0 || entry.plugin == updating_plugin ||
+                entry.plugin->getName() != name)
+            continue;
+        entry.next_tick = tick < 0 ? -1 : tick + entry.cadence.ticks;
+    }
+}
+
 void PluginManager::OnUpdate(color_ostream &out)
 {
+    if (update_schedule_dirty.exchange(false))
+        rebuildUpdateSchedule();
+
     auto &core = Core::getInstance();
     auto &counters = core.perf_counters;
-    for (auto it = begin(); it != end(); ++it) {
-        auto & plugin_name = it->first;
-        auto & plugin = it->second;
+    int32_t tick = df::global::world ? df::global::world->frame_counter : -1;
+    bool in_fort = core.isMapLoaded() && World::isFortressMode();
+    for (auto &entry : update_schedule) {
+        auto &cadence = entry.cadence;
+        if ((cadence.flags & PU_FORTRESS_ONLY) && !in_fort)
+            continue;
+        if (cadence.ticks > 0) {
+            if (tick < 0)
+                continue;
+            if (entry.next_tick < 0 || entry.next_tick - tick > cadence.ticks) {
+                // run right away after a (re)load, then settle into this
+                // plugin's phase. the second check catches the frame counter
+                // restarting when a different save is loaded.
+                entry.next_tick = tick + entry.phase;
+            } else if (tick < entry.next_tick) {
+                continue;
+            } else {
+                entry.next_tick = std::max(entry.next_tick + cadence.ticks, tick + 1);
+            }
+        } else if (cadence.flags & PU_UNPAUSED_ONLY) {
+            if (tick < 0 || tick == entry.last_tick)
+                continue;
+            entry.last_tick = tick;
+        }
+
+        auto plugin = entry.plugin;
+        auto & plugin_name = plugin->getName();
         uint32_t start_ms = core.p->getTickCount();
+        uint64_t start_ns = PerfCounters::getTimestampNs();
+        Tracing::Span span("plugin", plugin_name.c_str());
+        updating_plugin = plugin;
         plugin->on_update(out);
+        updating_plugin = NULL;
         counters.incCounter(counters.update_per_plugin[plugin_name], start_ms);
+        counters.addFrameTime(counters.frame_per_plugin[plugin_name], start_ns);
     }
 }
 
 void PluginManager::OnStateChange(color_ostream &out, state_change_event event)
 {
+    if (event == SC_MAP_LOADED || event == SC_MAP_UNLOADED) {
+        for (auto &entry : update_schedule)
+            entry.next_tick = entry.last_tick = -1;
+    }
+
     auto &core = Core::getInstance();
     auto &counters = core.perf_counters;
     for (auto it = begin(); it != end(); ++it) {
@@ -252,6 +252,8 @@ void ServerConnection::threadFn()
 {
     color_ostream_proxy out(Core::getInstance().getConsole());
 
+    Tracing::setThreadName("rpc");
+
     /* Handshake */
 
     {
@@ -341,10 +343,16 @@ void ServerConnection::threadFn()
 
                 reply = fn->out();
 
+                Tracing::Span span("rpc", fn->name);
                 if (fn->flags & SF_DONT_SUSPEND)
                 {
                     res = fn->execute(stream);
                 }
+                else if (fn->flags & SF_READ_ONLY)
+                {
+                    SharedCoreSuspender suspend;
+                    res = fn->execute(stream);
+                }
                 else
                 {
                     CoreSuspender suspend;
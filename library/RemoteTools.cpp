@@ -671,14 +671,14 @@ CoreService::CoreService() :
     addFunction("GetVersion", GetVersion, SF_DONT_SUSPEND | SF_ALLOW_REMOTE);
     addFunction("GetDFVersion", GetDFVersion, SF_DONT_SUSPEND | SF_ALLOW_REMOTE);
 
-    addFunction("GetWorldInfo", GetWorldInfo, SF_ALLOW_REMOTE);
+    addFunction("GetWorldInfo", GetWorldInfo, SF_READ_ONLY | SF_ALLOW_REMOTE);
 
     addFunction("ListEnums", ListEnums, SF_CALLED_ONCE | SF_DONT_SUSPEND | SF_ALLOW_REMOTE);
     addFunction("ListJobSkills", ListJobSkills, SF_CALLED_ONCE | SF_DONT_SUSPEND | SF_ALLOW_REMOTE);
 
-    addFunction("ListMaterials", ListMaterials, SF_CALLED_ONCE | SF_ALLOW_REMOTE);
-    addFunction("ListUnits", ListUnits, SF_ALLOW_REMOTE);
-    addFunction("ListSquads", ListSquads, SF_ALLOW_REMOTE);
+    addFunction("ListMaterials", ListMaterials, SF_CALLED_ONCE | SF_READ_ONLY | SF_ALLOW_REMOTE);
+    addFunction("ListUnits", ListUnits, SF_READ_ONLY | SF_ALLOW_REMOTE);
+    addFunction("ListSquads", ListSquads, SF_READ_ONLY | SF_ALLOW_REMOTE);
 
     addFunction("SetUnitLabors", SetUnitLabors, SF_ALLOW_REMOTE);
 }
@@ -28,6 +28,7 @@ distribution.
 
 #include <cassert>
 #include <map>
+#include <vector>
 
 using namespace DFHack;
 
@@ -257,6 +258,97 @@ static void init_tables()
     }
 }
 
+namespace {
+    // the tiletype attributes the lookups below compare, with the direction
+    // string already parsed
+    struct TileEntry
+    {
+        df::tiletype tt;
+        df::tiletype_shape shape;
+        df::tiletype_material material;
+        df::tiletype_variant variant;
+        df::tiletype_special special;
+        uint32_t direction;
+    };
+
+    // every tiletype, bucketed by (shape, material). the NONE shape and
+    // material buckets hold the tiletypes of every shape or material, so a
+    // lookup with wildcards is also a single bucket. each bucket is in enum
+    // order, so the first match in a bucket is the one a scan over the whole
+    // enum would find.
+    struct TileIndex
+    {
+        static const int FIRST_SHAPE = (int)tiletype_shape::NONE;
+        static const int LAST_SHAPE = (int)ENUM_LAST_ITEM(tiletype_shape);
+        static const int FIRST_MATERIAL = (int)tiletype_material::NONE;
+        static const int LAST_MATERIAL = (int)ENUM_LAST_ITEM(tiletype_material);
+        static const int NUM_SHAPE_KEYS = LAST_SHAPE - FIRST_SHAPE + 1;
+        static const int NUM_MATERIAL_KEYS = LAST_MATERIAL - FIRST_MATERIAL + 1;
+
+        std::vector<TileEntry> entries;
+        // bucket i is entries[offsets[i]] .. entries[offsets[i+1]]
+        std::vector<uint32_t> offsets;
+
+        static int key(df::tiletype_shape shape, df::tiletype_material mat)
+        {
+            if (shape < FIRST_SHAPE || shape > LAST_SHAPE || mat < FIRST_MATERIAL || mat > LAST_MATERIAL)
+                return -1;
+            return (shape - FIRST_SHAPE) * NUM_MATERIAL_KEYS + (mat - FIRST_MATERIAL);
+        }
+
+        TileIndex()
+        {
+            std::vector<std::vector<TileEntry>> buckets(NUM_SHAPE_KEYS * NUM_MATERIAL_KEYS);
+            FOR_ENUM_ITEMS(tiletype, tt)
+            {
+                TileEntry entry = {
+                    tt, tileShape(tt), tileMaterial(tt), tileVariant(tt), tileSpecial(tt),
+                    tileDirection(tt).whole
+                };
+                const int keys[] = {
+                    key(entry.shape, entry.material),
+                    key(entry.shape, tiletype_material::NONE),
+                    key(tiletype_shape::NONE, entry.material),
+                    key(tiletype_shape::NONE, tiletype_material::NONE),
+                };
+                for (int k : keys)
+                {
+                    // keys repeat for tiletypes whose shape or material is NONE
+                    if (k < 0 || (!buckets[k].empty() && buckets[k].back().tt == tt))
+                        continue;
+                    buckets[k].push_back(entry);
+                }
+            }
+
+            offsets.reserve(buckets.size() + 1);
+            for (auto &bucket : buckets)
+            {
+                offsets.push_back(entries.size());
+                entries.insert(entries.end(), bucket.begin(), bucket.end());
+            }
+            offsets.push_back(entries.size());
+        }
+
+        // returns false if shape or material is out of range
+        bool bucket(df::tiletype_shape shape, df::tiletype_material mat,
+                    const TileEntry *&begin, const TileEntry *&end) const
+        {
+            int k = key(shape, mat);
+            if (k < 0)
+                return false;
+            begin = entries.data() + offsets[k];
+            end = entries.data() + offsets[k + 1];
+            return true;
+        }
+    };
+}
+
+static const TileIndex &tile_index()
+{
+    static const TileIndex index;
+    return index;
+}
+
 df::tiletype DFHack::matchTileMaterial(df::tiletype source, df::tiletype_material tmat)
 {
     if (!isCoreMaterial(tmat) || !source || source >= NUM_TILETYPES)
@@ -271,6 +363,28 @@ df::tiletype DFHack::matchTileMaterial(df::tiletype source, df::tiletype_materia
 namespace DFHack
 {
 
+    df::tiletype findTileType(const df::tiletype_shape tshape, const df::tiletype_material tmat, const df::tiletype_variant tvar, const df::tiletype_special tspecial, const TileDirection tdir)
+    {
+        const TileEntry *begin, *end;
+        if (!tile_index().bucket(tshape, tmat, begin, end))
+            return tiletype::Void;
+
+        for (auto entry = begin; entry != end; ++entry)
+        {
+            // Don't require variant to match if the destination tile doesn't even have one
+            if (tvar != tiletype_variant::NONE && tvar != entry->variant && entry->variant != tiletype_variant::NONE)
+                continue;
+            // Same for special
+            if (tspecial != tiletype_special::NONE && tspecial != entry->special && entry->special != tiletype_special::NONE)
+                continue;
+            if (tdir && tdir.whole != entry->direction)
+                continue;
+            // Match!
+            return entry->tt;
+        }
+        return tiletype::Void;
+    }
+
     df::tiletype findSimilarTileType (const df::tiletype sourceTileType, const df::tiletype_shape tshape)
     {
         df::tiletype match = tiletype::Void;
@@ -316,46 +430,50 @@ namespace DFHack
             }
         }
 
-        // Run through until perfect match found or hit end.
-        FOR_ENUM_ITEMS(tiletype, tt)
+        // Run through the tiles of the wanted shape until perfect match found or hit end.
+        const TileEntry *begin, *end;
+        if (!tile_index().bucket(tshape, tiletype_material::NONE, begin, end))
+            begin = end = NULL;
+        for (auto entry = begin; entry != end; ++entry)
         {
             if (value == (8|4|1))
                 break;
-            if (tileShape(tt) == tshape)
-            {
-                // Special flag match is mandatory, but only if it might possibly make a difference
-                if (tileSpecial(tt) != tiletype_special::NONE && cur_special != tiletype_special::NONE && tileSpecial(tt) != cur_special)
-                    continue;
+            // the NONE bucket holds every shape
+            if (entry->shape != tshape)
+                continue;
 
-                // Special case for constructions.
-                // Never turn a construction into a non-contruction.
-                if ((cur_material == tiletype_material::CONSTRUCTION) && (tileMaterial(tt) != cur_material))
-                    continue;
+            // Special flag match is mandatory, but only if it might possibly make a difference
+            if (entry->special != tiletype_special::NONE && cur_special != tiletype_special::NONE && entry->special != cur_special)
+                continue;
 
-                value = 0;
-                //Material is high-value match
-                if (cur_material == tileMaterial(tt))
-                    value |= 8;
+            // Special case for constructions.
+            // Never turn a construction into a non-contruction.
+            if ((cur_material == tiletype_material::CONSTRUCTION) && (entry->material != cur_material))
+                continue;
 
-                // Direction is medium value match
-                if (cur_direction == tileDirection(tt))
-                    value |= 4;
+            value = 0;
+            //Material is high-value match
+            if (cur_material == entry->material)
+                value |= 8;
 
-                // If the material is a plant, consider soil an acceptable alternative
-                if (cur_material == tiletype_material::PLANT && tileMaterial(tt) == tiletype_material::SOIL) {
-                    value |= 2;
-                }
+            // Direction is medium value match
+            if (cur_direction.whole == entry->direction)
+                value |= 4;
 
-                // Variant is low-value match
-                if (cur_variant == tileVariant(tt))
-                    value |= 1;
+            // If the material is a plant, consider soil an acceptable alternative
+            if (cur_material == tiletype_material::PLANT && entry->material == tiletype_material::SOIL) {
+                value |= 2;
+            }
 
-                // Check value against last match.
-                if (value > matchv)
-                {
-                    match = tt;
-                    matchv = value;
-                }
+            // Variant is low-value match
+            if (cur_variant == entry->variant)
+                value |= 1;
+
+            // Check value against last match.
+            if (value > matchv)
+            {
+                match = entry->tt;
+                matchv = value;
             }
         }
 
@@ -369,13 +487,17 @@ namespace DFHack
     {
         if (tileVariant(tile) == tiletype_variant::NONE)
             return tile;
+        const TileEntry *begin, *end;
+        if (!tile_index().bucket(tileShape(tile), tileMaterial(tile), begin, end))
+            return tile;
         std::vector<df::tiletype> matches;
-        FOR_ENUM_ITEMS(tiletype, tt)
+        for (auto entry = begin; entry != end; ++entry)
         {
-            if (tileShape(tt) == tileShape(tile) &&
-                tileMaterial(tt) == tileMaterial(tile) &&
-                tileSpecial(tt) == tileSpecial(tile))
-                matches.push_back(tt);
+            // the NONE buckets hold every shape or material
+            if (entry->shape == tileShape(tile) &&
+                entry->material == tileMaterial(tile) &&
+                entry->special == tileSpecial(tile))
+                matches.push_back(entry->tt);
         }
         return matches[rand() % matches.size()];
     }
@@ -0,0 +1,53 @@
+#include "TileTypes.h"
+
+#include <gtest/gtest.h>
+
+using namespace DFHack;
+
+// the original scan over the whole enum
+static df::tiletype linearFindTileType(df::tiletype_shape tshape, df::tiletype_material tmat, df::tiletype_variant tvar, df::tiletype_special tspecial, TileDirection tdir) {
+    FOR_ENUM_ITEMS(tiletype, tt) {
+        if (tshape != tiletype_shape::NONE && tshape != tileShape(tt))
+            continue;
+        if (tmat != tiletype_material::NONE && tmat != tileMaterial(tt))
+            continue;
+        if (tvar != tiletype_variant::NONE && tvar != tileVariant(tt) && tileVariant(tt) != tiletype_variant::NONE)
+            continue;
+        if (tspecial != tiletype_special::NONE && tspecial != tileSpecial(tt) && tileSpecial(tt) != tiletype_special::NONE)
+            continue;
+        if (tdir && tdir != tileDirection(tt))
+            continue;
+        return tt;
+    }
+    return tiletype::Void;
+}
+
+TEST(TileTypes, findTileType_matches_linear_scan) {
+    // every tiletype's own attributes, with every combination of wildcards
+    FOR_ENUM_ITEMS(tiletype, source) {
+        for (int wild = 0; wild < 32; ++wild) {
+            auto shape = wild & 1 ? tiletype_shape::NONE : tileShape(source);
+            auto mat = wild & 2 ? tiletype_material::NONE : tileMaterial(source);
+            auto var = wild & 4 ? tiletype_variant::NONE : tileVariant(source);
+            auto special = wild & 8 ? tiletype_special::NONE : tileSpecial(source);
+            TileDirection dir = wild & 16 ? TileDirection() : tileDirection(source);
+            ASSERT_EQ(findTileType(shape, mat, var, special, dir),
+                      linearFindTileType(shape, mat, var, special, dir))
+                << enum_item_key(source) << " wildcards " << wild;
+        }
+    }
+}
+
+TEST(TileTypes, findTileType_mixed_attributes) {
+    // attribute combinations that don't belong to a single tiletype
+    FOR_ENUM_ITEMS(tiletype_shape, shape) {
+        FOR_ENUM_ITEMS(tiletype_material, mat) {
+            FOR_ENUM_ITEMS(tiletype_special, special) {
+                EXPECT_EQ(findTileType(shape, mat, tiletype_variant::VAR_2, special, TileDirection()),
+                          linearFindTileType(shape, mat, tiletype_variant::VAR_2, special, TileDirection()));
+            }
+            EXPECT_EQ(findTileType(shape, mat, tiletype_variant::NONE, tiletype_special::NONE, TileDirection("NSEW")),
+                      linearFindTileType(shape, mat, tiletype_variant::NONE, tiletype_special::NONE, TileDirection("NSEW")));
+        }
+    }
+}
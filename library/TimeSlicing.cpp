@@ -0,0 +1,218 @@
+#include "Internal.h"
+
+#include "Core.h"
+#include "PluginManager.h"
+#include "TimeSlicing.h"
+#include "Tracing.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace DFHack;
+
+namespace {
+    struct Task {
+        Plugin *plugin;
+        std::string plugin_name;
+        std::string name;
+        TimeSlicing::step_fn step;
+        bool active = false;
+        // bumped on every start and cancel so that a step that restarts or
+        // cancels its own task can be detected
+        uint64_t generation = 0;
+        uint64_t last_frame = 0;
+        uint64_t run_frames = 0;
+        TimeSlicing::TaskStats stats{};
+    };
+}
+
+// tasks are kept after they finish so their counters survive across runs
+static std::vector<std::unique_ptr<Task>> tasks;
+static size_t next_task = 0;
+static uint64_t frame_id = 0;
+static uint64_t overrun_frames = 0;
+static uint32_t frame_budget_us = TimeSlicing::DEFAULT_FRAME_BUDGET_US;
+
+bool TimeSlicing::Budget::expired() const {
+    return PerfCounters::getTimestampNs() >= deadline_ns;
+}
+
+uint64_t TimeSlicing::Budget::remainingNs() const {
+    uint64_t now = PerfCounters::getTimestampNs();
+    return now < deadline_ns ? deadline_ns - now : 0;
+}
+
+static Task *find_task(Plugin *plugin, const std::string &name) {
+    for (auto &task : tasks) {
+        if (task->plugin == plugin && task->name == name)
+            return task.get();
+    }
+    return NULL;
+}
+
+static void cancel_task(Task &task) {
+    if (!task.active)
+        return;
+    task.active = false;
+    task.step = nullptr;
+    ++task.generation;
+    ++task.stats.cancelled;
+}
+
+// runs one step of the task and updates its counters. returns true if the
+// task completed.
+static bool run_step(color_ostream &out, Task &task, const TimeSlicing::Budget &budget) {
+    auto &counters = Core::getInstance().perf_counters;
+    uint64_t start_ns = PerfCounters::getTimestampNs();
+    uint64_t generation = task.generation;
+    bool done;
+    {
+        Tracing::Span span("sliced", task.name.c_str());
+        // the step may cancel or restart its own task, which would otherwise
+        // destroy the function while it is running
+        TimeSlicing::step_fn step = std::move(task.step);
+        task.step = nullptr;
+        done = step(out, budget);
+        if (task.generation == generation && !done)
+            task.step = std::move(step);
+    }
+    uint64_t end_ns = PerfCounters::getTimestampNs();
+    counters.addFrameTime(counters.frame_per_plugin[task.plugin_name], start_ns);
+
+    auto &stats = task.stats;
+    ++stats.steps;
+    stats.total_ns += end_ns - start_ns;
+    stats.max_step_ns = std::max(stats.max_step_ns, end_ns - start_ns);
+    if (end_ns > budget.getDeadlineNs())
+        ++stats.overruns;
+    if (task.last_frame != frame_id) {
+        task.last_frame = frame_id;
+        ++stats.frames;
+        ++task.run_frames;
+    }
+
+    if (task.generation != generation || !done)
+        return false;
+    task.active = false;
+    ++stats.completed;
+    stats.last_run_frames = task.run_frames;
+    return true;
+}
+
+bool TimeSlicing::start(Plugin *plugin, const std::string &name, step_fn step) {
+    Task *task = find_task(plugin, name);
+    if (task && task->active)
+        return false;
+    if (!task) {
+        tasks.emplace_back(new Task());
+        task = tasks.back().get();
+        task->plugin = plugin;
+        task->plugin_name = plugin ? plugin->getName() : "core";
+        task->name = name;
+    }
+    task->step = std::move(step);
+    task->active = true;
+    ++task->generation;
+    task->run_frames = 0;
+    // make sure the first step is counted as a new frame
+    task->last_frame = 0;
+    return true;
+}
+
+bool TimeSlicing::isRunning(Plugin *plugin, const std::string &name) {
+    Task *task = find_task(plugin, name);
+    return task && task->active;
+}
+
+bool TimeSlicing::finish(color_ostream &out, Plugin *plugin, const std::string &name) {
+    Task *task = find_task(plugin, name);
+    if (!task || !task->active)
+        return false;
+    Budget unlimited(std::numeric_limits<uint64_t>::max());
+    uint64_t generation = task->generation;
+    while (task->active && task->generation == generation && task->step)
+        run_step(out, *task, unlimited);
+    return true;
+}
+
+void TimeSlicing::cancel(Plugin *plugin, const std::string &name) {
+    if (Task *task = find_task(plugin, name))
+        cancel_task(*task);
+}
+
+void TimeSlicing::cancelAll(Plugin *plugin) {
+    for (auto &task : tasks) {
+        if (task->plugin == plugin)
+            cancel_task(*task);
+    }
+}
+
+void TimeSlicing::setFrameBudgetUs(uint32_t budget_us) {
+    frame_budget_us = budget_us;
+}
+
+uint32_t TimeSlicing::getFrameBudgetUs() {
+    return frame_budget_us;
+}
+
+std::vector<TimeSlicing::TaskStats> TimeSlicing::getStats() {
+    std::vector<TaskStats> ret;
+    ret.reserve(tasks.size());
+    for (auto &task : tasks) {
+        ret.push_back(task->stats);
+        auto &stats = ret.back();
+        stats.plugin = task->plugin_name;
+        stats.name = task->name;
+        stats.running = task->active;
+    }
+    return ret;
+}
+
+uint64_t TimeSlicing::getOverrunFrames() {
+    return overrun_frames;
+}
+
+void TimeSlicing::onUpdate(color_ostream &out) {
+    if (std::none_of(tasks.begin(), tasks.end(), [](auto &task) { return task->active; }))
+        return;
+
+    ++frame_id;
+    Budget budget(PerfCounters::getTimestampNs() + uint64_t(frame_budget_us) * 1000);
+
+    // keep cycling through the running tasks until the budget is used up.
+    // the first step of the frame always runs so that every task eventually
+    // makes progress, whatever the budget is set to.
+    bool first = true;
+    bool ran_any = true;
+    size_t last_task = next_task;
+    while (ran_any && (first || !budget.expired())) {
+        ran_any = false;
+        // steps may start new tasks, so re-read the size on every pass
+        size_t num_tasks = tasks.size();
+        for (size_t i = 0; i < num_tasks && (first || !budget.expired()); ++i) {
+            size_t index = (next_task + i) % num_tasks;
+            Task &task = *tasks[index];
+            if (!task.active || !task.step)
+                continue;
+            run_step(out, task, budget);
+            last_task = index;
+            first = false;
+            ran_any = true;
+        }
+    }
+    if (PerfCounters::getTimestampNs() > budget.getDeadlineNs())
+        ++overrun_frames;
+
+    // continue after the last task that ran, so a task that uses up the
+    // whole budget can't starve the others. finished tasks stay in the list,
+    // so stepping on by one slot would favor the task after a run of them.
+    next_task = (last_task + 1) % tasks.size();
+}
+
+void TimeSlicing::onMapUnloaded() {
+    for (auto &task : tasks)
+        cancel_task(*task);
+}
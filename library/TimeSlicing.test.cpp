@@ -0,0 +1,183 @@
+#include "TimeSlicing.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace DFHack;
+
+// A task that takes the given number of steps, appending its name to log
+// on each one. Tasks are owned by the core (a NULL plugin), and no test
+// leaves its tasks running, since the task list is shared by the whole
+// process.
+static TimeSlicing::step_fn countingStep(const std::string &name, int steps, std::vector<std::string> &log) {
+    auto done = std::make_shared<int>(0);
+    return [=, &log](color_ostream &, const TimeSlicing::Budget &) {
+        log.push_back(name);
+        return ++*done >= steps;
+    };
+}
+
+// the counters of the named task, which are kept across runs; all zero if
+// it was never started
+static TimeSlicing::TaskStats getStats(const std::string &name) {
+    for (auto &task : TimeSlicing::getStats())
+        if (task.plugin == "core" && task.name == name)
+            return task;
+    return TimeSlicing::TaskStats{};
+}
+
+TEST(TimeSlicing, zero_budget_runs_one_step_per_frame) {
+    buffered_color_ostream out;
+    std::vector<std::string> log;
+    TimeSlicing::setFrameBudgetUs(0);
+    ASSERT_TRUE(TimeSlicing::start(NULL, "zero-a", countingStep("a", 2, log)));
+    ASSERT_TRUE(TimeSlicing::start(NULL, "zero-b", countingStep("b", 2, log)));
+    ASSERT_FALSE(TimeSlicing::start(NULL, "zero-a", countingStep("a", 2, log)));
+
+    for (size_t frame = 1; frame <= 4; frame++) {
+        TimeSlicing::onUpdate(out);
+        EXPECT_EQ(log.size(), frame);
+    }
+    EXPECT_FALSE(TimeSlicing::isRunning(NULL, "zero-a"));
+    EXPECT_FALSE(TimeSlicing::isRunning(NULL, "zero-b"));
+
+    // nothing is left to run
+    TimeSlicing::onUpdate(out);
+    EXPECT_EQ(log.size(), 4u);
+    TimeSlicing::setFrameBudgetUs(TimeSlicing::DEFAULT_FRAME_BUDGET_US);
+}
+
+TEST(TimeSlicing, budget_is_shared_by_all_tasks) {
+    buffered_color_ostream out;
+    std::vector<std::string> log;
+
+    // a generous budget runs every task to completion in one frame
+    TimeSlicing::setFrameBudgetUs(10 * 1000 * 1000);
+    TimeSlicing::start(NULL, "shared-a", countingStep("a", 3, log));
+    TimeSlicing::start(NULL, "shared-b", countingStep("b", 5, log));
+    TimeSlicing::onUpdate(out);
+    EXPECT_EQ(log.size(), 8u);
+    EXPECT_FALSE(TimeSlicing::isRunning(NULL, "shared-a"));
+    EXPECT_FALSE(TimeSlicing::isRunning(NULL, "shared-b"));
+
+    // a step that starts within the budget runs to its end, and nothing else
+    // runs in that frame once it has used the budget up
+    TimeSlicing::setFrameBudgetUs(1000);
+    log.clear();
+    TimeSlicing::start(NULL, "shared-slow", [&](color_ostream &, const TimeSlicing::Budget &) {
+        log.push_back("slow");
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        return false;
+    });
+    TimeSlicing::start(NULL, "shared-fast", countingStep("fast", 100, log));
+    auto before = getStats("shared-slow");
+    uint64_t overruns = TimeSlicing::getOverrunFrames();
+    TimeSlicing::onUpdate(out);
+    // the fast task may get its step of the first pass before the slow one
+    ASSERT_LE(log.size(), 2u);
+    EXPECT_EQ(log.back(), "slow");
+    EXPECT_EQ(TimeSlicing::getOverrunFrames(), overruns + 1);
+    auto after = getStats("shared-slow");
+    EXPECT_EQ(after.steps, before.steps + 1);
+    EXPECT_EQ(after.overruns, before.overruns + 1);
+
+    TimeSlicing::cancelAll(NULL);
+    TimeSlicing::setFrameBudgetUs(TimeSlicing::DEFAULT_FRAME_BUDGET_US);
+}
+
+TEST(TimeSlicing, round_robin_order) {
+    buffered_color_ostream out;
+    std::vector<std::string> log;
+
+    // within a frame, each running task gets one step per pass
+    TimeSlicing::setFrameBudgetUs(10 * 1000 * 1000);
+    TimeSlicing::start(NULL, "rr-a", countingStep("a", 3, log));
+    TimeSlicing::start(NULL, "rr-b", countingStep("b", 3, log));
+    TimeSlicing::start(NULL, "rr-c", countingStep("c", 3, log));
+    TimeSlicing::onUpdate(out);
+    ASSERT_EQ(log.size(), 9u);
+    for (size_t i = 3; i < log.size(); i++)
+        EXPECT_EQ(log[i], log[i - 3]);
+    EXPECT_NE(log[0], log[1]);
+    EXPECT_NE(log[1], log[2]);
+    EXPECT_NE(log[0], log[2]);
+
+    // across frames, each frame starts with the task after the one that ran
+    // last, even with finished tasks in between
+    TimeSlicing::setFrameBudgetUs(0);
+    log.clear();
+    TimeSlicing::start(NULL, "rr-a", countingStep("a", 3, log));
+    TimeSlicing::start(NULL, "rr-c", countingStep("c", 3, log));
+    for (int frame = 0; frame < 6; frame++)
+        TimeSlicing::onUpdate(out);
+    ASSERT_EQ(log.size(), 6u);
+    for (size_t i = 1; i < log.size(); i++)
+        EXPECT_NE(log[i], log[i - 1]);
+
+    TimeSlicing::cancelAll(NULL);
+    TimeSlicing::setFrameBudgetUs(TimeSlicing::DEFAULT_FRAME_BUDGET_US);
+}
+
+TEST(TimeSlicing, work_carries_over_to_later_frames) {
+    buffered_color_ostream out;
+    TimeSlicing::setFrameBudgetUs(0);
+
+    // the step keeps its own cursor, and yields once the budget runs out
+    std::vector<int> items(5);
+    size_t cursor = 0;
+    auto before = getStats("carry");
+    TimeSlicing::start(NULL, "carry", [&](color_ostream &, const TimeSlicing::Budget &budget) {
+        while (cursor < items.size()) {
+            ++items[cursor++];
+            if (budget.expired())
+                break;
+        }
+        return cursor == items.size();
+    });
+    for (size_t frame = 1; frame <= items.size(); frame++) {
+        EXPECT_TRUE(TimeSlicing::isRunning(NULL, "carry"));
+        TimeSlicing::onUpdate(out);
+        EXPECT_EQ(cursor, frame);
+    }
+    EXPECT_FALSE(TimeSlicing::isRunning(NULL, "carry"));
+    EXPECT_EQ(items, std::vector<int>(5, 1));
+
+    auto after = getStats("carry");
+    EXPECT_EQ(after.completed, before.completed + 1);
+    EXPECT_EQ(after.steps, before.steps + 5);
+    EXPECT_EQ(after.frames, before.frames + 5);
+    EXPECT_EQ(after.last_run_frames, 5u);
+
+    // finish runs the rest of the work at once, ignoring the budget
+    cursor = 0;
+    TimeSlicing::start(NULL, "carry", [&](color_ostream &, const TimeSlicing::Budget &budget) {
+        EXPECT_FALSE(budget.expired());
+        cursor = items.size();
+        return true;
+    });
+    EXPECT_TRUE(TimeSlicing::finish(out, NULL, "carry"));
+    EXPECT_EQ(cursor, items.size());
+    EXPECT_FALSE(TimeSlicing::finish(out, NULL, "carry"));
+
+    TimeSlicing::setFrameBudgetUs(TimeSlicing::DEFAULT_FRAME_BUDGET_US);
+}
+
+TEST(TimeSlicing, map_unload_cancels_tasks) {
+    buffered_color_ostream out;
+    std::vector<std::string> log;
+    auto before = getStats("unload");
+    TimeSlicing::start(NULL, "unload", countingStep("u", 10, log));
+    TimeSlicing::onMapUnloaded();
+    EXPECT_FALSE(TimeSlicing::isRunning(NULL, "unload"));
+    TimeSlicing::onUpdate(out);
+    EXPECT_TRUE(log.empty());
+
+    auto after = getStats("unload");
+    EXPECT_EQ(after.cancelled, before.cancelled + 1);
+    EXPECT_EQ(after.completed, before.completed);
+}
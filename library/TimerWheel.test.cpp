@@ -0,0 +1,168 @@
+#include "TimerWheel.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace DFHack;
+
+typedef TimerWheel<int> Wheel;
+
+static std::vector<int> advance(Wheel &wheel, int64_t now) {
+    std::vector<int> fired;
+    wheel.advance(now, [&](Wheel::handle_t, const int &value) { fired.push_back(value); });
+    return fired;
+}
+
+TEST(TimerWheel, fires_in_due_order) {
+    Wheel wheel(100);
+    wheel.schedule(105, 1);
+    wheel.schedule(101, 2);
+    wheel.schedule(105, 3);
+    wheel.schedule(100 + 70000, 4);
+    wheel.schedule(103, 5);
+    EXPECT_EQ(wheel.size(), 5);
+
+    EXPECT_EQ(advance(wheel, 100), std::vector<int>());
+    EXPECT_EQ(advance(wheel, 104), std::vector<int>({2, 5}));
+    EXPECT_EQ(advance(wheel, 105), std::vector<int>({1, 3}));
+    EXPECT_EQ(advance(wheel, 100 + 69999), std::vector<int>());
+    EXPECT_EQ(advance(wheel, 100 + 70000), std::vector<int>({4}));
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_EQ(wheel.getTime(), 100 + 70000);
+}
+
+TEST(TimerWheel, overdue_fires_on_next_advance) {
+    Wheel wheel(50);
+    wheel.schedule(50, 1);
+    wheel.schedule(10, 2);
+    EXPECT_EQ(advance(wheel, 50), std::vector<int>({2, 1}));
+}
+
+TEST(TimerWheel, same_due_keeps_schedule_order_across_levels) {
+    Wheel wheel(0);
+    // scheduled while the due time is still several levels away
+    wheel.schedule(1000000, 1);
+    EXPECT_EQ(advance(wheel, 999990), std::vector<int>());
+    // scheduled directly into the lowest level
+    wheel.schedule(1000000, 2);
+    EXPECT_EQ(advance(wheel, 1000000), std::vector<int>({1, 2}));
+}
+
+TEST(TimerWheel, cancel) {
+    Wheel wheel(0);
+    auto h1 = wheel.schedule(10, 1);
+    auto h2 = wheel.schedule(20, 2);
+    EXPECT_TRUE(wheel.isPending(h1));
+    EXPECT_EQ(*wheel.get(h2), 2);
+    EXPECT_TRUE(wheel.cancel(h1));
+    EXPECT_FALSE(wheel.cancel(h1));
+    EXPECT_FALSE(wheel.isPending(h1));
+    EXPECT_EQ(wheel.get(h1), nullptr);
+    EXPECT_FALSE(wheel.cancel(Wheel::INVALID_HANDLE));
+
+    // the freed node is reused, but the old handle must stay dead
+    auto h3 = wheel.schedule(15, 3);
+    EXPECT_NE(h1, h3);
+    EXPECT_FALSE(wheel.cancel(h1));
+    EXPECT_EQ(advance(wheel, 100), std::vector<int>({3, 2}));
+    EXPECT_FALSE(wheel.isPending(h2));
+}
+
+TEST(TimerWheel, callbacks_can_schedule_and_cancel) {
+    Wheel wheel(0);
+    Wheel::handle_t victim = wheel.schedule(7, 99);
+    wheel.schedule(5, 1);
+    std::vector<int> fired;
+    wheel.advance(10, [&](Wheel::handle_t, const int &value) {
+        fired.push_back(value);
+        if (value == 1) {
+            wheel.cancel(victim);
+            wheel.schedule(6, 2);
+            wheel.schedule(5, 3);
+            wheel.schedule(11, 4);
+        }
+    });
+    EXPECT_EQ(fired, std::vector<int>({1, 3, 2}));
+    EXPECT_EQ(wheel.size(), 1);
+    EXPECT_EQ(advance(wheel, 11), std::vector<int>({4}));
+}
+
+TEST(TimerWheel, clock_reset) {
+    Wheel wheel(5000000);
+    wheel.schedule(5000100, 1);
+    // e.g. a save with an earlier frame counter was loaded
+    wheel.setTime(1000);
+    wheel.schedule(1100, 2);
+    EXPECT_EQ(advance(wheel, 1100), std::vector<int>({2}));
+    EXPECT_EQ(advance(wheel, 5000099), std::vector<int>());
+    EXPECT_EQ(advance(wheel, 5000100), std::vector<int>({1}));
+
+    // advancing to an earlier time moves the clock back as well
+    wheel.schedule(5000200, 3);
+    EXPECT_EQ(advance(wheel, 10), std::vector<int>());
+    EXPECT_EQ(wheel.getTime(), 10);
+    EXPECT_EQ(advance(wheel, 5000200), std::vector<int>({3}));
+}
+
+TEST(TimerWheel, far_future) {
+    Wheel wheel(0);
+    int64_t far = int64_t(1) << 40;
+    wheel.schedule(far, 1);
+    wheel.schedule(far - 1, 2);
+    EXPECT_EQ(advance(wheel, far - 2), std::vector<int>());
+    EXPECT_EQ(advance(wheel, far), std::vector<int>({2, 1}));
+}
+
+TEST(TimerWheel, clear) {
+    Wheel wheel(0);
+    auto h = wheel.schedule(10, 1);
+    wheel.schedule(1000, 2);
+    int seen = 0;
+    wheel.forEach([&](Wheel::handle_t, const int &) { ++seen; });
+    EXPECT_EQ(seen, 2);
+    wheel.clear();
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_FALSE(wheel.isPending(h));
+    EXPECT_EQ(advance(wheel, 2000), std::vector<int>());
+}
+
+TEST(TimerWheel, matches_multimap) {
+    std::mt19937 rng(1234);
+    Wheel wheel(0);
+    std::multimap<int64_t, int> expected;
+    std::map<int, Wheel::handle_t> handles;
+    int64_t now = 0;
+    int next_id = 0;
+    for (int step = 0; step < 20000; ++step) {
+        int op = rng() % 10;
+        if (op < 5) {
+            int64_t due = now + rng() % (op == 0 ? 100000000 : 2000);
+            handles[next_id] = wheel.schedule(due, next_id);
+            expected.emplace(due, next_id++);
+        } else if (op < 7 && !handles.empty()) {
+            auto it = handles.begin();
+            std::advance(it, rng() % handles.size());
+            EXPECT_TRUE(wheel.cancel(it->second));
+            for (auto e = expected.begin(); e != expected.end(); ++e) {
+                if (e->second == it->first) {
+                    expected.erase(e);
+                    break;
+                }
+            }
+            handles.erase(it);
+        } else {
+            now += op == 9 ? rng() % 10000000 : rng() % 300;
+            std::vector<int> want;
+            while (!expected.empty() && expected.begin()->first <= now) {
+                want.push_back(expected.begin()->second);
+                handles.erase(expected.begin()->second);
+                expected.erase(expected.begin());
+            }
+            ASSERT_EQ(advance(wheel, now), want);
+            ASSERT_EQ(wheel.size(), expected.size());
+        }
+    }
+}
@@ -0,0 +1,256 @@
+#include "Internal.h"
+
+#include "Tracing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace DFHack;
+
+namespace {
+    struct Slot {
+        // seqlock: odd while the slot is being written, otherwise
+        // 2 * (ring index + 1) of the span it holds
+        std::atomic<uint64_t> seq{0};
+        uint64_t begin_ns;
+        uint64_t end_ns;
+        const char *category;
+        uint32_t tid;
+        char name[Tracing::MAX_NAME_LEN + 1];
+    };
+
+    struct Ring {
+        std::unique_ptr<Slot[]> slots;
+        size_t mask;
+        std::atomic<uint64_t> next{0};
+
+        explicit Ring(size_t capacity) : slots(new Slot[capacity]), mask(capacity - 1) {}
+    };
+
+    struct SpanRecord {
+        uint64_t begin_ns;
+        uint64_t end_ns;
+        const char *category;
+        uint32_t tid;
+        std::string name;
+    };
+}
+
+static std::atomic<bool> enabled{false};
+static std::atomic<Ring *> ring{nullptr};
+// number of addSpan calls that may be holding a ring pointer
+static std::atomic<uint32_t> writers{0};
+
+static std::mutex control_mutex;
+static std::unique_ptr<Ring> current;
+// rings replaced while a writer may still have been using them; freed once
+// no writer is
+static std::vector<std::unique_ptr<Ring>> retired;
+
+static std::mutex thread_names_mutex;
+static std::unordered_map<uint32_t, std::string> thread_names;
+
+static std::atomic<uint32_t> next_tid{1};
+
+static uint32_t get_tid() {
+    static thread_local uint32_t tid = next_tid.fetch_add(1, std::memory_order_relaxed);
+    return tid;
+}
+
+// A writer counts itself in writers before it loads enabled and the ring
+// pointer, and both are changed before writers is read here, so if no writer
+// is counted, none can still be using a ring that is no longer current, or
+// write to the current one until tracing is enabled again.
+static bool writersQuiescent() {
+    return writers.load(std::memory_order_seq_cst) == 0;
+}
+
+static void freeRetiredRings() {
+    if (!retired.empty() && writersQuiescent())
+        retired.clear();
+}
+
+void Tracing::start(size_t capacity) {
+    std::lock_guard<std::mutex> lock(control_mutex);
+    capacity = std::bit_ceil(std::clamp<size_t>(capacity, 2, MAX_CAPACITY));
+    enabled.store(false, std::memory_order_seq_cst);
+    if (current && current->mask + 1 == capacity && writersQuiescent()) {
+        // nothing can be writing to it, so it can be emptied in place
+        for (size_t i = 0; i < capacity; ++i)
+            current->slots[i].seq.store(0, std::memory_order_relaxed);
+        current->next.store(0, std::memory_order_relaxed);
+    } else {
+        std::unique_ptr<Ring> previous = std::move(current);
+        current.reset(new Ring(capacity));
+        ring.store(current.get(), std::memory_order_seq_cst);
+        if (previous)
+            retired.push_back(std::move(previous));
+    }
+    freeRetiredRings();
+    enabled.store(true, std::memory_order_release);
+}
+
+void Tracing::stop() {
+    std::lock_guard<std::mutex> lock(control_mutex);
+    enabled.store(false, std::memory_order_seq_cst);
+    freeRetiredRings();
+}
+
+bool Tracing::isEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+size_t Tracing::getCapacity() {
+    Ring *r = ring.load(std::memory_order_acquire);
+    return r ? r->mask + 1 : 0;
+}
+
+size_t Tracing::getCount() {
+    Ring *r = ring.load(std::memory_order_acquire);
+    return r ? std::min<uint64_t>(r->next.load(std::memory_order_relaxed), r->mask + 1) : 0;
+}
+
+uint64_t Tracing::getTimestampNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracing::setThreadName(const char *name) {
+    std::lock_guard<std::mutex> lock(thread_names_mutex);
+    thread_names[get_tid()] = name;
+}
+
+void Tracing::addSpan(const char *category, const char *name, uint64_t begin_ns, uint64_t end_ns) {
+    if (!enabled.load(std::memory_order_relaxed))
+        return;
+    writers.fetch_add(1, std::memory_order_seq_cst);
+    // checked again now that this writer is counted, so that start() can't
+    // empty the ring while this span is written to it
+    Ring *r = enabled.load(std::memory_order_seq_cst) ? ring.load(std::memory_order_seq_cst) : nullptr;
+    if (!r) {
+        writers.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+
+    uint64_t idx = r->next.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = r->slots[idx & r->mask];
+    slot.seq.store(2 * idx + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.begin_ns = begin_ns;
+    slot.end_ns = end_ns;
+    slot.category = category;
+    slot.tid = get_tid();
+    strncpy(slot.name, name ? name : "", MAX_NAME_LEN);
+    slot.name[MAX_NAME_LEN] = '\0';
+
+    slot.seq.store(2 * idx + 2, std::memory_order_release);
+    writers.fetch_sub(1, std::memory_order_release);
+}
+
+static void write_json_string(std::ostream &out, const std::string &str) {
+    out << '"';
+    for (unsigned char c : str) {
+        switch (c) {
+        case '"':  out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        default:
+            if (c < 0x20 || c >= 0x7f) {
+                // names are CP437 or ASCII; escape anything that isn't
+                // printable ASCII so the output is always valid JSON
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out << buf;
+            } else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+}
+
+static void write_us(std::ostream &out, uint64_t ns) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%llu.%03u", (unsigned long long)(ns / 1000), unsigned(ns % 1000));
+    out << buf;
+}
+
+int64_t Tracing::dump(const std::filesystem::path &path) {
+    std::vector<SpanRecord> records;
+    std::unordered_map<uint32_t, std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(control_mutex);
+        Ring *r = ring.load(std::memory_order_acquire);
+        if (r) {
+            size_t capacity = r->mask + 1;
+            records.reserve(std::min<uint64_t>(r->next.load(std::memory_order_relaxed), capacity));
+            for (size_t i = 0; i < capacity; ++i) {
+                Slot &slot = r->slots[i];
+                uint64_t seq = slot.seq.load(std::memory_order_acquire);
+                if (seq == 0 || (seq & 1))
+                    continue;
+                SpanRecord rec{slot.begin_ns, slot.end_ns, slot.category, slot.tid,
+                               std::string(slot.name, strnlen(slot.name, MAX_NAME_LEN))};
+                std::atomic_thread_fence(std::memory_order_acquire);
+                // skip slots that were overwritten while we were copying them
+                if (slot.seq.load(std::memory_order_relaxed) != seq)
+                    continue;
+                records.emplace_back(std::move(rec));
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(thread_names_mutex);
+        names = thread_names;
+    }
+
+    std::sort(records.begin(), records.end(), [](const SpanRecord &a, const SpanRecord &b) {
+        return a.begin_ns < b.begin_ns;
+    });
+    uint64_t base_ns = records.empty() ? 0 : records.front().begin_ns;
+
+    std::ofstream out(path);
+    if (!out.good())
+        return -1;
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (auto &[tid, name] : names) {
+        if (!first)
+            out << ",\n";
+        first = false;
+        out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << tid
+            << ",\"args\":{\"name\":";
+        write_json_string(out, name);
+        out << "}}";
+    }
+    for (auto &rec : records) {
+        if (!first)
+            out << ",\n";
+        first = false;
+        out << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << rec.tid << ",\"cat\":";
+        write_json_string(out, rec.category ? rec.category : "");
+        out << ",\"name\":";
+        write_json_string(out, rec.name);
+        out << ",\"ts\":";
+        write_us(out, rec.begin_ns - base_ns);
+        out << ",\"dur\":";
+        write_us(out, rec.end_ns >= rec.begin_ns ? rec.end_ns - rec.begin_ns : 0);
+        out << "}";
+    }
+    out << "\n]}\n";
+
+    if (!out.good())
+        return -1;
+    return records.size();
+}
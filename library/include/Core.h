@@ -28,6 +28,7 @@ distribution.
 #include "CoreDefs.h"
 #include "Export.h"
 #include "Hooks.h"
+#include "Tracing.h"
 
 #include "modules/Graphic.h"
 
@@ -67,6 +68,7 @@ namespace DFHack
     class Core;
     class ServerMain;
     class CoreSuspender;
+    class SharedCoreSuspender;
 
     namespace Lua { namespace Core {
         DFHACK_EXPORT void Reset(color_ostream &out, const char *where);
@@ -77,6 +79,43 @@ namespace DFHack
         struct Hide;
     }
 
+    // Log-linear histogram of nanosecond durations, in the spirit of
+    // HdrHistogram. Each power of two is split into SUB_BUCKET_COUNT linear
+    // buckets, so reported values are within ~6% of the true value.
+    class DFHACK_EXPORT PerfHistogram
+    {
+    public:
+        void record(uint64_t value_ns);
+
+        // returns the approximate value that the given fraction (0-1) of
+        // recorded samples are less than or equal to
+        uint64_t getPercentile(double fraction) const;
+        uint64_t getCount() const { return count; }
+        uint64_t getTotal() const { return total_ns; }
+        uint64_t getMax() const { return max_ns; }
+
+    private:
+        friend class PerfCounters;
+
+        static constexpr int SUB_BUCKET_BITS = 4;
+        static constexpr size_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+        // values above 2^MAX_EXPONENT ns (about 18 minutes) are clamped
+        static constexpr int MAX_EXPONENT = 40;
+        static constexpr size_t BUCKET_COUNT = SUB_BUCKET_COUNT * (MAX_EXPONENT - SUB_BUCKET_BITS + 2);
+
+        static size_t getBucket(uint64_t value_ns);
+        static uint64_t getBucketValue(size_t bucket);
+
+        uint32_t buckets[BUCKET_COUNT] = {};
+        uint64_t count = 0;
+        uint64_t total_ns = 0;
+        uint64_t max_ns = 0;
+
+        // time accumulated during the current frame, recorded by endFrame()
+        uint64_t frame_ns = 0;
+        bool frame_pending = false;
+    };
+
     class DFHACK_EXPORT PerfCounters
     {
     public:
@@ -88,6 +127,10 @@ namespace DFHack
         uint32_t update_lua_ms;
         uint32_t total_keybinding_ms;
         uint32_t total_overlay_ms;
+        // full job clones made by the JOB_COMPLETED event, and the clones
+        // that were skipped because the job had not reached completion yet
+        uint32_t event_manager_job_clones;
+        uint32_t event_manager_job_clones_avoided;
         std::unordered_map<int32_t, uint32_t> event_manager_event_total_ms;
         std::unordered_map<int32_t, std::unordered_map<std::string, uint32_t>> event_manager_event_per_plugin_ms;
         std::unordered_map<std::string, uint32_t> update_per_plugin;
@@ -96,12 +139,33 @@ namespace DFHack
         std::unordered_map<std::string, uint32_t> overlay_per_widget;
         std::unordered_map<std::string, uint32_t> zscreen_per_focus;
 
+        // per-frame nanosecond histograms (the frame profiler)
+        PerfHistogram frame_total_update;
+        PerfHistogram frame_event_manager;
+        PerfHistogram frame_plugin;
+        PerfHistogram frame_lua;
+        std::unordered_map<int32_t, PerfHistogram> frame_per_event;
+        std::unordered_map<std::string, PerfHistogram> frame_per_plugin;
+        std::unordered_map<std::string, PerfHistogram> frame_per_widget;
+
         void reset(bool ignorePauseState = false);
         bool getIgnorePauseState();
 
         // noop if game is paused and getIgnorePauseState() returns false
         void incCounter(uint32_t &counter, uint32_t baseline_ms);
 
+        // monotonic high-resolution timestamp for use with addFrameTime
+        static uint64_t getTimestampNs();
+
+        // adds the time elapsed since baseline_ns to the histogram's sample
+        // for the current frame
+        void addFrameTime(PerfHistogram &hist, uint64_t baseline_ns);
+
+        // records the per-frame samples accumulated since the previous call.
+        // samples are discarded if the game is paused and
+        // getIgnorePauseState() returns false
+        void endFrame();
+
         // returns number of unpaused ms since last tick
         uint32_t registerTick(uint32_t baseline_ms);
 
@@ -113,6 +177,7 @@ namespace DFHack
         static const size_t RECENT_TICKS_HISTORY_SIZE = 1000;
         int32_t last_frame_counter;
         uint32_t last_tick_baseline_ms;
+        std::vector<PerfHistogram *> frame_pending;
         struct {
             uint32_t history[RECENT_TICKS_HISTORY_SIZE];
             size_t head_idx;
@@ -154,8 +219,11 @@ namespace DFHack
     public:
         /// Get the single Core instance or make one.
         static Core& getInstance();
-        /// check if the activity lock is owned by this thread
+        /// check if the activity lock is owned by this thread, exclusively
+        /// or through a SharedCoreSuspender
         bool isSuspended(void);
+        /// check if this thread holds the core only through a SharedCoreSuspender
+        bool isSharedSuspended(void);
         /// Is everything OK?
         bool isValid(void) { return !errorstate; }
 
@@ -222,9 +290,12 @@ namespace DFHack
 
         PerfCounters perf_counters;
         uint32_t getUnpausedMs() { return unpaused_ms; }
+        // number of per-frame updates the core has run; unlike
+        // world->frame_counter, this also advances while the game is paused
+        uint32_t getUpdateCount() { return update_count; }
 
         lua_State* getLuaState(bool bypass_assertion = false) {
-            assert(bypass_assertion || isSuspended());
+            assert(bypass_assertion || (isSuspended() && !isSharedSuspended()));
             return State;
         }
 
@@ -330,6 +401,13 @@ namespace DFHack
         std::atomic<std::thread::id> ownerThread;
         std::atomic<size_t> toolCount;
         std::atomic<bool> shutdown;
+        //! number of threads holding a SharedCoreSuspender, guarded by SharedReaderMutex
+        size_t sharedReaders;
+        std::mutex SharedReaderMutex;
+        std::condition_variable SharedReadersDone;
+        //! waits until no SharedCoreSuspender is held. returns false on timeout;
+        //! a zero timeout only checks without waiting
+        bool waitForSharedReaders(std::chrono::milliseconds timeout = std::chrono::milliseconds::max());
         //! \}
 
         std::thread::id df_render_thread;
@@ -338,11 +416,13 @@ namespace DFHack
         lua_State* State;
 
         uint32_t unpaused_ms; // reset to 0 on map load
+        uint32_t update_count = 0;
 
         friend class CoreService;
         friend class ServerConnection;
         friend class CoreSuspender;
         friend class CoreSuspenderBase;
+        friend class SharedCoreSuspender;
         friend struct CoreSuspendClaimMain;
         friend struct CoreSuspendReleaseMain;
     };
@@ -432,6 +512,8 @@ namespace DFHack
 
     class CoreSuspender : protected CoreSuspenderBase {
         using parent_t = CoreSuspenderBase;
+        // nonzero while tracing the interval this suspender holds the core
+        uint64_t hold_begin_ns = 0;
     public:
         CoreSuspender() : CoreSuspender{Core::getInstance()} {}
 
@@ -455,21 +537,40 @@ namespace DFHack
 
         void lock()
         {
+            // a shared holder would wait on itself in waitForSharedReaders
+            assert(!core.isSharedSuspended());
             inc_tool_count();
+            uint64_t wait_begin_ns = Tracing::isEnabled() ? Tracing::getTimestampNs() : 0;
             parent_t::lock();
+            core.waitForSharedReaders();
+            if (wait_begin_ns) {
+                hold_begin_ns = Tracing::getTimestampNs();
+                Tracing::addSpan("suspend", "CoreSuspender wait", wait_begin_ns, hold_begin_ns);
+            }
         }
 
         bool try_lock()
         {
+            assert(!core.isSharedSuspended());
             inc_tool_count();
-            if (parent_t::try_lock())
-                return true;
+            if (parent_t::try_lock()) {
+                // fail rather than wait for shared holders to finish
+                if (core.waitForSharedReaders(std::chrono::milliseconds::zero())) {
+                    hold_begin_ns = Tracing::isEnabled() ? Tracing::getTimestampNs() : 0;
+                    return true;
+                }
+                parent_t::unlock();
+            }
             dec_tool_count();
             return false;
         }
 
         void unlock()
         {
+            if (hold_begin_ns) {
+                Tracing::addSpan("suspend", "CoreSuspender hold", hold_begin_ns, Tracing::getTimestampNs());
+                hold_begin_ns = 0;
+            }
             parent_t::unlock();
             dec_tool_count();
         }
@@ -491,6 +592,36 @@ namespace DFHack
         }
     };
 
+    /*!
+     * SharedCoreSuspender suspends the core like CoreSuspender, but any number
+     * of threads can hold a SharedCoreSuspender at the same time. CoreSuspender
+     * (and the simulation thread) still get exclusive access: they wait until
+     * all shared holders have released the core, and new shared holders wait
+     * while an exclusive holder is active or waiting.
+     *
+     * Holders of a SharedCoreSuspender must only read DF state. They must not
+     * use the core Lua state and must not acquire a CoreSuspender while holding
+     * the shared lock, since that would deadlock.
+     *
+     * If the calling thread already holds the core (exclusively or shared),
+     * constructing a SharedCoreSuspender has no effect.
+     */
+
+    class DFHACK_EXPORT SharedCoreSuspender {
+    public:
+        SharedCoreSuspender() : SharedCoreSuspender{Core::getInstance()} {}
+        SharedCoreSuspender(Core& core);
+        ~SharedCoreSuspender();
+
+        SharedCoreSuspender(const SharedCoreSuspender&) = delete;
+        SharedCoreSuspender& operator=(const SharedCoreSuspender&) = delete;
+
+    private:
+        Core& core;
+        bool owns_shared = false;
+        uint64_t hold_begin_ns = 0;
+    };
+
     /*!
      * ConditionalCoreSuspender attempts to acquire a CoreSuspender, but will fail if doing so
      * would cause a thread wait. The caller can determine if the suspender was acquired by casting
@@ -28,6 +28,7 @@ distribution.
 #include "Hooks.h"
 #include "ColorText.h"
 #include "MiscUtils.h"
+#include <atomic>
 #include <map>
 #include <mutex>
 #include <string>
@@ -136,6 +137,23 @@ namespace DFHack
         const command_hotkey_guard guard;
         std::string usage;
     };
+    enum plugin_update_flags
+    {
+        // only call plugin_onupdate on frames where the game tick advanced.
+        // this is implied when a tick cadence is set.
+        PU_UNPAUSED_ONLY = 1,
+        // only call plugin_onupdate while a fortress mode map is loaded
+        PU_FORTRESS_ONLY = 2,
+    };
+    // declared by a plugin with DFHACK_PLUGIN_UPDATE_CADENCE
+    struct PluginUpdateCadence
+    {
+        // call plugin_onupdate once every this many game ticks. 0 means every
+        // frame (subject to flags).
+        int32_t ticks;
+        // plugin_update_flags
+        uint32_t flags;
+    };
     class Plugin
     {
         struct RefLock;
@@ -239,6 +257,7 @@ namespace DFHack
         command_result (*plugin_save_site_data)(color_ostream &);
         command_result (*plugin_load_world_data)(color_ostream &);
         command_result (*plugin_load_site_data)(color_ostream &);
+        PluginUpdateCadence *plugin_update_cadence;
     };
     class DFHACK_EXPORT PluginManager
     {
@@ -273,6 +292,10 @@ namespace DFHack
         Plugin *getPluginByCommand (const std::string &command);
         command_result InvokeCommand(color_ostream &out, const std::string & command, std::vector <std::string> & parameters);
         bool CanInvokeHotkey(const std::string &command, df::viewscreen *top);
+        // Restarts the period of a plugin with a tick cadence from the
+        // current tick, so a cycle run on demand isn't followed by a
+        // scheduled one right away. Call with the core suspended.
+        void resetUpdateSchedule(const std::string &name);
         Plugin* operator[] (const std::string name);
         std::size_t size();
 
@@ -282,6 +305,23 @@ namespace DFHack
     private:
         Core *core;
         bool addPlugin(std::string name);
+
+        // compact list of the plugins that implement plugin_onupdate, with
+        // their cadence copied out of the plugin library
+        struct ScheduledUpdate
+        {
+            Plugin *plugin;
+            PluginUpdateCadence cadence;
+            int32_t phase;
+            // -1 until scheduled against the current frame counter
+            int32_t next_tick;
+            int32_t last_tick;
+        };
+        std::vector<ScheduledUpdate> update_schedule;
+        std::atomic<bool> update_schedule_dirty{true};
+        // the plugin whose plugin_onupdate is being called by OnUpdate
+        Plugin *updating_plugin = NULL;
+        void rebuildUpdateSchedule();
         std::recursive_mutex * plugin_mutex;
         std::mutex * cmdlist_mutex;
         std::map <std::string, Plugin*> command_map;
@@ -319,6 +359,14 @@ extern "C" { \
 #define DFHACK_PLUGIN(m_plugin_name) DFHACK_PLUGIN_AUX(m_plugin_name, false)
 #endif
 
+// Declares how often plugin_onupdate should be called, e.g.
+//   DFHACK_PLUGIN_UPDATE_CADENCE(CYCLE_TICKS, DFHack::PU_FORTRESS_ONLY);
+// Plugins that don't declare a cadence are called every frame. Plugins with
+// a tick cadence are spread out over different ticks so that they don't all
+// run in the same frame.
+#define DFHACK_PLUGIN_UPDATE_CADENCE(ticks, flags) \
+    DFhackDataExport DFHack::PluginUpdateCadence plugin_update_cadence = { ticks, flags }
+
 #define DFHACK_PLUGIN_IS_ENABLED(varname) \
     DFhackDataExport bool plugin_is_enabled = false; \
     bool &varname = plugin_is_enabled;
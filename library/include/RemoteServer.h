@@ -50,7 +50,11 @@ namespace  DFHack
         SF_DONT_SUSPEND = 2,
         // The function is considered safe to call from a remote computer.
         // All other functions cannot be allowed for security reasons.
-        SF_ALLOW_REMOTE = 4
+        SF_ALLOW_REMOTE = 4,
+        // The function only reads DF state and doesn't use Lua, so it is run
+        // under a SharedCoreSuspender and may run concurrently with other
+        // read-only functions called from other connections.
+        SF_READ_ONLY = 8
     };
 
     class DFHACK_EXPORT ServerFunctionBase : public RPCFunctionBase {
@@ -306,30 +306,12 @@ namespace DFHack
      * All parameters are optional.
      * To omit, specify NONE for that type
      * For tile directions, pass nullptr to omit.
-     * @return matching index in tileTypeTable, or 0 if none found.
+     * A variant or special is also ignored for tiles that don't have one.
+     * Only the tiletypes with the requested shape and material are searched,
+     * using an index built on first use.
+     * @return the first matching tiletype in enum order, or Void if none found.
      */
-    inline
-    df::tiletype findTileType(const df::tiletype_shape tshape, const df::tiletype_material tmat, const df::tiletype_variant tvar, const df::tiletype_special tspecial, const TileDirection tdir)
-    {
-        FOR_ENUM_ITEMS(tiletype, tt)
-        {
-            if (tshape != tiletype_shape::NONE && tshape != tileShape(tt))
-                continue;
-            if (tmat != tiletype_material::NONE && tmat != tileMaterial(tt))
-                continue;
-            // Don't require variant to match if the destination tile doesn't even have one
-            if (tvar != tiletype_variant::NONE && tvar != tileVariant(tt) && tileVariant(tt) != tiletype_variant::NONE)
-                continue;
-            // Same for special
-            if (tspecial != tiletype_special::NONE && tspecial != tileSpecial(tt) && tileSpecial(tt) != tiletype_special::NONE)
-                continue;
-            if (tdir && tdir != tileDirection(tt))
-                continue;
-            // Match!
-            return tt;
-        }
-        return tiletype::Void;
-    }
+    DFHACK_EXPORT df::tiletype findTileType(const df::tiletype_shape tshape, const df::tiletype_material tmat, const df::tiletype_variant tvar, const df::tiletype_special tspecial, const TileDirection tdir);
 
     /**
      * zilpin: Find a tile type similar to the one given, but with a different class.
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "ColorText.h"
+#include "Export.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace DFHack {
+
+class Plugin;
+
+/*! \file TimeSlicing.h
+ * Cooperative time slicing for long-running plugin cycles.
+ *
+ * A plugin starts a task with a step function that does a bounded amount of
+ * work and returns true when the whole cycle is complete. Once per frame, the
+ * core calls the steps of all running tasks in round-robin order until the
+ * shared per-frame budget is used up; the rest of the work is carried over to
+ * later frames. The step function keeps its own cursor (e.g. an index into a
+ * vector) and can poll the Budget it is passed to decide when to yield.
+ *
+ * Steps run on the simulation thread with the core suspended, just like
+ * plugin_onupdate, and the functions below must also be called with the core
+ * suspended. All tasks are cancelled when the map is unloaded and when
+ * the owning plugin is unloaded, so a step never sees stale game pointers
+ * from a previous map.
+ */
+namespace TimeSlicing {
+    static const uint32_t DEFAULT_FRAME_BUDGET_US = 2000;
+
+    class Budget {
+        uint64_t deadline_ns;
+    public:
+        explicit Budget(uint64_t deadline_ns) : deadline_ns(deadline_ns) {}
+
+        uint64_t getDeadlineNs() const { return deadline_ns; }
+        // whether the step should yield now
+        DFHACK_EXPORT bool expired() const;
+        DFHACK_EXPORT uint64_t remainingNs() const;
+    };
+
+    // returns true when the task is complete
+    typedef std::function<bool(color_ostream &out, const Budget &budget)> step_fn;
+
+    struct TaskStats {
+        std::string plugin;
+        std::string name;
+        bool running;
+        // number of times the task ran to completion
+        uint64_t completed;
+        // number of times the task was cancelled before completing
+        uint64_t cancelled;
+        uint64_t steps;
+        // number of frames in which at least one step of the task ran
+        uint64_t frames;
+        // number of steps that finished after the frame budget had run out
+        uint64_t overruns;
+        uint64_t total_ns;
+        uint64_t max_step_ns;
+        // frames spanned by the most recently completed run
+        uint64_t last_run_frames;
+    };
+
+    // starts a task owned by the given plugin. returns false (and does
+    // nothing) if a task with this name is already running for the plugin.
+    DFHACK_EXPORT bool start(Plugin *plugin, const std::string &name, step_fn step);
+    DFHACK_EXPORT bool isRunning(Plugin *plugin, const std::string &name);
+    // runs the task to completion now, ignoring the budget. returns false if
+    // the task was not running.
+    DFHACK_EXPORT bool finish(color_ostream &out, Plugin *plugin, const std::string &name);
+    DFHACK_EXPORT void cancel(Plugin *plugin, const std::string &name);
+    DFHACK_EXPORT void cancelAll(Plugin *plugin);
+
+    // the shared budget, in microseconds, that all tasks together get each
+    // frame. a step that is started before the budget is used up always runs
+    // to the end, so the budget can be overrun by the length of one step.
+    DFHACK_EXPORT void setFrameBudgetUs(uint32_t budget_us);
+    DFHACK_EXPORT uint32_t getFrameBudgetUs();
+
+    DFHACK_EXPORT std::vector<TaskStats> getStats();
+    // frames in which running steps exceeded the budget
+    DFHACK_EXPORT uint64_t getOverrunFrames();
+
+    // called by the core; exported for the tests
+    DFHACK_EXPORT void onUpdate(color_ostream &out);
+    DFHACK_EXPORT void onMapUnloaded();
+}
+
+}
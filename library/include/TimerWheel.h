@@ -0,0 +1,334 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace DFHack {
+
+/*! \file TimerWheel.h
+ * Hierarchical timing wheel for scheduling callbacks at absolute times in a
+ * single integral time domain (game ticks, frames, ...).
+ *
+ * Scheduling and cancelling are O(1). Advancing the clock costs O(1) per
+ * expiring timer plus a few word scans per wheel level, independent of the
+ * number of pending timers, and large jumps in time are skipped without
+ * stepping through every intermediate value.
+ *
+ * Timers fire in order of their due time; timers with the same due time fire
+ * in the order they were scheduled. A timer whose due time is not after the
+ * current time is due right away: it fires on the next call to advance(), or,
+ * when scheduled from a callback, later in the advance() call that is running
+ * it. Callbacks may also cancel timers, including ones due in the same call.
+ */
+template<typename T>
+class TimerWheel {
+public:
+    // identifies a scheduled timer. handles are never reused, so a handle to
+    // a timer that has fired or was cancelled is safely ignored.
+    typedef uint64_t handle_t;
+    static const handle_t INVALID_HANDLE = 0;
+
+    explicit TimerWheel(int64_t now = 0) : current(now) {
+        std::fill(std::begin(heads), std::end(heads), -1);
+        std::fill(std::begin(tails), std::end(tails), -1);
+        std::fill(&occupied[0][0], &occupied[0][0] + LEVELS * WORDS, 0);
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    int64_t getTime() const { return current; }
+
+    handle_t schedule(int64_t due, const T &value) {
+        int32_t idx;
+        if (free_nodes.empty()) {
+            idx = nodes.size();
+            nodes.push_back(Node{value});
+        } else {
+            idx = free_nodes.back();
+            free_nodes.pop_back();
+            nodes[idx].value = value;
+        }
+        Node &node = nodes[idx];
+        node.due = due;
+        node.seq = next_seq++;
+        place(idx);
+        ++count;
+        return make_handle(idx, node.generation);
+    }
+
+    // returns false if the timer has already fired or been cancelled
+    bool cancel(handle_t handle) {
+        int32_t idx = find_node(handle);
+        if (idx < 0)
+            return false;
+        unlink(idx);
+        release(idx);
+        return true;
+    }
+
+    bool isPending(handle_t handle) const {
+        return find_node(handle) >= 0;
+    }
+
+    // returns the value of a pending timer, or NULL
+    const T *get(handle_t handle) const {
+        int32_t idx = find_node(handle);
+        return idx < 0 ? NULL : &nodes[idx].value;
+    }
+
+    // calls fn(handle, value) for every pending timer, in no particular order
+    template<typename F>
+    void forEach(F fn) const {
+        for (size_t idx = 0; idx < nodes.size(); ++idx) {
+            if (nodes[idx].list >= 0)
+                fn(make_handle(idx, nodes[idx].generation), nodes[idx].value);
+        }
+    }
+
+    // cancels all pending timers
+    void clear() {
+        for (size_t idx = 0; idx < nodes.size(); ++idx) {
+            if (nodes[idx].list >= 0) {
+                nodes[idx].list = -1;
+                release(idx);
+            }
+        }
+        std::fill(std::begin(heads), std::end(heads), -1);
+        std::fill(std::begin(tails), std::end(tails), -1);
+        std::fill(&occupied[0][0], &occupied[0][0] + LEVELS * WORDS, 0);
+    }
+
+    // moves the clock to now without firing anything. pending timers keep
+    // their due times. used when the underlying clock is reset, e.g. when a
+    // different save is loaded. ignored when called from a timer callback.
+    void setTime(int64_t now) {
+        if (advancing || now == current)
+            return;
+        rebase(now);
+    }
+
+    // moves the clock forward to now and calls fn(handle, value) for every
+    // timer that is due by then. if now is before the current time, the clock
+    // is moved back first, as with setTime.
+    template<typename F>
+    void advance(int64_t now, F fn) {
+        if (advancing)
+            return;
+        advancing = true;
+        if (now < current)
+            rebase(now);
+        fire_current(fn);
+        while (count > 0) {
+            int level;
+            int64_t next = next_event(level);
+            if (next > now)
+                break;
+            current = next;
+            if (level > 0)
+                cascade(level);
+            fire_current(fn);
+        }
+        current = std::max(current, now);
+        advancing = false;
+    }
+
+private:
+    static constexpr int SLOT_BITS = 8;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+    static constexpr int LEVELS = 4;
+    static constexpr int WORDS = SLOTS / 64;
+    // holds timers that are due more than 2^32 after the current time
+    static constexpr int OVERFLOW_LIST = LEVELS * SLOTS;
+
+    struct Node {
+        T value;
+        int64_t due = 0;
+        uint64_t seq = 0;
+        uint32_t generation = 1;
+        int32_t list = -1;
+        int32_t prev = -1;
+        int32_t next = -1;
+    };
+
+    struct Pending {
+        int64_t due;
+        uint64_t seq;
+        int32_t idx;
+        uint32_t generation;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int32_t> free_nodes;
+    int32_t heads[OVERFLOW_LIST + 1];
+    int32_t tails[OVERFLOW_LIST + 1];
+    uint64_t occupied[LEVELS][WORDS];
+    std::vector<Pending> batch;
+    int64_t current;
+    uint64_t next_seq = 0;
+    size_t count = 0;
+    bool advancing = false;
+
+    static handle_t make_handle(size_t idx, uint32_t generation) {
+        return (handle_t(generation) << 32) | handle_t(idx);
+    }
+
+    int32_t find_node(handle_t handle) const {
+        size_t idx = handle & 0xffffffff;
+        if (idx >= nodes.size())
+            return -1;
+        const Node &node = nodes[idx];
+        if (node.list < 0 || node.generation != uint32_t(handle >> 32))
+            return -1;
+        return idx;
+    }
+
+    void release(int32_t idx) {
+        Node &node = nodes[idx];
+        if (++node.generation == 0)
+            node.generation = 1;
+        free_nodes.push_back(idx);
+        --count;
+    }
+
+    void place(int32_t idx) {
+        Node &node = nodes[idx];
+        int list;
+        if (node.due <= current) {
+            list = current & (SLOTS - 1);
+        } else {
+            uint64_t diff = uint64_t(node.due) ^ uint64_t(current);
+            if (diff >> (LEVELS * SLOT_BITS)) {
+                list = OVERFLOW_LIST;
+            } else {
+                int level = (std::bit_width(diff) - 1) / SLOT_BITS;
+                list = level * SLOTS + ((node.due >> (level * SLOT_BITS)) & (SLOTS - 1));
+            }
+        }
+
+        node.list = list;
+        node.next = -1;
+        node.prev = tails[list];
+        if (tails[list] >= 0)
+            nodes[tails[list]].next = idx;
+        else
+            heads[list] = idx;
+        tails[list] = idx;
+        if (list < OVERFLOW_LIST)
+            occupied[list / SLOTS][(list % SLOTS) / 64] |= uint64_t(1) << (list % 64);
+    }
+
+    void unlink(int32_t idx) {
+        Node &node = nodes[idx];
+        int list = node.list;
+        if (node.prev >= 0)
+            nodes[node.prev].next = node.next;
+        else
+            heads[list] = node.next;
+        if (node.next >= 0)
+            nodes[node.next].prev = node.prev;
+        else
+            tails[list] = node.prev;
+        node.list = -1;
+        if (list < OVERFLOW_LIST && heads[list] < 0)
+            occupied[list / SLOTS][(list % SLOTS) / 64] &= ~(uint64_t(1) << (list % 64));
+    }
+
+    // re-places every timer in the given list relative to the current time
+    void redistribute(int list) {
+        int32_t idx = heads[list];
+        heads[list] = tails[list] = -1;
+        if (list < OVERFLOW_LIST)
+            occupied[list / SLOTS][(list % SLOTS) / 64] &= ~(uint64_t(1) << (list % 64));
+        while (idx >= 0) {
+            int32_t next = nodes[idx].next;
+            place(idx);
+            idx = next;
+        }
+    }
+
+    void cascade(int level) {
+        if (level == LEVELS)
+            redistribute(OVERFLOW_LIST);
+        else
+            redistribute(level * SLOTS + ((current >> (level * SLOT_BITS)) & (SLOTS - 1)));
+    }
+
+    void rebase(int64_t now) {
+        batch.clear();
+        for (size_t idx = 0; idx < nodes.size(); ++idx) {
+            if (nodes[idx].list >= 0)
+                batch.push_back({nodes[idx].due, nodes[idx].seq, int32_t(idx), nodes[idx].generation});
+        }
+        std::sort(batch.begin(), batch.end(),
+            [](const Pending &a, const Pending &b) { return a.seq < b.seq; });
+        std::fill(std::begin(heads), std::end(heads), -1);
+        std::fill(std::begin(tails), std::end(tails), -1);
+        std::fill(&occupied[0][0], &occupied[0][0] + LEVELS * WORDS, 0);
+        current = now;
+        for (auto &entry : batch)
+            place(entry.idx);
+    }
+
+    // returns the index of the first occupied slot after slot at the given
+    // level, or -1
+    int next_occupied(int level, int slot) const {
+        for (int word = (slot + 1) / 64; word < WORDS; ++word) {
+            uint64_t bits = occupied[level][word];
+            if (word == (slot + 1) / 64)
+                bits &= ~uint64_t(0) << ((slot + 1) % 64);
+            if (bits)
+                return word * 64 + std::countr_zero(bits);
+        }
+        return -1;
+    }
+
+    // returns the next time after the current one at which a timer is due
+    // (level 0) or a higher level slot has to be cascaded down
+    int64_t next_event(int &level) const {
+        for (level = 0; level < LEVELS; ++level) {
+            int shift = level * SLOT_BITS;
+            int slot = next_occupied(level, (current >> shift) & (SLOTS - 1));
+            if (slot >= 0) {
+                int64_t base = (current >> (shift + SLOT_BITS)) << (shift + SLOT_BITS);
+                return base | (int64_t(slot) << shift);
+            }
+        }
+        if (heads[OVERFLOW_LIST] >= 0)
+            return ((current >> (LEVELS * SLOT_BITS)) + 1) << (LEVELS * SLOT_BITS);
+        return std::numeric_limits<int64_t>::max();
+    }
+
+    template<typename F>
+    void fire_current(F &fn) {
+        int list = current & (SLOTS - 1);
+        while (heads[list] >= 0) {
+            batch.clear();
+            for (int32_t idx = heads[list]; idx >= 0; idx = nodes[idx].next)
+                batch.push_back({nodes[idx].due, nodes[idx].seq, idx, nodes[idx].generation});
+            // timers cascaded from higher levels can land behind ones that
+            // were scheduled later, and overdue timers share the slot with
+            // timers due now, so restore (due time, scheduling) order
+            if (batch.size() > 1)
+                std::sort(batch.begin(), batch.end(),
+                    [](const Pending &a, const Pending &b) {
+                        return a.due < b.due || (a.due == b.due && a.seq < b.seq);
+                    });
+            for (size_t i = 0; i < batch.size(); ++i) {
+                Pending entry = batch[i];
+                Node &node = nodes[entry.idx];
+                // skip timers cancelled by an earlier callback
+                if (node.list != list || node.generation != entry.generation)
+                    continue;
+                unlink(entry.idx);
+                T value = node.value;
+                release(entry.idx);
+                fn(make_handle(entry.idx, entry.generation), value);
+            }
+        }
+    }
+};
+
+}
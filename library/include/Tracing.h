@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Export.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace DFHack {
+
+/*! \file Tracing.h
+ * Low overhead span tracer for the DFHack update loop and its worker threads.
+ * Spans are recorded into a fixed-size, lock-free ring buffer that keeps the
+ * most recent spans, and can be written out in the Chrome trace-event JSON
+ * format (loadable in chrome://tracing or https://ui.perfetto.dev).
+ *
+ * When tracing is disabled, a Span costs a single atomic load.
+ */
+namespace Tracing {
+    // maximum number of characters of a span name that are kept
+    static const size_t MAX_NAME_LEN = 47;
+    static const size_t DEFAULT_CAPACITY = 1 << 18;
+    // each span takes about 90 bytes
+    static const size_t MAX_CAPACITY = 1 << 20;
+
+    // starts recording, keeping at most capacity (rounded up to a power of
+    // two, and limited to MAX_CAPACITY) of the most recent spans. spans
+    // recorded by an earlier session are discarded. the ring buffer of the
+    // earlier session is reused if it has the same capacity.
+    DFHACK_EXPORT void start(size_t capacity = DEFAULT_CAPACITY);
+    DFHACK_EXPORT void stop();
+    DFHACK_EXPORT bool isEnabled();
+
+    DFHACK_EXPORT size_t getCapacity();
+    // number of spans currently held in the ring buffer
+    DFHACK_EXPORT size_t getCount();
+
+    // monotonic timestamp used for span boundaries
+    DFHACK_EXPORT uint64_t getTimestampNs();
+
+    // names the calling thread in the exported trace
+    DFHACK_EXPORT void setThreadName(const char *name);
+
+    // records a completed span. category must be a string literal or have
+    // static storage duration; name is copied.
+    DFHACK_EXPORT void addSpan(const char *category, const char *name, uint64_t begin_ns, uint64_t end_ns);
+
+    // writes the recorded spans to the given file as trace-event JSON.
+    // returns the number of spans written, or -1 if the file could not be
+    // written.
+    DFHACK_EXPORT int64_t dump(const std::filesystem::path &path);
+
+    // RAII helper that records a span covering its own lifetime
+    class Span {
+        const char *category;
+        const char *name;
+        uint64_t begin_ns;
+    public:
+        Span(const char *category, const char *name)
+            : category(category), name(name),
+              begin_ns(isEnabled() ? getTimestampNs() : 0) {}
+        ~Span() {
+            if (begin_ns)
+                addSpan(category, name, begin_ns, getTimestampNs());
+        }
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+    };
+}
+
+}
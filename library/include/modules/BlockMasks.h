@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Export.h"
+
+#include "df/tile_bitmask.h"
+#include "df/tile_designation.h"
+#include "df/tile_occupancy.h"
+#include "df/tiletype_material.h"
+#include "df/tiletype_shape.h"
+#include "df/tiletype_shape_basic.h"
+
+#include <bit>
+
+namespace df {
+    struct map_block;
+}
+
+namespace DFHack {
+
+/**
+ * Whole-block tile classification.
+ *
+ * Each function tests all 256 tiles of a map block at once and returns a mask
+ * of the matching tiles in df::tile_bitmask layout (bit x of bits[y] is tile
+ * (x, y) of the block), which can be combined with the tile_bitmask operators
+ * and walked with Maps::forMaskTiles. Tiletype tests look the tiletypes up in
+ * per-tiletype attribute tables that are built on first use; the comparisons
+ * are vectorized with SSE2 where it is available.
+ *
+ * This is much cheaper than calling ENUM_ATTR or reading the designation
+ * bitfields for every tile when scanning large parts of the map.
+ * \ingroup grp_modules
+ */
+namespace BlockMasks {
+    // tiles whose tiletype has the given shape, basic shape, or material
+    DFHACK_EXPORT df::tile_bitmask byShape(const df::map_block *block, df::tiletype_shape shape);
+    DFHACK_EXPORT df::tile_bitmask byShapeBasic(const df::map_block *block, df::tiletype_shape_basic basic);
+    DFHACK_EXPORT df::tile_bitmask byMaterial(const df::map_block *block, df::tiletype_material material);
+    // tiles whose basic shape is not None or Open, i.e. anything but empty space
+    DFHACK_EXPORT df::tile_bitmask nonEmpty(const df::map_block *block);
+
+    // tiles where any of the bits set in mask are also set in the tile's
+    // designation or occupancy
+    DFHACK_EXPORT df::tile_bitmask byDesignation(const df::map_block *block, df::tile_designation mask);
+    DFHACK_EXPORT df::tile_bitmask byOccupancy(const df::map_block *block, df::tile_occupancy mask);
+    // tiles where the designation bits set in mask have the values they have
+    // in value
+    DFHACK_EXPORT df::tile_bitmask byDesignationValue(const df::map_block *block, df::tile_designation mask,
+                                                      df::tile_designation value);
+
+    DFHACK_EXPORT df::tile_bitmask hidden(const df::map_block *block);
+    // tiles with flow_size > 0
+    DFHACK_EXPORT df::tile_bitmask liquid(const df::map_block *block);
+    // tiles with any building occupancy
+    DFHACK_EXPORT df::tile_bitmask building(const df::map_block *block);
+
+    inline bool isEmpty(const df::tile_bitmask &mask) {
+        for (int y = 0; y < 16; y++)
+            if (mask.bits[y])
+                return false;
+        return true;
+    }
+    inline bool isFull(const df::tile_bitmask &mask) {
+        for (int y = 0; y < 16; y++)
+            if (mask.bits[y] != 0xFFFF)
+                return false;
+        return true;
+    }
+    inline int count(const df::tile_bitmask &mask) {
+        int total = 0;
+        for (int y = 0; y < 16; y++)
+            total += std::popcount(mask.bits[y]);
+        return total;
+    }
+}
+
+}
@@ -99,6 +99,18 @@ DFHACK_EXPORT df::building *findAtTile(df::coord pos);
  */
 DFHACK_EXPORT bool findCivzonesAt(std::vector<df::building_civzonest*> *pvec, df::coord pos);
 
+/**
+ * Find all buildings and civzones whose area includes the specified tile,
+ * in order of id.
+ */
+DFHACK_EXPORT bool findAllAtTile(std::vector<df::building*> *pvec, df::coord pos);
+
+/**
+ * Find all buildings and civzones whose bounding box intersects the box
+ * between the two corners (inclusive), in order of id.
+ */
+DFHACK_EXPORT bool findInBox(std::vector<df::building*> *pvec, df::coord p1, df::coord p2);
+
 /**
  * Allocates a building object using this type and position.
  */
@@ -27,6 +27,8 @@ distribution.
 #include "DataDefs.h"
 #include "modules/Maps.h"
 
+#include "df/tile_designation.h"
+
 #include <vector>
 
 /**
@@ -74,5 +76,24 @@ namespace Burrows
     inline bool deleteBlockMask(df::burrow *burrow, df::map_block *block) {
         return deleteBlockMask(burrow, block, getBlockMask(burrow, block));
     }
+
+    // Bulk tile operations. These work a whole block mask at a time, looking
+    // the masks up through an index of each burrow's blocks built once per
+    // call, and drop block masks that end up empty.
+
+    // target = target | source
+    DFHACK_EXPORT void unionTiles(df::burrow *target, df::burrow *source);
+    // target = target & source
+    DFHACK_EXPORT void intersectTiles(df::burrow *target, df::burrow *source);
+    // target = target & ~source
+    DFHACK_EXPORT void subtractTiles(df::burrow *target, df::burrow *source);
+    // target = source
+    DFHACK_EXPORT void copyTiles(df::burrow *target, df::burrow *source);
+    // Adds or removes every tile of the map whose designation bits selected
+    // by mask equal those in value.
+    DFHACK_EXPORT void setTilesByDesignation(df::burrow *target, df::tile_designation mask,
+                                             df::tile_designation value, bool enable);
+    // Adds or removes every tile in the box between the corners, inclusive.
+    DFHACK_EXPORT void setTilesInBox(df::burrow *target, df::coord pos1, df::coord pos2, bool enable);
 }
 }
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Export.h"
+
+#include "df/coord.h"
+
+#include <cstdint>
+
+namespace df {
+    struct unit;
+}
+
+namespace DFHack {
+
+/**
+ * Connected components of the tiles that walkers and wagons can stand on.
+ *
+ * The map is split into regions: the connected parts of each map block that
+ * a mover can cross without leaving the block or changing z-level. Regions
+ * are linked across block borders and through stairs and ramps (using the
+ * rules of Maps::canStepBetween), and the linked regions form components. Two
+ * tiles are mutually reachable exactly when they are in the same component,
+ * so reachability queries are a lookup rather than a flood fill.
+ *
+ * The graph is built on the first query after a map is loaded. After that,
+ * each query asks MapJournal for the blocks whose tiletypes, liquids, or
+ * building occupancy changed since the last query, and rebuilds only the
+ * regions and links around those whose path signature (tiletypes,
+ * walkability, building occupancy, and deep liquid) differs from the last one
+ * seen. Components are recomputed from the region links when any changed,
+ * which is proportional to the number of regions, not tiles.
+ *
+ * Walkers use DF's own walkability (the tiles that Maps::getWalkableGroup
+ * gives a group for) minus tiles with deep liquid, and step in all eight
+ * directions. Wagons need all nine tiles of their footprint to be free of
+ * stairs, boulders, tracks, doors and other blocking buildings, pools, and
+ * rivers, and step orthogonally; this follows the rules the pathable plugin
+ * uses to check depot access.
+ * \ingroup grp_modules
+ */
+namespace Connectivity {
+    enum Mover {
+        WALKER,
+        WAGON
+    };
+
+    // Returns an id for the component the tile belongs to, or 0 if the mover
+    // cannot stand on the tile. Ids stay valid only until the map changes.
+    DFHACK_EXPORT uint32_t getComponent(df::coord pos, Mover mover = WALKER);
+    // true if the mover can stand on the tile; the same test the graph uses
+    DFHACK_EXPORT bool canStand(df::coord pos, Mover mover = WALKER);
+    // true if both tiles can be stood on and a path connects them
+    DFHACK_EXPORT bool canReach(df::coord from, df::coord to, Mover mover = WALKER);
+    // true if the unit can walk from where it stands to the tile
+    DFHACK_EXPORT bool canUnitReach(df::unit *unit, df::coord to);
+
+    // Marks the block holding the tile as changed, so the next query takes
+    // the change into account even if it is made in the same frame update.
+    // Changes made in earlier updates are found without this.
+    DFHACK_EXPORT void invalidate(df::coord pos);
+}
+
+}
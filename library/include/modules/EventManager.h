@@ -60,6 +60,29 @@ namespace DFHack {
             }
         };
 
+        // receives all the objects found by one check for an event in a single
+        // call, after the per-object handlers for that check have run. args
+        // holds, in order, what an EventHandler for the same event would have
+        // been passed for each object; pointers into args are only valid for
+        // the duration of the call. TICK and UNLOAD have no batched form.
+        struct BatchEventHandler {
+            Plugin* plugin;
+            typedef void (*callback_t)(color_ostream&, const std::vector<void*>& args);
+            callback_t eventHandler;
+            int32_t freq;
+
+            BatchEventHandler(Plugin* pluginIn, callback_t eventHandlerIn, int32_t freqIn)
+                : plugin(pluginIn), eventHandler(eventHandlerIn), freq(freqIn)
+            { }
+
+            bool operator==(const BatchEventHandler& handle) const {
+                return plugin == handle.plugin && eventHandler == handle.eventHandler && freq == handle.freq;
+            }
+            bool operator!=(const BatchEventHandler& handle) const {
+                return !( *this == handle);
+            }
+        };
+
         struct SyndromeData {
             int32_t unitId;
             int32_t syndromeIndex;
@@ -122,6 +145,8 @@ namespace DFHack {
         DFHACK_EXPORT void registerListener(EventType::EventType e, EventHandler handler);
         DFHACK_EXPORT int32_t registerTick(EventHandler handler, int32_t when, bool absolute=false);
         DFHACK_EXPORT void unregister(EventType::EventType e, EventHandler handler);
+        DFHACK_EXPORT void registerBatchListener(EventType::EventType e, BatchEventHandler handler);
+        DFHACK_EXPORT void unregister(EventType::EventType e, BatchEventHandler handler);
         DFHACK_EXPORT void unregisterAll(Plugin* plugin);
         void manageEvents(color_ostream& out);
         void onStateChange(color_ostream& out, state_change_event event);
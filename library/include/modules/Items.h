@@ -40,6 +40,11 @@ distribution.
 #include "df/specific_ref.h"
 #include "df/unit_inventory_item.h"
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
 namespace df {
     struct body_part_raw;
     struct building_actual;
@@ -201,5 +206,108 @@ DFHACK_EXPORT bool isRouteVehicle(df::item *item);
 DFHACK_EXPORT bool isSquadEquipment(df::item *item);
 // Returns the item's capacity as a storage container.
 DFHACK_EXPORT int32_t getCapacity(df::item *item);
+
+/**
+ * A query over the items in play (items in world->items.all that are not
+ * flagged as removed), answered from an index that groups item ids by
+ * (item type, subtype, material type, material index). Constrain the query
+ * with the setters, which can be chained, then call count, getIds, or
+ * getItems. Only the items in the index groups that can match are looked at,
+ * so the more of the key is given, the less work a query does.
+ *
+ * The index picks up new items incrementally as their ids are allocated and
+ * drops destroyed ones as it meets them. Flag constraints test the items'
+ * current flags.
+ */
+class DFHACK_EXPORT ItemQuery {
+public:
+    // match items of this type, and optionally exactly this subtype
+    ItemQuery &type(df::item_type type);
+    ItemQuery &type(df::item_type type, int16_t subtype);
+    // match items of this material type, and optionally exactly this index
+    ItemQuery &material(int16_t mat_type);
+    ItemQuery &material(int16_t mat_type, int32_t mat_index);
+    ItemQuery &material(const MaterialInfo &mat) { return material(mat.type, mat.index); }
+
+    // require the flag to be set (true) or clear (false)
+    ItemQuery &forbidden(bool value);
+    ItemQuery &inJob(bool value);
+    ItemQuery &owned(bool value);
+    // in a container or a unit's inventory
+    ItemQuery &inContainer(bool value);
+    ItemQuery &onGround(bool value);
+    // exclude items that have any of these flags set
+    ItemQuery &withoutFlags(const df::item_flags &flags);
+    // extra test, called only for items that pass everything else
+    ItemQuery &filter(std::function<bool(df::item *)> fn);
+
+    size_t count() const;
+    // results are in order of id
+    void getIds(std::vector<int32_t> &ids) const;
+    void getItems(std::vector<df::item *> &items) const;
+
+private:
+    df::item_type item_type = df::enums::item_type::NONE;
+    bool has_subtype = false, has_mat_type = false, has_mat_index = false;
+    int16_t subtype = -1;
+    int16_t mat_type = -1;
+    int32_t mat_index = -1;
+    uint32_t flags_mask = 0;
+    uint32_t flags_value = 0;
+    std::function<bool(df::item *)> fn;
+
+    void setFlag(uint32_t flag, bool value);
+    void collect(std::vector<df::item *> &items) const;
+};
+
+/**
+ * Counts of the items in play, grouped by (item type, subtype, material
+ * type, material index), taken in a single pass over the items. A census is
+ * never modified once it is published, so it can be kept and read without
+ * holding any locks.
+ *
+ * An item is usable if it is not forbidden, dumped, owned, in a job, in a
+ * building or construction, an artifact, rotten, on fire, held by a trader
+ * or hostile, encased, or a web. It is accessible if it is usable and there
+ * is a walkable path to it from a citizen.
+ */
+struct DFHACK_EXPORT ItemCensus {
+    struct Key {
+        int16_t type;
+        int16_t subtype;
+        int16_t mat_type;
+        int32_t mat_index;
+
+        bool operator<(const Key &other) const {
+            if (type != other.type) return type < other.type;
+            if (subtype != other.subtype) return subtype < other.subtype;
+            if (mat_type != other.mat_type) return mat_type < other.mat_type;
+            return mat_index < other.mat_index;
+        }
+    };
+    struct Counts {
+        int32_t items = 0;
+        int32_t stack = 0; // sum of stack sizes
+    };
+    struct Entry {
+        Counts all;
+        Counts usable;
+        Counts accessible;
+    };
+
+    // world->frame_counter when the census was taken
+    int32_t frame = 0;
+    std::map<Key, Entry> entries;
+
+    // Totals over the matching entries; -1 for subtype, mat_type, or
+    // mat_index matches any value.
+    Entry get(df::item_type type, int16_t subtype = -1, int16_t mat_type = -1, int32_t mat_index = -1) const;
+};
+
+// Returns a census of the items in play that is at most max_age ticks old,
+// taking a new one if needed. All callers share the same census, so several
+// tools counting items on the same tick pay for one pass between them.
+// Returns an empty census if no map is loaded.
+DFHACK_EXPORT std::shared_ptr<const ItemCensus> getCensus(int32_t max_age = 100);
 }
 }
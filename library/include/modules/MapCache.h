@@ -36,7 +36,9 @@ distribution.
 
 #include <bitset>
 #include <cstring>
+#include <map>
 #include <stdint.h>
+#include <vector>
 
 namespace df {
     struct map_block;
@@ -327,6 +329,20 @@ private:
     df::map_block *block;
 
     void init();
+    // reinitializes a pooled block for the given position
+    void reset(DFCoord _bcoord);
+    // returns the parsed tile and material layers to the parent's pools
+    void releaseParsed();
+
+    // hash of the game data the parsed layers were decoded from; only
+    // computed (otherwise 0) in caches that are revalidated
+    uint64_t source_hash;
+    uint64_t computeSourceHash();
+    // rereads the block from the game, keeping the parsed layers if the
+    // game has not changed the data they were decoded from
+    void revalidate();
+    // MapCache::generation when the block was last read from the game
+    uint32_t generation;
 
     bool valid:1;
     bool dirty_designations:1;
@@ -338,6 +354,8 @@ private:
     std::bitset<16*16> designated_tiles;
 
     DFCoord bcoord;
+    // position in MapCache::block_list
+    size_t list_index;
 
     // Custom tags for floodfill
     typedef int16_t T_tags[16];
@@ -375,6 +393,7 @@ private:
         TileInfo();
         ~TileInfo();
 
+        void clear();
         void init_iceinfo();
         void init_coninfo();
 
@@ -411,17 +430,20 @@ class DFHACK_EXPORT MapCache
 {
     public:
     MapCache();
-    ~MapCache()
-    {
-        trash();
-    }
+    ~MapCache();
     bool isValid ()
     {
         return valid;
     }
 
     /// get the map block at a *block* coord. Block coord = tile coord / 16
-    Block *BlockAt(DFCoord blockcoord);
+    Block *BlockAt(DFCoord blockcoord)
+    {
+        // consecutive accesses usually hit the same block
+        if (last_block && blockcoord == last_bcoord)
+            return last_block;
+        return lookupBlock(blockcoord);
+    }
     /// get the map block at a tile coord.
     Block *BlockAtTile(DFCoord coord) {
         return BlockAt(df::coord(coord.x>>4,coord.y>>4,coord.z));
@@ -581,15 +603,25 @@ class DFHACK_EXPORT MapCache
 
     bool WriteAll();
 
-    void trash()
-    {
-        std::map<DFCoord, Block *>::iterator p;
-        for(p = blocks.begin(); p != blocks.end(); p++)
-        {
-            delete p->second;
-        }
-        blocks.clear();
-    }
+    /// drop all loaded blocks and any changes that were not written. the
+    /// memory is kept for reuse by later lookups.
+    void trash();
+
+    /**
+     * Bring a long-lived cache up to date with the game, discarding any
+     * changes that were not written. Loaded blocks are reread lazily, the
+     * next time they are looked up, so the cost is proportional to the blocks
+     * used afterwards rather than to every block the cache has ever loaded.
+     * Blocks the game has not modified since they were decoded keep their
+     * decoded tile and material layers, so repeated queries over the same
+     * area do not decode them again. Returns false (and trashes the cache) if
+     * the map has changed size, in which case the cache has to be recreated.
+     *
+     * Caches only record what their blocks were decoded from once revalidate
+     * has been called on them, so short-lived caches don't pay for it; call
+     * it right after creating a cache that is meant to be kept.
+     */
+    bool revalidate();
 
     uint32_t maxBlockX() { return x_bmax; }
     uint32_t maxBlockY() { return y_bmax; }
@@ -608,8 +640,27 @@ private:
 
     static const BiomeInfo biome_stub;
 
+    Block *lookupBlock(DFCoord blockcoord);
+
+    // free lists, so that blocks and their decoded layers are reused instead
+    // of being allocated for every block of every query
+    std::vector<Block *> free_blocks;
+    std::vector<Block::TileInfo *> free_tiles;
+    std::vector<Block::BasematInfo *> free_basemats;
+    Block::TileInfo *allocTiles();
+    void releaseTiles(Block::TileInfo *tiles);
+    Block::BasematInfo *allocBasemats();
+    void releaseBasemats(Block::BasematInfo *basemats);
+    // returns the block if it is already loaded and up to date, without
+    // creating or rereading it
+    Block *findBlock(DFCoord blockcoord);
+
     bool valid;
     bool validgeo;
+    // set by the first revalidate; blocks then record their source hashes
+    bool track_sources = false;
+    // bumped by revalidate; blocks of an older generation are stale
+    uint32_t generation = 0;
     uint32_t x_bmax;
     uint32_t y_bmax;
     uint32_t x_tmax;
@@ -617,6 +668,12 @@ private:
     uint32_t z_max;
     std::vector<BiomeInfo> biomes;
     std::map<df::coord2d, df::world_region_details*> region_details;
-    std::map<DFCoord, Block *> blocks;
+    // loaded blocks, indexed by z and then by x + y * x_bmax. the table for
+    // a z-level is only allocated when a block on that level is first used.
+    std::vector<std::vector<Block *>> block_table;
+    // loaded blocks, in no particular order
+    std::vector<Block *> block_list;
+    Block *last_block;
+    DFCoord last_bcoord;
 };
 }
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Export.h"
+
+#include "df/coord.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace DFHack {
+
+/**
+ * Tracks which map blocks changed, so incremental map tools can ask for the
+ * blocks that changed since they last looked instead of rescanning the map.
+ *
+ * Each block has a hash for every aspect below. When a change is detected,
+ * the changed aspects of the block are stamped with a new generation number
+ * and appended to a journal. Generations only grow, including across map
+ * loads, so a generation saved while an earlier map was loaded reports every
+ * block of the current one as changed.
+ *
+ * Blocks are hashed at most once per frame update of the core: the whole
+ * map on the first call to getGeneration or getChangedBlocks in an update,
+ * or a single block when getBlockGeneration asks about one that hasn't been
+ * checked in this update. Updates run while the game is paused too, so
+ * edits made then are seen on the next frame. A change that is undone
+ * before the next check goes unnoticed.
+ * \ingroup grp_modules
+ */
+namespace MapJournal {
+    enum Aspect : uint32_t {
+        TILETYPES    = 1 << 0, // block->tiletype
+        DESIGNATIONS = 1 << 1, // designation bits other than the liquid ones
+        LIQUIDS      = 1 << 2, // flow size, liquid type, stagnant, salt, static
+        SPATTER      = 1 << 3, // material and item spatter events
+        ITEMS        = 1 << 4, // the ids in block->items
+        BUILDINGS    = 1 << 5, // the building bits of the occupancy
+        ALL          = (1 << 6) - 1
+    };
+
+    // The generation of the latest change, after checking every block. 0 if
+    // no map is loaded.
+    DFHACK_EXPORT uint32_t getGeneration();
+    // Fills blocks with the block coordinates of the blocks with a change in
+    // any of the aspects after generation since, and returns the current
+    // generation to pass as since next time. Apart from the first call in a
+    // frame, which hashes the map, takes time proportional to the number of
+    // changes, except that every block is listed if since is older than the
+    // current map.
+    DFHACK_EXPORT uint32_t getChangedBlocks(std::vector<df::coord> *blocks, uint32_t since, uint32_t aspects = ALL);
+    // The generation of the latest change to any of the aspects of the block
+    // at the given block coordinates, or 0 if there is no such block.
+    DFHACK_EXPORT uint32_t getBlockGeneration(df::coord block_pos, uint32_t aspects = ALL);
+
+    // Rechecks the block holding the tile on the next call, even if it is
+    // made in the same update, and records the given aspects as changed even
+    // if their hashes didn't change.
+    DFHACK_EXPORT void invalidate(df::coord pos, uint32_t aspects = 0);
+}
+
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "Export.h"
+
+#include "df/coord.h"
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace DFHack {
+
+/**
+ * A columnar binary file format for snapshots of the loaded map, meant to be
+ * memory mapped and read without parsing.
+ *
+ * The file holds one array per field ("column"). Tile columns have 256
+ * values for each map block in the block table, in the [x][y] order DF uses;
+ * record columns have one value per record (a plant or a building), and the
+ * columns of one table share a name prefix ("plant_", "building_"). Each
+ * column is split into chunks of a fixed number of blocks or records, and
+ * each chunk is stored raw or zlib compressed, whichever is smaller. Raw
+ * chunks start on 4096 byte boundaries, so they can be used in place from a
+ * mapping of the file.
+ *
+ * Layout, all integers little endian:
+ *
+ *   FileHeader at offset 0
+ *   chunk data: raw chunks at multiples of 4096, compressed ones at
+ *     multiples of 8
+ *   block table: block_count BlockEntry, sorted by z, y, x
+ *   column table: column_count ColumnEntry
+ *   for each column, its chunk_count ChunkEntry at chunk_table_offset
+ *
+ * Readers should reject files whose version they don't know. New columns
+ * can be added without a version change; readers look columns up by name.
+ * \ingroup grp_modules
+ */
+namespace MapSnapshot {
+    const uint32_t VERSION = 1;
+    const uint32_t ALIGNMENT = 4096;
+    const size_t TILES_PER_BLOCK = 256;
+
+    enum ColumnKind : uint32_t {
+        TILES = 0,
+        RECORDS = 1
+    };
+
+    enum Codec : uint32_t {
+        RAW = 0,
+        ZLIB = 1
+    };
+
+    struct FileHeader {
+        char magic[8];          // "DFHKSNAP"
+        uint32_t version;
+        uint32_t header_size;   // sizeof(FileHeader)
+        int32_t x_count_block;  // map size, in blocks
+        int32_t y_count_block;
+        int32_t z_count_block;
+        int32_t region_x;       // map position in the world
+        int32_t region_y;
+        int32_t region_z;
+        uint32_t block_count;
+        uint32_t column_count;
+        uint32_t chunk_blocks;  // blocks per chunk of a tile column
+        uint32_t chunk_records; // records per chunk of a record column
+        uint64_t block_table_offset;
+        uint64_t column_table_offset;
+    };
+
+    struct BlockEntry {
+        int16_t x, y, z;        // block coordinates
+        int16_t padding;
+    };
+
+    struct ColumnEntry {
+        char name[32];          // zero padded
+        uint32_t kind;          // ColumnKind
+        uint32_t elem_size;     // bytes per value
+        uint64_t count;         // number of values
+        uint32_t chunk_count;
+        uint32_t padding;
+        uint64_t chunk_table_offset;
+    };
+
+    struct ChunkEntry {
+        uint64_t offset;
+        uint64_t stored_size;
+        uint64_t raw_size;
+        uint32_t codec;         // Codec
+        uint32_t padding;
+    };
+
+    struct Options {
+        bool compress = true;
+        int level = 6;          // zlib compression level
+        uint32_t chunk_blocks = 64;
+        uint32_t chunk_records = 16384;
+    };
+
+    /**
+     * Writes a snapshot file. Values are appended to the columns in any
+     * interleaving, and each chunk is written out as soon as it is full, so
+     * only one chunk per column is held in memory.
+     */
+    class DFHACK_EXPORT Writer {
+    public:
+        explicit Writer(const Options &options = Options());
+
+        bool open(const std::string &path, std::string *error = NULL);
+        // map size in blocks, and its position in the world
+        void setMap(df::coord block_size, df::coord region);
+        // the blocks that tile values are appended for, in order; add them
+        // sorted by z, then y, then x, so that readers can search for them
+        void addBlock(df::coord block_pos);
+        // returns the column index to pass to append
+        int addColumn(const std::string &name, ColumnKind kind, uint32_t elem_size);
+        // appends count values of the column's elem_size from data
+        void append(int column, const void *data, size_t count);
+        // writes the last chunks and the tables; the file is only valid after
+        // this returns true
+        bool finish(std::string *error = NULL);
+
+    private:
+        struct Column {
+            ColumnEntry entry;
+            std::vector<uint8_t> buffer;
+            std::vector<ChunkEntry> chunks;
+        };
+
+        void flush(Column &column);
+        void writeAligned(const void *data, size_t size, uint64_t alignment, uint64_t *offset);
+
+        Options options;
+        std::ofstream file;
+        uint64_t end = 0;
+        FileHeader header;
+        std::vector<BlockEntry> blocks;
+        std::vector<Column> columns;
+    };
+
+    /**
+     * A read-only memory mapping of a snapshot file. Raw chunks are read in
+     * place; compressed ones are inflated into a buffer per column, which
+     * holds the last chunk read from that column.
+     */
+    class DFHACK_EXPORT Snapshot {
+    public:
+        Snapshot() {}
+        ~Snapshot() { close(); }
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+
+        bool open(const std::string &path, std::string *error = NULL);
+        void close();
+        bool isOpen() const { return data != NULL; }
+
+        const FileHeader &header() const { return *(const FileHeader *)data; }
+
+        size_t blockCount() const { return header().block_count; }
+        df::coord block(size_t index) const;
+        // index of the block at the given block coordinates, or -1
+        int findBlock(df::coord block_pos) const;
+
+        size_t columnCount() const { return header().column_count; }
+        const ColumnEntry &column(int index) const;
+        // index of the named column, or -1
+        int findColumn(const std::string &name) const;
+        // the column's chunk_count chunk table entries
+        const ChunkEntry *chunks(int column) const;
+
+        // The 256 tile values of a tile column for the block at the given
+        // index, or NULL if the column is missing or damaged. The pointer
+        // is valid until the next read from the same column.
+        const void *tiles(int column, size_t block);
+        template<typename T> const T *tiles(int column, size_t block) {
+            if (column < 0 || size_t(column) >= columnCount() || this->column(column).elem_size != sizeof(T))
+                return NULL;
+            return (const T *)tiles(column, block);
+        }
+        // Copies all the values of a column. Returns false if the column is
+        // missing or damaged.
+        bool readColumn(int column, std::vector<uint8_t> &out);
+
+    private:
+        const uint8_t *chunk(int column, uint32_t index, size_t *size);
+
+        const uint8_t *data = NULL;
+        uint64_t size = 0;
+#ifdef _WIN32
+        void *file_handle = NULL;
+        void *map_handle = NULL;
+#endif
+        std::map<int, std::pair<uint32_t, std::vector<uint8_t>>> inflated;
+    };
+
+    /// Writes the loaded map to the file. Returns false and sets error if no
+    /// map is loaded or the file can't be written.
+    DFHACK_EXPORT bool save(const std::string &path, const Options &options = Options(),
+                            std::string *error = NULL);
+
+    struct ColumnDiff {
+        std::string name;
+        uint64_t changed_tiles = 0;
+        uint64_t changed_blocks = 0;
+    };
+
+    struct TableDiff {
+        std::string name;
+        uint64_t added = 0;
+        uint64_t removed = 0;
+        uint64_t changed = 0;
+    };
+
+    /**
+     * Compares two snapshots of the same map. Tile columns are compared
+     * block by block for the blocks in both files. Records are matched by
+     * their table's "_id" column, or by position ("_x", "_y", "_z") if the
+     * table has no ids. Returns false and sets error if the maps differ in
+     * size or position.
+     */
+    DFHACK_EXPORT bool diff(Snapshot &a, Snapshot &b, std::vector<ColumnDiff> &columns,
+                            std::vector<TableDiff> &tables, std::string *error = NULL);
+}
+
+}
@@ -40,9 +40,16 @@ distribution.
 #include "df/block_flags.h"
 #include "df/feature_type.h"
 #include "df/flow_type.h"
+#include "df/tile_bitmask.h"
 #include "df/tile_dig_designation.h"
 #include "df/tiletype.h"
 
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <string>
+#include <vector>
+
 namespace df {
     struct block_square_event;
     struct block_square_event_designation_priorityst;
@@ -238,6 +245,16 @@ class cuboid {
     /// Can optionally attempt to create map blocks if they aren't allocated.
     /// "fn" should return true to keep iterating. Won't iterate if cuboid::clampMap() would fail.
     DFHACK_EXPORT void forBlock(std::function<bool(df::map_block *, cuboid)> fn, bool ensure_block = false) const;
+
+    /// Same as forCoord, but "fn" can be any callable and is inlined. Prefer this for large areas.
+    template<typename F> void forEachCoord(F fn) const;
+
+    /// Iterate over every non-NULL map block intersecting the tile cuboid in the same order as forBlock
+    /// (top-down, N-S, then W-E). "fn" is called as fn(df::map_block *block, const df::tile_bitmask &mask),
+    /// where mask marks the tiles of the block inside the cuboid (see Maps::forMaskTiles), and
+    /// should return true to keep iterating. "fn" is inlined, so prefer this to forBlock for large areas.
+    /// Can optionally attempt to create map blocks if they aren't allocated.
+    template<typename F> void forBlockMask(F fn, bool ensure_block = false) const;
 };
 
 /**
@@ -258,6 +275,29 @@ inline void forCoord(std::function<bool(df::coord)> fn, const df::coord &p1, con
     forCoord(fn, p1.x, p1.y, p1.z, p2.x, p2.y, p2.z);
 }
 
+/// Same as forCoord, but "fn" can be any callable and is inlined.
+template<typename F>
+inline void forEachCoord(F fn, int16_t x1, int16_t y1, int16_t z1, int16_t x2, int16_t y2, int16_t z2) {
+    int16_t dx = x1 > x2 ? -1 : 1;
+    int16_t dy = y1 > y2 ? -1 : 1;
+    int16_t dz = z1 > z2 ? -1 : 1;
+
+    // Process z, y, then x.
+    for (int16_t x = x1; x != x2 + dx; x += dx)
+        for (int16_t y = y1; y != y2 + dy; y += dy)
+            for (int16_t z = z1; z != z2 + dz; z += dz)
+                if (!fn(df::coord(x, y, z)))
+                    return; // Break iterator.
+}
+
+/// Call fn(tx, ty) for every tile set in a block-local tile mask, in row order.
+template<typename F>
+inline void forMaskTiles(const df::tile_bitmask &mask, F fn) {
+    for (int ty = 0; ty < 16; ty++)
+        for (uint32_t row = mask.bits[ty]; row; row &= row - 1)
+            fn(std::countr_zero(row), ty);
+}
+
 /**
  * Method for reading the geological surrounding of the currently loaded region.
  * assign is a reference to an array of nine vectors of unsigned words that are to be filled with the data
@@ -379,6 +419,47 @@ DFHACK_EXPORT uint16_t getWalkableGroup(df::coord pos);
 DFHACK_EXPORT bool canWalkBetween(df::coord pos1, df::coord pos2);
 DFHACK_EXPORT bool canStepBetween(df::coord pos1, df::coord pos2);
 
+// A hash of everything in the block that affects movement: tiletypes,
+// walkability, deep liquid, and building occupancy.
+DFHACK_EXPORT uint64_t getBlockPathSignature(const df::map_block *block);
+
+/**
+ * How a kind of unit moves, for findPath. canStand tells whether the unit can
+ * occupy a tile, and canStep whether it can move between two adjacent tiles
+ * (including diagonal and z-level moves) that both pass canStand. canStep
+ * must give the same answer in both directions.
+ *
+ * Path data is cached by name, so movers that behave differently must have
+ * different names, and their tests should only depend on what
+ * getBlockPathSignature covers.
+ */
+struct DFHACK_EXPORT PathMover {
+    std::string name;
+    std::function<bool(df::coord)> canStand;
+    std::function<bool(df::coord, df::coord)> canStep;
+    // Optional quick check for whether two tiles are connected at all. If it
+    // returns false, findPath fails without searching.
+    std::function<bool(df::coord, df::coord)> mayReach;
+
+    // walking units, as in canStepBetween
+    static PathMover walker();
+    // wagons, as in Connectivity::WAGON: a clear 3x3 footprint, moving
+    // orthogonally and up and down ramps
+    static PathMover wagon();
+    // flying units: any tile that isn't solid or deep in liquid, moving up
+    // and down through open space and stairs as well as ramps
+    static PathMover flier();
+};
+
+// Finds a path between the tiles, including both ends, with hierarchical A*
+// over map blocks. The path is not always the shortest, but is close to it.
+// Returns false if there is no path.
+DFHACK_EXPORT bool findPath(df::coord from, df::coord to, std::vector<df::coord> &path,
+                            const PathMover &mover = PathMover::walker());
+// Makes findPath look at the block holding the tile again, for changes made
+// on the current tick. Changes made on earlier ticks are found without this.
+DFHACK_EXPORT void invalidatePaths(df::coord pos);
+
 // Get the plant that owns the tile at the specified position.
 extern DFHACK_EXPORT df::plant *getPlantAtTile(int32_t x, int32_t y, int32_t z);
 inline df::plant *getPlantAtTile(df::coord pos) { return getPlantAtTile(pos.x, pos.y, pos.z); }
@@ -400,5 +481,45 @@ inline bool removeTileAquifer(df::coord pos) { return removeTileAquifer(pos.x, p
 DFHACK_EXPORT int removeAreaAquifer(df::coord pos1, df::coord pos2,
     std::function<bool(df::coord, df::map_block *)> filter = [](df::coord pos, df::map_block *block) { return true; });
 }
+
+template<typename F>
+inline void cuboid::forEachCoord(F fn) const
+{
+    if (isValid()) // Only iterate if valid cuboid.
+        Maps::forEachCoord(fn, x_min, y_min, z_max, x_max, y_max, z_min);
+}
+
+template<typename F>
+inline void cuboid::forBlockMask(F fn, bool ensure_block) const
+{
+    auto c = *this; // Create a copy to modify.
+    if (!c.clampMap().isValid()) // No intersection.
+        return;
+
+    df::tile_bitmask mask;
+    for (int16_t x = (c.x_min >> 4) << 4; x <= c.x_max; x += 16)
+    {
+        int x_lo = std::max(c.x_min - x, 0);
+        int x_hi = std::min(c.x_max - x, 15);
+        uint16_t row = uint16_t(((2u << x_hi) - 1) & ~((1u << x_lo) - 1));
+
+        for (int16_t y = (c.y_min >> 4) << 4; y <= c.y_max; y += 16)
+        {
+            int y_lo = std::max(c.y_min - y, 0);
+            int y_hi = std::min(c.y_max - y, 15);
+            for (int ty = 0; ty < 16; ty++)
+                mask.bits[ty] = (ty >= y_lo && ty <= y_hi) ? row : 0;
+
+            for (int16_t z = c.z_max; z >= c.z_min; z--)
+            {
+                auto *block = ensure_block ? Maps::ensureTileBlock(x, y, z) : Maps::getTileBlock(x, y, z);
+                if (!block) // Skip unallocated block.
+                    continue;
+                if (!fn(block, (const df::tile_bitmask &)mask))
+                    return; // Break iterator.
+            }
+        }
+    }
+}
 }
 #endif
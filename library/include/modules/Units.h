@@ -190,6 +190,12 @@ DFHACK_EXPORT inline bool getUnitsInBox(std::vector<df::unit *> &units, int16_t
 DFHACK_EXPORT inline bool getUnitsInBox(std::vector<df::unit *> &units, df::coord pos1, df::coord pos2,
     std::function<bool(df::unit *)> filter = [](df::unit *u) { return true; })
     { return getUnitsInBox(units, cuboid(pos1, pos2), filter); }
+// Fill vector with units no more than radius tiles (straight-line distance) from pos matching filter.
+DFHACK_EXPORT bool getUnitsInRadius(std::vector<df::unit *> &units, df::coord pos, int radius,
+    std::function<bool(df::unit *)> filter = [](df::unit *u) { return true; });
+// Get the unit matching filter that is closest to pos, but no more than max_radius tiles away.
+DFHACK_EXPORT df::unit *getNearestUnit(df::coord pos, int max_radius,
+    std::function<bool(df::unit *)> filter = [](df::unit *u) { return true; });
 
 // Noble string must be in form "CAPTAIN_OF_THE_GUARD", etc.
 DFHACK_EXPORT bool getUnitsByNobleRole(std::vector<df::unit *> &units, std::string noble);
@@ -35,6 +35,7 @@ local BUILTINS = {
     clear='cls',
     cls=true,
     ['devel/dump-rpc']=true,
+    ['devel/trace']=true,
     die=true,
     dir='ls',
     disable=true,
@@ -283,6 +283,11 @@ function print_timers()
         print('----------------------------')
         print()
         print_sorted_timers(em_per_event, 25, summary.update_event_manager_ms, 'event manager', elapsed, 'elapsed')
+        local job_clones, clones_avoided = summary.event_manager_job_clones, summary.event_manager_job_clones_avoided
+        if job_clones + clones_avoided > 0 then
+            print()
+            print(('job completion tracking: %d job clones, %d clones avoided'):format(job_clones, clones_avoided))
+        end
 
         for k,v in pairs(em_per_plugin_per_event) do
             if em_per_event[k] <= 0 then goto continue end
@@ -340,4 +345,65 @@ function print_timers()
     end
 end
 
+local function format_us(ns)
+    return ('%9.1f'):format(ns / 1000)
+end
+
+local function print_frame_histograms(title, histograms, width, limit)
+    local sorted = {}
+    for name,hist in pairs(histograms) do
+        if hist.frames > 0 then
+            table.insert(sorted, {name=name, hist=hist})
+        end
+    end
+    if #sorted == 0 then return end
+    table.sort(sorted, function(a, b) return a.hist.p99_ns > b.hist.p99_ns end)
+
+    print()
+    print()
+    print(title)
+    print(('-'):rep(#title))
+    print()
+    local fmt = '%' .. tostring(width) .. 's %9s %9s %9s %9s %8s'
+    print(fmt:format('', 'p50 us', 'p95 us', 'p99 us', 'max us', 'frames'))
+    for i, elem in ipairs(sorted) do
+        if limit and i > limit then break end
+        local hist = elem.hist
+        print(fmt:format(elem.name, format_us(hist.p50_ns), format_us(hist.p95_ns),
+            format_us(hist.p99_ns), format_us(hist.max_ns), tostring(hist.frames)))
+    end
+end
+
+function print_frame_profile(limit)
+    local summary, per_event, per_plugin, per_widget = dfhack.internal.getFrameProfile()
+
+    print_frame_histograms('Update stages per frame', summary, 15)
+    print_frame_histograms('Event manager per event type per frame', per_event, 25, limit)
+    print_frame_histograms('Plugin onUpdate per frame', per_plugin, 25, limit)
+    print_frame_histograms('Overlay widgets per frame', per_widget, 45, limit)
+    print_time_slices()
+end
+
+function print_time_slices()
+    local overrun_frames, tasks = dfhack.internal.getTimeSliceStats()
+    if #tasks == 0 then return end
+    table.sort(tasks, function(a, b) return a.total_ns > b.total_ns end)
+
+    local title = ('Time-sliced tasks (budget %d us per frame, %d frames over budget)'):format(
+        dfhack.internal.getTimeSliceBudgetUs(), overrun_frames)
+    print()
+    print()
+    print(title)
+    print(('-'):rep(#title))
+    print()
+    local fmt = '%35s %7s %8s %8s %8s %9s %9s'
+    print(fmt:format('', 'runs', 'steps', 'frames', 'overrun', 'max us', 'last run'))
+    for _, task in ipairs(tasks) do
+        local name = ('%s%s/%s'):format(task.running and '*' or '', task.plugin, task.name)
+        print(fmt:format(name, tostring(task.completed), tostring(task.steps),
+            tostring(task.frames), tostring(task.overruns), format_us(task.max_step_ns),
+            tostring(task.last_run_frames)))
+    end
+end
+
 return _ENV
@@ -0,0 +1,213 @@
+#include "Internal.h"
+
+#include "DataDefs.h"
+#include "TileTypes.h"
+
+#include "modules/BlockMasks.h"
+
+#include "df/map_block.h"
+#include "df/tile_building_occ.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// define BLOCKMASKS_NO_SIMD to build (and test) the scalar kernels on x86
+#if !defined(BLOCKMASKS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define BLOCKMASKS_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace DFHack;
+
+static_assert(sizeof(df::tile_designation) == sizeof(uint32_t));
+static_assert(sizeof(df::tile_occupancy) == sizeof(uint32_t));
+
+namespace {
+    // one byte per tiletype for each attribute, holding the attribute value
+    // plus one so that NONE (-1) fits. the last entry is used for tiletype
+    // values outside the enum and reads as NONE.
+    struct TiletypeTables {
+        static constexpr int FIRST = df::enum_traits<df::tiletype>::first_item_value;
+        static constexpr int LAST = df::enum_traits<df::tiletype>::last_item_value;
+        static constexpr size_t SIZE = LAST - FIRST + 2;
+
+        uint8_t shape[SIZE];
+        uint8_t shape_basic[SIZE];
+        uint8_t material[SIZE];
+        uint8_t non_empty[SIZE];
+
+        TiletypeTables() {
+            for (size_t i = 0; i < SIZE; i++) {
+                if (i == SIZE - 1) {
+                    shape[i] = shape_basic[i] = material[i] = non_empty[i] = 0;
+                    continue;
+                }
+                auto tt = df::tiletype(FIRST + int(i));
+                auto tshape = tileShape(tt);
+                auto basic = tileShapeBasic(tshape);
+                shape[i] = uint8_t(tshape + 1);
+                shape_basic[i] = uint8_t(basic + 1);
+                material[i] = uint8_t(tileMaterial(tt) + 1);
+                non_empty[i] = basic != tiletype_shape_basic::None && basic != tiletype_shape_basic::Open;
+            }
+        }
+
+        static size_t index(df::tiletype tt) {
+            return std::min(size_t(uint32_t(int(tt) - FIRST)), SIZE - 1);
+        }
+    };
+}
+
+static const TiletypeTables &tables() {
+    static const TiletypeTables instance;
+    return instance;
+}
+
+// tiles whose tiletype maps to value in the given table
+static df::tile_bitmask matchTiletypes(const df::map_block *block, const uint8_t *table, uint8_t value) {
+    // gather the attributes in row order ([y][x]), so that each row of the
+    // result comes from one 16 byte vector
+    alignas(16) uint8_t attrs[16][16];
+    for (int x = 0; x < 16; x++)
+        for (int y = 0; y < 16; y++)
+            attrs[y][x] = table[TiletypeTables::index(block->tiletype[x][y])];
+
+    df::tile_bitmask out;
+#ifdef BLOCKMASKS_SSE2
+    __m128i want = _mm_set1_epi8(char(value));
+    for (int y = 0; y < 16; y++) {
+        __m128i row = _mm_load_si128((const __m128i *)attrs[y]);
+        out.bits[y] = uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(row, want)));
+    }
+#else
+    for (int y = 0; y < 16; y++) {
+        uint16_t bits = 0;
+        for (int x = 0; x < 16; x++)
+            if (attrs[y][x] == value)
+                bits |= uint16_t(1 << x);
+        out.bits[y] = bits;
+    }
+#endif
+    return out;
+}
+
+// turns per-column masks (bit y of cols[x]) into a tile_bitmask
+static df::tile_bitmask transpose(uint16_t cols[16]) {
+    // swap the off-diagonal 8x8 blocks, then the 4x4, 2x2 and 1x1 blocks
+    uint16_t mask = 0x00FF;
+    for (int j = 8; j; j >>= 1, mask ^= uint16_t(mask << j)) {
+        for (int k = 0; k < 16; k = (k + j + 1) & ~j) {
+            uint16_t t = ((cols[k] >> j) ^ cols[k + j]) & mask;
+            cols[k] ^= uint16_t(t << j);
+            cols[k + j] ^= t;
+        }
+    }
+    df::tile_bitmask out;
+    std::copy(cols, cols + 16, out.bits);
+    return out;
+}
+
+// tiles where (word & mask) != 0, for [x][y] arrays of 32-bit bitfields such
+// as the designation and occupancy arrays
+static df::tile_bitmask matchWords(const uint32_t (*words)[16], uint32_t mask) {
+    uint16_t cols[16];
+#ifdef BLOCKMASKS_SSE2
+    __m128i want = _mm_set1_epi32(int(mask));
+    __m128i zero = _mm_setzero_si128();
+    for (int x = 0; x < 16; x++) {
+        unsigned col = 0;
+        for (int y = 0; y < 16; y += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)&words[x][y]);
+            __m128i none = _mm_cmpeq_epi32(_mm_and_si128(v, want), zero);
+            col |= unsigned(~_mm_movemask_ps(_mm_castsi128_ps(none)) & 0xF) << y;
+        }
+        cols[x] = uint16_t(col);
+    }
+#else
+    for (int x = 0; x < 16; x++) {
+        uint16_t col = 0;
+        for (int y = 0; y < 16; y++)
+            if (words[x][y] & mask)
+                col |= uint16_t(1 << y);
+        cols[x] = col;
+    }
+#endif
+    return transpose(cols);
+}
+
+// tiles where (word & mask) == value
+static df::tile_bitmask matchWordValues(const uint32_t (*words)[16], uint32_t mask, uint32_t value) {
+    uint16_t cols[16];
+#ifdef BLOCKMASKS_SSE2
+    __m128i want_mask = _mm_set1_epi32(int(mask));
+    __m128i want_value = _mm_set1_epi32(int(value & mask));
+    for (int x = 0; x < 16; x++) {
+        unsigned col = 0;
+        for (int y = 0; y < 16; y += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)&words[x][y]);
+            __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(v, want_mask), want_value);
+            col |= unsigned(_mm_movemask_ps(_mm_castsi128_ps(eq))) << y;
+        }
+        cols[x] = uint16_t(col);
+    }
+#else
+    for (int x = 0; x < 16; x++) {
+        uint16_t col = 0;
+        for (int y = 0; y < 16; y++)
+            if ((words[x][y] & mask) == (value & mask))
+                col |= uint16_t(1 << y);
+        cols[x] = col;
+    }
+#endif
+    return transpose(cols);
+}
+
+df::tile_bitmask BlockMasks::byShape(const df::map_block *block, df::tiletype_shape shape) {
+    return matchTiletypes(block, tables().shape, uint8_t(shape + 1));
+}
+
+df::tile_bitmask BlockMasks::byShapeBasic(const df::map_block *block, df::tiletype_shape_basic basic) {
+    return matchTiletypes(block, tables().shape_basic, uint8_t(basic + 1));
+}
+
+df::tile_bitmask BlockMasks::byMaterial(const df::map_block *block, df::tiletype_material material) {
+    return matchTiletypes(block, tables().material, uint8_t(material + 1));
+}
+
+df::tile_bitmask BlockMasks::nonEmpty(const df::map_block *block) {
+    return matchTiletypes(block, tables().non_empty, 1);
+}
+
+df::tile_bitmask BlockMasks::byDesignation(const df::map_block *block, df::tile_designation mask) {
+    return matchWords((const uint32_t (*)[16])block->designation, mask.whole);
+}
+
+df::tile_bitmask BlockMasks::byOccupancy(const df::map_block *block, df::tile_occupancy mask) {
+    return matchWords((const uint32_t (*)[16])block->occupancy, mask.whole);
+}
+
+df::tile_bitmask BlockMasks::byDesignationValue(const df::map_block *block, df::tile_designation mask,
+                                                df::tile_designation value) {
+    return matchWordValues((const uint32_t (*)[16])block->designation, mask.whole, value.whole);
+}
+
+df::tile_bitmask BlockMasks::hidden(const df::map_block *block) {
+    df::tile_designation mask;
+    mask.whole = 0;
+    mask.bits.hidden = true;
+    return byDesignation(block, mask);
+}
+
+df::tile_bitmask BlockMasks::liquid(const df::map_block *block) {
+    df::tile_designation mask;
+    mask.whole = 0;
+    mask.bits.flow_size = 7;
+    return byDesignation(block, mask);
+}
+
+df::tile_bitmask BlockMasks::building(const df::map_block *block) {
+    df::tile_occupancy mask;
+    mask.whole = 0;
+    mask.bits.building = df::tile_building_occ(7);
+    return byOccupancy(block, mask);
+}
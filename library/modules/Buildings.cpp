@@ -90,6 +90,7 @@ distribution.
 #include <cstdlib>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -109,13 +110,191 @@ using std::string;
 using std::unordered_map;
 using std::vector;
 
-struct CoordHash {
-    size_t operator()(const df::coord pos) const {
-        return pos.x*65537 + pos.y*17 + pos.z;
-    }
+/*
+ * Spatial index of buildings and civzones.
+ *
+ * Every building and zone is filed under each 16x16 cell of its z-level that
+ * its bounding box overlaps, so tile and box queries only look at the few
+ * buildings near them. The index is updated by the DFHack building
+ * create/destroy paths and the EventManager building event, and is checked
+ * against the game before each query: if a building was created or removed
+ * since then, or the game advanced a tick (the game can change buildings on
+ * its own), every building's bounding box is compared with its entry.
+ * Queries still test each candidate against the building itself.
+ */
+struct IndexedBuilding {
+    df::coord p1, p2; // bounding box, inclusive
+    uint32_t generation;
 };
 
-static unordered_map<df::coord, int32_t, CoordHash> locationToBuilding;
+static const int BUILDING_CELL_SHIFT = 4;
+
+static unordered_map<int32_t, IndexedBuilding> indexedBuildings;
+static unordered_map<uint64_t, vector<int32_t>> buildingCells;
+static uint32_t buildingIndexGeneration = 0;
+// the state of the game the last time the index was brought up to date
+static int32_t buildingIndexNextId = -1;
+static size_t buildingIndexCount = 0;
+// Core::getUpdateCount(), which unlike world->frame_counter also advances
+// while the game is paused, when zones can still be painted and resized
+static uint32_t buildingIndexUpdate = 0;
+static bool buildingIndexBuilt = false;
+
+static uint64_t buildingCellKey(int32_t cx, int32_t cy, int32_t z)
+{
+    return (uint64_t(uint16_t(z)) << 32) | (uint64_t(uint16_t(cy)) << 16) | uint16_t(cx);
+}
+
+static void getBuildingBounds(df::building *bld, df::coord &p1, df::coord &p2)
+{
+    p1 = df::coord(std::min(bld->x1, bld->x2), std::min(bld->y1, bld->y2), bld->z);
+    p2 = df::coord(std::max(bld->x1, bld->x2), std::max(bld->y1, bld->y2), bld->z);
+    // extents are relative to the room rectangle, which normally matches
+    if (bld->room.extents && bld->room.width > 0 && bld->room.height > 0)
+    {
+        p1.x = std::min<int32_t>(p1.x, bld->room.x);
+        p1.y = std::min<int32_t>(p1.y, bld->room.y);
+        p2.x = std::max<int32_t>(p2.x, bld->room.x + bld->room.width - 1);
+        p2.y = std::max<int32_t>(p2.y, bld->room.y + bld->room.height - 1);
+    }
+}
+
+// calls fn(key) for the cells of the index that overlap the given box
+template<typename F>
+static void forBuildingCells(df::coord p1, df::coord p2, F fn)
+{
+    // don't let bogus coordinates fill the index with empty cells
+    int32_t x1 = std::max<int32_t>(p1.x, 0), x2 = std::min<int32_t>(p2.x, world->map.x_count - 1);
+    int32_t y1 = std::max<int32_t>(p1.y, 0), y2 = std::min<int32_t>(p2.y, world->map.y_count - 1);
+    int32_t z1 = std::max<int32_t>(p1.z, 0), z2 = std::min<int32_t>(p2.z, world->map.z_count - 1);
+    for (int32_t z = z1; z <= z2; z++)
+        for (int32_t cy = y1 >> BUILDING_CELL_SHIFT; y1 <= y2 && cy <= y2 >> BUILDING_CELL_SHIFT; cy++)
+            for (int32_t cx = x1 >> BUILDING_CELL_SHIFT; x1 <= x2 && cx <= x2 >> BUILDING_CELL_SHIFT; cx++)
+                fn(buildingCellKey(cx, cy, z));
+}
+
+static void unindexBuilding(int32_t id)
+{
+    auto it = indexedBuildings.find(id);
+    if (it == indexedBuildings.end())
+        return;
+    forBuildingCells(it->second.p1, it->second.p2, [&](uint64_t key) {
+        auto cell = buildingCells.find(key);
+        if (cell == buildingCells.end())
+            return;
+        auto &ids = cell->second;
+        auto pos = std::find(ids.begin(), ids.end(), id);
+        if (pos != ids.end())
+        {
+            *pos = ids.back();
+            ids.pop_back();
+        }
+        if (ids.empty())
+            buildingCells.erase(cell);
+    });
+    indexedBuildings.erase(it);
+}
+
+static void indexBuilding(df::building *bld)
+{
+    if (bld->id < 0 || !world->map.block_index)
+        return;
+
+    df::coord p1, p2;
+    getBuildingBounds(bld, p1, p2);
+
+    auto it = indexedBuildings.find(bld->id);
+    if (it != indexedBuildings.end())
+    {
+        it->second.generation = buildingIndexGeneration;
+        if (it->second.p1 == p1 && it->second.p2 == p2)
+            return;
+        unindexBuilding(bld->id);
+    }
+
+    indexedBuildings[bld->id] = { p1, p2, buildingIndexGeneration };
+    forBuildingCells(p1, p2, [&](uint64_t key) {
+        buildingCells[key].push_back(bld->id);
+    });
+}
+
+static bool buildingIndexInSync()
+{
+    return building_next_id && buildingIndexNextId == *building_next_id &&
+        buildingIndexCount == world->buildings.all.size() &&
+        buildingIndexBuilt && buildingIndexUpdate == Core::getInstance().getUpdateCount();
+}
+
+static void markBuildingIndexInSync()
+{
+    buildingIndexNextId = building_next_id ? *building_next_id : -1;
+    buildingIndexCount = world->buildings.all.size();
+    buildingIndexUpdate = Core::getInstance().getUpdateCount();
+    buildingIndexBuilt = true;
+}
+
+static void refreshBuildingIndex()
+{
+    if (buildingIndexInSync())
+        return;
+
+    ++buildingIndexGeneration;
+    for (auto bld : world->buildings.all)
+        indexBuilding(bld);
+
+    if (indexedBuildings.size() != world->buildings.all.size())
+    {
+        vector<int32_t> stale;
+        for (auto &entry : indexedBuildings)
+            if (entry.second.generation != buildingIndexGeneration)
+                stale.push_back(entry.first);
+        for (auto id : stale)
+            unindexBuilding(id);
+    }
+
+    markBuildingIndexInSync();
+}
+
+// queries may run concurrently under a SharedCoreSuspender and refresh the
+// index; everything else that changes it holds the core exclusively
+static std::mutex buildingIndexMutex;
+
+// calls fn(bld) once for each building whose bounding box intersects the
+// given box (inclusive), in order of id. fn can return true to stop early.
+template<typename F>
+static void forBuildingsNear(df::coord p1, df::coord p2, F fn)
+{
+    if (!world->map.block_index)
+        return;
+
+    vector<int32_t> ids;
+    {
+        std::lock_guard<std::mutex> lock(buildingIndexMutex);
+        refreshBuildingIndex();
+
+        forBuildingCells(p1, p2, [&](uint64_t key) {
+            auto cell = buildingCells.find(key);
+            if (cell == buildingCells.end())
+                return;
+            for (auto id : cell->second)
+            {
+                auto &entry = indexedBuildings[id];
+                if (entry.p2.x >= p1.x && entry.p1.x <= p2.x && entry.p2.y >= p1.y && entry.p1.y <= p2.y)
+                    ids.push_back(id);
+            }
+        });
+    }
+    // same order as the building vectors
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    for (auto id : ids)
+    {
+        auto bld = df::building::find(id);
+        if (bld && fn(bld))
+            return;
+    }
+}
 
 static df::building_extents_type *getExtentTile(const df::building::T_room &room, df::coord2d tile)
 {
@@ -372,19 +551,15 @@ df::building *Buildings::findAtTile(df::coord pos)
     if (!occ || !occ->bits.building)
         return NULL;
 
-    // Try cache lookup in case it works:
-    auto cached = locationToBuilding.find(pos);
-    if (cached != locationToBuilding.end())
-    {
-        auto building = df::building::find(cached->second);
-
-        if (building && building->z == pos.z &&
-            building->isSettingOccupancy() &&
-            containsTile(building, pos))
-        {
-            return building;
-        }
-    }
+    // Try the index first:
+    df::building *found = NULL;
+    forBuildingsNear(pos, pos, [&](df::building *bld) {
+        if (bld->z == pos.z && bld->isSettingOccupancy() && containsTile(bld, pos))
+            found = bld;
+        return found != NULL;
+    });
+    if (found)
+        return found;
 
     // The authentic method, i.e. how the game generally does this:
     auto &vec = df::building::get_vector();
@@ -413,44 +588,53 @@ df::building *Buildings::findAtTile(df::coord pos)
     return NULL;
 }
 
-static unordered_map<int32_t, df::coord> corner1;
-static unordered_map<int32_t, df::coord> corner2;
-static void cacheBuilding(df::building *building) {
-    int32_t id = building->id;
-    df::coord p1(std::min(building->x1, building->x2), std::min(building->y1,building->y2), building->z);
-    df::coord p2(std::max(building->x1, building->x2), std::max(building->y1,building->y2), building->z);
+bool Buildings::findCivzonesAt(std::vector<df::building_civzonest*> *pvec,
+                               df::coord pos) {
+    pvec->clear();
 
-    corner1[id] = p1;
-    corner2[id] = p2;
+    forBuildingsNear(pos, pos, [&](df::building *bld) {
+        if (pos.z != bld->z || bld->getType() != building_type::Civzone)
+            return false;
 
-    for (int32_t x = p1.x; x <= p2.x; x++) {
-        for (int32_t y = p1.y; y <= p2.y; y++) {
-            df::coord pt(x, y, building->z);
-            if (Buildings::containsTile(building, pt)) {
-                locationToBuilding[pt] = id;
-            }
+        auto zone = strict_virtual_cast<df::building_civzonest>(bld);
+        if (zone && zone->room.extents && zone->isExtentShaped())
+        {
+            auto etile = getExtentTile(zone->room, pos);
+            if (etile && *etile)
+                pvec->push_back(zone);
         }
-    }
+        return false;
+    });
+
+    return !pvec->empty();
 }
 
-bool Buildings::findCivzonesAt(std::vector<df::building_civzonest*> *pvec,
-                               df::coord pos) {
+bool Buildings::findAllAtTile(std::vector<df::building*> *pvec, df::coord pos)
+{
+    CHECK_NULL_POINTER(pvec);
     pvec->clear();
 
-    for (df::building_civzonest* zone : world->buildings.other.ANY_ZONE)
-    {
-        if (pos.z != zone->z)
-            continue;
+    forBuildingsNear(pos, pos, [&](df::building *bld) {
+        if (pos.z == bld->z && containsTile(bld, pos))
+            pvec->push_back(bld);
+        return false;
+    });
 
-        if (zone->room.extents && zone->isExtentShaped())
-        {
-            auto etile = getExtentTile(zone->room, pos);
-            if (!etile || !*etile)
-                continue;
+    return !pvec->empty();
+}
 
-            pvec->push_back(zone);
-        }
-    }
+bool Buildings::findInBox(std::vector<df::building*> *pvec, df::coord p1, df::coord p2)
+{
+    CHECK_NULL_POINTER(pvec);
+    pvec->clear();
+
+    df::coord lo(std::min(p1.x, p2.x), std::min(p1.y, p2.y), std::min(p1.z, p2.z));
+    df::coord hi(std::max(p1.x, p2.x), std::max(p1.y, p2.y), std::max(p1.z, p2.z));
+    forBuildingsNear(lo, hi, [&](df::building *bld) {
+        if (bld->z >= lo.z && bld->z <= hi.z)
+            pvec->push_back(bld);
+        return false;
+    });
 
     return !pvec->empty();
 }
@@ -1023,11 +1207,18 @@ static void markBuildingTiles(df::building *bld, bool remove)
 
 static void linkBuilding(df::building *bld)
 {
+    bool index_synced = buildingIndexInSync();
+
     bld->id = (*building_next_id)++;
 
     world->buildings.all.push_back(bld);
     bld->categorize(true);
 
+    // keep the index in sync without rechecking every building
+    indexBuilding(bld);
+    if (index_synced)
+        markBuildingIndexInSync();
+
     if (bld->isSettingOccupancy())
         markBuildingTiles(bld, false);
 
@@ -1311,6 +1502,8 @@ bool Buildings::deconstruct(df::building *bld)
         return true;
     bld->flags.bits.almost_deleted = true;
 
+    bool index_synced = buildingIndexInSync();
+
     if (bld->isSettingOccupancy()) {
         markBuildingTiles(bld, true);
         bld->cleanupMap();
@@ -1414,6 +1607,10 @@ bool Buildings::deconstruct(df::building *bld)
 
     delete bld;
 
+    unindexBuilding(id);
+    if (index_synced)
+        markBuildingIndexInSync();
+
     for (int i = ui_look_list->size()-1; i >= 0; --i) {
         auto item = (*ui_look_list)[i];
         if (item->type == df::look_info_type::Building &&
@@ -1449,15 +1646,19 @@ void Buildings::notifyCivzoneModified(df::building* bld)
     if (bld->getType() != building_type::Civzone)
         return;
 
+    indexBuilding(bld);
+
     //remove zone here needs to be the slow method
     remove_zone_from_all_buildings(bld);
     add_zone_to_all_buildings(bld);
 }
 
 void Buildings::clearBuildings(color_ostream& out) {
-    corner1.clear();
-    corner2.clear();
-    locationToBuilding.clear();
+    indexedBuildings.clear();
+    buildingCells.clear();
+    buildingIndexNextId = -1;
+    buildingIndexCount = 0;
+    buildingIndexBuilt = false;
 }
 
 void Buildings::updateBuildings(color_ostream&, void* ptr)
@@ -1466,32 +1667,9 @@ void Buildings::updateBuildings(color_ostream&, void* ptr)
     auto building = df::building::find(id);
 
     if (building)
-    {
-        bool is_civzone = !building->isSettingOccupancy();
-        if (!corner1.count(id) && !is_civzone)
-            cacheBuilding(building);
-    }
-    else if (corner1.count(id))
-    {
-        // existing building: destroy it
-        // note that civzones are lazy-destroyed in findCivzonesAt() and are
-        // not handled here
-        df::coord p1 = corner1[id];
-        df::coord p2 = corner2[id];
-
-        for ( int32_t x = p1.x; x <= p2.x; x++ ) {
-            for ( int32_t y = p1.y; y <= p2.y; y++ ) {
-                df::coord pt(x,y,p1.z);
-
-                auto cur = locationToBuilding.find(pt);
-                if (cur != locationToBuilding.end() && cur->second == id)
-                    locationToBuilding.erase(cur);
-            }
-        }
-
-        corner1.erase(id);
-        corner2.erase(id);
-    }
+        indexBuilding(building);
+    else
+        unindexBuilding(id);
 }
 
 static std::map<df::building_type, std::vector<std::string>> room_quality_names = {
@@ -30,6 +30,7 @@ distribution.
 #include "Error.h"
 #include "MiscUtils.h"
 
+#include "modules/BlockMasks.h"
 #include "modules/Burrows.h"
 #include "modules/Maps.h"
 #include "modules/Units.h"
@@ -43,8 +44,11 @@ distribution.
 #include "df/unit.h"
 #include "df/world.h"
 
+#include <algorithm>
 #include <vector>
 #include <cstdlib>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace DFHack;
 using namespace df::enums;
@@ -270,3 +274,184 @@ bool Burrows::setAssignedBlockTile(df::burrow *burrow, df::map_block *block, df:
 
     return true;
 }
+
+/*
+ * Bulk tile operations
+ */
+
+typedef std::pair<df::map_block *, df::block_burrow *> BlockMask;
+
+// the burrow's block masks, in the order of its block list
+static void listBlockMasks(df::burrow *burrow, std::vector<BlockMask> &out)
+{
+    std::vector<df::map_block *> blocks;
+    Burrows::listBlocks(&blocks, burrow);
+    out.clear();
+    out.reserve(blocks.size());
+    for (auto block : blocks)
+        if (auto mask = Burrows::getBlockMask(burrow, block))
+            out.emplace_back(block, mask);
+}
+
+static void indexBlockMasks(df::burrow *burrow, std::unordered_map<df::map_block *, df::block_burrow *> &index)
+{
+    std::vector<BlockMask> masks;
+    listBlockMasks(burrow, masks);
+    index.clear();
+    index.reserve(masks.size());
+    for (auto &entry : masks)
+        index.emplace(entry.first, entry.second);
+}
+
+// deletes the empty masks among the given ones, updating the burrow's block
+// list in one pass instead of one search per mask
+static void deleteEmptyMasks(df::burrow *burrow, const std::vector<BlockMask> &masks)
+{
+    df::coord base(world->map.region_x*3,world->map.region_y*3,world->map.region_z);
+    std::unordered_set<df::coord> deleted;
+    for (auto &entry : masks) {
+        if (entry.second->has_assignments())
+            continue;
+        deleted.insert(base + entry.first->map_pos/16);
+        destroyBurrowMask(entry.second);
+    }
+    if (deleted.empty())
+        return;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < burrow->block_x.size(); i++) {
+        df::coord pos(burrow->block_x[i], burrow->block_y[i], burrow->block_z[i]);
+        if (deleted.count(pos))
+            continue;
+        burrow->block_x[kept] = burrow->block_x[i];
+        burrow->block_y[kept] = burrow->block_y[i];
+        burrow->block_z[kept] = burrow->block_z[i];
+        kept++;
+    }
+    burrow->block_x.resize(kept);
+    burrow->block_y.resize(kept);
+    burrow->block_z.resize(kept);
+}
+
+// adds or removes the tiles of a block mask, creating or deleting the
+// burrow's mask for the block as needed
+static void applyBlockMask(df::burrow *target, std::unordered_map<df::map_block *, df::block_burrow *> &index,
+                           df::map_block *block, const df::tile_bitmask &tiles, bool enable,
+                           std::vector<BlockMask> &changed)
+{
+    if (BlockMasks::isEmpty(tiles))
+        return;
+    auto it = index.find(block);
+    df::block_burrow *mask = it != index.end() ? it->second : NULL;
+    if (!mask) {
+        if (!enable)
+            return;
+        mask = Burrows::getBlockMask(target, block, true);
+        index.emplace(block, mask);
+    }
+    if (enable) {
+        mask->tile_bitmask |= tiles;
+    } else {
+        mask->tile_bitmask -= tiles;
+        changed.emplace_back(block, mask);
+    }
+}
+
+void Burrows::unionTiles(df::burrow *target, df::burrow *source)
+{
+    CHECK_NULL_POINTER(target);
+    CHECK_NULL_POINTER(source);
+
+    if (target == source)
+        return;
+
+    std::unordered_map<df::map_block *, df::block_burrow *> index;
+    indexBlockMasks(target, index);
+    std::vector<BlockMask> masks, changed;
+    listBlockMasks(source, masks);
+    for (auto &entry : masks)
+        applyBlockMask(target, index, entry.first, entry.second->tile_bitmask, true, changed);
+}
+
+void Burrows::intersectTiles(df::burrow *target, df::burrow *source)
+{
+    CHECK_NULL_POINTER(target);
+    CHECK_NULL_POINTER(source);
+
+    if (target == source)
+        return;
+
+    std::unordered_map<df::map_block *, df::block_burrow *> index;
+    indexBlockMasks(source, index);
+    std::vector<BlockMask> masks;
+    listBlockMasks(target, masks);
+    for (auto &entry : masks) {
+        auto it = index.find(entry.first);
+        if (it == index.end())
+            entry.second->tile_bitmask.clear();
+        else
+            entry.second->tile_bitmask &= it->second->tile_bitmask;
+    }
+    deleteEmptyMasks(target, masks);
+}
+
+void Burrows::subtractTiles(df::burrow *target, df::burrow *source)
+{
+    CHECK_NULL_POINTER(target);
+    CHECK_NULL_POINTER(source);
+
+    if (target == source) {
+        clearTiles(target);
+        return;
+    }
+
+    std::unordered_map<df::map_block *, df::block_burrow *> index;
+    indexBlockMasks(target, index);
+    std::vector<BlockMask> masks, changed;
+    listBlockMasks(source, masks);
+    for (auto &entry : masks)
+        applyBlockMask(target, index, entry.first, entry.second->tile_bitmask, false, changed);
+    deleteEmptyMasks(target, changed);
+}
+
+void Burrows::copyTiles(df::burrow *target, df::burrow *source)
+{
+    CHECK_NULL_POINTER(target);
+    CHECK_NULL_POINTER(source);
+
+    if (target == source)
+        return;
+
+    clearTiles(target);
+    unionTiles(target, source);
+}
+
+void Burrows::setTilesByDesignation(df::burrow *target, df::tile_designation mask,
+                                    df::tile_designation value, bool enable)
+{
+    CHECK_NULL_POINTER(target);
+
+    std::unordered_map<df::map_block *, df::block_burrow *> index;
+    indexBlockMasks(target, index);
+    std::vector<BlockMask> changed;
+    for (auto block : world->map.map_blocks)
+        applyBlockMask(target, index, block, BlockMasks::byDesignationValue(block, mask, value), enable, changed);
+    deleteEmptyMasks(target, changed);
+}
+
+void Burrows::setTilesInBox(df::burrow *target, df::coord pos1, df::coord pos2, bool enable)
+{
+    CHECK_NULL_POINTER(target);
+
+    if (!Maps::IsValid())
+        return;
+
+    std::unordered_map<df::map_block *, df::block_burrow *> index;
+    indexBlockMasks(target, index);
+    std::vector<BlockMask> changed;
+    cuboid(pos1, pos2).forBlockMask([&](df::map_block *block, const df::tile_bitmask &tiles) {
+        applyBlockMask(target, index, block, tiles, enable, changed);
+        return true;
+    });
+    deleteEmptyMasks(target, changed);
+}
@@ -0,0 +1,504 @@
+#include "Internal.h"
+
+#include "DataDefs.h"
+#include "TileTypes.h"
+
+#include "modules/Connectivity.h"
+#include "modules/MapJournal.h"
+#include "modules/Maps.h"
+#include "modules/Units.h"
+
+#include "df/map_block.h"
+#include "df/tile_building_occ.h"
+#include "df/unit.h"
+#include "df/world.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+using namespace DFHack;
+using namespace df::enums;
+using df::global::world;
+
+using Connectivity::Mover;
+
+namespace {
+    const int LAYERS = 2;
+    const uint32_t NO_REGION = UINT32_MAX;
+
+    // A block has at most 64 walker regions (8-connected) and 128 wagon
+    // regions (4-connected), so a region key is the block index followed by
+    // seven bits of 0-based local region.
+    inline uint32_t regionKey(int32_t block_index, uint8_t region) {
+        return (uint32_t(block_index) << 7) | uint32_t(region - 1);
+    }
+
+    struct Edge {
+        uint8_t from; // region of this block, 1-based
+        uint32_t to;  // key of a region in another block
+
+        bool operator<(const Edge &other) const {
+            return from != other.from ? from < other.from : to < other.to;
+        }
+        bool operator==(const Edge &other) const {
+            return from == other.from && to == other.to;
+        }
+    };
+
+    struct BlockGraph {
+        bool present = false;
+        uint64_t signature = 0;
+        // 1-based region of each tile, or 0 if the mover can't stand there
+        uint8_t region[LAYERS][16][16];
+        uint8_t count[LAYERS] = { 0, 0 };
+        // links to regions of other blocks: up, and across the block border
+        std::vector<Edge> edges[LAYERS];
+        // index of the first region of this block in the component vector
+        uint32_t base[LAYERS] = { 0, 0 };
+    };
+
+    struct Graph {
+        bool built = false;
+        int32_t x_count = 0, y_count = 0, z_count = 0; // in blocks
+        uint32_t generation = 0; // of MapJournal, when the graph was last synced
+        std::vector<BlockGraph> blocks;
+        std::vector<uint8_t> marks;
+        std::vector<int32_t> pending; // blocks passed to invalidate
+        std::vector<int32_t> changed;
+        std::vector<df::coord> journal_blocks;
+        bool components_valid[LAYERS] = { false, false };
+        std::vector<uint32_t> component[LAYERS];
+
+        int32_t index(int32_t bx, int32_t by, int32_t bz) const {
+            return (bz * y_count + by) * x_count + bx;
+        }
+        void position(int32_t index, int32_t &bx, int32_t &by, int32_t &bz) const {
+            bx = index % x_count;
+            by = index / x_count % y_count;
+            bz = index / x_count / y_count;
+        }
+    };
+}
+
+static std::mutex graph_mutex;
+static Graph graph;
+
+static bool isWalkPassable(const df::map_block *block, int x, int y) {
+    return block->walkable[x][y] && block->designation[x][y].bits.flow_size < 4;
+}
+
+static bool isWalkPassable(int32_t x, int32_t y, int32_t z) {
+    auto block = Maps::getTileBlock(x, y, z);
+    return block && isWalkPassable(block, x & 15, y & 15);
+}
+
+// whether a tile can be part of a wagon's footprint
+static bool isWagonPassable(int32_t x, int32_t y, int32_t z) {
+    auto block = Maps::getTileBlock(x, y, z);
+    if (!block)
+        return false;
+    int tx = x & 15, ty = y & 15;
+    df::tiletype tt = block->tiletype[tx][ty];
+    auto shape = tileShape(tt);
+
+    // wagons pass through the space above a ramp on their way up or down
+    if (shape == tiletype_shape::RAMP_TOP)
+        return isWalkPassable(x, y, z - 1);
+    if (!isWalkPassable(block, tx, ty))
+        return false;
+
+    switch (block->occupancy[tx][ty].bits.building) {
+    case tile_building_occ::Obstacle:
+    case tile_building_occ::Well:
+    case tile_building_occ::Impassable:
+    case tile_building_occ::Dynamic: // doors, levers, traps, hatches
+        return false;
+    case tile_building_occ::Floored: // depots, lowered bridges
+        return true;
+    default:
+        break;
+    }
+
+    if (shape == tiletype_shape::STAIR_UP || shape == tiletype_shape::STAIR_DOWN ||
+            shape == tiletype_shape::STAIR_UPDOWN || shape == tiletype_shape::BOULDER ||
+            shape == tiletype_shape::EMPTY || shape == tiletype_shape::NONE)
+        return false;
+    if (tileSpecial(tt) == tiletype_special::TRACK)
+        return false;
+    auto material = tileMaterial(tt);
+    return material != tiletype_material::POOL && material != tiletype_material::RIVER;
+}
+
+// the wall that a ramp leads up onto is part of the footprint of a wagon on
+// the ramp
+static bool isRampSide(int32_t x, int32_t y, int32_t z) {
+    auto tt = Maps::getTileType(x, y, z);
+    return tt && tileShape(*tt) == tiletype_shape::WALL && isWalkPassable(x, y, z + 1);
+}
+
+static bool isWagonTile(int32_t x, int32_t y, int32_t z) {
+    if (!isWalkPassable(x, y, z) || !isWagonPassable(x, y, z))
+        return false;
+    auto tt = Maps::getTileType(x, y, z);
+    bool ramp = tt && tileShape(*tt) == tiletype_shape::RAMP;
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            if ((dx || dy) && !isWagonPassable(x + dx, y + dy, z) &&
+                    !(ramp && isRampSide(x + dx, y + dy, z)))
+                return false;
+        }
+    }
+    return true;
+}
+
+// labels the connected groups of passable tiles, counting from 1
+static uint8_t labelRegions(const bool pass[16][16], bool diagonal, uint8_t out[16][16]) {
+    memset(out, 0, 16 * 16);
+    uint8_t count = 0;
+    uint8_t stack[256];
+    for (int x = 0; x < 16; x++) {
+        for (int y = 0; y < 16; y++) {
+            if (!pass[x][y] || out[x][y])
+                continue;
+            out[x][y] = ++count;
+            int top = 0;
+            stack[top++] = uint8_t(x << 4 | y);
+            while (top) {
+                uint8_t tile = stack[--top];
+                int cx = tile >> 4, cy = tile & 15;
+                for (int dx = -1; dx <= 1; dx++) {
+                    for (int dy = -1; dy <= 1; dy++) {
+                        if ((!dx && !dy) || (!diagonal && dx && dy))
+                            continue;
+                        int nx = cx + dx, ny = cy + dy;
+                        if (nx < 0 || ny < 0 || nx > 15 || ny > 15 || !pass[nx][ny] || out[nx][ny])
+                            continue;
+                        out[nx][ny] = count;
+                        stack[top++] = uint8_t(nx << 4 | ny);
+                    }
+                }
+            }
+        }
+    }
+    return count;
+}
+
+static void computeRegions(Graph &g, int32_t index) {
+    auto &node = g.blocks[index];
+    int32_t bx, by, bz;
+    g.position(index, bx, by, bz);
+    auto block = Maps::getBlock(bx, by, bz);
+
+    node.present = block != NULL;
+    node.signature = block ? Maps::getBlockPathSignature(block) : 0;
+    for (int layer = 0; layer < LAYERS; layer++) {
+        memset(node.region[layer], 0, sizeof(node.region[layer]));
+        node.count[layer] = 0;
+    }
+    if (!block)
+        return;
+
+    bool walk[16][16];
+    bool any = false;
+    for (int x = 0; x < 16; x++) {
+        for (int y = 0; y < 16; y++) {
+            walk[x][y] = isWalkPassable(block, x, y);
+            any = any || walk[x][y];
+        }
+    }
+    if (!any)
+        return;
+    node.count[Connectivity::WALKER] = labelRegions(walk, true, node.region[Connectivity::WALKER]);
+
+    // the wagon footprint reaches one tile past the block
+    bool pass[18][18];
+    int32_t x0 = bx * 16 - 1, y0 = by * 16 - 1;
+    for (int x = 0; x < 18; x++)
+        for (int y = 0; y < 18; y++)
+            pass[x][y] = isWagonPassable(x0 + x, y0 + y, bz);
+
+    bool wagon[16][16];
+    for (int x = 0; x < 16; x++) {
+        for (int y = 0; y < 16; y++) {
+            bool ok = walk[x][y] && pass[x + 1][y + 1];
+            bool ramp = ok && tileShape(block->tiletype[x][y]) == tiletype_shape::RAMP;
+            for (int dx = -1; ok && dx <= 1; dx++) {
+                for (int dy = -1; ok && dy <= 1; dy++) {
+                    if (pass[x + 1 + dx][y + 1 + dy])
+                        continue;
+                    ok = ramp && isRampSide(x0 + 1 + x + dx, y0 + 1 + y + dy, bz);
+                }
+            }
+            wagon[x][y] = ok;
+        }
+    }
+    node.count[Connectivity::WAGON] = labelRegions(wagon, false, node.region[Connectivity::WAGON]);
+}
+
+static uint32_t regionAt(const Graph &g, int32_t x, int32_t y, int32_t z, int layer) {
+    if (x < 0 || y < 0 || z < 0 || x >= g.x_count * 16 || y >= g.y_count * 16 || z >= g.z_count)
+        return NO_REGION;
+    int32_t index = g.index(x >> 4, y >> 4, z);
+    uint8_t region = g.blocks[index].region[layer][x & 15][y & 15];
+    return region ? regionKey(index, region) : NO_REGION;
+}
+
+static void computeEdges(Graph &g, int32_t index) {
+    auto &node = g.blocks[index];
+    for (int layer = 0; layer < LAYERS; layer++)
+        node.edges[layer].clear();
+    if (!node.present)
+        return;
+    int32_t bx, by, bz;
+    g.position(index, bx, by, bz);
+    auto block = Maps::getBlock(bx, by, bz);
+    if (!block)
+        return;
+    int32_t x0 = bx * 16, y0 = by * 16;
+
+    for (int layer = 0; layer < LAYERS; layer++) {
+        if (!node.count[layer])
+            continue;
+        bool walker = layer == Connectivity::WALKER;
+        auto &edges = node.edges[layer];
+
+        for (int x = 0; x < 16; x++) {
+            for (int y = 0; y < 16; y++) {
+                uint8_t region = node.region[layer][x][y];
+                if (!region)
+                    continue;
+                df::coord pos(x0 + x, y0 + y, bz);
+
+                // across the block border
+                if (x == 0 || y == 0 || x == 15 || y == 15) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        for (int dy = -1; dy <= 1; dy++) {
+                            if ((!dx && !dy) || (!walker && dx && dy))
+                                continue;
+                            int nx = x + dx, ny = y + dy;
+                            if (nx >= 0 && ny >= 0 && nx <= 15 && ny <= 15)
+                                continue;
+                            uint32_t key = regionAt(g, pos.x + dx, pos.y + dy, bz, layer);
+                            if (key != NO_REGION)
+                                edges.push_back({ region, key });
+                        }
+                    }
+                }
+
+                // up stairs and ramps; the block above links back down
+                // through the edges of this block
+                auto shape = tileShape(block->tiletype[x][y]);
+                bool stair = walker && (shape == tiletype_shape::STAIR_UP || shape == tiletype_shape::STAIR_UPDOWN);
+                if (!stair && shape != tiletype_shape::RAMP)
+                    continue;
+                for (int dx = -1; dx <= 1; dx++) {
+                    for (int dy = -1; dy <= 1; dy++) {
+                        if (stair && (dx || dy))
+                            continue;
+                        if (!walker && (!dx == !dy))
+                            continue;
+                        df::coord up(pos.x + dx, pos.y + dy, bz + 1);
+                        uint32_t key = regionAt(g, up.x, up.y, up.z, layer);
+                        if (key != NO_REGION && Maps::canStepBetween(pos, up))
+                            edges.push_back({ region, key });
+                    }
+                }
+            }
+        }
+
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    }
+}
+
+static void computeComponents(Graph &g, int layer) {
+    uint32_t total = 0;
+    for (auto &node : g.blocks) {
+        node.base[layer] = total;
+        total += node.count[layer];
+    }
+
+    auto &parent = g.component[layer];
+    parent.resize(total);
+    std::iota(parent.begin(), parent.end(), 0);
+    auto find = [&](uint32_t i) {
+        while (parent[i] != i)
+            i = parent[i] = parent[parent[i]];
+        return i;
+    };
+
+    for (auto &node : g.blocks) {
+        for (auto &edge : node.edges[layer]) {
+            auto &other = g.blocks[edge.to >> 7];
+            uint32_t local = edge.to & 127;
+            if (local >= other.count[layer])
+                continue;
+            uint32_t a = find(node.base[layer] + edge.from - 1);
+            uint32_t b = find(other.base[layer] + local);
+            if (a != b)
+                parent[std::max(a, b)] = std::min(a, b);
+        }
+    }
+
+    // component ids are the root's index plus one, so 0 can mean "none"
+    for (uint32_t i = 0; i < total; i++)
+        parent[i] = find(i);
+    for (uint32_t i = 0; i < total; i++)
+        parent[i] += 1;
+    g.components_valid[layer] = true;
+}
+
+template<typename F>
+static void forNeighborhood(const Graph &g, int32_t index, F fn) {
+    int32_t bx, by, bz;
+    g.position(index, bx, by, bz);
+    for (int32_t z = std::max(bz - 1, 0); z <= std::min(bz + 1, g.z_count - 1); z++)
+        for (int32_t y = std::max(by - 1, 0); y <= std::min(by + 1, g.y_count - 1); y++)
+            for (int32_t x = std::max(bx - 1, 0); x <= std::min(bx + 1, g.x_count - 1); x++)
+                fn(g.index(x, y, z));
+}
+
+// Wagon regions depend on the blocks around a block, and edges depend on the
+// regions of the blocks around a block, so a change is felt two blocks away.
+static void updateBlocks(Graph &g, const std::vector<int32_t> &changed) {
+    const uint8_t REGIONS = 1, EDGES = 2;
+    std::vector<int32_t> regions, edges;
+    for (int32_t index : changed) {
+        forNeighborhood(g, index, [&](int32_t n) {
+            if (!(g.marks[n] & REGIONS)) {
+                g.marks[n] |= REGIONS;
+                regions.push_back(n);
+            }
+        });
+    }
+    for (int32_t index : regions)
+        computeRegions(g, index);
+    for (int32_t index : regions) {
+        forNeighborhood(g, index, [&](int32_t n) {
+            if (!(g.marks[n] & EDGES)) {
+                g.marks[n] |= EDGES;
+                edges.push_back(n);
+            }
+        });
+    }
+    for (int32_t index : edges) {
+        computeEdges(g, index);
+        g.marks[index] = 0;
+    }
+    for (int32_t index : regions)
+        g.marks[index] = 0;
+    for (int layer = 0; layer < LAYERS; layer++)
+        g.components_valid[layer] = false;
+}
+
+static bool syncGraph(Graph &g) {
+    if (!world || !Maps::IsValid()) {
+        g = Graph();
+        return false;
+    }
+    int32_t x_count = world->map.x_count_block;
+    int32_t y_count = world->map.y_count_block;
+    int32_t z_count = world->map.z_count_block;
+
+    if (!g.built || g.x_count != x_count || g.y_count != y_count || g.z_count != z_count) {
+        g = Graph();
+        g.x_count = x_count;
+        g.y_count = y_count;
+        g.z_count = z_count;
+        int32_t size = x_count * y_count * z_count;
+        g.blocks.resize(size);
+        g.marks.assign(size, 0);
+        for (int32_t index = 0; index < size; index++)
+            computeRegions(g, index);
+        for (int32_t index = 0; index < size; index++)
+            computeEdges(g, index);
+        g.built = true;
+        g.generation = MapJournal::getGeneration();
+        return true;
+    }
+
+    // MapJournal hashes the map at most once per update for all of its
+    // users; of the blocks it reports, only those whose path signature
+    // changed (e.g. not just a shallow flow) need their regions rebuilt
+    auto &changed = g.changed;
+    changed.clear();
+    changed.swap(g.pending);
+    g.generation = MapJournal::getChangedBlocks(&g.journal_blocks, g.generation,
+        MapJournal::TILETYPES | MapJournal::LIQUIDS | MapJournal::BUILDINGS);
+    for (auto &pos : g.journal_blocks) {
+        int32_t index = g.index(pos.x, pos.y, pos.z);
+        auto block = Maps::getBlock(pos);
+        auto &node = g.blocks[index];
+        if (node.present != (block != NULL) || (block && Maps::getBlockPathSignature(block) != node.signature))
+            changed.push_back(index);
+    }
+    if (!changed.empty())
+        updateBlocks(g, changed);
+    return true;
+}
+
+static uint32_t componentAt(Graph &g, df::coord pos, Mover mover) {
+    if (pos.x < 0 || pos.y < 0 || pos.z < 0 ||
+            pos.x >= g.x_count * 16 || pos.y >= g.y_count * 16 || pos.z >= g.z_count)
+        return 0;
+    auto &node = g.blocks[g.index(pos.x >> 4, pos.y >> 4, pos.z)];
+    uint8_t region = node.region[mover][pos.x & 15][pos.y & 15];
+    if (!region)
+        return 0;
+    if (!g.components_valid[mover])
+        computeComponents(g, mover);
+    return g.component[mover][node.base[mover] + region - 1];
+}
+
+void connectivity_onStateChange(color_ostream &out, state_change_event event) {
+    switch (event) {
+    case SC_MAP_LOADED:
+    case SC_MAP_UNLOADED:
+    case SC_WORLD_UNLOADED:
+    {
+        std::lock_guard<std::mutex> lock(graph_mutex);
+        graph = Graph();
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+uint32_t Connectivity::getComponent(df::coord pos, Mover mover) {
+    std::lock_guard<std::mutex> lock(graph_mutex);
+    if (!syncGraph(graph))
+        return 0;
+    return componentAt(graph, pos, mover);
+}
+
+bool Connectivity::canStand(df::coord pos, Mover mover) {
+    if (mover == WAGON)
+        return isWagonTile(pos.x, pos.y, pos.z);
+    return isWalkPassable(pos.x, pos.y, pos.z);
+}
+
+bool Connectivity::canReach(df::coord from, df::coord to, Mover mover) {
+    std::lock_guard<std::mutex> lock(graph_mutex);
+    if (!syncGraph(graph))
+        return false;
+    uint32_t component = componentAt(graph, from, mover);
+    return component && component == componentAt(graph, to, mover);
+}
+
+bool Connectivity::canUnitReach(df::unit *unit, df::coord to) {
+    CHECK_NULL_POINTER(unit);
+    return canReach(Units::getPosition(unit), to, WALKER);
+}
+
+void Connectivity::invalidate(df::coord pos) {
+    std::lock_guard<std::mutex> lock(graph_mutex);
+    auto &g = graph;
+    if (!g.built || pos.x < 0 || pos.y < 0 || pos.z < 0 ||
+            pos.x >= g.x_count * 16 || pos.y >= g.y_count * 16 || pos.z >= g.z_count)
+        return;
+    g.pending.push_back(g.index(pos.x >> 4, pos.y >> 4, pos.z));
+}
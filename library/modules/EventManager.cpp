@@ -1,6 +1,7 @@
 #include "Core.h"
 #include "Console.h"
 #include "Debug.h"
+#include "TimerWheel.h"
 #include "VTableInterpose.h"
 
 #include "modules/Buildings.h"
@@ -26,6 +27,7 @@
 #include "df/item_crafted.h"
 #include "df/item_weaponst.h"
 #include "df/job.h"
+#include "df/job_item_ref.h"
 #include "df/job_list_link.h"
 #include "df/report.h"
 #include "df/plotinfost.h"
@@ -39,6 +41,7 @@
 
 #include <algorithm>
 #include <cstring>
+#include <iterator>
 #include <map>
 #include <string>
 #include <unordered_map>
@@ -61,17 +64,96 @@ using namespace df::enums;
  *  consider a typedef instead of a struct for EventHandler
  **/
 
-static multimap<int32_t, EventHandler> tickQueue;
+typedef TimerWheel<EventHandler> TickQueue;
+static TickQueue tickQueue;
+// lets tick handlers be cancelled by value without scanning the queue
+static unordered_multimap<EventHandler, TickQueue::handle_t> tickHandles;
 
-//TODO: consider unordered_map of pairs, or unordered_map of unordered_set, or whatever
-static multimap<Plugin*, EventHandler> handlers[EventType::EVENT_MAX];
+/*
+ * Handlers for each event type live in a flat array in registration order.
+ * Every change bumps the list's generation. Dispatch iterates a snapshot that
+ * is only re-copied (into storage that is reused across ticks) when the
+ * generation has moved on, so handlers can register and unregister listeners
+ * while an event is being dispatched, and dispatch does not allocate once the
+ * set of listeners has settled. Dispatch for a given event type is never
+ * re-entered, so a snapshot is not refreshed while it is being iterated.
+ */
+template<typename Handler>
+struct HandlerList {
+    vector<Handler> entries;
+    uint32_t generation = 0;
+    // lowest freq of all entries
+    int32_t min_freq = 0;
+
+    bool empty() const { return entries.empty(); }
+
+    void add(const Handler &handler) {
+        entries.push_back(handler);
+        changed();
+    }
+
+    // removes the first entry equal to handler, or all of them
+    bool remove(const Handler &handler, bool all) {
+        bool found = false;
+        for (auto it = entries.begin(); it != entries.end(); ) {
+            if (*it != handler) {
+                ++it;
+                continue;
+            }
+            it = entries.erase(it);
+            found = true;
+            if (!all)
+                break;
+        }
+        if (found)
+            changed();
+        return found;
+    }
+
+    void removePlugin(Plugin *plugin) {
+        size_t num = std::erase_if(entries, [&](const Handler &h) { return h.plugin == plugin; });
+        if (num)
+            changed();
+    }
+
+    void clear() {
+        entries.clear();
+        changed();
+    }
+
+    const vector<Handler> &snapshot() {
+        if (snapshot_generation != generation) {
+            snapshot_entries.assign(entries.begin(), entries.end());
+            snapshot_generation = generation;
+        }
+        return snapshot_entries;
+    }
+
+private:
+    vector<Handler> snapshot_entries;
+    uint32_t snapshot_generation = 0;
+
+    void changed() {
+        ++generation;
+        min_freq = 0;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (i == 0 || entries[i].freq < min_freq)
+                min_freq = entries[i].freq;
+        }
+    }
+};
+
+static HandlerList<EventHandler> handlers[EventType::EVENT_MAX];
+static HandlerList<BatchEventHandler> batchHandlers[EventType::EVENT_MAX];
+// the arguments collected for batched handlers by the last check of each event
+static vector<void*> batchArgs[EventType::EVENT_MAX];
 static int32_t eventLastTick[EventType::EVENT_MAX];
 
 static const int32_t ticksPerYear = 403200;
 
 void DFHack::EventManager::registerListener(EventType::EventType e, EventHandler handler) {
     DEBUG(log).print("registering handler %p from plugin %s for event %d\n", handler.eventHandler, !handler.plugin ? "<null>" : handler.plugin->getName().c_str(), e);
-    handlers[e].insert(pair<Plugin*, EventHandler>(handler.plugin, handler));
+    handlers[e].add(handler);
 }
 
 int32_t DFHack::EventManager::registerTick(EventHandler handler, int32_t when, bool absolute) {
@@ -85,50 +167,53 @@ int32_t DFHack::EventManager::registerTick(EventHandler handler, int32_t when, b
         }
     }
     handler.freq = when;
-    tickQueue.insert(pair<int32_t, EventHandler>(handler.freq, handler));
+    tickHandles.emplace(handler, tickQueue.schedule(when, handler));
     DEBUG(log).print("registering handler %p from plugin %s for event TICK\n", handler.eventHandler, !handler.plugin ? "<null>" : handler.plugin->getName().c_str());
-    handlers[EventType::TICK].insert(pair<Plugin*,EventHandler>(handler.plugin,handler));
+    handlers[EventType::TICK].add(handler);
     return when;
 }
 
 static void removeFromTickQueue(EventHandler getRidOf) {
-    for ( auto j = tickQueue.find(getRidOf.freq); j != tickQueue.end(); ) {
-        if ( (*j).first > getRidOf.freq )
-            break;
-        if ( (*j).second != getRidOf ) {
-            j++;
-            continue;
-        }
-        j = tickQueue.erase(j);
-    }
+    auto range = tickHandles.equal_range(getRidOf);
+    for (auto j = range.first; j != range.second; ++j)
+        tickQueue.cancel(j->second);
+    tickHandles.erase(range.first, range.second);
 }
 
 void DFHack::EventManager::unregister(EventType::EventType e, EventHandler handler) {
-    for ( auto i = handlers[e].find(handler.plugin); i != handlers[e].end(); ) {
-        if ( (*i).first != handler.plugin )
-            break;
-        EventHandler &handle = (*i).second;
-        if ( handle != handler ) {
-            i++;
-            continue;
-        }
-        DEBUG(log).print("unregistering handler %p from plugin %s for event %d\n", handler.eventHandler, !handler.plugin ? "<null>" : handler.plugin->getName().c_str(), e);
-        i = handlers[e].erase(i);
-        if ( e == EventType::TICK )
-            removeFromTickQueue(handler);
+    if (!handlers[e].remove(handler, true))
+        return;
+    DEBUG(log).print("unregistering handler %p from plugin %s for event %d\n", handler.eventHandler, !handler.plugin ? "<null>" : handler.plugin->getName().c_str(), e);
+    if ( e == EventType::TICK )
+        removeFromTickQueue(handler);
+}
+
+void DFHack::EventManager::registerBatchListener(EventType::EventType e, BatchEventHandler handler) {
+    if (e == EventType::TICK || e == EventType::UNLOAD) {
+        WARN(log).print("event %d cannot be delivered in batches\n", e);
+        return;
     }
+    DEBUG(log).print("registering batch handler %p from plugin %s for event %d\n", handler.eventHandler, !handler.plugin ? "<null>" : handler.plugin->getName().c_str(), e);
+    batchHandlers[e].add(handler);
+}
+
+void DFHack::EventManager::unregister(EventType::EventType e, BatchEventHandler handler) {
+    if (!batchHandlers[e].remove(handler, true))
+        return;
+    DEBUG(log).print("unregistering batch handler %p from plugin %s for event %d\n", handler.eventHandler, !handler.plugin ? "<null>" : handler.plugin->getName().c_str(), e);
 }
 
 void DFHack::EventManager::unregisterAll(Plugin* plugin) {
     DEBUG(log).print("unregistering all handlers for plugin %s\n", !plugin ? "<null>" : plugin->getName().c_str());
-    for ( auto i = handlers[EventType::TICK].find(plugin); i != handlers[EventType::TICK].end(); i++ ) {
-        if ( (*i).first != plugin )
-            break;
-
-        removeFromTickQueue((*i).second);
+    for (auto &handle : handlers[EventType::TICK].entries) {
+        if (handle.plugin == plugin)
+            removeFromTickQueue(handle);
     }
     for (auto &handler : handlers) {
-        handler.erase(plugin);
+        handler.removePlugin(plugin);
+    }
+    for (auto &handler : batchHandlers) {
+        handler.removePlugin(plugin);
     }
 }
 
@@ -194,6 +279,31 @@ eventManager_t getManager(EventType::EventType t) {
     return nullptr;
 }
 
+// names used for the event manager's trace spans
+static const char *getManagerName(EventType::EventType t) {
+    switch (t) {
+        case EventType::TICK:             return "manageTickEvent";
+        case EventType::JOB_INITIATED:    return "manageJobInitiatedEvent";
+        case EventType::JOB_STARTED:      return "manageJobStartedEvent";
+        case EventType::JOB_COMPLETED:    return "manageJobCompletedEvent";
+        case EventType::UNIT_NEW_ACTIVE:  return "manageNewUnitActiveEvent";
+        case EventType::UNIT_DEATH:       return "manageUnitDeathEvent";
+        case EventType::ITEM_CREATED:     return "manageItemCreationEvent";
+        case EventType::BUILDING:         return "manageBuildingEvent";
+        case EventType::CONSTRUCTION:     return "manageConstructionEvent";
+        case EventType::SYNDROME:         return "manageSyndromeEvent";
+        case EventType::INVASION:         return "manageInvasionEvent";
+        case EventType::INVENTORY_CHANGE: return "manageEquipmentEvent";
+        case EventType::REPORT:           return "manageReportEvent";
+        case EventType::UNIT_ATTACK:      return "manageUnitAttackEvent";
+        case EventType::UNLOAD:           return "manageUnloadEvent";
+        case EventType::INTERACTION:      return "manageInteractionEvent";
+        case EventType::EVENT_MAX:
+            return nullptr;
+    }
+    return nullptr;
+}
+
 std::array<eventManager_t,EventType::EVENT_MAX> compileManagerArray() {
     std::array<eventManager_t, EventType::EVENT_MAX> managers{};
     auto t = (EventType::EventType) 0;
@@ -209,46 +319,66 @@ static int32_t lastJobId = -1;
 
 //job started
 static std::vector<int32_t> startedJobs;
+static std::vector<int32_t> nextStartedJobs;
 
 //job completed
+/*
+ * Compact per-poll record of a job. Only the fields that are checked for
+ * churn are kept; the item ids live in a shared arena (prevJobItems /
+ * nowJobItems) that keeps its capacity across polls, so recording a
+ * snapshot of every job does not allocate. A full clone of the job is only
+ * made once its completion timer reaches zero, i.e. when it is about to
+ * complete and may have to be handed to the listeners.
+ */
 struct JobCompleteData {
     int32_t id;
     int32_t completion_timer;
     uint32_t flags_bits_repeat;
+    // the fields below are only filled in for started jobs
+    uint32_t flags;
+    df::job_type job_type;
+    df::coord pos;
+    int32_t worker_id;
+    uint32_t items_begin;
+    uint32_t items_count;
+    uint32_t refs_count;
 };
 
-
 static std::unordered_map<int32_t, Job::JobUniquePtr> seenJobs;
 static std::vector<JobCompleteData> prevJobs;
+static std::vector<JobCompleteData> nowJobs;
+static std::vector<int32_t> prevJobItems;
+static std::vector<int32_t> nowJobItems;
 
-//active units
-static unordered_set<int32_t> activeUnits;
+//active units (sorted)
+static vector<int32_t> activeUnits;
+static vector<int32_t> nextActiveUnits;
+static vector<int32_t> newlyActiveUnits;
 
 //unit death
-static unordered_set<int32_t> livingUnits;
+static uint32_t unitDeathSerial;
+static vector<int32_t> deadUnits;
 
 //item creation
 static int32_t nextItem;
+static vector<int32_t> createdItems;
 
 //building
 static int32_t nextBuilding;
 static unordered_set<int32_t> buildings;
+static vector<int32_t> newBuildings;
 
-namespace std {
-    template <>
-    struct hash<df::construction> {
-        std::size_t operator()(const df::construction& construct) const {
-            return construct();
-        }
-    };
-}
-
-//construction
-static unordered_set<df::construction> constructions;
+//construction (sorted by pos, like world->event.constructions)
+static vector<df::construction> constructions;
+static vector<df::construction> nextConstructions;
+static vector<df::construction> removedConstructions;
+static vector<df::construction> newConstructions;
 static bool gameLoaded;
 
 //syndrome
 static int32_t lastSyndromeTime;
+static uint32_t syndromeSerial;
+static vector<SyndromeData> newSyndromes;
 
 //invasion
 static int32_t nextInvasion;
@@ -256,6 +386,20 @@ static int32_t nextInvasion;
 //equipment change
 //static unordered_map<int32_t, vector<df::unit_inventory_item> > equipmentLog;
 static unordered_map<int32_t, vector<InventoryItem>> equipmentLog;
+static uint32_t equipmentSerial;
+// copies of the items involved in the changes found this tick. the events
+// refer to them by index until all changes are collected, since the vector
+// may be reallocated while it grows.
+struct PendingInventoryChange {
+    int32_t unitId;
+    int32_t oldIdx;
+    int32_t newIdx;
+};
+static vector<InventoryItem> changedItems;
+static vector<PendingInventoryChange> pendingPickups;
+static vector<PendingInventoryChange> pendingDrops;
+static vector<PendingInventoryChange> pendingChanges;
+static vector<InventoryChangeData> inventoryChanges;
 
 //report
 static int32_t lastReport;
@@ -264,10 +408,163 @@ static int32_t lastReport;
 static int32_t lastReportUnitAttack;
 static std::map<int32_t,std::vector<int32_t>> reportToRelevantUnits;
 static int32_t reportToRelevantUnitsTime = -1;
+static uint32_t reportToRelevantUnitsSerial;
 
 //interaction
 static int32_t lastReportInteraction;
 
+/*
+ * Shared change detection for the events that look at the state of every
+ * unit: unit death, syndrome, inventory change, and the report-to-unit
+ * mapping used by the unit attack and interaction events. Rather than each of
+ * them walking world->units.all, which holds every unit ever loaded, the
+ * tracker walks units.active at most once per tick and keeps a compact
+ * fingerprint of each aspect of a unit those events care about, along with
+ * the refresh in which it last changed. Each event keeps the serial of the
+ * refresh it last looked at and only visits the units that changed since.
+ * A unit that drops out of units.active is fingerprinted one last time on
+ * the way out, so changes made as it leaves (e.g. items dropped on death)
+ * are still seen.
+ */
+namespace {
+    enum UnitAspect {
+        UA_FLAGS,
+        UA_INVENTORY,
+        UA_SYNDROMES,
+        UA_REPORTS,
+        UA_MAX
+    };
+
+    struct TrackedUnit {
+        df::unit *unit; // only valid while on_map
+        int32_t id;
+        bool on_map;
+        // for unit death events: seen alive, and not reported dead yet
+        bool living;
+        uint32_t seen_serial;
+        uint64_t fingerprint[UA_MAX];
+        uint32_t changed_serial[UA_MAX];
+    };
+}
+
+static vector<TrackedUnit> trackedUnits;
+static unordered_map<int32_t, size_t> trackedUnitIndex;
+static uint32_t unitTrackerSerial;
+static int32_t unitTrackerTick = -1;
+
+static inline uint64_t fingerprintMix(uint64_t h, int64_t v) {
+    return h ^ (uint64_t(v) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+}
+
+static uint64_t fingerprintUnit(df::unit *unit, UnitAspect aspect) {
+    uint64_t h = 0;
+    switch (aspect) {
+    case UA_FLAGS:
+        return (unit->flags1.bits.inactive ? 1 : 0) |
+               (unit->flags2.bits.killed ? 2 : 0) |
+               (unit->flags3.bits.ghostly ? 4 : 0);
+    case UA_INVENTORY:
+        h = fingerprintMix(h, unit->inventory.size());
+        for (auto dfitem : unit->inventory) {
+            h = fingerprintMix(h, dfitem->item ? dfitem->item->id : -1);
+            h = fingerprintMix(h, dfitem->mode);
+            h = fingerprintMix(h, dfitem->body_part_id);
+            h = fingerprintMix(h, dfitem->wound_id);
+        }
+        return h;
+    case UA_SYNDROMES:
+        h = fingerprintMix(h, unit->syndromes.active.size());
+        for (auto syndrome : unit->syndromes.active) {
+            h = fingerprintMix(h, syndrome->type);
+            h = fingerprintMix(h, syndrome->year);
+            h = fingerprintMix(h, syndrome->year_time);
+        }
+        return h;
+    case UA_REPORTS:
+        for (auto &log : unit->reports.log) {
+            h = fingerprintMix(h, log.size());
+            if (!log.empty())
+                h = fingerprintMix(h, log.back());
+        }
+        return h;
+    case UA_MAX:
+        break;
+    }
+    return h;
+}
+
+static void updateFingerprints(TrackedUnit &rec, df::unit *unit, bool is_new) {
+    for (int a = 0; a < UA_MAX; a++) {
+        uint64_t fingerprint = fingerprintUnit(unit, UnitAspect(a));
+        if (is_new || fingerprint != rec.fingerprint[a]) {
+            rec.fingerprint[a] = fingerprint;
+            rec.changed_serial[a] = unitTrackerSerial;
+        }
+    }
+}
+
+static void refreshUnitTracker() {
+    int32_t tick = df::global::world->frame_counter;
+    if (tick == unitTrackerTick)
+        return;
+    unitTrackerTick = tick;
+    ++unitTrackerSerial;
+
+    for (df::unit *unit : df::global::world->units.active) {
+        auto it = trackedUnitIndex.find(unit->id);
+        bool is_new = it == trackedUnitIndex.end();
+        size_t idx;
+        if (is_new) {
+            idx = trackedUnits.size();
+            trackedUnitIndex.emplace(unit->id, idx);
+            trackedUnits.push_back(TrackedUnit{});
+            trackedUnits[idx].id = unit->id;
+        } else {
+            idx = it->second;
+        }
+        TrackedUnit &rec = trackedUnits[idx];
+        rec.unit = unit;
+        rec.on_map = true;
+        rec.seen_serial = unitTrackerSerial;
+        updateFingerprints(rec, unit, is_new);
+    }
+
+    for (auto &rec : trackedUnits) {
+        if (!rec.on_map || rec.seen_serial == unitTrackerSerial)
+            continue;
+        rec.on_map = false;
+        rec.unit = nullptr;
+        if (df::unit *unit = df::unit::find(rec.id))
+            updateFingerprints(rec, unit, false);
+    }
+}
+
+// calls fn(rec, unit) for every unit whose given aspect changed since the
+// refresh recorded in serial, and moves serial up to the current refresh
+template<typename F>
+static void forChangedUnits(UnitAspect aspect, uint32_t &serial, F fn) {
+    refreshUnitTracker();
+    uint32_t since = serial;
+    serial = unitTrackerSerial;
+    for (auto &rec : trackedUnits) {
+        if (rec.changed_serial[aspect] <= since)
+            continue;
+        if (df::unit *unit = rec.on_map ? rec.unit : df::unit::find(rec.id))
+            fn(rec, unit);
+    }
+}
+
+static void clearUnitTracker() {
+    trackedUnits.clear();
+    trackedUnitIndex.clear();
+    unitTrackerSerial = 0;
+    unitTrackerTick = -1;
+    unitDeathSerial = 0;
+    syndromeSerial = 0;
+    equipmentSerial = 0;
+    reportToRelevantUnitsSerial = 0;
+}
+
 struct hash_pair {
     template<typename A, typename B>
     size_t operator()(const std::pair<A,B>& p) const {
@@ -286,6 +583,28 @@ static void run_handler(color_ostream& out, EventType::EventType eventType, cons
     counters.incCounter(counters.event_manager_event_per_plugin_ms[eventType][plugin_name], start_ms);
 }
 
+// starts collecting the arguments for the batched handlers of an event
+static vector<void*> &begin_batch(EventType::EventType eventType) {
+    auto &args = batchArgs[eventType];
+    args.clear();
+    return args;
+}
+
+static void run_batch_handlers(color_ostream& out, EventType::EventType eventType) {
+    auto &args = batchArgs[eventType];
+    if (args.empty() || batchHandlers[eventType].empty())
+        return;
+    auto &core = Core::getInstance();
+    auto &counters = core.perf_counters;
+    for (auto &handle : batchHandlers[eventType].snapshot()) {
+        DEBUG(log,out).print("calling batch handler for event %d with %zu objects\n", eventType, args.size());
+        uint32_t start_ms = core.p->getTickCount();
+        const char * plugin_name = !handle.plugin ? "<null>" : handle.plugin->getName().c_str();
+        handle.eventHandler(out, args);
+        counters.incCounter(counters.event_manager_event_per_plugin_ms[eventType][plugin_name], start_ms);
+    }
+}
+
 void DFHack::EventManager::onStateChange(color_ostream& out, state_change_event event) {
     static bool doOnce = false;
 //    const string eventNames[] = {"world loaded", "world unloaded", "map loaded", "map unloaded", "viewscreen changed", "core initialized", "begin unload", "paused", "unpaused"};
@@ -302,8 +621,11 @@ void DFHack::EventManager::onStateChange(color_ostream& out, state_change_event
         startedJobs.clear();
         seenJobs.clear();
         prevJobs.clear();
+        prevJobItems.clear();
         tickQueue.clear();
-        livingUnits.clear();
+        tickHandles.clear();
+        handlers[EventType::TICK].clear();
+        clearUnitTracker();
         buildings.clear();
         constructions.clear();
         equipmentLog.clear();
@@ -314,22 +636,16 @@ void DFHack::EventManager::onStateChange(color_ostream& out, state_change_event
         lastReportUnitAttack = -1;
         gameLoaded = false;
 
-        multimap<Plugin*,EventHandler> copy(handlers[EventType::UNLOAD].begin(), handlers[EventType::UNLOAD].end());
-        for (auto &[_,handle] : copy) {
+        for (auto &handle : handlers[EventType::UNLOAD].snapshot()) {
             DEBUG(log,out).print("calling handler for map unloaded state change event\n");
             run_handler(out, EventType::UNLOAD, handle, nullptr);
         }
     } else if ( event == DFHack::SC_MAP_LOADED ) {
-        /*
-        int32_t tick = df::global::world->frame_counter;
-        multimap<int32_t,EventHandler> newTickQueue;
-        for ( auto i = tickQueue.begin(); i != tickQueue.end(); i++ )
-            newTickQueue.insert(pair<int32_t,EventHandler>(tick+(*i).first, (*i).second));
-        tickQueue.clear();
-        tickQueue.insert(newTickQueue.begin(), newTickQueue.end());
-        //out.print("%s,%d: on load, frame_counter = %d\n", __FILE__, __LINE__, tick);
-        */
-        //tickQueue.clear();
+        // the loaded save may have an earlier frame counter than the last one.
+        // handlers that were registered before the map was loaded keep their
+        // absolute due ticks.
+        if (df::global::world)
+            tickQueue.setTime(df::global::world->frame_counter);
         if (!df::global::item_next_id)
             return;
         if (!df::global::building_next_id)
@@ -359,8 +675,10 @@ void DFHack::EventManager::onStateChange(color_ostream& out, state_change_event
                     out.print("EventManager.onLoad null position of construction.\n");
                 continue;
             }
-            constructions.emplace(*c);
+            constructions.push_back(*c);
         }
+        std::sort(constructions.begin(), constructions.end(),
+            [](const df::construction &a, const df::construction &b) { return a.pos < b.pos; });
         for (auto b : df::global::world->buildings.all) {
             Buildings::updateBuildings(out, (void*)intptr_t(b->id));
             buildings.insert(b->id);
@@ -368,7 +686,7 @@ void DFHack::EventManager::onStateChange(color_ostream& out, state_change_event
         lastSyndromeTime = -1;
         for (auto unit : df::global::world->units.all) {
             if (Units::isActive(unit)) {
-                activeUnits.emplace(unit->id);
+                activeUnits.push_back(unit->id);
             }
             for (auto syndrome : unit->syndromes.active) {
                 int32_t startTime = syndrome->year*ticksPerYear + syndrome->year_time;
@@ -376,6 +694,7 @@ void DFHack::EventManager::onStateChange(color_ostream& out, state_change_event
                     lastSyndromeTime = startTime;
             }
         }
+        std::sort(activeUnits.begin(), activeUnits.end());
         lastReport = -1;
         if ( !df::global::world->status.reports.empty() ) {
             lastReport = df::global::world->status.reports[df::global::world->status.reports.size()-1]->id;
@@ -383,6 +702,7 @@ void DFHack::EventManager::onStateChange(color_ostream& out, state_change_event
         lastReportUnitAttack = -1;
         lastReportInteraction = -1;
         reportToRelevantUnitsTime = -1;
+        reportToRelevantUnitsSerial = 0;
         reportToRelevantUnits.clear();
         for (int &last_tick : eventLastTick) {
             last_tick = -1;//-1000000;
@@ -412,53 +732,49 @@ void DFHack::EventManager::manageEvents(color_ostream& out) {
     auto &core = Core::getInstance();
     auto &counters = core.perf_counters;
     for ( size_t a = 0; a < EventType::EVENT_MAX; a++ ) {
-        if ( handlers[a].empty() )
+        bool have_single = !handlers[a].empty();
+        bool have_batch = !batchHandlers[a].empty();
+        if ( !have_single && !have_batch )
             continue;
-        int32_t eventFrequency = -100;
-        if ( a != EventType::TICK )
-            for (auto &[_,handle] : handlers[a]) {
-                if (handle.freq < eventFrequency || eventFrequency == -100 )
-                    eventFrequency = handle.freq;
-            }
-        else eventFrequency = 1;
+        int32_t eventFrequency = 1;
+        if ( a != EventType::TICK ) {
+            if ( have_single && have_batch )
+                eventFrequency = std::min(handlers[a].min_freq, batchHandlers[a].min_freq);
+            else
+                eventFrequency = have_single ? handlers[a].min_freq : batchHandlers[a].min_freq;
+        }
 
         if ( tick >= eventLastTick[a] && tick - eventLastTick[a] < eventFrequency )
             continue;
 
         uint32_t start_ms = core.p->getTickCount();
-        eventManager[a](out);
+        uint64_t start_ns = PerfCounters::getTimestampNs();
+        {
+            Tracing::Span span("eventmanager", getManagerName((EventType::EventType)a));
+            eventManager[a](out);
+        }
         eventLastTick[a] = tick;
         counters.incCounter(counters.event_manager_event_total_ms[a], start_ms);
+        counters.addFrameTime(counters.frame_per_event[a], start_ns);
     }
 }
 
 static void manageTickEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    unordered_set<EventHandler> toRemove;
     int32_t tick = df::global::world->frame_counter;
-    while ( !tickQueue.empty() ) {
-        if ( tick < (*tickQueue.begin()).first )
-            break;
-        EventHandler &handle = (*tickQueue.begin()).second;
-        tickQueue.erase(tickQueue.begin());
+    tickQueue.advance(tick, [&](TickQueue::handle_t id, const EventHandler &handle) {
+        auto range = tickHandles.equal_range(handle);
+        for (auto j = range.first; j != range.second; ++j) {
+            if (j->second == id) {
+                tickHandles.erase(j);
+                break;
+            }
+        }
+        handlers[EventType::TICK].remove(handle, false);
         DEBUG(log,out).print("calling handler for tick event\n");
         run_handler(out, EventType::TICK, handle, (void*)intptr_t(tick));
-        toRemove.insert(handle);
-    }
-    if ( toRemove.empty() )
-        return;
-    for ( auto a = handlers[EventType::TICK].begin(); a != handlers[EventType::TICK].end(); ) {
-        EventHandler &handle = (*a).second;
-        if ( toRemove.find(handle) == toRemove.end() ) {
-            a++;
-            continue;
-        }
-        a = handlers[EventType::TICK].erase(a);
-        toRemove.erase(handle);
-        if ( toRemove.empty() )
-            break;
-    }
+    });
 }
 
 static void manageJobInitiatedEvent(color_ostream& out) {
@@ -474,20 +790,23 @@ static void manageJobInitiatedEvent(color_ostream& out) {
     if ( lastJobId+1 == *df::global::job_next_id ) {
         return; //no new jobs
     }
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::JOB_INITIATED].begin(), handlers[EventType::JOB_INITIATED].end());
+    auto &copy = handlers[EventType::JOB_INITIATED].snapshot();
+    auto &batch = begin_batch(EventType::JOB_INITIATED);
 
     for ( df::job_list_link* link = &df::global::world->jobs.list; link != nullptr; link = link->next ) {
         if ( link->item == nullptr )
             continue;
         if ( link->item->id <= lastJobId )
             continue;
-        for (auto &[_,handle] : copy) {
+        batch.push_back((void*)link->item);
+        for (auto &handle : copy) {
             DEBUG(log,out).print("calling handler for job initiated event\n");
             run_handler(out, EventType::JOB_INITIATED, handle, (void*)link->item);
         }
     }
 
     lastJobId = *df::global::job_next_id - 1;
+    run_batch_handlers(out, EventType::JOB_INITIATED);
 }
 
 static void manageJobStartedEvent(color_ostream& out) {
@@ -495,16 +814,16 @@ static void manageJobStartedEvent(color_ostream& out) {
         return;
 
     // iterate event handler callbacks
-    multimap<Plugin*, EventHandler> copy(handlers[EventType::JOB_STARTED].begin(), handlers[EventType::JOB_STARTED].end());
+    auto &copy = handlers[EventType::JOB_STARTED].snapshot();
+    auto &batch = begin_batch(EventType::JOB_STARTED);
 
-    std::vector<int32_t> newStartedJobs;
-    newStartedJobs.reserve(startedJobs.size());
+    nextStartedJobs.clear();
 
     for (const auto jobPtr : df::global::world->jobs.list) {
         // posting_index of -1 implies a worker has been assigned to a new job.
         if (jobPtr->posting_index == -1) {
             auto jobId = jobPtr->id;
-            newStartedJobs.push_back(jobId);
+            nextStartedJobs.push_back(jobId);
             /*
              * The startedJobs set peaks at the number of work-eligible citizens.
              * This set is small enough to fit comfortably in the CPU caches,
@@ -513,14 +832,48 @@ static void manageJobStartedEvent(color_ostream& out) {
              * where memory access tends to be all over the place.
              */
             if (!std::binary_search(startedJobs.begin(), startedJobs.end(), jobId)) {
-                for (auto &[_,handle] : copy) {
+                batch.push_back(jobPtr);
+                for (auto &handle : copy) {
                     DEBUG(log,out).print("calling handler for job started event\n");
                     run_handler(out, EventType::JOB_STARTED, handle, jobPtr);
                 }
             }
         }
     }
-    startedJobs = std::move(newStartedJobs);
+    startedJobs.swap(nextStartedJobs);
+    run_batch_handlers(out, EventType::JOB_STARTED);
+}
+
+// appends a snapshot of the job to nowJobs (and its items to nowJobItems)
+static JobCompleteData & recordJobSnapshot(df::job &job) {
+    auto &data = nowJobs.emplace_back();
+    data.id = job.id;
+    data.completion_timer = job.completion_timer;
+    data.flags_bits_repeat = job.flags.bits.repeat;
+    if (job.completion_timer == -1)
+        return data;
+    data.flags = job.flags.whole;
+    data.job_type = job.job_type;
+    data.pos = job.pos;
+    df::unit *worker = Job::getWorker(&job);
+    data.worker_id = worker ? worker->id : -1;
+    data.items_begin = nowJobItems.size();
+    data.items_count = job.items.size();
+    for (auto item_ref : job.items)
+        nowJobItems.push_back(item_ref && item_ref->item ? item_ref->item->id : -1);
+    data.refs_count = job.general_refs.size();
+    return data;
+}
+
+// compares a snapshot from the previous poll with one from this poll
+static bool sameJobSnapshot(const JobCompleteData &prev, const JobCompleteData &now) {
+    if (prev.flags != now.flags || prev.job_type != now.job_type || prev.pos != now.pos
+            || prev.worker_id != now.worker_id || prev.items_count != now.items_count
+            || prev.refs_count != now.refs_count)
+        return false;
+    return std::equal(prevJobItems.begin() + prev.items_begin,
+                      prevJobItems.begin() + prev.items_begin + prev.items_count,
+                      nowJobItems.begin() + now.items_begin);
 }
 
 /*
@@ -530,29 +883,49 @@ static void manageJobCompletedEvent(color_ostream& out) {
     if (!df::global::world)
         return;
 
-    multimap<Plugin*, EventHandler> copy(handlers[EventType::JOB_COMPLETED].begin(), handlers[EventType::JOB_COMPLETED].end());
-    std::vector<JobCompleteData> nowJobs;
-    // predict the size in advance, this will prevent or reduce memory reallocation.
-    nowJobs.reserve(prevJobs.size());
+    auto &copy = handlers[EventType::JOB_COMPLETED].snapshot();
+    auto &batch = begin_batch(EventType::JOB_COMPLETED);
+    auto &counters = Core::getInstance().perf_counters;
+    // nowJobs and nowJobItems keep their capacity across ticks, so this
+    // rarely reallocates
+    nowJobs.clear();
+    nowJobItems.clear();
+    // both the job list and prevJobs are sorted by id
+    auto prevCursor = prevJobs.cbegin();
     for (const auto jobPtr : df::global::world->jobs.list) {
         auto& job = *jobPtr;
 
-        auto seenIt = seenJobs.find(job.id);
-        if (seenIt != seenJobs.end()) {
+        while (prevCursor != prevJobs.cend() && prevCursor->id < job.id)
+            ++prevCursor;
+        const JobCompleteData *prevJob = NULL;
+        if (prevCursor != prevJobs.cend() && prevCursor->id == job.id)
+            prevJob = &*prevCursor;
+
+        auto &nowJob = recordJobSnapshot(job);
+        if (nowJob.completion_timer == 0) {
             /*
-             * No reference here, to prevent dangling reference situation
-             * when job is re-cloned.
+             * The clone is (re)made whenever the job enters timer zero, so a
+             * repeat job hands its listeners the state of the current cycle.
+             * While it stays at zero, comparing with the previous poll is
+             * enough, since every change since the clone was made re-clones.
              */
-            auto seenJob = seenIt->second.get();
-            // The key here is to strategically check the most important bits to reduce churn.
-            if (seenJob->flags.whole != job.flags.whole
-                    || (seenJob->items.size() != job.items.size())
-                    || (seenJob->general_refs.size() != job.general_refs.size())) {
+            bool entered = !prevJob || prevJob->completion_timer != 0;
+            auto seenIt = seenJobs.find(job.id);
+            if (seenIt == seenJobs.end()) {
+                seenJobs.emplace(job.id, Job::JobUniquePtr(Job::cloneJobStruct(&job, true)));
+                ++counters.event_manager_job_clones;
+            } else if (entered || !sameJobSnapshot(*prevJob, nowJob)) {
                 seenIt->second = Job::JobUniquePtr(Job::cloneJobStruct(&job, true));
+                ++counters.event_manager_job_clones;
             }
-        } else if (job.completion_timer != -1) {
-            // Restrict additions to seenJobs to jobs that we know have started.
-            seenJobs.emplace(job.id, Job::JobUniquePtr(Job::cloneJobStruct(&job, true)));
+        } else if (nowJob.completion_timer != -1) {
+            // a running job that would have been cloned here if every job
+            // was cloned as soon as it started, and again whenever one of
+            // the churn bits below changed
+            if (!prevJob || prevJob->completion_timer == -1 || prevJob->flags != nowJob.flags
+                    || prevJob->items_count != nowJob.items_count
+                    || prevJob->refs_count != nowJob.refs_count)
+                ++counters.event_manager_job_clones_avoided;
         }
         /*
          * We still need to push back all jobs to maintain the invariant of the
@@ -580,7 +953,6 @@ static void manageJobCompletedEvent(color_ostream& out) {
          * 1 in nowJobs is less than the smallest ID in prevJobs,
          * which breaks the algorithm.
          */
-        nowJobs.emplace_back(job.id, job.completion_timer, (bool)job.flags.bits.repeat);
     }
 
     // Do we want this check?
@@ -653,6 +1025,10 @@ static void manageJobCompletedEvent(color_ostream& out) {
 
     auto prevIt = prevJobs.begin();
     auto nowIt = nowJobs.begin();
+    // jobs whose clone was reported; the batch handlers still hold the
+    // clones, so they are freed after those have run
+    static std::vector<int32_t> completedJobs;
+    completedJobs.clear();
     /*
      * Iterate through two ordered sets, prevJobs and nowJobs, where job IDs in nowJobs are invariably
      * greater than or equal to job IDs in prevJobs. The algorithm maintains the invariant that for each
@@ -669,11 +1045,12 @@ static void manageJobCompletedEvent(color_ostream& out) {
                 auto seenIt = seenJobs.find(prevJob.id);
                 if (seenIt != seenJobs.end()) {
                     df::job& seenJob = *seenIt->second;
-                    for (auto& [_, handle] : copy) {
+                    batch.push_back((void*)&seenJob);
+                    for (auto &handle : copy) {
                         DEBUG(log, out).print("calling handler for job completed event\n");
                         run_handler(out, EventType::JOB_COMPLETED, handle, (void*)&seenJob);
                     }
-                    seenJobs.erase(prevJob.id);
+                    completedJobs.push_back(prevJob.id);
                 }
             }
         } else { // prevIt job ID and nowIt job ID are equal.
@@ -685,10 +1062,12 @@ static void manageJobCompletedEvent(color_ostream& out) {
                 if (seenIt != seenJobs.end()) {
                     df::job& seenJob = *seenIt->second;
                     // still false positive if cancelled at EXACTLY the right time, but experiments show this doesn't happen
-                    for (auto& [_, handle] : copy) {
+                    batch.push_back((void*)&seenJob);
+                    for (auto &handle : copy) {
                         DEBUG(log, out).print("calling handler for repeated job completed event\n");
                         run_handler(out, EventType::JOB_COMPLETED, handle, (void*)&seenJob);
                     }
+                    completedJobs.push_back(prevJob.id);
                 }
             }
             // prevIt has caught up to nowIt.
@@ -696,6 +1075,10 @@ static void manageJobCompletedEvent(color_ostream& out) {
         }
         ++prevIt;
     }
+    // before the cleanup below, which can free the jobs in the batch
+    run_batch_handlers(out, EventType::JOB_COMPLETED);
+    for (int32_t id : completedJobs)
+        seenJobs.erase(id);
 
     /*
      * Clean up garbage, if any.
@@ -716,58 +1099,81 @@ static void manageJobCompletedEvent(color_ostream& out) {
         seenJobs.swap(newMap);
     }
 
-    prevJobs = std::move(nowJobs);
+    prevJobs.swap(nowJobs);
+    prevJobItems.swap(nowJobItems);
 }
 
 static void manageNewUnitActiveEvent(color_ostream& out) {
     if (!df::global::world)
         return;
 
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::UNIT_NEW_ACTIVE].begin(), handlers[EventType::UNIT_NEW_ACTIVE].end());
-    unordered_set<int32_t> next_activeUnits;
-    vector<int32_t> newly_active_unit_ids;
+    auto &copy = handlers[EventType::UNIT_NEW_ACTIVE].snapshot();
+    auto &batch = begin_batch(EventType::UNIT_NEW_ACTIVE);
+    nextActiveUnits.clear();
+    newlyActiveUnits.clear();
     for (df::unit* unit : df::global::world->units.active) {
         if (!Units::isActive(unit))
             continue;
-        next_activeUnits.emplace(unit->id);
-        if (!activeUnits.count(unit->id))
-            newly_active_unit_ids.emplace_back(unit->id);
+        nextActiveUnits.push_back(unit->id);
+        if (!std::binary_search(activeUnits.begin(), activeUnits.end(), unit->id))
+            newlyActiveUnits.push_back(unit->id);
     }
-    for (int32_t unit_id : newly_active_unit_ids) {
-        for (auto &[_,handle] : copy) {
+    // units.active is usually close to sorted by id already
+    if (!std::is_sorted(nextActiveUnits.begin(), nextActiveUnits.end()))
+        std::sort(nextActiveUnits.begin(), nextActiveUnits.end());
+    activeUnits.swap(nextActiveUnits);
+    for (int32_t unit_id : newlyActiveUnits) {
+        batch.push_back((void*) intptr_t(unit_id));
+        for (auto &handle : copy) {
             DEBUG(log,out).print("calling handler for new unit event\n");
             run_handler(out, EventType::UNIT_NEW_ACTIVE, handle, (void*) intptr_t(unit_id)); // intptr_t() avoids cast from smaller type warning
         }
     }
-    activeUnits = std::move(next_activeUnits);
+    run_batch_handlers(out, EventType::UNIT_NEW_ACTIVE);
 }
 
 
 static void manageUnitDeathEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::UNIT_DEATH].begin(), handlers[EventType::UNIT_DEATH].end());
-    vector<int32_t> dead_unit_ids;
-    for (auto unit : df::global::world->units.all) {
-        //if ( unit->counters.death_id == -1 ) {
+    auto &copy = handlers[EventType::UNIT_DEATH].snapshot();
+    auto &batch = begin_batch(EventType::UNIT_DEATH);
+    deadUnits.clear();
+    forChangedUnits(UA_FLAGS, unitDeathSerial, [](TrackedUnit &rec, df::unit *unit) {
         if ( Units::isActive(unit) ) {
-            livingUnits.insert(unit->id);
-            continue;
+            rec.living = true;
+            return;
         }
-        if (!Units::isDead(unit)) continue; // for units that have left the map but aren't dead
         //dead: if dead since last check, trigger events
-        if ( livingUnits.find(unit->id) == livingUnits.end() )
+        if ( rec.living && Units::isDead(unit) ) {
+            rec.living = false;
+            deadUnits.push_back(rec.id);
+        }
+    });
+    // units that left the map alive are no longer fingerprinted, but they
+    // can still die elsewhere
+    for (auto &rec : trackedUnits) {
+        if ( rec.on_map || !rec.living )
+            continue;
+        df::unit *unit = df::unit::find(rec.id);
+        if ( !unit ) {
+            rec.living = false;
             continue;
-        livingUnits.erase(unit->id);
-        dead_unit_ids.emplace_back(unit->id);
+        }
+        if ( !Units::isActive(unit) && Units::isDead(unit) ) {
+            rec.living = false;
+            deadUnits.push_back(rec.id);
+        }
     }
 
-    for (int32_t unit_id : dead_unit_ids) {
-        for (auto &[_,handle] : copy) {
+    for (int32_t unit_id : deadUnits) {
+        batch.push_back((void*)intptr_t(unit_id));
+        for (auto &handle : copy) {
             DEBUG(log,out).print("calling handler for unit death event\n");
             run_handler(out, EventType::UNIT_DEATH, handle, (void*)intptr_t(unit_id));
         }
     }
+    run_batch_handlers(out, EventType::UNIT_DEATH);
 }
 
 static void manageItemCreationEvent(color_ostream& out) {
@@ -779,11 +1185,12 @@ static void manageItemCreationEvent(color_ostream& out) {
         return;
     }
 
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::ITEM_CREATED].begin(), handlers[EventType::ITEM_CREATED].end());
+    auto &copy = handlers[EventType::ITEM_CREATED].snapshot();
+    auto &batch = begin_batch(EventType::ITEM_CREATED);
     size_t index = df::item::binsearch_index(df::global::world->items.all, nextItem, false);
     if ( index != 0 ) index--;
 
-    std::vector<int32_t> created_items;
+    createdItems.clear();
     for ( size_t a = index; a < df::global::world->items.all.size(); a++ ) {
         df::item* item = df::global::world->items.all[a];
         //already processed
@@ -801,18 +1208,20 @@ static void manageItemCreationEvent(color_ostream& out) {
         //spider webs don't count
         if ( item->flags.bits.spider_web )
             continue;
-        created_items.push_back(item->id);
+        createdItems.push_back(item->id);
     }
 
     // handle all created items
-    for (int32_t item_id : created_items) {
-        for (auto &[_,handle] : copy) {
+    for (int32_t item_id : createdItems) {
+        batch.push_back((void*)intptr_t(item_id));
+        for (auto &handle : copy) {
             DEBUG(log,out).print("calling handler for item created event\n");
             run_handler(out, EventType::ITEM_CREATED, handle, (void*)intptr_t(item_id));
         }
     }
 
     nextItem = *df::global::item_next_id;
+    run_batch_handlers(out, EventType::ITEM_CREATED);
 }
 
 static void manageBuildingEvent(color_ostream& out) {
@@ -824,9 +1233,10 @@ static void manageBuildingEvent(color_ostream& out) {
      * TODO: could be faster
      * consider looking at jobs: building creation / destruction
      **/
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::BUILDING].begin(), handlers[EventType::BUILDING].end());
+    auto &copy = handlers[EventType::BUILDING].snapshot();
+    auto &batch = begin_batch(EventType::BUILDING);
     //first alert people about new buildings
-    vector<int32_t> new_buildings;
+    newBuildings.clear();
     for ( int32_t a = nextBuilding; a < *df::global::building_next_id; a++ ) {
         int32_t index = df::building::binsearch_index(df::global::world->buildings.all, a);
         if ( index == -1 ) {
@@ -835,7 +1245,7 @@ static void manageBuildingEvent(color_ostream& out) {
             continue;
         }
         buildings.insert(a);
-        new_buildings.emplace_back(a);
+        newBuildings.push_back(a);
 
     }
     nextBuilding = *df::global::building_next_id;
@@ -849,7 +1259,8 @@ static void manageBuildingEvent(color_ostream& out) {
             continue;
         }
 
-        for (auto &[_,handle] : copy) {
+        batch.push_back((void*)intptr_t(id));
+        for (auto &handle : copy) {
             DEBUG(log,out).print("calling handler for destroyed building event\n");
             run_handler(out, EventType::BUILDING, handle, (void*)intptr_t(id));
         }
@@ -857,12 +1268,14 @@ static void manageBuildingEvent(color_ostream& out) {
     }
 
     //alert people about newly created buildings
-    std::for_each(new_buildings.begin(), new_buildings.end(), [&](int32_t building){
-        for (auto &[_,handle] : copy) {
+    std::for_each(newBuildings.begin(), newBuildings.end(), [&](int32_t building){
+        batch.push_back((void*)intptr_t(building));
+        for (auto &handle : copy) {
             DEBUG(log,out).print("calling handler for created building event\n");
             run_handler(out, EventType::BUILDING, handle, (void*)intptr_t(building));
         }
     });
+    run_batch_handlers(out, EventType::BUILDING);
 }
 
 static void manageConstructionEvent(color_ostream& out) {
@@ -870,59 +1283,57 @@ static void manageConstructionEvent(color_ostream& out) {
         return;
     //unordered_set<df::construction*> constructionsNow(df::global::world->event.constructions.begin(), df::global::world->event.constructions.end());
 
-    multimap<Plugin*, EventHandler> copy(handlers[EventType::CONSTRUCTION].begin(), handlers[EventType::CONSTRUCTION].end());
-
-    unordered_set<df::construction> next_construction_set; // will be swapped with constructions
-    next_construction_set.reserve(constructions.bucket_count());
-    vector<df::construction> new_constructions;
-
-    // find new constructions - swapping found constructions over from constructions to next_construction_set
-    for (auto c : df::global::world->event.constructions) {
-        auto &construction = *c;
-        auto it = constructions.find(construction);
-        if (it == constructions.end()) {
-            // handle new construction event later
-            new_constructions.emplace_back(construction);
-        }
-        else {
-            constructions.erase(it);
-        }
-        next_construction_set.emplace(construction);
-    }
-
-    constructions.swap(next_construction_set);
-
-    // now next_construction_set contains all the constructions that were removed (not found in df::global::world->event.constructions)
-    for (auto& construction : next_construction_set) {
+    auto &copy = handlers[EventType::CONSTRUCTION].snapshot();
+    auto &batch = begin_batch(EventType::CONSTRUCTION);
+
+    // both lists are sorted by pos, so a single merge pass finds the
+    // constructions that were added and removed since the last check
+    nextConstructions.clear();
+    for (auto c : df::global::world->event.constructions)
+        nextConstructions.push_back(*c);
+    auto by_pos = [](const df::construction &a, const df::construction &b) { return a.pos < b.pos; };
+    if (!std::is_sorted(nextConstructions.begin(), nextConstructions.end(), by_pos))
+        std::sort(nextConstructions.begin(), nextConstructions.end(), by_pos);
+
+    removedConstructions.clear();
+    newConstructions.clear();
+    std::set_difference(constructions.begin(), constructions.end(),
+                        nextConstructions.begin(), nextConstructions.end(),
+                        std::back_inserter(removedConstructions), by_pos);
+    std::set_difference(nextConstructions.begin(), nextConstructions.end(),
+                        constructions.begin(), constructions.end(),
+                        std::back_inserter(newConstructions), by_pos);
+    constructions.swap(nextConstructions);
+
+    for (auto& construction : removedConstructions) {
         // handle construction removed event
-        for (const auto &[_,handle]: copy) {
+        batch.push_back((void*) &construction);
+        for (auto &handle : copy) {
             DEBUG(log,out).print("calling handler for destroyed construction event\n");
             run_handler(out, EventType::CONSTRUCTION, handle, (void*) &construction);
         }
     }
 
     // now handle all the new constructions
-    for (auto& construction : new_constructions) {
-        for (const auto &[_,handle]: copy) {
+    for (auto& construction : newConstructions) {
+        batch.push_back((void*) &construction);
+        for (auto &handle : copy) {
             DEBUG(log,out).print("calling handler for created construction event\n");
             run_handler(out, EventType::CONSTRUCTION, handle, (void*) &construction);
         }
     }
+    run_batch_handlers(out, EventType::CONSTRUCTION);
 }
 
 static void manageSyndromeEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::SYNDROME].begin(), handlers[EventType::SYNDROME].end());
-    int32_t highestTime = -1;
-
-    std::vector<SyndromeData> new_syndrome_data;
-    for (auto unit : df::global::world->units.all) {
+    auto &copy = handlers[EventType::SYNDROME].snapshot();
+    auto &batch = begin_batch(EventType::SYNDROME);
+    int32_t highestTime = lastSyndromeTime;
 
-/*
-        if ( unit->flags1.bits.inactive )
-            continue;
-*/
+    newSyndromes.clear();
+    forChangedUnits(UA_SYNDROMES, syndromeSerial, [&](TrackedUnit &, df::unit *unit) {
         for ( size_t b = 0; b < unit->syndromes.active.size(); b++ ) {
             df::unit_syndrome* syndrome = unit->syndromes.active[b];
             int32_t startTime = syndrome->year*ticksPerYear + syndrome->year_time;
@@ -931,141 +1342,117 @@ static void manageSyndromeEvent(color_ostream& out) {
             if ( startTime <= lastSyndromeTime )
                 continue;
 
-            new_syndrome_data.emplace_back(unit->id, b);
+            newSyndromes.emplace_back(unit->id, b);
         }
-    }
-    for (auto& data : new_syndrome_data) {
-        for (auto &[_,handle] : copy) {
+    });
+    for (auto& data : newSyndromes) {
+        batch.push_back((void*)&data);
+        for (auto &handle : copy) {
             DEBUG(log,out).print("calling handler for syndrome event\n");
             run_handler(out, EventType::SYNDROME, handle, (void*)&data);
         }
     }
 
     lastSyndromeTime = highestTime;
+    run_batch_handlers(out, EventType::SYNDROME);
 }
 
 static void manageInvasionEvent(color_ostream& out) {
     if (!df::global::plotinfo)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::INVASION].begin(), handlers[EventType::INVASION].end());
+    auto &copy = handlers[EventType::INVASION].snapshot();
+    auto &batch = begin_batch(EventType::INVASION);
 
     if ( df::global::plotinfo->invasions.next_id <= nextInvasion )
         return;
     nextInvasion = df::global::plotinfo->invasions.next_id;
 
-    for (auto &[_,handle] : copy) {
+    batch.push_back((void*)intptr_t(nextInvasion-1));
+    for (auto &handle : copy) {
         DEBUG(log,out).print("calling handler for invasion event\n");
         run_handler(out, EventType::INVASION, handle, (void*)intptr_t(nextInvasion-1));
     }
+    run_batch_handlers(out, EventType::INVASION);
 }
 
 static void manageEquipmentEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::INVENTORY_CHANGE].begin(), handlers[EventType::INVENTORY_CHANGE].end());
-
-    unordered_map<int32_t, InventoryItem> itemIdToInventoryItem;
-    unordered_set<int32_t> currentlyEquipped;
-
-    vector<InventoryChangeData> equipment_pickups;
-    vector<InventoryChangeData> equipment_drops;
-    vector<InventoryChangeData> equipment_changes;
-
-
-    // This vector stores the pointers to newly created changed items
-    // needed as the stack allocated temporary (in the loop) is lost when we go to
-    // handle the event calls, so we move that data to the heap if its needed,
-    // and then once we are done we delete everything.
-    vector<InventoryItem*> changed_items;
-
-    for (auto unit : df::global::world->units.all) {
-        itemIdToInventoryItem.clear();
-        currentlyEquipped.clear();
-        /*if ( unit->flags1.bits.inactive )
-            continue;
-        */
+    auto &copy = handlers[EventType::INVENTORY_CHANGE].snapshot();
+    auto &batch = begin_batch(EventType::INVENTORY_CHANGE);
+
+    changedItems.clear();
+    pendingPickups.clear();
+    pendingDrops.clear();
+    pendingChanges.clear();
+    static const vector<InventoryItem> noEquipment;
+
+    auto keep = [](const InventoryItem &item) {
+        changedItems.push_back(item);
+        return int32_t(changedItems.size() - 1);
+    };
 
+    forChangedUnits(UA_INVENTORY, equipmentSerial, [&](TrackedUnit &, df::unit *unit) {
+        // inventories are short, so linear searches are cheaper than
+        // building lookup tables for every unit
         auto oldEquipment = equipmentLog.find(unit->id);
         bool hadEquipment = oldEquipment != equipmentLog.end();
-        vector<InventoryItem>* temp;
-        if ( hadEquipment ) {
-            temp = &((*oldEquipment).second);
-        } else {
-            temp = new vector<InventoryItem>;
-        }
-        //vector<InventoryItem>& v = (*oldEquipment).second;
-        vector<InventoryItem>& v = *temp;
-        for (auto & i : v) {
-            itemIdToInventoryItem[i.itemId] = i;
-        }
-        for ( size_t b = 0; b < unit->inventory.size(); b++ ) {
-            df::unit_inventory_item* dfitem_new = unit->inventory[b];
-            currentlyEquipped.insert(dfitem_new->item->id);
-            InventoryItem item_new(dfitem_new->item->id, *dfitem_new);
-            auto c = itemIdToInventoryItem.find(dfitem_new->item->id);
-            if ( c == itemIdToInventoryItem.end() ) {
+        const vector<InventoryItem>& v = hadEquipment ? oldEquipment->second : noEquipment;
+        for (auto dfitem_new : unit->inventory) {
+            int32_t item_id = dfitem_new->item->id;
+            InventoryItem item_new(item_id, *dfitem_new);
+            auto c = std::find_if(v.begin(), v.end(), [&](const InventoryItem &i) { return i.itemId == item_id; });
+            if ( c == v.end() ) {
                 //new item equipped (probably just picked up)
-                changed_items.emplace_back(new InventoryItem(item_new));
-                equipment_pickups.emplace_back(unit->id, nullptr, changed_items.back());
+                pendingPickups.push_back({unit->id, -1, keep(item_new)});
                 continue;
             }
-            InventoryItem item_old = c->second;
-
-            df::unit_inventory_item& item0 = item_old.item;
-            df::unit_inventory_item& item1 = item_new.item;
+            const df::unit_inventory_item& item0 = c->item;
+            const df::unit_inventory_item& item1 = item_new.item;
             if ( item0.mode == item1.mode && item0.body_part_id == item1.body_part_id && item0.wound_id == item1.wound_id )
                 continue;
             //some sort of change in how it's equipped
-            changed_items.emplace_back(new InventoryItem(item_new));
-            InventoryItem* item_new_ptr = changed_items.back();
-            changed_items.emplace_back(new InventoryItem(item_old));
-            InventoryItem* item_old_ptr = changed_items.back();
-            equipment_changes.emplace_back(unit->id, item_old_ptr, item_new_ptr);
+            int32_t new_idx = keep(item_new);
+            int32_t old_idx = keep(*c);
+            pendingChanges.push_back({unit->id, old_idx, new_idx});
         }
         //check for dropped items
-        for (auto i : v) {
-            if ( currentlyEquipped.find(i.itemId) != currentlyEquipped.end() )
+        for (auto &i : v) {
+            bool equipped = std::any_of(unit->inventory.begin(), unit->inventory.end(),
+                [&](df::unit_inventory_item *dfitem) { return dfitem->item->id == i.itemId; });
+            if ( equipped )
                 continue;
             //TODO: delete ptr if invalid
-            changed_items.emplace_back(new InventoryItem(i));
-            equipment_drops.emplace_back(unit->id, changed_items.back(), nullptr);
+            pendingDrops.push_back({unit->id, keep(i), -1});
         }
-        if ( !hadEquipment )
-            delete temp;
 
         //update equipment
-        vector<InventoryItem>& equipment = equipmentLog[unit->id];
+        if ( !hadEquipment && unit->inventory.empty() )
+            return;
+        vector<InventoryItem>& equipment = hadEquipment ? oldEquipment->second : equipmentLog[unit->id];
         equipment.clear();
         for (auto dfitem : unit->inventory) {
-            InventoryItem item(dfitem->item->id, *dfitem);
-            equipment.push_back(item);
-        }
-    }
-
-    // now handle events
-    std::for_each(equipment_pickups.begin(), equipment_pickups.end(), [&](InventoryChangeData& data) {
-        for (auto &[_, handle] : copy) {
-            DEBUG(log,out).print("calling handler for new item equipped inventory change event\n");
-            run_handler(out, EventType::INVENTORY_CHANGE, handle, (void*) &data);
+            equipment.emplace_back(dfitem->item->id, *dfitem);
         }
     });
-    std::for_each(equipment_drops.begin(), equipment_drops.end(), [&](InventoryChangeData& data) {
-        for (auto &[_, handle] : copy) {
-            DEBUG(log,out).print("calling handler for dropped item inventory change event\n");
-            run_handler(out, EventType::INVENTORY_CHANGE, handle, (void*) &data);
+
+    // changedItems won't grow any more, so the events can point into it now
+    inventoryChanges.clear();
+    for (auto pending : {&pendingPickups, &pendingDrops, &pendingChanges}) {
+        for (auto &change : *pending) {
+            inventoryChanges.emplace_back(change.unitId,
+                change.oldIdx < 0 ? nullptr : &changedItems[change.oldIdx],
+                change.newIdx < 0 ? nullptr : &changedItems[change.newIdx]);
         }
-    });
-    std::for_each(equipment_changes.begin(), equipment_changes.end(), [&](InventoryChangeData& data) {
-        for (auto &[_, handle] : copy) {
+    }
+    for (auto &data : inventoryChanges) {
+        batch.push_back(&data);
+        for (auto &handle : copy) {
             DEBUG(log,out).print("calling handler for inventory change event\n");
             run_handler(out, EventType::INVENTORY_CHANGE, handle, (void*) &data);
         }
-    });
-
-    // clean up changed items list
-    std::for_each(changed_items.begin(), changed_items.end(), [](InventoryItem* p){
-        delete p;
-    });
+    }
+    run_batch_handlers(out, EventType::INVENTORY_CHANGE);
 }
 
 static void updateReportToRelevantUnits() {
@@ -1075,7 +1462,7 @@ static void updateReportToRelevantUnits() {
         return;
     reportToRelevantUnitsTime = df::global::world->frame_counter;
 
-    for (auto unit : df::global::world->units.all) {
+    forChangedUnits(UA_REPORTS, reportToRelevantUnitsSerial, [](TrackedUnit &, df::unit *unit) {
         for ( int16_t b = df::enum_traits<df::unit_report_type>::first_item_value; b <= df::enum_traits<df::unit_report_type>::last_item_value; b++ ) {
             if ( b == df::unit_report_type::Sparring )
                 continue;
@@ -1086,13 +1473,14 @@ static void updateReportToRelevantUnits() {
                 reportToRelevantUnits[unit->reports.log[b][c]].push_back(unit->id);
             }
         }
-    }
+    });
 }
 
 static void manageReportEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::REPORT].begin(), handlers[EventType::REPORT].end());
+    auto &copy = handlers[EventType::REPORT].snapshot();
+    auto &batch = begin_batch(EventType::REPORT);
     std::vector<df::report*>& reports = df::global::world->status.reports;
     size_t idx = df::report::binsearch_index(reports, lastReport, false);
     // returns the index to the key equal to or greater than the key provided
@@ -1103,12 +1491,14 @@ static void manageReportEvent(color_ostream& out) {
 
     for ( ; idx < reports.size(); idx++ ) {
         df::report* report = reports[idx];
-        for (auto &[_,handle] : copy) {
+        batch.push_back((void*)intptr_t(report->id));
+        for (auto &handle : copy) {
             DEBUG(log,out).print("calling handler for report event\n");
             run_handler(out, EventType::REPORT, handle, (void*)intptr_t(report->id));
         }
         lastReport = report->id;
     }
+    run_batch_handlers(out, EventType::REPORT);
 }
 
 static df::unit_wound* getWound(df::unit* attacker, df::unit* defender) {
@@ -1123,13 +1513,20 @@ static df::unit_wound* getWound(df::unit* attacker, df::unit* defender) {
 static void manageUnitAttackEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::UNIT_ATTACK].begin(), handlers[EventType::UNIT_ATTACK].end());
+    auto &copy = handlers[EventType::UNIT_ATTACK].snapshot();
+    auto &batch = begin_batch(EventType::UNIT_ATTACK);
+    // the event data is built on the stack, so batched handlers get copies
+    static vector<UnitAttackData> attackBatch;
+    attackBatch.clear();
+    bool batching = !batchHandlers[EventType::UNIT_ATTACK].empty();
     std::vector<df::report*>& reports = df::global::world->status.reports;
     size_t idx = df::report::binsearch_index(reports, lastReportUnitAttack, false);
     // returns the index to the key equal to or greater than the key provided
     idx = reports[idx]->id == lastReportUnitAttack ? idx + 1 : idx; // we need the index after (where the new stuff is)
 
-    std::set<int32_t> strikeReports;
+    // reports are sorted by id, so this stays sorted
+    static vector<int32_t> strikeReports;
+    strikeReports.clear();
     for ( ; idx < reports.size(); idx++ ) {
         df::report* report = reports[idx];
         lastReportUnitAttack = report->id;
@@ -1137,14 +1534,15 @@ static void manageUnitAttackEvent(color_ostream& out) {
             continue;
         df::announcement_type type = report->type;
         if ( type == df::announcement_type::COMBAT_STRIKE_DETAILS ) {
-            strikeReports.insert(report->id);
+            strikeReports.push_back(report->id);
         }
     }
 
     if ( strikeReports.empty() )
         return;
     updateReportToRelevantUnits();
-    unordered_set<std::pair<int32_t, int32_t>, hash_pair> already_done;
+    static unordered_set<std::pair<int32_t, int32_t>, hash_pair> already_done;
+    already_done.clear();
     for (int reportId : strikeReports) {
         df::report* report = df::report::find(reportId);
         if ( !report )
@@ -1180,7 +1578,9 @@ static void manageUnitAttackEvent(color_ostream& out) {
             data.wound = wound1->id;
 
             already_done.emplace(unit1->id, unit2->id);
-            for (auto &[_,handle] : copy) {
+            if ( batching )
+                attackBatch.push_back(data);
+            for (auto &handle : copy) {
                 DEBUG(log,out).print("calling handler for unit1 attack unit attack event\n");
                 run_handler(out, EventType::UNIT_ATTACK, handle, (void*)&data);
             }
@@ -1192,7 +1592,9 @@ static void manageUnitAttackEvent(color_ostream& out) {
             data.wound = wound2->id;
 
             already_done.emplace(unit1->id, unit2->id);
-            for (auto &[_,handle] : copy) {
+            if ( batching )
+                attackBatch.push_back(data);
+            for (auto &handle : copy) {
                 DEBUG(log,out).print("calling handler for unit2 attack unit attack event\n");
                 run_handler(out, EventType::UNIT_ATTACK, handle, (void*)&data);
             }
@@ -1204,7 +1606,9 @@ static void manageUnitAttackEvent(color_ostream& out) {
             data.wound = -1;
 
             already_done.emplace(unit1->id, unit2->id);
-            for (auto &[_,handle] : copy) {
+            if ( batching )
+                attackBatch.push_back(data);
+            for (auto &handle : copy) {
                 DEBUG(log,out).print("calling handler for unit1 killed unit attack event\n");
                 run_handler(out, EventType::UNIT_ATTACK, handle, (void*)&data);
             }
@@ -1216,7 +1620,9 @@ static void manageUnitAttackEvent(color_ostream& out) {
             data.wound = -1;
 
             already_done.emplace(unit1->id, unit2->id);
-            for (auto &[_,handle] : copy) {
+            if ( batching )
+                attackBatch.push_back(data);
+            for (auto &handle : copy) {
                 DEBUG(log,out).print("calling handler for unit2 killed unit attack event\n");
                 run_handler(out, EventType::UNIT_ATTACK, handle, (void*)&data);
             }
@@ -1232,6 +1638,9 @@ static void manageUnitAttackEvent(color_ostream& out) {
             }
         }
     }
+    for (auto &data : attackBatch)
+        batch.push_back(&data);
+    run_batch_handlers(out, EventType::UNIT_ATTACK);
 }
 
 static std::string getVerb(df::unit* unit, const std::string &reportStr) {
@@ -1410,7 +1819,12 @@ static vector<df::unit*> gatherRelevantUnits(color_ostream& out, df::report* r1,
 static void manageInteractionEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::INTERACTION].begin(), handlers[EventType::INTERACTION].end());
+    auto &copy = handlers[EventType::INTERACTION].snapshot();
+    auto &batch = begin_batch(EventType::INTERACTION);
+    // the event data is built on the stack, so batched handlers get copies
+    static vector<InteractionData> interactionBatch;
+    interactionBatch.clear();
+    bool batching = !batchHandlers[EventType::INTERACTION].empty();
     std::vector<df::report*>& reports = df::global::world->status.reports;
     size_t a = df::report::binsearch_index(reports, lastReportInteraction, false);
     while (a < reports.size() && reports[a]->id <= lastReportInteraction) {
@@ -1474,10 +1888,15 @@ static void manageInteractionEvent(color_ostream& out) {
         lastAttacker = df::unit::find(data.attacker);
         //lastDefender = df::unit::find(data.defender);
         //fire event
-        for (auto &[_,handle] : copy) {
+        if ( batching )
+            interactionBatch.push_back(data);
+        for (auto &handle : copy) {
             DEBUG(log,out).print("calling handler for interaction event\n");
             run_handler(out, EventType::INTERACTION, handle, (void*)&data);
         }
         //TODO: deduce attacker from latest defend event first
     }
+    for (auto &data : interactionBatch)
+        batch.push_back(&data);
+    run_batch_handlers(out, EventType::INTERACTION);
 }
@@ -35,6 +35,7 @@ distribution.
 #include "modules/Buildings.h"
 #include "modules/Items.h"
 #include "modules/Job.h"
+#include "modules/Maps.h"
 #include "modules/Materials.h"
 #include "modules/Translation.h"
 #include "modules/Units.h"
@@ -68,6 +69,7 @@ distribution.
 #include "df/item_plant_growthst.h"
 #include "df/item_toolst.h"
 #include "df/item_type.h"
+#include "df/items_other_id.h"
 #include "df/itemdef_ammost.h"
 #include "df/itemdef_armorst.h"
 #include "df/itemdef_foodst.h"
@@ -106,7 +108,11 @@ distribution.
 #include "df/world_site.h"
 #include "df/written_content.h"
 
+#include <algorithm>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 using std::string;
@@ -2046,3 +2052,355 @@ int32_t Items::getCapacity(df::item *item) {
     }
     return 0;
 }
+
+/*
+ * Item index for ItemQuery.
+ *
+ * Item ids grouped by (type, subtype, mat_type, mat_index), which never
+ * change for an item, with each group in order of id. items.all is sorted by
+ * id and new items get increasing ids, so new items are found by looking at
+ * the end of items.all. Destroyed items are dropped when a query finds that
+ * their id no longer resolves. The index is rebuilt from scratch when the
+ * map is unloaded, once per game day, and when items.all grew by more than
+ * the number of new ids (items with old ids came back into play).
+ */
+namespace {
+    struct ItemKey {
+        int16_t type;
+        int16_t subtype;
+        int16_t mat_type;
+        int32_t mat_index;
+
+        bool operator==(const ItemKey &other) const {
+            return type == other.type && subtype == other.subtype &&
+                mat_type == other.mat_type && mat_index == other.mat_index;
+        }
+    };
+
+    struct ItemKeyHash {
+        size_t operator()(const ItemKey &key) const {
+            uint64_t v = (uint64_t(uint16_t(key.type)) << 48) | (uint64_t(uint16_t(key.subtype)) << 32) |
+                (uint64_t(uint16_t(key.mat_type)) << 16);
+            return std::hash<uint64_t>()(v ^ (uint64_t(uint32_t(key.mat_index)) * 0x9E3779B97F4A7C15ULL));
+        }
+    };
+
+    struct ItemIndex {
+        std::unordered_map<ItemKey, vector<int32_t>, ItemKeyHash> groups;
+        // the keys of the groups of each item type
+        std::unordered_map<int16_t, vector<ItemKey>> keys_by_type;
+        bool valid = false;
+        int32_t next_id = 0;
+        size_t all_size = 0;
+        int32_t built_frame = 0;
+
+        void clear() {
+            groups.clear();
+            keys_by_type.clear();
+            valid = false;
+        }
+
+        void add(df::item *item) {
+            ItemKey key = { int16_t(item->getType()), item->getSubtype(),
+                            item->getMaterial(), item->getMaterialIndex() };
+            auto &group = groups[key];
+            if (group.empty())
+                keys_by_type[key.type].push_back(key);
+            group.push_back(item->id);
+        }
+    };
+}
+
+static const int32_t ITEM_INDEX_REBUILD_TICKS = 1200;
+
+static std::mutex item_index_mutex;
+static ItemIndex item_index;
+
+static std::mutex census_mutex;
+static std::shared_ptr<const Items::ItemCensus> census;
+
+static void refreshItemIndex() {
+    auto &all = world->items.all;
+    int32_t next_id = df::global::item_next_id ? *df::global::item_next_id : 0;
+    auto &index = item_index;
+
+    if (index.valid && index.next_id == next_id && index.all_size == all.size() &&
+            world->frame_counter - index.built_frame < ITEM_INDEX_REBUILD_TICKS)
+        return;
+
+    if (index.valid && next_id >= index.next_id &&
+            world->frame_counter - index.built_frame >= 0 &&
+            world->frame_counter - index.built_frame < ITEM_INDEX_REBUILD_TICKS) {
+        auto it = std::lower_bound(all.begin(), all.end(), index.next_id,
+            [](df::item *item, int32_t id) { return item->id < id; });
+        size_t added = all.end() - it;
+        if (all.size() <= index.all_size + added) {
+            for (; it != all.end(); ++it)
+                index.add(*it);
+            index.next_id = next_id;
+            index.all_size = all.size();
+            return;
+        }
+    }
+
+    index.clear();
+    for (auto item : all)
+        index.add(item);
+    index.valid = true;
+    index.next_id = next_id;
+    index.all_size = all.size();
+    index.built_frame = world->frame_counter;
+}
+
+void items_onStateChange(color_ostream &out, state_change_event event) {
+    switch (event) {
+    case SC_MAP_UNLOADED:
+    case SC_WORLD_UNLOADED:
+    {
+        std::lock_guard<std::mutex> lock(item_index_mutex);
+        item_index.clear();
+        std::lock_guard<std::mutex> census_lock(census_mutex);
+        census.reset();
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+using Items::ItemQuery;
+
+ItemQuery &ItemQuery::type(df::item_type type) {
+    item_type = type;
+    has_subtype = false;
+    return *this;
+}
+
+ItemQuery &ItemQuery::type(df::item_type type, int16_t subtype) {
+    item_type = type;
+    has_subtype = true;
+    this->subtype = subtype;
+    return *this;
+}
+
+ItemQuery &ItemQuery::material(int16_t mat_type) {
+    has_mat_type = true;
+    has_mat_index = false;
+    this->mat_type = mat_type;
+    return *this;
+}
+
+ItemQuery &ItemQuery::material(int16_t mat_type, int32_t mat_index) {
+    has_mat_type = has_mat_index = true;
+    this->mat_type = mat_type;
+    this->mat_index = mat_index;
+    return *this;
+}
+
+void ItemQuery::setFlag(uint32_t flag, bool value) {
+    flags_mask |= flag;
+    if (value)
+        flags_value |= flag;
+    else
+        flags_value &= ~flag;
+}
+
+static uint32_t itemFlagBit(void (*set)(df::item_flags &)) {
+    df::item_flags flags;
+    flags.whole = 0;
+    set(flags);
+    return flags.whole;
+}
+
+ItemQuery &ItemQuery::forbidden(bool value) {
+    static const uint32_t bit = itemFlagBit([](df::item_flags &f) { f.bits.forbid = true; });
+    setFlag(bit, value);
+    return *this;
+}
+
+ItemQuery &ItemQuery::inJob(bool value) {
+    static const uint32_t bit = itemFlagBit([](df::item_flags &f) { f.bits.in_job = true; });
+    setFlag(bit, value);
+    return *this;
+}
+
+ItemQuery &ItemQuery::owned(bool value) {
+    static const uint32_t bit = itemFlagBit([](df::item_flags &f) { f.bits.owned = true; });
+    setFlag(bit, value);
+    return *this;
+}
+
+ItemQuery &ItemQuery::inContainer(bool value) {
+    static const uint32_t bit = itemFlagBit([](df::item_flags &f) { f.bits.in_inventory = true; });
+    setFlag(bit, value);
+    return *this;
+}
+
+ItemQuery &ItemQuery::onGround(bool value) {
+    static const uint32_t bit = itemFlagBit([](df::item_flags &f) { f.bits.on_ground = true; });
+    setFlag(bit, value);
+    return *this;
+}
+
+ItemQuery &ItemQuery::withoutFlags(const df::item_flags &flags) {
+    flags_mask |= flags.whole;
+    flags_value &= ~flags.whole;
+    return *this;
+}
+
+ItemQuery &ItemQuery::filter(std::function<bool(df::item *)> fn) {
+    this->fn = fn;
+    return *this;
+}
+
+void ItemQuery::collect(vector<df::item *> &items) const {
+    items.clear();
+    if (!world)
+        return;
+
+    static const uint32_t removed = itemFlagBit([](df::item_flags &f) { f.bits.removed = true; });
+    uint32_t mask = flags_mask | removed;
+    uint32_t value = flags_value & ~removed;
+
+    // resolve ids while holding the lock; the filter runs afterwards
+    {
+        std::lock_guard<std::mutex> lock(item_index_mutex);
+        refreshItemIndex();
+
+        auto scan = [&](vector<int32_t> &group) {
+            size_t kept = 0;
+            for (size_t i = 0; i < group.size(); ++i) {
+                auto item = df::item::find(group[i]);
+                if (!item)
+                    continue; // destroyed
+                group[kept++] = group[i];
+                if ((item->flags.whole & mask) == value)
+                    items.push_back(item);
+            }
+            group.resize(kept);
+        };
+        auto matches = [&](const ItemKey &key) {
+            return (!has_subtype || key.subtype == subtype) &&
+                (!has_mat_type || key.mat_type == mat_type) &&
+                (!has_mat_index || key.mat_index == mat_index);
+        };
+
+        if (item_type != item_type::NONE && has_subtype && has_mat_type && has_mat_index) {
+            auto group = item_index.groups.find({ int16_t(item_type), subtype, mat_type, mat_index });
+            if (group != item_index.groups.end())
+                scan(group->second);
+        } else if (item_type != item_type::NONE) {
+            auto keys = item_index.keys_by_type.find(int16_t(item_type));
+            if (keys != item_index.keys_by_type.end())
+                for (auto &key : keys->second)
+                    if (matches(key))
+                        scan(item_index.groups[key]);
+        } else {
+            for (auto &group : item_index.groups)
+                if (matches(group.first))
+                    scan(group.second);
+        }
+    }
+
+    if (fn)
+        items.erase(std::remove_if(items.begin(), items.end(),
+            [&](df::item *item) { return !fn(item); }), items.end());
+    std::sort(items.begin(), items.end(),
+        [](df::item *a, df::item *b) { return a->id < b->id; });
+}
+
+size_t ItemQuery::count() const {
+    vector<df::item *> items;
+    collect(items);
+    return items.size();
+}
+
+void ItemQuery::getIds(vector<int32_t> &ids) const {
+    vector<df::item *> items;
+    collect(items);
+    ids.clear();
+    for (auto item : items)
+        ids.push_back(item->id);
+}
+
+void ItemQuery::getItems(vector<df::item *> &items) const {
+    collect(items);
+}
+
+Items::ItemCensus::Entry Items::ItemCensus::get(df::item_type type, int16_t subtype, int16_t mat_type, int32_t mat_index) const {
+    Entry total;
+    auto add = [](Counts &to, const Counts &from) {
+        to.items += from.items;
+        to.stack += from.stack;
+    };
+    // entries are sorted by key, so all the entries of the type are together
+    Key first = { int16_t(type), INT16_MIN, INT16_MIN, INT32_MIN };
+    for (auto it = entries.lower_bound(first); it != entries.end() && it->first.type == type; ++it) {
+        auto &key = it->first;
+        if ((subtype != -1 && key.subtype != subtype) ||
+                (mat_type != -1 && key.mat_type != mat_type) ||
+                (mat_index != -1 && key.mat_index != mat_index))
+            continue;
+        add(total.all, it->second.all);
+        add(total.usable, it->second.usable);
+        add(total.accessible, it->second.accessible);
+    }
+    return total;
+}
+
+static uint32_t censusBadFlags() {
+    df::item_flags flags;
+    flags.whole = 0;
+    #define F(x) flags.bits.x = true;
+    F(dump); F(forbid); F(garbage_collect);
+    F(hostile); F(on_fire); F(rotten); F(trader);
+    F(in_building); F(construction); F(artifact);
+    F(in_job); F(owned); F(removed);
+    F(encased); F(spider_web);
+    #undef F
+    return flags.whole;
+}
+
+static std::shared_ptr<const Items::ItemCensus> takeCensus() {
+    static const uint32_t bad_flags = censusBadFlags();
+    auto result = std::make_shared<Items::ItemCensus>();
+    result->frame = world->frame_counter;
+
+    // the walkable groups that citizens are standing in
+    std::unordered_set<uint16_t> citizen_groups;
+    vector<df::unit *> citizens;
+    Units::getCitizens(citizens, true);
+    for (auto unit : citizens) {
+        if (auto group = Maps::getWalkableGroup(Units::getPosition(unit)))
+            citizen_groups.insert(group);
+    }
+
+    for (auto item : world->items.other[items_other_id::IN_PLAY]) {
+        Items::ItemCensus::Key key = { int16_t(item->getType()), item->getSubtype(),
+                                       item->getMaterial(), item->getMaterialIndex() };
+        auto &entry = result->entries[key];
+        int32_t stack = item->getStackSize();
+        entry.all.items++;
+        entry.all.stack += stack;
+        if (item->flags.whole & bad_flags)
+            continue;
+        entry.usable.items++;
+        entry.usable.stack += stack;
+        auto group = Maps::getWalkableGroup(Items::getPosition(item));
+        if (group && citizen_groups.count(group)) {
+            entry.accessible.items++;
+            entry.accessible.stack += stack;
+        }
+    }
+    return result;
+}
+
+std::shared_ptr<const Items::ItemCensus> Items::getCensus(int32_t max_age) {
+    std::lock_guard<std::mutex> lock(census_mutex);
+    if (!world || !Maps::IsValid())
+        return std::make_shared<const ItemCensus>();
+    int32_t age = census ? world->frame_counter - census->frame : 0;
+    if (!census || age < 0 || age > max_age)
+        census = takeCensus();
+    return census;
+}
@@ -34,7 +34,9 @@ distribution.
 #include "VersionInfo.h"
 
 #include "modules/Buildings.h"
+#include "modules/Connectivity.h"
 #include "modules/MapCache.h"
+#include "modules/MapJournal.h"
 #include "modules/Maps.h"
 #include "modules/Job.h"
 #include "modules/Materials.h"
@@ -71,6 +73,7 @@ distribution.
 #include "df/world_underground_region.h"
 #include "df/z_level_flags.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <map>
@@ -103,25 +106,50 @@ MapExtras::Block::Block(MapCache *parent, DFCoord _bcoord) :
     parent(parent),
     designated_tiles{}
 {
+    tags = NULL;
+    item_counts = NULL;
+    tiles = NULL;
+    basemats = NULL;
+
+    reset(_bcoord);
+}
+
+void MapExtras::Block::reset(DFCoord _bcoord)
+{
+    releaseParsed();
+    delete[] item_counts;
+    item_counts = NULL;
+    delete[] tags;
+    tags = NULL;
+
     dirty_designations = false;
     dirty_tiles = false;
     dirty_veins = false;
     dirty_temperatures = false;
     dirty_occupancies = false;
     valid = false;
+    designated_tiles.reset();
     bcoord = _bcoord;
+    list_index = 0;
+    source_hash = 0;
+    generation = parent->generation;
     block = Maps::getBlock(bcoord);
-    tags = NULL;
 
     init();
 }
 
-void MapExtras::Block::init()
+void MapExtras::Block::releaseParsed()
 {
-    item_counts = NULL;
+    if (tiles)
+        parent->releaseTiles(tiles);
+    if (basemats)
+        parent->releaseBasemats(basemats);
     tiles = NULL;
     basemats = NULL;
+}
 
+void MapExtras::Block::init()
+{
     if(block)
     {
         COPY(designation, block->designation);
@@ -151,8 +179,8 @@ bool MapExtras::Block::Allocate()
         return false;
 
     delete[] item_counts;
-    delete tiles;
-    delete basemats;
+    item_counts = NULL;
+    releaseParsed();
     init();
 
     return true;
@@ -162,8 +190,105 @@ MapExtras::Block::~Block()
 {
     delete[] item_counts;
     delete[] tags;
-    delete tiles;
-    delete basemats;
+    releaseParsed();
+}
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size)
+{
+    // FNV-1a
+    auto bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t MapExtras::Block::computeSourceHash()
+{
+    using namespace df::enums::tiletype_material;
+
+    if (!block)
+        return 0;
+
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hashBytes(hash, block->tiletype, sizeof(block->tiletype));
+    hash = hashBytes(hash, block->region_offset, sizeof(block->region_offset));
+
+    // only the designation bits that select layer and feature materials;
+    // the rest change all the time (flows, dig designations, ...)
+    df::tile_designation mask;
+    mask.whole = 0;
+    mask.bits.biome = 15;
+    mask.bits.geolayer_index = 15;
+    mask.bits.feature_local = true;
+    mask.bits.feature_global = true;
+    for (int x = 0; x < 16; x++)
+    {
+        for (int y = 0; y < 16; y++)
+        {
+            auto bits = block->designation[x][y].whole & mask.whole;
+            hash = hashBytes(hash, &bits, sizeof(bits));
+
+            if (tileMaterial(block->tiletype[x][y]) != CONSTRUCTION)
+                continue;
+            if (auto con = df::construction::find(block->map_pos + df::coord(x,y,0)))
+            {
+                hash = hashBytes(hash, &con->original_tile, sizeof(con->original_tile));
+                hash = hashBytes(hash, &con->mat_type, sizeof(con->mat_type));
+                hash = hashBytes(hash, &con->mat_index, sizeof(con->mat_index));
+            }
+        }
+    }
+
+    for (auto event : block->block_events)
+    {
+        if (auto vein = strict_virtual_cast<df::block_square_event_mineralst>(event))
+        {
+            hash = hashBytes(hash, &vein->inorganic_mat, sizeof(vein->inorganic_mat));
+            hash = hashBytes(hash, &vein->flags, sizeof(vein->flags));
+            hash = hashBytes(hash, vein->tile_bitmask.bits, sizeof(vein->tile_bitmask.bits));
+        }
+        else if (auto ice = strict_virtual_cast<df::block_square_event_frozen_liquidst>(event))
+        {
+            hash = hashBytes(hash, ice->tiles, sizeof(ice->tiles));
+        }
+        else if (auto grass = strict_virtual_cast<df::block_square_event_grassst>(event))
+        {
+            hash = hashBytes(hash, &grass->plant_index, sizeof(grass->plant_index));
+            hash = hashBytes(hash, grass->amount, sizeof(grass->amount));
+        }
+    }
+
+    return hash;
+}
+
+void MapExtras::Block::revalidate()
+{
+    df::map_block *cur_block = Maps::getBlock(bcoord);
+    // a zero hash means the layers were decoded before the cache started
+    // tracking sources
+    bool keep = tiles && cur_block && cur_block == block
+        && !dirty_tiles && !dirty_veins && source_hash
+        && computeSourceHash() == source_hash;
+    if (!keep)
+        releaseParsed();
+
+    delete[] item_counts;
+    item_counts = NULL;
+
+    dirty_designations = false;
+    dirty_tiles = false;
+    dirty_veins = false;
+    dirty_temperatures = false;
+    dirty_occupancies = false;
+    valid = false;
+    designated_tiles.reset();
+    block = cur_block;
+    generation = parent->generation;
+
+    init();
 }
 
 void MapExtras::Block::init_tags()
@@ -177,17 +302,21 @@ void MapExtras::Block::init_tiles(bool basemat)
 {
     if (!tiles)
     {
-        tiles = new TileInfo();
+        tiles = parent->allocTiles();
 
         dirty_tiles = false;
 
         if (block)
+        {
             ParseTiles(tiles);
+            if (parent->track_sources)
+                source_hash = computeSourceHash();
+        }
     }
 
     if (basemat && !basemats)
     {
-        basemats = new BasematInfo();
+        basemats = parent->allocBasemats();
 
         dirty_veins = false;
 
@@ -198,11 +327,9 @@ void MapExtras::Block::init_tiles(bool basemat)
 
 MapExtras::Block::TileInfo::TileInfo()
 {
-    dirty_raw.clear();
-    memset(raw_tiles,0,sizeof(raw_tiles));
     ice_info = NULL;
     con_info = NULL;
-    memset(base_tiles,0,sizeof(base_tiles));
+    clear();
 }
 
 MapExtras::Block::TileInfo::~TileInfo()
@@ -211,6 +338,17 @@ MapExtras::Block::TileInfo::~TileInfo()
     delete con_info;
 }
 
+void MapExtras::Block::TileInfo::clear()
+{
+    delete ice_info;
+    delete con_info;
+    ice_info = NULL;
+    con_info = NULL;
+    dirty_raw.clear();
+    memset(raw_tiles,0,sizeof(raw_tiles));
+    memset(base_tiles,0,sizeof(base_tiles));
+}
+
 void MapExtras::Block::TileInfo::init_iceinfo()
 {
     if (ice_info)
@@ -778,6 +916,14 @@ bool MapExtras::Block::Write ()
 {
     if(!valid) return false;
 
+    if(dirty_designations || dirty_tiles || dirty_occupancies)
+    {
+        df::coord pos(bcoord.x*16, bcoord.y*16, bcoord.z);
+        Connectivity::invalidate(pos);
+        Maps::invalidatePaths(pos);
+        MapJournal::invalidate(pos);
+    }
+
     if(dirty_designations)
     {
         COPY(block->designation, designation);
@@ -794,8 +940,7 @@ bool MapExtras::Block::Write ()
 
         dirty_tiles = dirty_veins = false;
 
-        delete tiles; tiles = NULL;
-        delete basemats; basemats = NULL;
+        releaseParsed();
     }
     if(dirty_temperatures)
     {
@@ -1237,8 +1382,10 @@ bool MapExtras::Block::removeItemOnGround(df::item *item)
 MapExtras::MapCache::MapCache()
 {
     valid = 0;
+    last_block = NULL;
     Maps::getSize(x_bmax, y_bmax, z_max);
     x_tmax = x_bmax*16; y_tmax = y_bmax*16;
+    block_table.resize(z_max);
     std::vector<df::coord2d> geoidx;
     std::vector<std::vector<int16_t> > layer_mats;
     validgeo = Maps::ReadGeology(&layer_mats, &geoidx);
@@ -1293,6 +1440,17 @@ MapExtras::MapCache::MapCache()
     }
 }
 
+MapExtras::MapCache::~MapCache()
+{
+    trash();
+    for (Block *b : free_blocks)
+        delete b;
+    for (auto tiles : free_tiles)
+        delete tiles;
+    for (auto basemats : free_basemats)
+        delete basemats;
+}
+
 bool MapExtras::MapCache::addItemOnGround(df::item *item) {
     Block * b= BlockAtTile(item->pos);
     return b ? b->addItemOnGround(item) : false;
@@ -1312,11 +1470,10 @@ bool MapExtras::MapCache::WriteAll()
         df::job* job = job_link->item;
         df::coord pos = job->pos;
         df::coord blockpos(pos.x>>4,pos.y>>4,pos.z);
-        auto iter = blocks.find(blockpos);
-        if (iter == blocks.end())
+        auto block = findBlock(blockpos);
+        if (!block)
             continue;
         df::coord2d bpos(pos.x - (blockpos.x<<4),pos.y - (blockpos.y<<4));
-        auto block = iter->second;
         if (!block->designated_tiles.test(bpos.x+bpos.y*16))
             continue;
         bool is_designed = ENUM_ATTR(job_type,is_designation,job->job_type);
@@ -1326,48 +1483,141 @@ bool MapExtras::MapCache::WriteAll()
         // processing.
         Job::removeJob(job);
     }
-    std::map<DFCoord, Block *>::iterator p;
-    for(p = blocks.begin(); p != blocks.end(); p++)
+    for (Block *b : block_list)
     {
-        p->second->Write();
+        // stale blocks had their changes discarded by revalidate
+        if (b->generation == generation)
+            b->Write();
     }
     return true;
 }
 
-MapExtras::Block *MapExtras::MapCache::BlockAt(DFCoord blockcoord)
+MapExtras::Block *MapExtras::MapCache::findBlock(DFCoord blockcoord)
+{
+    if(unsigned(blockcoord.x) >= x_bmax ||
+       unsigned(blockcoord.y) >= y_bmax ||
+       unsigned(blockcoord.z) >= z_max)
+        return 0;
+    auto &level = block_table[blockcoord.z];
+    if (level.empty())
+        return 0;
+    Block *block = level[blockcoord.x + blockcoord.y * x_bmax];
+    return block && block->generation == generation ? block : 0;
+}
+
+MapExtras::Block *MapExtras::MapCache::lookupBlock(DFCoord blockcoord)
 {
     if(!valid)
         return 0;
-    std::map <DFCoord, Block*>::iterator iter = blocks.find(blockcoord);
-    if(iter != blocks.end())
-    {
-        return (*iter).second;
-    }
-    else
+    if(unsigned(blockcoord.x) >= x_bmax ||
+       unsigned(blockcoord.y) >= y_bmax ||
+       unsigned(blockcoord.z) >= z_max)
+        return 0;
+
+    auto &level = block_table[blockcoord.z];
+    if (level.empty())
+        level.resize(x_bmax * y_bmax, NULL);
+    Block *&slot = level[blockcoord.x + blockcoord.y * x_bmax];
+    if (!slot)
     {
-        if(unsigned(blockcoord.x) < x_bmax &&
-           unsigned(blockcoord.y) < y_bmax &&
-           unsigned(blockcoord.z) < z_max)
+        if (free_blocks.empty())
+            slot = new Block(this, blockcoord);
+        else
         {
-            Block * nblo = new Block(this, blockcoord);
-            blocks[blockcoord] = nblo;
-            return nblo;
+            slot = free_blocks.back();
+            free_blocks.pop_back();
+            slot->reset(blockcoord);
         }
-        return 0;
+        slot->list_index = block_list.size();
+        block_list.push_back(slot);
     }
+    else if (slot->generation != generation)
+        slot->revalidate();
+    last_block = slot;
+    last_bcoord = blockcoord;
+    return slot;
 }
 
 void MapExtras::MapCache::discardBlock(Block *block)
 {
-    blocks.erase(block->bcoord);
-    delete block;
+    DFCoord bcoord = block->bcoord;
+    block_table[bcoord.z][bcoord.x + bcoord.y * x_bmax] = NULL;
+    Block *moved = block_list.back();
+    block_list[block->list_index] = moved;
+    moved->list_index = block->list_index;
+    block_list.pop_back();
+    if (last_block == block)
+        last_block = NULL;
+    block->releaseParsed();
+    free_blocks.push_back(block);
+}
+
+void MapExtras::MapCache::trash()
+{
+    for (Block *b : block_list)
+    {
+        b->releaseParsed();
+        free_blocks.push_back(b);
+    }
+    block_list.clear();
+    for (auto &level : block_table)
+        std::fill(level.begin(), level.end(), (Block *)NULL);
+    last_block = NULL;
+}
+
+bool MapExtras::MapCache::revalidate()
+{
+    uint32_t x_size, y_size, z_size;
+    Maps::getSize(x_size, y_size, z_size);
+    if (!valid || x_size != x_bmax || y_size != y_bmax || z_size != z_max)
+    {
+        trash();
+        valid = false;
+        return false;
+    }
+
+    // blocks are reread when they are next looked up
+    track_sources = true;
+    ++generation;
+    last_block = NULL;
+    return true;
+}
+
+MapExtras::Block::TileInfo *MapExtras::MapCache::allocTiles()
+{
+    if (free_tiles.empty())
+        return new Block::TileInfo();
+    auto tiles = free_tiles.back();
+    free_tiles.pop_back();
+    tiles->clear();
+    return tiles;
+}
+
+void MapExtras::MapCache::releaseTiles(Block::TileInfo *tiles)
+{
+    free_tiles.push_back(tiles);
+}
+
+MapExtras::Block::BasematInfo *MapExtras::MapCache::allocBasemats()
+{
+    if (free_basemats.empty())
+        return new Block::BasematInfo();
+    auto basemats = free_basemats.back();
+    free_basemats.pop_back();
+    *basemats = Block::BasematInfo();
+    return basemats;
+}
+
+void MapExtras::MapCache::releaseBasemats(Block::BasematInfo *basemats)
+{
+    free_basemats.push_back(basemats);
 }
 
 void MapExtras::MapCache::resetTags()
 {
-    for (auto it = blocks.begin(); it != blocks.end(); ++it)
+    for (Block *b : block_list)
     {
-        delete[] it->second->tags;
-        it->second->tags = NULL;
+        delete[] b->tags;
+        b->tags = NULL;
     }
 }
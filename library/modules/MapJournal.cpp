@@ -0,0 +1,344 @@
+#include "Internal.h"
+
+#include "Core.h"
+#include "DataDefs.h"
+
+#include "modules/MapJournal.h"
+#include "modules/Maps.h"
+
+#include "df/block_square_event_item_spatterst.h"
+#include "df/block_square_event_material_spatterst.h"
+#include "df/block_square_event_type.h"
+#include "df/map_block.h"
+#include "df/tile_building_occ.h"
+#include "df/tile_liquid.h"
+#include "df/world.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using namespace DFHack;
+using df::global::world;
+
+namespace {
+    const int ASPECTS = 6;
+
+    struct BlockState {
+        bool present = false;
+        uint32_t checked_update = 0;
+        uint64_t hash[ASPECTS] = {};
+        // generation of the latest change to each aspect
+        uint32_t generation[ASPECTS] = {};
+    };
+
+    struct Entry {
+        uint32_t generation;
+        int32_t index;
+        uint32_t aspects;
+    };
+
+    struct Journal {
+        bool built = false;
+        int32_t x_count = 0, y_count = 0, z_count = 0; // in blocks
+        uint32_t checked_update = 0;
+        // generation the map was first hashed at; changes before it aren't
+        // in the journal
+        uint32_t base = 0;
+        std::vector<BlockState> blocks;
+        std::vector<Entry> entries; // in generation order
+        std::vector<std::pair<int32_t, uint32_t>> pending; // blocks passed to invalidate
+        std::vector<uint32_t> seen; // per block, stamp of the last query listing it
+        uint32_t stamp = 0;
+
+        int32_t index(int32_t bx, int32_t by, int32_t bz) const {
+            return (bz * y_count + by) * x_count + bx;
+        }
+        df::coord position(int32_t index) const {
+            return df::coord(index % x_count, index / x_count % y_count, index / x_count / y_count);
+        }
+        bool contains(df::coord block_pos) const {
+            return block_pos.x >= 0 && block_pos.y >= 0 && block_pos.z >= 0 &&
+                block_pos.x < x_count && block_pos.y < y_count && block_pos.z < z_count;
+        }
+    };
+}
+
+static std::mutex journal_mutex;
+static Journal journal;
+// not reset on map loads, so that generations from an earlier map are older
+// than every change to the current one
+static uint32_t last_generation = 0;
+
+// Hashes the bytes of data, masking every 64-bit word with mask. Four words
+// are mixed into four independent lanes per step so that the multiplies
+// overlap instead of waiting on each other.
+static uint64_t hashBytes(const void *data, size_t size, uint64_t mask = ~0ULL, uint64_t seed = 0) {
+    const uint64_t PRIME = 0x9E3779B97F4A7C15ULL;
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint64_t lanes[4] = { seed ^ size, seed + PRIME, seed ^ (PRIME << 1), seed - PRIME };
+    size_t words = size / 8, i = 0;
+    for (; i + 4 <= words; i += 4) {
+        uint64_t w[4];
+        memcpy(w, bytes + i * 8, sizeof(w));
+        for (int k = 0; k < 4; k++) {
+            lanes[k] = (lanes[k] ^ (w[k] & mask)) * PRIME;
+            lanes[k] ^= lanes[k] >> 32;
+        }
+    }
+    for (; i < words; i++) {
+        uint64_t w;
+        memcpy(&w, bytes + i * 8, 8);
+        lanes[0] = (lanes[0] ^ (w & mask)) * PRIME;
+        lanes[0] ^= lanes[0] >> 32;
+    }
+    if (size % 8) {
+        uint64_t w = 0;
+        memcpy(&w, bytes + words * 8, size % 8);
+        lanes[1] = (lanes[1] ^ (w & mask)) * PRIME;
+        lanes[1] ^= lanes[1] >> 32;
+    }
+    uint64_t hash = lanes[0];
+    for (int k = 1; k < 4; k++) {
+        hash = (hash ^ lanes[k]) * PRIME;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+static uint64_t wordMask(uint32_t bits) {
+    return uint64_t(bits) | (uint64_t(bits) << 32);
+}
+
+static void hashBlock(df::map_block *block, uint64_t hash[ASPECTS]) {
+    df::tile_designation liquid;
+    liquid.whole = 0;
+    liquid.bits.flow_size = 7;
+    liquid.bits.liquid_type = df::tile_liquid::Magma;
+    liquid.bits.liquid_static = true;
+    liquid.bits.water_stagnant = true;
+    liquid.bits.water_salt = true;
+    df::tile_occupancy building;
+    building.whole = 0;
+    building.bits.building = df::tile_building_occ(7);
+
+    hash[0] = hashBytes(block->tiletype, sizeof(block->tiletype));
+    hash[1] = hashBytes(block->designation, sizeof(block->designation), ~wordMask(liquid.whole));
+    hash[2] = hashBytes(block->designation, sizeof(block->designation), wordMask(liquid.whole));
+
+    uint64_t spatter = 0;
+    for (auto event : block->block_events) {
+        switch (event->getType()) {
+        case df::block_square_event_type::material_spatter:
+            spatter = hashBytes(event, sizeof(df::block_square_event_material_spatterst), ~0ULL, spatter);
+            break;
+        case df::block_square_event_type::item_spatter:
+            spatter = hashBytes(event, sizeof(df::block_square_event_item_spatterst), ~0ULL, spatter);
+            break;
+        default:
+            break;
+        }
+    }
+    hash[3] = spatter;
+
+    hash[4] = hashBytes(block->items.data(), block->items.size() * sizeof(block->items[0]));
+    hash[5] = hashBytes(block->occupancy, sizeof(block->occupancy), wordMask(building.whole));
+}
+
+// rehashes the block, returning the aspects whose hash changed
+static uint32_t checkBlock(Journal &j, int32_t index) {
+    auto &state = j.blocks[index];
+    state.checked_update = Core::getInstance().getUpdateCount();
+    df::coord pos = j.position(index);
+    auto block = Maps::getBlock(pos);
+    uint64_t hash[ASPECTS] = {};
+    if (block)
+        hashBlock(block, hash);
+
+    uint32_t changed = state.present != (block != NULL) ? MapJournal::ALL : 0;
+    for (int aspect = 0; aspect < ASPECTS; aspect++) {
+        if (hash[aspect] != state.hash[aspect])
+            changed |= 1 << aspect;
+        state.hash[aspect] = hash[aspect];
+    }
+    state.present = block != NULL;
+    return changed;
+}
+
+// stamps the aspects of the block with generation, taking a new generation
+// for the first change of a sync
+static void record(Journal &j, int32_t index, uint32_t aspects, uint32_t &generation) {
+    if (!aspects)
+        return;
+    if (!generation)
+        generation = ++last_generation;
+    auto &state = j.blocks[index];
+    for (int aspect = 0; aspect < ASPECTS; aspect++)
+        if (aspects & (1 << aspect))
+            state.generation[aspect] = generation;
+    j.entries.push_back({ generation, index, aspects });
+}
+
+// Once the journal is much longer than the map, rebuilds it from the
+// generations kept per block, which keeps only the latest change to each
+// aspect of each block.
+static void compactJournal(Journal &j) {
+    if (j.entries.size() <= 8 * j.blocks.size() + 1024)
+        return;
+    j.entries.clear();
+    for (int32_t index = 0; index < int32_t(j.blocks.size()); index++) {
+        auto &state = j.blocks[index];
+        uint32_t done = 0;
+        for (int aspect = 0; aspect < ASPECTS; aspect++) {
+            uint32_t generation = state.generation[aspect];
+            if ((done & (1 << aspect)) || generation <= j.base)
+                continue;
+            uint32_t aspects = 0;
+            for (int other = aspect; other < ASPECTS; other++)
+                if (state.generation[other] == generation)
+                    aspects |= 1 << other;
+            done |= aspects;
+            j.entries.push_back({ generation, index, aspects });
+        }
+    }
+    std::stable_sort(j.entries.begin(), j.entries.end(), [](const Entry &a, const Entry &b) {
+        return a.generation < b.generation;
+    });
+}
+
+// Brings the journal up to date with the map: applies invalidations, and if
+// full is set, checks every block not yet checked in this update. Checks are
+// keyed on the core's update count rather than world->frame_counter, which
+// stands still while the game is paused and the map can still be edited.
+static bool syncJournal(Journal &j, bool full) {
+    if (!world || !Maps::IsValid()) {
+        j = Journal();
+        return false;
+    }
+    int32_t x_count = world->map.x_count_block;
+    int32_t y_count = world->map.y_count_block;
+    int32_t z_count = world->map.z_count_block;
+
+    if (!j.built || j.x_count != x_count || j.y_count != y_count || j.z_count != z_count) {
+        j = Journal();
+        j.x_count = x_count;
+        j.y_count = y_count;
+        j.z_count = z_count;
+        int32_t size = x_count * y_count * z_count;
+        j.blocks.resize(size);
+        j.seen.assign(size, 0);
+        j.base = ++last_generation;
+        for (int32_t index = 0; index < size; index++) {
+            checkBlock(j, index);
+            auto &state = j.blocks[index];
+            if (state.present)
+                std::fill(state.generation, state.generation + ASPECTS, j.base);
+        }
+        j.built = true;
+        j.checked_update = Core::getInstance().getUpdateCount();
+        return true;
+    }
+
+    uint32_t generation = 0;
+    std::vector<std::pair<int32_t, uint32_t>> pending;
+    pending.swap(j.pending);
+    for (auto &entry : pending)
+        record(j, entry.first, checkBlock(j, entry.first) | entry.second, generation);
+
+    uint32_t update = Core::getInstance().getUpdateCount();
+    if (full && j.checked_update != update) {
+        j.checked_update = update;
+        for (int32_t index = 0; index < int32_t(j.blocks.size()); index++)
+            if (j.blocks[index].checked_update != update)
+                record(j, index, checkBlock(j, index), generation);
+    }
+
+    if (generation)
+        compactJournal(j);
+    return true;
+}
+
+void mapjournal_onStateChange(color_ostream &out, state_change_event event) {
+    switch (event) {
+    case SC_MAP_LOADED:
+    case SC_MAP_UNLOADED:
+    case SC_WORLD_UNLOADED:
+    {
+        std::lock_guard<std::mutex> lock(journal_mutex);
+        journal = Journal();
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+uint32_t MapJournal::getGeneration() {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    if (!syncJournal(journal, true))
+        return 0;
+    return last_generation;
+}
+
+uint32_t MapJournal::getChangedBlocks(std::vector<df::coord> *blocks, uint32_t since, uint32_t aspects) {
+    CHECK_NULL_POINTER(blocks);
+    blocks->clear();
+
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    auto &j = journal;
+    if (!syncJournal(j, true))
+        return 0;
+
+    if (since < j.base) {
+        for (int32_t index = 0; index < int32_t(j.blocks.size()); index++)
+            if (j.blocks[index].present)
+                blocks->push_back(j.position(index));
+        return last_generation;
+    }
+
+    if (++j.stamp == 0) {
+        std::fill(j.seen.begin(), j.seen.end(), 0);
+        j.stamp = 1;
+    }
+    auto it = std::upper_bound(j.entries.begin(), j.entries.end(), since,
+        [](uint32_t generation, const Entry &entry) { return generation < entry.generation; });
+    for (; it != j.entries.end(); ++it) {
+        if (!(it->aspects & aspects) || j.seen[it->index] == j.stamp)
+            continue;
+        j.seen[it->index] = j.stamp;
+        blocks->push_back(j.position(it->index));
+    }
+    return last_generation;
+}
+
+uint32_t MapJournal::getBlockGeneration(df::coord block_pos, uint32_t aspects) {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    auto &j = journal;
+    if (!syncJournal(j, false) || !j.contains(block_pos))
+        return 0;
+
+    int32_t index = j.index(block_pos.x, block_pos.y, block_pos.z);
+    if (j.blocks[index].checked_update != Core::getInstance().getUpdateCount()) {
+        uint32_t generation = 0;
+        record(j, index, checkBlock(j, index), generation);
+        if (generation)
+            compactJournal(j);
+    }
+
+    uint32_t latest = 0;
+    auto &state = j.blocks[index];
+    for (int aspect = 0; aspect < ASPECTS; aspect++)
+        if (aspects & (1 << aspect))
+            latest = std::max(latest, state.generation[aspect]);
+    return latest;
+}
+
+void MapJournal::invalidate(df::coord pos, uint32_t aspects) {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    auto &j = journal;
+    df::coord block_pos(pos.x >> 4, pos.y >> 4, pos.z);
+    if (!j.built || !j.contains(block_pos))
+        return;
+    j.pending.push_back(std::make_pair(j.index(block_pos.x, block_pos.y, block_pos.z), aspects & ALL));
+}
@@ -0,0 +1,598 @@
+#include "Internal.h"
+
+#include "DataDefs.h"
+
+#include "modules/MapCache.h"
+#include "modules/MapSnapshot.h"
+#include "modules/Maps.h"
+
+#include "df/building.h"
+#include "df/map_block.h"
+#include "df/plant.h"
+#include "df/world.h"
+
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace DFHack;
+using namespace MapSnapshot;
+using df::global::world;
+
+static_assert(sizeof(FileHeader) == 72, "snapshot header layout");
+static_assert(sizeof(BlockEntry) == 8, "snapshot block entry layout");
+static_assert(sizeof(ColumnEntry) == 64, "snapshot column entry layout");
+static_assert(sizeof(ChunkEntry) == 32, "snapshot chunk entry layout");
+
+static const char MAGIC[8] = { 'D', 'F', 'H', 'K', 'S', 'N', 'A', 'P' };
+
+static bool fail(std::string *error, const std::string &message) {
+    if (error)
+        *error = message;
+    return false;
+}
+
+static uint64_t alignUp(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+static std::string columnName(const ColumnEntry &entry) {
+    return std::string(entry.name, strnlen(entry.name, sizeof(entry.name)));
+}
+
+static bool blockLess(const BlockEntry &a, const BlockEntry &b) {
+    if (a.z != b.z)
+        return a.z < b.z;
+    if (a.y != b.y)
+        return a.y < b.y;
+    return a.x < b.x;
+}
+
+/*
+ * Writer
+ */
+
+Writer::Writer(const Options &options) : options(options) {
+    this->options.chunk_blocks = std::max(this->options.chunk_blocks, 1u);
+    this->options.chunk_records = std::max(this->options.chunk_records, 1u);
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.header_size = sizeof(FileHeader);
+    header.chunk_blocks = this->options.chunk_blocks;
+    header.chunk_records = this->options.chunk_records;
+}
+
+bool Writer::open(const std::string &path, std::string *error) {
+    file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!file)
+        return fail(error, "cannot open " + path + " for writing");
+    // the header is written last, once the table offsets are known
+    end = sizeof(FileHeader);
+    return true;
+}
+
+void Writer::setMap(df::coord block_size, df::coord region) {
+    header.x_count_block = block_size.x;
+    header.y_count_block = block_size.y;
+    header.z_count_block = block_size.z;
+    header.region_x = region.x;
+    header.region_y = region.y;
+    header.region_z = region.z;
+}
+
+void Writer::addBlock(df::coord block_pos) {
+    BlockEntry entry = { block_pos.x, block_pos.y, block_pos.z, 0 };
+    blocks.push_back(entry);
+}
+
+int Writer::addColumn(const std::string &name, ColumnKind kind, uint32_t elem_size) {
+    Column column;
+    memset(&column.entry, 0, sizeof(column.entry));
+    strncpy(column.entry.name, name.c_str(), sizeof(column.entry.name) - 1);
+    column.entry.kind = kind;
+    column.entry.elem_size = elem_size;
+    columns.push_back(std::move(column));
+    return int(columns.size()) - 1;
+}
+
+void Writer::append(int index, const void *data, size_t count) {
+    auto &column = columns.at(index);
+    size_t rows = column.entry.kind == TILES ? options.chunk_blocks * TILES_PER_BLOCK : options.chunk_records;
+    size_t chunk_bytes = rows * column.entry.elem_size;
+    auto bytes = (const uint8_t *)data;
+    size_t remaining = count * column.entry.elem_size;
+    while (remaining) {
+        size_t take = std::min(remaining, chunk_bytes - column.buffer.size());
+        column.buffer.insert(column.buffer.end(), bytes, bytes + take);
+        bytes += take;
+        remaining -= take;
+        if (column.buffer.size() == chunk_bytes)
+            flush(column);
+    }
+    column.entry.count += count;
+}
+
+void Writer::writeAligned(const void *data, size_t size, uint64_t alignment, uint64_t *offset) {
+    *offset = alignUp(end, alignment);
+    file.seekp(std::streamoff(*offset));
+    file.write((const char *)data, size);
+    end = *offset + size;
+}
+
+void Writer::flush(Column &column) {
+    if (column.buffer.empty())
+        return;
+
+    ChunkEntry chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.raw_size = column.buffer.size();
+    chunk.codec = RAW;
+
+    std::vector<uint8_t> packed;
+    if (options.compress) {
+        uLongf packed_size = compressBound(uLong(column.buffer.size()));
+        packed.resize(packed_size);
+        if (compress2(packed.data(), &packed_size, column.buffer.data(), uLong(column.buffer.size()),
+                      options.level) == Z_OK && packed_size < column.buffer.size()) {
+            packed.resize(packed_size);
+            chunk.codec = ZLIB;
+        }
+    }
+
+    if (chunk.codec == ZLIB) {
+        chunk.stored_size = packed.size();
+        writeAligned(packed.data(), packed.size(), sizeof(uint64_t), &chunk.offset);
+    } else {
+        chunk.stored_size = column.buffer.size();
+        writeAligned(column.buffer.data(), column.buffer.size(), ALIGNMENT, &chunk.offset);
+    }
+    column.chunks.push_back(chunk);
+    column.buffer.clear();
+}
+
+bool Writer::finish(std::string *error) {
+    if (!file.is_open())
+        return fail(error, "snapshot file is not open");
+
+    for (auto &column : columns) {
+        if (column.entry.kind == TILES && column.entry.count != blocks.size() * TILES_PER_BLOCK)
+            return fail(error, std::string("column ") + column.entry.name + " does not have a value for every tile");
+        flush(column);
+    }
+
+    // the tables are read in place, so keep their entries aligned
+    end = alignUp(end, sizeof(uint64_t));
+    std::vector<ColumnEntry> entries;
+    for (auto &column : columns) {
+        column.entry.chunk_count = uint32_t(column.chunks.size());
+        file.seekp(std::streamoff(end));
+        column.entry.chunk_table_offset = end;
+        file.write((const char *)column.chunks.data(), column.chunks.size() * sizeof(ChunkEntry));
+        end += column.chunks.size() * sizeof(ChunkEntry);
+        entries.push_back(column.entry);
+    }
+
+    header.block_count = uint32_t(blocks.size());
+    header.block_table_offset = end;
+    file.seekp(std::streamoff(end));
+    file.write((const char *)blocks.data(), blocks.size() * sizeof(BlockEntry));
+    end += blocks.size() * sizeof(BlockEntry);
+
+    header.column_count = uint32_t(entries.size());
+    header.column_table_offset = end;
+    file.write((const char *)entries.data(), entries.size() * sizeof(ColumnEntry));
+    end += entries.size() * sizeof(ColumnEntry);
+
+    file.seekp(0);
+    file.write((const char *)&header, sizeof(header));
+    file.close();
+    if (file.fail())
+        return fail(error, "error writing the snapshot file");
+    return true;
+}
+
+/*
+ * Snapshot
+ */
+
+bool Snapshot::open(const std::string &path, std::string *error) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return fail(error, "cannot open " + path);
+    LARGE_INTEGER file_size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!view) {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return fail(error, "cannot map " + path);
+    }
+    file_handle = file;
+    map_handle = mapping;
+    data = (const uint8_t *)view;
+    size = uint64_t(file_size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return fail(error, "cannot open " + path);
+    struct stat st;
+    void *view = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        view = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return fail(error, "cannot map " + path);
+    data = (const uint8_t *)view;
+    size = uint64_t(st.st_size);
+#endif
+
+    std::string problem;
+    auto &h = header();
+    if (size < sizeof(FileHeader) || memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0)
+        problem = "not a map snapshot";
+    else if (h.version != VERSION)
+        problem = "unsupported snapshot version " + std::to_string(h.version);
+    else if (h.header_size < sizeof(FileHeader) || !h.chunk_blocks || !h.chunk_records ||
+             h.block_table_offset > size || (size - h.block_table_offset) / sizeof(BlockEntry) < h.block_count ||
+             h.column_table_offset > size || (size - h.column_table_offset) / sizeof(ColumnEntry) < h.column_count)
+        problem = "damaged snapshot header";
+    for (size_t i = 0; problem.empty() && i < h.column_count; i++) {
+        auto &entry = column(int(i));
+        if (entry.chunk_table_offset > size ||
+                (size - entry.chunk_table_offset) / sizeof(ChunkEntry) < entry.chunk_count || !entry.elem_size)
+            problem = "damaged snapshot column table";
+    }
+    if (!problem.empty()) {
+        close();
+        return fail(error, path + ": " + problem);
+    }
+    return true;
+}
+
+void Snapshot::close() {
+    inflated.clear();
+    if (!data)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(map_handle);
+    CloseHandle(file_handle);
+    map_handle = file_handle = NULL;
+#else
+    munmap((void *)data, size_t(size));
+#endif
+    data = NULL;
+    size = 0;
+}
+
+df::coord Snapshot::block(size_t index) const {
+    auto &entry = ((const BlockEntry *)(data + header().block_table_offset))[index];
+    return df::coord(entry.x, entry.y, entry.z);
+}
+
+int Snapshot::findBlock(df::coord block_pos) const {
+    auto begin = (const BlockEntry *)(data + header().block_table_offset);
+    auto end = begin + header().block_count;
+    BlockEntry key = { block_pos.x, block_pos.y, block_pos.z, 0 };
+    auto it = std::lower_bound(begin, end, key, blockLess);
+    if (it == end || it->x != key.x || it->y != key.y || it->z != key.z)
+        return -1;
+    return int(it - begin);
+}
+
+const ColumnEntry &Snapshot::column(int index) const {
+    return ((const ColumnEntry *)(data + header().column_table_offset))[index];
+}
+
+const ChunkEntry *Snapshot::chunks(int index) const {
+    return (const ChunkEntry *)(data + column(index).chunk_table_offset);
+}
+
+int Snapshot::findColumn(const std::string &name) const {
+    for (size_t i = 0; i < columnCount(); i++)
+        if (columnName(column(int(i))) == name)
+            return int(i);
+    return -1;
+}
+
+const uint8_t *Snapshot::chunk(int index, uint32_t chunk_index, size_t *chunk_size) {
+    auto &entry = column(index);
+    if (chunk_index >= entry.chunk_count)
+        return NULL;
+    auto &chunk = chunks(index)[chunk_index];
+    if (chunk.offset > size || size - chunk.offset < chunk.stored_size)
+        return NULL;
+
+    *chunk_size = size_t(chunk.raw_size);
+    if (chunk.codec == RAW)
+        return chunk.stored_size == chunk.raw_size ? data + chunk.offset : NULL;
+    if (chunk.codec != ZLIB)
+        return NULL;
+
+    auto &cached = inflated[index];
+    if (cached.second.empty() || cached.first != chunk_index) {
+        cached.second.resize(size_t(chunk.raw_size));
+        uLongf raw_size = uLongf(chunk.raw_size);
+        if (uncompress(cached.second.data(), &raw_size, data + chunk.offset, uLong(chunk.stored_size)) != Z_OK ||
+                raw_size != chunk.raw_size) {
+            cached.second.clear();
+            return NULL;
+        }
+        cached.first = chunk_index;
+    }
+    return cached.second.data();
+}
+
+const void *Snapshot::tiles(int index, size_t block) {
+    if (index < 0 || size_t(index) >= columnCount())
+        return NULL;
+    auto &entry = column(index);
+    if (entry.kind != TILES || block >= blockCount())
+        return NULL;
+    uint32_t per_chunk = header().chunk_blocks;
+    size_t block_bytes = TILES_PER_BLOCK * entry.elem_size;
+    size_t chunk_size = 0;
+    auto base = chunk(index, uint32_t(block / per_chunk), &chunk_size);
+    size_t offset = block % per_chunk * block_bytes;
+    if (!base || chunk_size < offset + block_bytes)
+        return NULL;
+    return base + offset;
+}
+
+bool Snapshot::readColumn(int index, std::vector<uint8_t> &out) {
+    out.clear();
+    if (index < 0 || size_t(index) >= columnCount())
+        return false;
+    auto &entry = column(index);
+    for (uint32_t i = 0; i < entry.chunk_count; i++) {
+        size_t chunk_size = 0;
+        auto base = chunk(index, i, &chunk_size);
+        if (!base)
+            return false;
+        out.insert(out.end(), base, base + chunk_size);
+    }
+    inflated.erase(index);
+    return out.size() == entry.count * entry.elem_size;
+}
+
+/*
+ * Saving the loaded map
+ */
+
+bool MapSnapshot::save(const std::string &path, const Options &options, std::string *error) {
+    if (!world || !Maps::IsValid())
+        return fail(error, "no map is loaded");
+
+    Writer writer(options);
+    if (!writer.open(path, error))
+        return false;
+
+    int32_t x_count, y_count, z_count;
+    Maps::getSize(x_count, y_count, z_count);
+    writer.setMap(df::coord(x_count, y_count, z_count),
+                  df::coord(world->map.region_x, world->map.region_y, world->map.region_z));
+
+    int tiletype = writer.addColumn("tiletype", TILES, sizeof(int16_t));
+    int designation = writer.addColumn("designation", TILES, sizeof(uint32_t));
+    int occupancy = writer.addColumn("occupancy", TILES, sizeof(uint32_t));
+    int base_mat_type = writer.addColumn("base_mat_type", TILES, sizeof(int16_t));
+    int base_mat_index = writer.addColumn("base_mat_index", TILES, sizeof(int32_t));
+    int vein_mat = writer.addColumn("vein_mat", TILES, sizeof(int16_t));
+    int temperature = writer.addColumn("temperature", TILES, sizeof(uint16_t));
+
+    MapExtras::MapCache cache;
+    int16_t mat_types[16][16], vein_mats[16][16];
+    int32_t mat_indexes[16][16];
+    for (int32_t z = 0; z < z_count; z++) {
+        for (int32_t y = 0; y < y_count; y++) {
+            for (int32_t x = 0; x < x_count; x++) {
+                auto block = Maps::getBlock(x, y, z);
+                if (!block)
+                    continue;
+                df::coord pos(x, y, z);
+                writer.addBlock(pos);
+                writer.append(tiletype, block->tiletype, TILES_PER_BLOCK);
+                writer.append(designation, block->designation, TILES_PER_BLOCK);
+                writer.append(occupancy, block->occupancy, TILES_PER_BLOCK);
+                writer.append(temperature, block->temperature_1, TILES_PER_BLOCK);
+
+                auto mblock = cache.BlockAt(pos);
+                for (int tx = 0; tx < 16; tx++) {
+                    for (int ty = 0; ty < 16; ty++) {
+                        auto mat = mblock ? mblock->baseMaterialAt(df::coord2d(tx, ty)) : t_matpair();
+                        mat_types[tx][ty] = mat.mat_type;
+                        mat_indexes[tx][ty] = mat.mat_index;
+                        vein_mats[tx][ty] = mblock ? mblock->veinMaterialAt(df::coord2d(tx, ty)) : -1;
+                    }
+                }
+                if (mblock)
+                    cache.discardBlock(mblock);
+                writer.append(base_mat_type, mat_types, TILES_PER_BLOCK);
+                writer.append(base_mat_index, mat_indexes, TILES_PER_BLOCK);
+                writer.append(vein_mat, vein_mats, TILES_PER_BLOCK);
+            }
+        }
+    }
+
+    std::vector<int16_t> plant_x, plant_y, plant_z, plant_material, plant_type;
+    for (auto plant : world->plants.all) {
+        plant_x.push_back(plant->pos.x);
+        plant_y.push_back(plant->pos.y);
+        plant_z.push_back(plant->pos.z);
+        plant_material.push_back(plant->material);
+        plant_type.push_back(int16_t(plant->type));
+    }
+    writer.append(writer.addColumn("plant_x", RECORDS, sizeof(int16_t)), plant_x.data(), plant_x.size());
+    writer.append(writer.addColumn("plant_y", RECORDS, sizeof(int16_t)), plant_y.data(), plant_y.size());
+    writer.append(writer.addColumn("plant_z", RECORDS, sizeof(int16_t)), plant_z.data(), plant_z.size());
+    writer.append(writer.addColumn("plant_material", RECORDS, sizeof(int16_t)), plant_material.data(), plant_material.size());
+    writer.append(writer.addColumn("plant_type", RECORDS, sizeof(int16_t)), plant_type.data(), plant_type.size());
+
+    std::vector<int32_t> building_id;
+    std::vector<int16_t> building_type, building_subtype, building_x1, building_y1, building_x2, building_y2, building_z;
+    for (auto bld : world->buildings.all) {
+        building_id.push_back(bld->id);
+        building_type.push_back(int16_t(bld->getType()));
+        building_subtype.push_back(int16_t(bld->getSubtype()));
+        building_x1.push_back(int16_t(bld->x1));
+        building_y1.push_back(int16_t(bld->y1));
+        building_x2.push_back(int16_t(bld->x2));
+        building_y2.push_back(int16_t(bld->y2));
+        building_z.push_back(int16_t(bld->z));
+    }
+    writer.append(writer.addColumn("building_id", RECORDS, sizeof(int32_t)), building_id.data(), building_id.size());
+    writer.append(writer.addColumn("building_type", RECORDS, sizeof(int16_t)), building_type.data(), building_type.size());
+    writer.append(writer.addColumn("building_subtype", RECORDS, sizeof(int16_t)), building_subtype.data(), building_subtype.size());
+    writer.append(writer.addColumn("building_x1", RECORDS, sizeof(int16_t)), building_x1.data(), building_x1.size());
+    writer.append(writer.addColumn("building_y1", RECORDS, sizeof(int16_t)), building_y1.data(), building_y1.size());
+    writer.append(writer.addColumn("building_x2", RECORDS, sizeof(int16_t)), building_x2.data(), building_x2.size());
+    writer.append(writer.addColumn("building_y2", RECORDS, sizeof(int16_t)), building_y2.data(), building_y2.size());
+    writer.append(writer.addColumn("building_z", RECORDS, sizeof(int16_t)), building_z.data(), building_z.size());
+
+    return writer.finish(error);
+}
+
+/*
+ * Comparing snapshots
+ */
+
+// the column of b with the same name, kind and value size as column index of a
+static int matchingColumn(Snapshot &a, int index, Snapshot &b) {
+    auto &entry = a.column(index);
+    int other = b.findColumn(columnName(entry));
+    if (other < 0 || b.column(other).kind != entry.kind || b.column(other).elem_size != entry.elem_size)
+        return -1;
+    return other;
+}
+
+static void diffTiles(Snapshot &a, int column_a, Snapshot &b, int column_b, ColumnDiff &out) {
+    size_t elem_size = a.column(column_a).elem_size;
+    size_t block_bytes = TILES_PER_BLOCK * elem_size;
+    for (size_t block = 0; block < a.blockCount(); block++) {
+        int other = b.findBlock(a.block(block));
+        if (other < 0)
+            continue;
+        auto tiles_a = (const uint8_t *)a.tiles(column_a, block);
+        auto tiles_b = (const uint8_t *)b.tiles(column_b, size_t(other));
+        if (!tiles_a || !tiles_b || memcmp(tiles_a, tiles_b, block_bytes) == 0)
+            continue;
+        out.changed_blocks++;
+        for (size_t tile = 0; tile < TILES_PER_BLOCK; tile++)
+            if (memcmp(tiles_a + tile * elem_size, tiles_b + tile * elem_size, elem_size) != 0)
+                out.changed_tiles++;
+    }
+}
+
+// reads the records of a table as key -> row bytes, using the given key
+// columns and every column the two files share
+static bool readTable(Snapshot &s, const std::vector<int> &columns, const std::vector<bool> &is_key,
+                      std::map<std::string, std::string> &rows) {
+    std::vector<std::vector<uint8_t>> values(columns.size());
+    uint64_t count = 0;
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (!s.readColumn(columns[i], values[i]))
+            return false;
+        uint64_t column_count = s.column(columns[i]).count;
+        if (i > 0 && column_count != count)
+            return false;
+        count = column_count;
+    }
+    for (uint64_t row = 0; row < count; row++) {
+        std::string key, data;
+        for (size_t i = 0; i < columns.size(); i++) {
+            size_t elem_size = s.column(columns[i]).elem_size;
+            auto value = (const char *)values[i].data() + row * elem_size;
+            if (is_key[i])
+                key.append(value, elem_size);
+            data.append(value, elem_size);
+        }
+        rows[key] = data;
+    }
+    return true;
+}
+
+bool MapSnapshot::diff(Snapshot &a, Snapshot &b, std::vector<ColumnDiff> &columns,
+                       std::vector<TableDiff> &tables, std::string *error) {
+    columns.clear();
+    tables.clear();
+    if (!a.isOpen() || !b.isOpen())
+        return fail(error, "snapshot is not open");
+    auto &ha = a.header(), &hb = b.header();
+    if (ha.x_count_block != hb.x_count_block || ha.y_count_block != hb.y_count_block ||
+            ha.z_count_block != hb.z_count_block || ha.region_x != hb.region_x ||
+            ha.region_y != hb.region_y || ha.region_z != hb.region_z)
+        return fail(error, "the snapshots are of different maps");
+
+    // the shared columns of each record table, in column order
+    std::map<std::string, std::vector<std::pair<int, int>>> table_columns;
+    for (size_t i = 0; i < a.columnCount(); i++) {
+        int other = matchingColumn(a, int(i), b);
+        if (other < 0)
+            continue;
+        auto &entry = a.column(int(i));
+        std::string name = columnName(entry);
+        if (entry.kind == TILES) {
+            ColumnDiff result;
+            result.name = name;
+            diffTiles(a, int(i), b, other, result);
+            columns.push_back(result);
+        } else if (entry.kind == RECORDS) {
+            table_columns[name.substr(0, name.find('_'))].push_back(std::make_pair(int(i), other));
+        }
+    }
+
+    for (auto &table : table_columns) {
+        const std::string &prefix = table.first;
+        std::vector<int> columns_a, columns_b;
+        std::vector<bool> is_key;
+        bool has_id = false;
+        for (auto &pair : table.second) {
+            std::string field = columnName(a.column(pair.first)).substr(prefix.size());
+            if (field == "_id")
+                has_id = true;
+            columns_a.push_back(pair.first);
+            columns_b.push_back(pair.second);
+        }
+        for (auto &pair : table.second) {
+            std::string field = columnName(a.column(pair.first)).substr(prefix.size());
+            is_key.push_back(has_id ? field == "_id" : field == "_x" || field == "_y" || field == "_z");
+        }
+
+        std::map<std::string, std::string> rows_a, rows_b;
+        if (!readTable(a, columns_a, is_key, rows_a) || !readTable(b, columns_b, is_key, rows_b))
+            continue;
+
+        TableDiff result;
+        result.name = prefix;
+        for (auto &row : rows_a) {
+            auto it = rows_b.find(row.first);
+            if (it == rows_b.end())
+                result.removed++;
+            else if (it->second != row.second)
+                result.changed++;
+        }
+        for (auto &row : rows_b)
+            if (!rows_a.count(row.first))
+                result.added++;
+        tables.push_back(result);
+    }
+    return true;
+}
@@ -32,9 +32,11 @@ distribution.
 #include "MemAccess.h"
 #include "MiscUtils.h"
 #include "ModuleFactory.h"
+#include "TileTypes.h"
 #include "VersionInfo.h"
 
 #include "modules/Buildings.h"
+#include "modules/Connectivity.h"
 #include "modules/MapCache.h"
 #include "modules/Maps.h"
 
@@ -68,7 +70,11 @@ distribution.
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
 #include <set>
+#include <unordered_map>
 #include <cstdlib>
 #include <iostream>
 
@@ -199,27 +205,16 @@ bool cuboid::containsPos(int16_t x, int16_t y, int16_t z) const {
 
 void cuboid::forCoord(std::function<bool(df::coord)> fn) const
 {
-    if (isValid()) // Only iterate if valid cuboid.
-        Maps::forCoord(fn, x_min, y_min, z_max, x_max, y_max, z_min);
+    forEachCoord(fn);
 }
 
 void cuboid::forBlock(std::function<bool(df::map_block *, cuboid)> fn, bool ensure_block) const
 {
-    auto c = *this; // Create a copy to modify.
-    if (!c.clampMap().isValid()) // No intersection.
-        return;
-
-    // Process z, y, then x.
-    for (int16_t x = (c.x_min >> 4) << 4; x <= c.x_max; x += 16)
-        for (int16_t y = (c.y_min >> 4) << 4; y <= c.y_max; y += 16)
-            for (int16_t z = c.z_max; z >= c.z_min; z--)
-            {
-                auto *block = ensure_block ? Maps::ensureTileBlock(x, y, z) : Maps::getTileBlock(x, y, z);
-                if (!block) // Skip unallocated block.
-                    continue;
-                else if (!fn(block, cuboid(block).clamp(c)))
-                    return; // Break iterator.
-            }
+    // Blocks are inside the map, so clamping to this is the same as clamping
+    // to its intersection with the map.
+    forBlockMask([&](df::map_block *block, const df::tile_bitmask &) {
+        return fn(block, cuboid(block).clamp(*this));
+    }, ensure_block);
 }
 
 /*
@@ -232,16 +227,7 @@ bool Maps::IsValid() {
 void Maps::forCoord(std::function<bool(df::coord)> fn, int16_t x1, int16_t y1, int16_t z1,
     int16_t x2, int16_t y2, int16_t z2)
 {
-    int16_t dx = x1 > x2 ? -1 : 1;
-    int16_t dy = y1 > y2 ? -1 : 1;
-    int16_t dz = z1 > z2 ? -1 : 1;
-
-    // Process z, y, then x.
-    for (int16_t x = x1; x != x2 + dx; x += dx)
-        for (int16_t y = y1; y != y2 + dy; y += dy)
-            for (int16_t z = z1; z != z2 + dz; z += dz)
-                if (!fn(df::coord(x, y, z)))
-                    return; // Break iterator.
+    forEachCoord(fn, x1, y1, z1, x2, y2, z2);
 }
 
 // getter for map size in blocks
@@ -899,9 +885,591 @@ bool Maps::canStepBetween(df::coord pos1, df::coord pos2)
     return false;
 }
 
+uint64_t Maps::getBlockPathSignature(const df::map_block *block)
+{
+    CHECK_NULL_POINTER(block);
+    uint64_t hash = 14695981039346656037ULL;
+    for (int x = 0; x < 16; x++) {
+        for (int y = 0; y < 16; y++) {
+            uint64_t v = uint16_t(block->tiletype[x][y]) |
+                (uint64_t(block->walkable[x][y] != 0) << 16) |
+                (uint64_t(block->designation[x][y].bits.flow_size >= 4) << 17) |
+                (uint64_t(block->occupancy[x][y].bits.building) << 18);
+            hash = (hash ^ v) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+/*
+* Pathfinding
+*/
+
+Maps::PathMover Maps::PathMover::walker()
+{
+    PathMover mover;
+    mover.name = "walker";
+    mover.canStand = [](df::coord pos) { return Connectivity::canStand(pos, Connectivity::WALKER); };
+    mover.canStep = canStepBetween;
+    mover.mayReach = [](df::coord a, df::coord b) { return Connectivity::canReach(a, b, Connectivity::WALKER); };
+    return mover;
+}
+
+Maps::PathMover Maps::PathMover::wagon()
+{
+    PathMover mover;
+    mover.name = "wagon";
+    mover.canStand = [](df::coord pos) { return Connectivity::canStand(pos, Connectivity::WAGON); };
+    mover.canStep = [](df::coord a, df::coord b) {
+        int dx = abs(b.x - a.x), dy = abs(b.y - a.y);
+        if (dx + dy != 1)
+            return false;
+        return a.z == b.z || canStepBetween(a, b);
+    };
+    mover.mayReach = [](df::coord a, df::coord b) { return Connectivity::canReach(a, b, Connectivity::WAGON); };
+    return mover;
+}
+
+Maps::PathMover Maps::PathMover::flier()
+{
+    PathMover mover;
+    mover.name = "flier";
+    mover.canStand = [](df::coord pos) {
+        auto block = getTileBlock(pos);
+        if (!block)
+            return false;
+        auto tt = index_tile(block->tiletype, pos);
+        auto shape = tileShape(tt);
+        if (shape == tiletype_shape::NONE || tileShapeBasic(shape) == tiletype_shape_basic::Wall)
+            return false;
+        if (index_tile(block->designation, pos).bits.flow_size >= 4)
+            return false;
+        auto occ = index_tile(block->occupancy, pos).bits.building;
+        return occ != tile_building_occ::Impassable && occ != tile_building_occ::Obstacle &&
+            occ != tile_building_occ::Well;
+    };
+    mover.canStep = [](df::coord a, df::coord b) {
+        if (a.z == b.z)
+            return true;
+        if (a.x == b.x && a.y == b.y) {
+            // through the floor of the upper tile
+            df::coord up = a.z > b.z ? a : b;
+            auto block = getTileBlock(up);
+            if (!block || index_tile(block->occupancy, up).bits.building == tile_building_occ::Floored)
+                return false;
+            auto shape = tileShape(index_tile(block->tiletype, up));
+            if (tileShapeBasic(shape) == tiletype_shape_basic::Open || shape == tiletype_shape::RAMP_TOP ||
+                    shape == tiletype_shape::STAIR_DOWN || shape == tiletype_shape::STAIR_UPDOWN)
+                return true;
+        }
+        return canStepBetween(a, b);
+    };
+    return mover;
+}
+
+/*
+ * Hierarchical A* (HPA*) with each map block as a cluster.
+ *
+ * Where two clusters touch, the pairs of tiles that a mover can step between
+ * are the transitions. Transitions that are next to each other on both sides
+ * form a group, and the middle one of each group links an entrance tile on
+ * each side. Both clusters work out the groups the same way, so their links
+ * always match. Within a cluster, the distances between its entrances are
+ * found with a breadth first search that stays inside the cluster. A path is
+ * found by A* over the entrances and filled in with searches within single
+ * clusters.
+ *
+ * Cluster data is cached per mover and rebuilt when the signature of the
+ * cluster's block or one of the blocks around it changes, which is checked at
+ * most once per tick for each cluster that a search reaches.
+ */
+namespace {
+    struct PathCluster {
+        bool built = false;
+        int32_t checked_frame = -1;
+        uint64_t signature = 0; // of the block and the blocks around it
+        vector<uint8_t> nodes;  // entrance tiles, as x << 4 | y
+        int16_t node_at[256];
+        // per entrance: (entrance, distance) pairs within the cluster, and
+        // keys of the entrances linked to it in other clusters
+        vector<vector<std::pair<uint8_t, int32_t>>> intra;
+        vector<vector<uint64_t>> links;
+    };
+
+    struct PathCache {
+        vector<std::unique_ptr<PathCluster>> clusters;
+    };
+
+    struct PathGrid {
+        int32_t x_count = 0, y_count = 0, z_count = 0; // in blocks
+        vector<uint64_t> signatures;
+        vector<int32_t> signature_frames;
+        std::unordered_map<string, PathCache> caches;
+
+        int32_t index(int32_t bx, int32_t by, int32_t bz) const {
+            return (bz * y_count + by) * x_count + bx;
+        }
+        void position(int32_t index, int32_t &bx, int32_t &by, int32_t &bz) const {
+            bx = index % x_count;
+            by = index / x_count % y_count;
+            bz = index / x_count / y_count;
+        }
+    };
+
+    // an entrance: the cluster index followed by the tile
+    inline uint64_t pathKey(int32_t cluster, uint8_t tile) {
+        return (uint64_t(cluster) << 8) | tile;
+    }
+
+    struct PathOpen {
+        int32_t f, g;
+        uint64_t key;
+        bool operator>(const PathOpen &other) const {
+            return f != other.f ? f > other.f : g < other.g;
+        }
+    };
+}
+
+static std::mutex path_mutex;
+static PathGrid path_grid;
+
+static df::coord clusterOrigin(const PathGrid &grid, int32_t cluster) {
+    int32_t bx, by, bz;
+    grid.position(cluster, bx, by, bz);
+    return df::coord(bx * 16, by * 16, bz);
+}
+
+static df::coord pathKeyPos(const PathGrid &grid, uint64_t key) {
+    df::coord origin = clusterOrigin(grid, int32_t(key >> 8));
+    return df::coord(origin.x + ((key >> 4) & 15), origin.y + (key & 15), origin.z);
+}
+
+static uint64_t blockSignatureThisTick(PathGrid &grid, int32_t index) {
+    if (grid.signature_frames[index] != world->frame_counter) {
+        int32_t bx, by, bz;
+        grid.position(index, bx, by, bz);
+        auto block = Maps::getBlock(bx, by, bz);
+        grid.signatures[index] = block ? Maps::getBlockPathSignature(block) : 0;
+        grid.signature_frames[index] = world->frame_counter;
+    }
+    return grid.signatures[index];
+}
+
+template<typename F>
+static void forClusterNeighbors(const PathGrid &grid, int32_t index, F fn) {
+    int32_t bx, by, bz;
+    grid.position(index, bx, by, bz);
+    for (int32_t z = std::max(bz - 1, 0); z <= std::min(bz + 1, grid.z_count - 1); z++)
+        for (int32_t y = std::max(by - 1, 0); y <= std::min(by + 1, grid.y_count - 1); y++)
+            for (int32_t x = std::max(bx - 1, 0); x <= std::min(bx + 1, grid.x_count - 1); x++)
+                fn(grid.index(x, y, z));
+}
+
+static void clusterStand(const Maps::PathMover &mover, df::coord origin, bool stand[256]) {
+    for (int tile = 0; tile < 256; tile++)
+        stand[tile] = mover.canStand(df::coord(origin.x + (tile >> 4), origin.y + (tile & 15), origin.z));
+}
+
+// breadth first search from start over the tiles of one cluster
+static void clusterSearch(const Maps::PathMover &mover, df::coord origin, const bool stand[256],
+                          uint8_t start, int16_t dist[256], uint8_t parent[256]) {
+    std::fill(dist, dist + 256, int16_t(-1));
+    uint8_t queue[256];
+    int head = 0, tail = 0;
+    dist[start] = 0;
+    parent[start] = start;
+    queue[tail++] = start;
+    while (head < tail) {
+        uint8_t tile = queue[head++];
+        int x = tile >> 4, y = tile & 15;
+        df::coord pos(origin.x + x, origin.y + y, origin.z);
+        for (int dx = -1; dx <= 1; dx++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                int nx = x + dx, ny = y + dy;
+                if ((!dx && !dy) || nx < 0 || ny < 0 || nx > 15 || ny > 15)
+                    continue;
+                uint8_t next = uint8_t(nx << 4 | ny);
+                if (dist[next] >= 0 || !stand[next])
+                    continue;
+                if (!mover.canStep(pos, df::coord(origin.x + nx, origin.y + ny, origin.z)))
+                    continue;
+                dist[next] = dist[tile] + 1;
+                parent[next] = tile;
+                queue[tail++] = next;
+            }
+        }
+    }
+}
+
+// Appends the path from one tile of a cluster to another, not including the
+// first tile. The parents must come from a search started at the first tile.
+static void appendClusterPath(df::coord origin, const uint8_t parent[256], uint8_t from, uint8_t to,
+                              vector<df::coord> &path) {
+    size_t start = path.size();
+    for (uint8_t tile = to; tile != from; tile = parent[tile])
+        path.emplace_back(origin.x + (tile >> 4), origin.y + (tile & 15), origin.z);
+    std::reverse(path.begin() + start, path.end());
+}
+
+// The transitions between two clusters, grouped, as (tile in a, tile in b)
+// pairs of the middle transition of each group. Gives the same answer
+// whichever of the two clusters asks.
+static void clusterLinks(const Maps::PathMover &mover, const PathGrid &grid, int32_t a, int32_t b,
+                         vector<std::pair<uint8_t, uint8_t>> &out) {
+    out.clear();
+    df::coord oa = clusterOrigin(grid, a), ob = clusterOrigin(grid, b);
+    int ox = (ob.x - oa.x) / 16, oy = (ob.y - oa.y) / 16, oz = ob.z - oa.z;
+
+    bool stand_a[256], stand_b[256];
+    clusterStand(mover, oa, stand_a);
+    clusterStand(mover, ob, stand_b);
+
+    vector<std::pair<uint8_t, uint8_t>> transitions;
+    for (int dx = -1; dx <= 1; dx++) {
+        if (ox && dx != ox)
+            continue;
+        for (int dy = -1; dy <= 1; dy++) {
+            if ((oy && dy != oy) || (!dx && !dy && !oz))
+                continue;
+            int x1 = ox ? (ox > 0 ? 15 : 0) : std::max(0, -dx);
+            int x2 = ox ? x1 : std::min(15, 15 - dx);
+            int y1 = oy ? (oy > 0 ? 15 : 0) : std::max(0, -dy);
+            int y2 = oy ? y1 : std::min(15, 15 - dy);
+            for (int x = x1; x <= x2; x++) {
+                for (int y = y1; y <= y2; y++) {
+                    df::coord pa(oa.x + x, oa.y + y, oa.z);
+                    df::coord pb(pa.x + dx, pa.y + dy, pa.z + oz);
+                    uint8_t ta = uint8_t(x << 4 | y);
+                    uint8_t tb = uint8_t((pb.x - ob.x) << 4 | (pb.y - ob.y));
+                    if (stand_a[ta] && stand_b[tb] && mover.canStep(pa, pb))
+                        transitions.emplace_back(ta, tb);
+                }
+            }
+        }
+    }
+    std::sort(transitions.begin(), transitions.end());
+
+    auto adjacent = [](uint8_t t1, uint8_t t2) {
+        return abs((t1 >> 4) - (t2 >> 4)) <= 1 && abs((t1 & 15) - (t2 & 15)) <= 1;
+    };
+    vector<int> group(transitions.size(), -1);
+    int groups = 0;
+    for (size_t i = 0; i < transitions.size(); i++) {
+        for (size_t j = 0; j < i && group[i] < 0; j++) {
+            if (adjacent(transitions[i].first, transitions[j].first) &&
+                    adjacent(transitions[i].second, transitions[j].second))
+                group[i] = group[j];
+        }
+        if (group[i] < 0)
+            group[i] = groups++;
+    }
+    for (int g = 0; g < groups; g++) {
+        vector<size_t> members;
+        for (size_t i = 0; i < transitions.size(); i++)
+            if (group[i] == g)
+                members.push_back(i);
+        out.push_back(transitions[members[members.size() / 2]]);
+    }
+}
+
+static void buildCluster(const Maps::PathMover &mover, const PathGrid &grid, int32_t index, PathCluster &cluster) {
+    cluster.nodes.clear();
+    cluster.intra.clear();
+    cluster.links.clear();
+    std::fill(cluster.node_at, cluster.node_at + 256, int16_t(-1));
+    cluster.built = true;
+
+    vector<std::pair<uint8_t, uint8_t>> links;
+    forClusterNeighbors(grid, index, [&](int32_t other) {
+        if (other == index)
+            return;
+        bool first = index < other;
+        clusterLinks(mover, grid, first ? index : other, first ? other : index, links);
+        for (auto &link : links) {
+            uint8_t mine = first ? link.first : link.second;
+            uint8_t theirs = first ? link.second : link.first;
+            if (cluster.node_at[mine] < 0) {
+                cluster.node_at[mine] = int16_t(cluster.nodes.size());
+                cluster.nodes.push_back(mine);
+                cluster.links.emplace_back();
+            }
+            cluster.links[cluster.node_at[mine]].push_back(pathKey(other, theirs));
+        }
+    });
+
+    df::coord origin = clusterOrigin(grid, index);
+    bool stand[256];
+    clusterStand(mover, origin, stand);
+    int16_t dist[256];
+    uint8_t parent[256];
+    cluster.intra.resize(cluster.nodes.size());
+    for (size_t i = 0; i < cluster.nodes.size(); i++) {
+        clusterSearch(mover, origin, stand, cluster.nodes[i], dist, parent);
+        for (size_t j = 0; j < cluster.nodes.size(); j++) {
+            if (i != j && dist[cluster.nodes[j]] >= 0)
+                cluster.intra[i].emplace_back(uint8_t(j), dist[cluster.nodes[j]]);
+        }
+    }
+}
+
+static PathCluster &getCluster(const Maps::PathMover &mover, PathCache &cache, int32_t index) {
+    auto &cluster = cache.clusters[index];
+    if (!cluster)
+        cluster.reset(new PathCluster());
+    if (cluster->built && cluster->checked_frame == world->frame_counter)
+        return *cluster;
+
+    uint64_t signature = 14695981039346656037ULL;
+    forClusterNeighbors(path_grid, index, [&](int32_t n) {
+        signature = (signature ^ blockSignatureThisTick(path_grid, n)) * 1099511628211ULL;
+    });
+    cluster->checked_frame = world->frame_counter;
+    if (!cluster->built || cluster->signature != signature) {
+        buildCluster(mover, path_grid, index, *cluster);
+        cluster->signature = signature;
+    }
+    return *cluster;
+}
+
+static bool syncPathGrid() {
+    if (!world || !Maps::IsValid()) {
+        path_grid = PathGrid();
+        return false;
+    }
+    int32_t x_count = world->map.x_count_block;
+    int32_t y_count = world->map.y_count_block;
+    int32_t z_count = world->map.z_count_block;
+    if (path_grid.x_count != x_count || path_grid.y_count != y_count || path_grid.z_count != z_count) {
+        path_grid = PathGrid();
+        path_grid.x_count = x_count;
+        path_grid.y_count = y_count;
+        path_grid.z_count = z_count;
+        path_grid.signatures.resize(x_count * y_count * z_count);
+        path_grid.signature_frames.assign(x_count * y_count * z_count, -1);
+    }
+    return true;
+}
+
+bool Maps::findPath(df::coord from, df::coord to, vector<df::coord> &path, const PathMover &mover)
+{
+    path.clear();
+    std::lock_guard<std::mutex> lock(path_mutex);
+    if (!syncPathGrid() || !isValidTilePos(from) || !isValidTilePos(to))
+        return false;
+    if (!mover.canStand(from) || !mover.canStand(to))
+        return false;
+    if (from == to) {
+        path.push_back(from);
+        return true;
+    }
+    if (mover.mayReach && !mover.mayReach(from, to))
+        return false;
+
+    auto &grid = path_grid;
+    auto &cache = grid.caches[mover.name];
+    if (cache.clusters.empty())
+        cache.clusters.resize(grid.signatures.size());
+
+    int32_t src = grid.index(from.x >> 4, from.y >> 4, from.z);
+    int32_t dst = grid.index(to.x >> 4, to.y >> 4, to.z);
+    uint8_t src_tile = uint8_t((from.x & 15) << 4 | (from.y & 15));
+    uint8_t dst_tile = uint8_t((to.x & 15) << 4 | (to.y & 15));
+    df::coord src_origin = clusterOrigin(grid, src), dst_origin = clusterOrigin(grid, dst);
+
+    bool src_stand[256], dst_stand[256];
+    int16_t src_dist[256], dst_dist[256];
+    uint8_t src_parent[256], dst_parent[256];
+    clusterStand(mover, src_origin, src_stand);
+    clusterSearch(mover, src_origin, src_stand, src_tile, src_dist, src_parent);
+    path.push_back(from);
+    if (src == dst && src_dist[dst_tile] >= 0) {
+        appendClusterPath(src_origin, src_parent, src_tile, dst_tile, path);
+        return true;
+    }
+    clusterStand(mover, dst_origin, dst_stand);
+    clusterSearch(mover, dst_origin, dst_stand, dst_tile, dst_dist, dst_parent);
+
+    // A* over the entrances; the goal gets a key of its own
+    const uint64_t START = UINT64_MAX - 1, GOAL = UINT64_MAX;
+    std::unordered_map<uint64_t, std::pair<int32_t, uint64_t>> best; // key -> (g, parent)
+    std::priority_queue<PathOpen, vector<PathOpen>, std::greater<PathOpen>> open;
+    auto heuristic = [&](uint64_t key) {
+        if (key == GOAL)
+            return 0;
+        df::coord pos = pathKeyPos(grid, key);
+        return std::max({ abs(pos.x - to.x), abs(pos.y - to.y), abs(pos.z - to.z) });
+    };
+    auto relax = [&](uint64_t key, int32_t g, uint64_t parent) {
+        auto it = best.find(key);
+        if (it != best.end() && it->second.first <= g)
+            return;
+        best[key] = std::make_pair(g, parent);
+        open.push({ g + heuristic(key), g, key });
+    };
+
+    auto &start_cluster = getCluster(mover, cache, src);
+    for (uint8_t tile : start_cluster.nodes) {
+        if (src_dist[tile] >= 0)
+            relax(pathKey(src, tile), src_dist[tile], START);
+    }
+
+    bool found = false;
+    while (!open.empty()) {
+        PathOpen entry = open.top();
+        open.pop();
+        if (entry.key == GOAL) {
+            found = true;
+            break;
+        }
+        if (entry.g > best[entry.key].first)
+            continue;
+        int32_t index = int32_t(entry.key >> 8);
+        uint8_t tile = uint8_t(entry.key & 255);
+        auto &cluster = getCluster(mover, cache, index);
+        int16_t node = cluster.node_at[tile];
+        if (node < 0)
+            continue; // the cluster was rebuilt and this is no longer an entrance
+        if (index == dst && dst_dist[tile] >= 0)
+            relax(GOAL, entry.g + dst_dist[tile], entry.key);
+        for (auto &edge : cluster.intra[node])
+            relax(pathKey(index, cluster.nodes[edge.first]), entry.g + edge.second, entry.key);
+        for (uint64_t link : cluster.links[node])
+            relax(link, entry.g + 1, entry.key);
+    }
+    if (!found) {
+        path.clear();
+        return false;
+    }
+
+    vector<uint64_t> keys;
+    for (uint64_t key = best[GOAL].second; key != START; key = best[key].second)
+        keys.push_back(key);
+    std::reverse(keys.begin(), keys.end());
+
+    // fill in the steps within clusters
+    appendClusterPath(src_origin, src_parent, src_tile, uint8_t(keys.front() & 255), path);
+    bool stand[256];
+    int16_t dist[256];
+    uint8_t parent[256];
+    for (size_t i = 1; i < keys.size(); i++) {
+        int32_t index = int32_t(keys[i] >> 8);
+        if (index != int32_t(keys[i - 1] >> 8)) {
+            path.push_back(pathKeyPos(grid, keys[i]));
+            continue;
+        }
+        df::coord origin = clusterOrigin(grid, index);
+        uint8_t start = uint8_t(keys[i - 1] & 255);
+        clusterStand(mover, origin, stand);
+        clusterSearch(mover, origin, stand, start, dist, parent);
+        appendClusterPath(origin, parent, start, uint8_t(keys[i] & 255), path);
+    }
+    // the search from the goal gives the parents toward the goal, so walk
+    // them forward from the last entrance
+    for (uint8_t tile = uint8_t(keys.back() & 255); tile != dst_tile; ) {
+        tile = dst_parent[tile];
+        path.emplace_back(dst_origin.x + (tile >> 4), dst_origin.y + (tile & 15), dst_origin.z);
+    }
+    return true;
+}
+
+void Maps::invalidatePaths(df::coord pos)
+{
+    std::lock_guard<std::mutex> lock(path_mutex);
+    auto &grid = path_grid;
+    if (pos.x < 0 || pos.y < 0 || pos.z < 0 || pos.x >= grid.x_count * 16 ||
+            pos.y >= grid.y_count * 16 || pos.z >= grid.z_count)
+        return;
+    int32_t index = grid.index(pos.x >> 4, pos.y >> 4, pos.z);
+    grid.signature_frames[index] = -1;
+    for (auto &entry : grid.caches) {
+        auto &clusters = entry.second.clusters;
+        forClusterNeighbors(grid, index, [&](int32_t n) {
+            if (clusters[n])
+                clusters[n]->checked_frame = -1;
+        });
+    }
+}
+
 /*
 * Plants
 */
+
+/*
+ * Tile -> plant index, one per 48x48 map block column (a mid level tile).
+ * Each index holds every tile occupied by the column's plants, including the
+ * non-blocked body and root tiles of trees. The first plant in the column's
+ * plant vector wins a tile, which is the plant a scan of the vector would
+ * find first.
+ *
+ * An index is rebuilt when it is next used after the column's plant vector
+ * has changed or the game has advanced a tick, since trees grow without
+ * being added to or removed from the vector.
+ */
+namespace {
+    struct PlantColumnIndex
+    {
+        df::plant * const *plants_data = NULL;
+        size_t plants_size = 0;
+        df::plant *plants_front = NULL;
+        df::plant *plants_back = NULL;
+        int32_t frame = -1;
+        std::unordered_map<uint32_t, df::plant *> tiles;
+    };
+}
+
+static std::mutex plant_index_mutex;
+static std::unordered_map<df::map_block_column *, PlantColumnIndex> plant_index;
+
+// x and y are relative to the column
+static uint32_t plantTileKey(int32_t x, int32_t y, int32_t z)
+{
+    return (uint32_t(z) << 12) | uint32_t(y * 48 + x);
+}
+
+static void indexPlantTile(PlantColumnIndex &index, df::plant *plant, int32_t x, int32_t y, int32_t z)
+{
+    // Trees never cross MLT borders
+    if (x < 0 || x >= 48 || y < 0 || y >= 48 || z < 0)
+        return;
+    index.tiles.emplace(plantTileKey(x, y, z), plant);
+}
+
+static void buildPlantIndex(PlantColumnIndex &index, df::map_block_column *mbc)
+{
+    index.tiles.clear();
+    for (auto plant : mbc->plants)
+    {
+        int32_t px = plant->pos.x % 48;
+        int32_t py = plant->pos.y % 48;
+        indexPlantTile(index, plant, px, py, plant->pos.z);
+        if (!plant->tree_info)
+            continue;
+
+        auto &t = *(plant->tree_info);
+        for (int32_t y_index = 0; y_index < t.dim_y; y_index++)
+        {
+            for (int32_t x_index = 0; x_index < t.dim_x; x_index++)
+            {
+                int32_t x = px - (t.dim_x / 2) + x_index;
+                int32_t y = py - (t.dim_y / 2) + y_index;
+                int32_t idx = x_index + y_index * t.dim_x;
+                for (int32_t z_dis = 0; z_dis < t.body_height; z_dis++)
+                    if ((t.body[z_dis][idx].whole & 0x7F) != 0) // Any non-blocked
+                        indexPlantTile(index, plant, x, y, plant->pos.z + z_dis);
+                for (int32_t depth = 0; depth < t.roots_depth; depth++)
+                    if ((t.roots[depth][idx].whole & 0x7F) != 0) // Any non-blocked
+                        indexPlantTile(index, plant, x, y, plant->pos.z - 1 - depth);
+            }
+        }
+    }
+
+    index.plants_data = mbc->plants.data();
+    index.plants_size = mbc->plants.size();
+    index.plants_front = mbc->plants.empty() ? NULL : mbc->plants.front();
+    index.plants_back = mbc->plants.empty() ? NULL : mbc->plants.back();
+    index.frame = world->frame_counter;
+}
+
 df::plant *Maps::getPlantAtTile(int32_t x, int32_t y, int32_t z)
 {
     if (x < 0 || x >= world->map.x_count || y < 0 || y >= world->map.y_count || !world->map.column_index)
@@ -911,33 +1479,36 @@ df::plant *Maps::getPlantAtTile(int32_t x, int32_t y, int32_t z)
     if (!mbc)
         return NULL;
 
-    for (auto plant : mbc->plants)
+    std::lock_guard<std::mutex> lock(plant_index_mutex);
+    auto &index = plant_index[mbc];
+    auto &plants = mbc->plants;
+    if (index.frame != world->frame_counter ||
+        index.plants_data != plants.data() ||
+        index.plants_size != plants.size() ||
+        (!plants.empty() && (index.plants_front != plants.front() || index.plants_back != plants.back())))
     {
-        if (plant->pos.x == x && plant->pos.y == y && plant->pos.z == z)
-            return plant;
-        else if (!plant->tree_info)
-            continue;
+        buildPlantIndex(index, mbc);
+    }
 
-        auto &t = *(plant->tree_info);
-        // Trees never cross MLT borders
-        int x_index = (t.dim_x / 2) - (plant->pos.x % 48) + (x % 48);
-        int y_index = (t.dim_y / 2) - (plant->pos.y % 48) + (y % 48);
-        int z_dis = z - plant->pos.z;
-        if (x_index < 0 || x_index >= t.dim_x || y_index < 0 || y_index >= t.dim_y || z_dis >= t.body_height)
-            continue;
+    auto it = index.tiles.find(plantTileKey(x % 48, y % 48, z));
+    return it == index.tiles.end() ? NULL : it->second;
+}
 
-        if (z_dis < 0)
-        {
-            if (z_dis < -(t.roots_depth))
-                continue;
-            else if ((t.roots[-1 - z_dis][x_index + y_index * t.dim_x].whole & 0x7F) != 0) // Any non-blocked
-                return plant;
-        }
-        else if ((t.body[z_dis][x_index + y_index * t.dim_x].whole & 0x7F) != 0) // Any non-blocked
-            return plant;
+void maps_onStateChange(color_ostream &out, state_change_event event)
+{
+    switch (event) {
+    case SC_MAP_UNLOADED:
+    case SC_WORLD_UNLOADED:
+    {
+        std::lock_guard<std::mutex> lock(plant_index_mutex);
+        plant_index.clear();
+        std::lock_guard<std::mutex> path_lock(path_mutex);
+        path_grid = PathGrid();
+        break;
+    }
+    default:
+        break;
     }
-
-    return NULL;
 }
 
 /*
@@ -1172,16 +1743,15 @@ int Maps::setAreaAquifer(df::coord pos1, df::coord pos2, bool heavy, std::functi
     cuboid bounds(pos1, pos2);
 
     // Loop through the affected blocks
-    bounds.forBlock([&](df::map_block *block, cuboid intersect) {
+    bounds.forBlockMask([&](df::map_block *block, const df::tile_bitmask &mask) {
         int blockAffectedCount = 0;
         // Loop through the affected tiles in the block
-        intersect.forCoord([&](df::coord pos) {
-            if (filter(pos, block)) {
+        forMaskTiles(mask, [&](int tx, int ty) {
+            if (filter(block->map_pos + df::coord(tx, ty, 0), block)) {
                 blockAffectedCount++;
-                block->designation[pos.x&15][pos.y&15].bits.water_table = true;
-                block->occupancy[pos.x&15][pos.y&15].bits.heavy_aquifer = heavy;
+                block->designation[tx][ty].bits.water_table = true;
+                block->occupancy[tx][ty].bits.heavy_aquifer = heavy;
             }
-            return true; // Keep iterating tiles
         });
 
         // If any tile was set to be an aquifer, update the block
@@ -1232,26 +1802,25 @@ int Maps::removeAreaAquifer(df::coord pos1, df::coord pos2, std::function<bool(d
     cuboid bounds(pos1, pos2);
 
     // Loop through the affected blocks
-    bounds.forBlock([&](df::map_block *block, cuboid intersect) {
+    bounds.forBlockMask([&](df::map_block *block, const df::tile_bitmask &mask) {
         int blockAffectedCount = 0;
         int aquiferCount = 0;
-        cuboid block_bounds(block);
 
         // Loop through all tiles in the block
-        block_bounds.forCoord([&](df::coord pos) {
-            auto &des = block->designation[pos.x&15][pos.y&15];
-            if (des.bits.water_table) {
-                if (intersect.containsPos(pos) && filter(pos, block)) {
+        for (int tx = 0; tx < 16; tx++) {
+            for (int ty = 0; ty < 16; ty++) {
+                auto &des = block->designation[tx][ty];
+                if (!des.bits.water_table)
+                    continue;
+                if ((mask.bits[ty] & (1 << tx)) && filter(block->map_pos + df::coord(tx, ty, 0), block)) {
                     blockAffectedCount++;
                     des.bits.water_table = false;
-                    block->occupancy[pos.x&15][pos.y&15].bits.heavy_aquifer = false;
+                    block->occupancy[tx][ty].bits.heavy_aquifer = false;
                 }
                 else
                     aquiferCount++;
             }
-
-            return true; // Keep iterating tiles
-        });
+        }
 
         // If none of the block's tiles are now aquifers, update the block
         if (aquiferCount == 0) {
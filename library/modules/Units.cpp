@@ -92,6 +92,7 @@ distribution.
 #include <cstring>
 #include <functional>
 #include <map>
+#include <mutex>
 #include <numeric>
 #include <stddef.h>
 #include <string>
@@ -671,17 +672,177 @@ bool Units::isUnitInBox(df::unit *u, const cuboid &box) {
     return box.containsPos(getPosition(u));
 }
 
+/*
+ * Spatial index of the active units, for box, radius, and nearest unit
+ * queries. Units are sorted by the 16x16 cell (per z-level) that contains
+ * their position (caged units use their cage's position), so the units in a
+ * row of cells are a contiguous range found by binary search. The index is
+ * built on the first query of each tick and whenever the active unit vector
+ * has changed since; Units::teleport also invalidates it.
+ */
+namespace {
+    struct UnitIndexEntry {
+        uint64_t key;
+        df::coord pos;
+        size_t active_index; // results keep the order of the active vector
+        df::unit *unit;
+
+        bool operator<(const UnitIndexEntry &other) const {
+            return key < other.key || (key == other.key && active_index < other.active_index);
+        }
+    };
+
+    struct UnitIndex {
+        vector<UnitIndexEntry> entries;
+        // bounds of the indexed positions
+        df::coord min_pos, max_pos;
+        int32_t frame = -1;
+        df::unit * const *active_data = NULL;
+        size_t active_size = 0;
+        bool dirty = true;
+    };
+}
+
+static const int UNIT_CELL_SHIFT = 4;
+
+static std::mutex unit_index_mutex;
+static UnitIndex unit_index;
+
+static uint64_t unitCellKey(int32_t cx, int32_t cy, int32_t z) {
+    // offset so that negative coordinates keep their order
+    return (uint64_t(z + 0x8000) << 32) | (uint64_t(cy + 0x8000) << 16) | uint64_t(cx + 0x8000);
+}
+
+static void refreshUnitIndex() {
+    auto &active = world->units.active;
+    if (!unit_index.dirty && unit_index.frame == world->frame_counter &&
+        unit_index.active_data == active.data() && unit_index.active_size == active.size())
+        return;
+
+    auto &entries = unit_index.entries;
+    entries.clear();
+    for (size_t i = 0; i < active.size(); ++i) {
+        auto unit = active[i];
+        // inactive and dead units are indexed too; callers filter them
+        auto pos = Units::getPosition(unit);
+        if (!pos.isValid())
+            continue;
+        entries.push_back({unitCellKey(pos.x >> UNIT_CELL_SHIFT, pos.y >> UNIT_CELL_SHIFT, pos.z), pos, i, unit});
+        if (entries.size() == 1) {
+            unit_index.min_pos = unit_index.max_pos = pos;
+        } else {
+            unit_index.min_pos = df::coord(min(unit_index.min_pos.x, pos.x), min(unit_index.min_pos.y, pos.y), min(unit_index.min_pos.z, pos.z));
+            unit_index.max_pos = df::coord(max(unit_index.max_pos.x, pos.x), max(unit_index.max_pos.y, pos.y), max(unit_index.max_pos.z, pos.z));
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    unit_index.frame = world->frame_counter;
+    unit_index.active_data = active.data();
+    unit_index.active_size = active.size();
+    unit_index.dirty = false;
+}
+
+// collects the units of the active vector whose position is inside the box
+// (inclusive), in the order of that vector
+static void findIndexedUnits(vector<UnitIndexEntry> &found, int32_t x1, int32_t y1, int32_t z1,
+                             int32_t x2, int32_t y2, int32_t z2) {
+    found.clear();
+    if (!world)
+        return;
+
+    std::lock_guard<std::mutex> lock(unit_index_mutex);
+    refreshUnitIndex();
+    auto &entries = unit_index.entries;
+    if (entries.empty())
+        return;
+
+    x1 = max<int32_t>(x1, unit_index.min_pos.x), x2 = min<int32_t>(x2, unit_index.max_pos.x);
+    y1 = max<int32_t>(y1, unit_index.min_pos.y), y2 = min<int32_t>(y2, unit_index.max_pos.y);
+    z1 = max<int32_t>(z1, unit_index.min_pos.z), z2 = min<int32_t>(z2, unit_index.max_pos.z);
+    if (x1 > x2 || y1 > y2 || z1 > z2)
+        return;
+
+    for (int32_t z = z1; z <= z2; ++z) {
+        for (int32_t cy = y1 >> UNIT_CELL_SHIFT; cy <= y2 >> UNIT_CELL_SHIFT; ++cy) {
+            // the cells of one row are contiguous
+            UnitIndexEntry first = {unitCellKey(x1 >> UNIT_CELL_SHIFT, cy, z), df::coord(), 0, NULL};
+            uint64_t last_key = unitCellKey(x2 >> UNIT_CELL_SHIFT, cy, z);
+            for (auto it = std::lower_bound(entries.begin(), entries.end(), first);
+                    it != entries.end() && it->key <= last_key; ++it) {
+                auto &pos = it->pos;
+                if (pos.x >= x1 && pos.x <= x2 && pos.y >= y1 && pos.y <= y2)
+                    found.push_back(*it);
+            }
+        }
+    }
+
+    std::sort(found.begin(), found.end(), [](const UnitIndexEntry &a, const UnitIndexEntry &b) {
+        return a.active_index < b.active_index;
+    });
+}
+
+static int64_t unitDistanceSq(const df::coord &a, const df::coord &b) {
+    int64_t dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    return dx * dx + dy * dy + dz * dz;
+}
+
 bool Units::getUnitsInBox(vector<df::unit *> &units, const cuboid &box, std::function<bool(df::unit *)> filter) {
     if (!world)
         return false;
 
     units.clear();
-    for (auto unit : world->units.active)
-        if (isUnitInBox(unit, box) && filter(unit))
-            units.push_back(unit);
+    vector<UnitIndexEntry> found;
+    findIndexedUnits(found, box.x_min, box.y_min, box.z_min, box.x_max, box.y_max, box.z_max);
+    // the filter runs outside the index lock, since it may query units itself
+    for (auto &entry : found)
+        if (filter(entry.unit))
+            units.push_back(entry.unit);
+    return true;
+}
+
+bool Units::getUnitsInRadius(vector<df::unit *> &units, df::coord pos, int radius, std::function<bool(df::unit *)> filter) {
+    if (!world)
+        return false;
+
+    units.clear();
+    if (radius < 0)
+        return true;
+    radius = min(radius, 0xFFFF);
+    vector<UnitIndexEntry> found;
+    findIndexedUnits(found, pos.x - radius, pos.y - radius, pos.z - radius,
+                     pos.x + radius, pos.y + radius, pos.z + radius);
+    int64_t radius_sq = int64_t(radius) * radius;
+    for (auto &entry : found)
+        if (unitDistanceSq(entry.pos, pos) <= radius_sq && filter(entry.unit))
+            units.push_back(entry.unit);
     return true;
 }
 
+df::unit *Units::getNearestUnit(df::coord pos, int max_radius, std::function<bool(df::unit *)> filter) {
+    if (!world || max_radius < 0)
+        return NULL;
+    max_radius = min(max_radius, 0xFFFF);
+
+    // search boxes of growing size. a unit found within distance r of pos
+    // is closer than anything outside a box of radius r.
+    vector<UnitIndexEntry> found;
+    for (int r = min(max_radius, 16); ; r = min(max_radius, r * 2)) {
+        findIndexedUnits(found, pos.x - r, pos.y - r, pos.z - r, pos.x + r, pos.y + r, pos.z + r);
+        int64_t best_dist = int64_t(r) * r + 1;
+        df::unit *best = NULL;
+        for (auto &entry : found) {
+            int64_t dist = unitDistanceSq(entry.pos, pos);
+            if (dist < best_dist && filter(entry.unit)) {
+                best_dist = dist;
+                best = entry.unit;
+            }
+        }
+        if (best || r >= max_radius)
+            return best;
+    }
+}
+
 static int32_t get_noble_position_id(const df::historical_entity::T_positions &positions, const string &noble) {
     string target_id = toUpper_cp437(noble);
     for (auto position : positions.own)
@@ -767,6 +928,11 @@ bool Units::teleport(df::unit *unit, df::coord target_pos)
     if (!old_occ || !new_occ)
         return false;
 
+    {
+        std::lock_guard<std::mutex> lock(unit_index_mutex);
+        unit_index.dirty = true;
+    }
+
     // Clear appropriate occupancy flags at old tile
     if (unit->flags1.bits.on_ground)
         // This is potentially wrong, but the game will recompute this as needed
@@ -65,7 +65,7 @@ static std::unordered_map<int, WatchedRace*> watched_races;
 static std::unordered_map<string, int> race_to_id;
 
 static const int32_t CYCLE_TICKS = 5987;
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+DFHACK_PLUGIN_UPDATE_CADENCE(CYCLE_TICKS, 0);
 
 static void init_autobutcher(color_ostream &out);
 static void cleanup_autobutcher(color_ostream &out);
@@ -110,7 +110,6 @@ DFhackCExport command_result plugin_shutdown (color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_load_site_data (color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentSiteData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -150,8 +149,7 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
 }
 
 DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (world->frame_counter - cycle_timestamp >= CYCLE_TICKS)
-        autobutcher_cycle(out);
+    autobutcher_cycle(out);
     return CR_OK;
 }
 
@@ -678,7 +676,7 @@ static bool isProtectedUnit(df::unit *unit) {
 
 static void autobutcher_cycle(color_ostream &out) {
     // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
+    Core::getInstance().getPluginManager()->resetUpdateSchedule(plugin_name);
 
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
 
@@ -104,7 +104,7 @@ static void validate_burrow_configs(color_ostream &out) {
 }
 
 static const int32_t CYCLE_TICKS = 1181;
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+DFHACK_PLUGIN_UPDATE_CADENCE(CYCLE_TICKS, 0);
 
 static command_result do_command(color_ostream &out, vector<string> &parameters);
 static int32_t do_cycle(color_ostream &out, bool force_designate = false);
@@ -149,7 +149,6 @@ DFhackCExport command_result plugin_shutdown (color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_load_site_data (color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentSiteData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -191,11 +190,9 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
 }
 
 DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (world->frame_counter - cycle_timestamp >= CYCLE_TICKS) {
-        int32_t designated = do_cycle(out);
-        if (0 < designated)
-            out.print("autochop: designated %d tree(s) for chopping\n", designated);
-    }
+    int32_t designated = do_cycle(out);
+    if (0 < designated)
+        out.print("autochop: designated %d tree(s) for chopping\n", designated);
     return CR_OK;
 }
 
@@ -517,14 +514,13 @@ static void scan_logs(color_ostream &out, int32_t *usable_logs,
     if (inaccessible_logs)
         *inaccessible_logs = 0;
 
-    for (auto &item : world->items.other[items_other_id::IN_PLAY]) {
-        TRACE(cycle,out).print("  scanning log %d\n", item->id);
-        if (item->flags.whole & bad_flags.whole)
-            continue;
-
-        if (item->getType() != item_type::WOOD)
-            continue;
+    df::item_flags without;
+    without.whole = bad_flags.whole;
+    vector<df::item *> logs;
+    Items::ItemQuery().type(item_type::WOOD).withoutFlags(without).getItems(logs);
 
+    for (auto item : logs) {
+        TRACE(cycle,out).print("  scanning log %d\n", item->id);
         if (!is_valid_item(item))
             continue;
 
@@ -541,7 +537,7 @@ static int32_t do_cycle(color_ostream &out, bool force_designate) {
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
 
     // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
+    Core::getInstance().getPluginManager()->resetUpdateSchedule(plugin_name);
 
     validate_burrow_configs(out);
 
@@ -48,7 +48,7 @@ enum ConfigValues {
 
 static bool did_complain = false; // avoids message spam
 static const int32_t CYCLE_TICKS = 6067;
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+DFHACK_PLUGIN_UPDATE_CADENCE(CYCLE_TICKS, 0);
 
 static command_result df_autonestbox(color_ostream &out, vector<string> &parameters);
 static void autonestbox_cycle(color_ostream &out);
@@ -81,7 +81,6 @@ DFhackCExport command_result plugin_enable(color_ostream &out, bool enable) {
 }
 
 DFhackCExport command_result plugin_load_site_data (color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentSiteData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -112,8 +111,7 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
 }
 
 DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (world->frame_counter - cycle_timestamp >= CYCLE_TICKS)
-        autonestbox_cycle(out);
+    autonestbox_cycle(out);
     return CR_OK;
 }
 
@@ -347,7 +345,7 @@ static size_t assign_nestboxes(color_ostream &out) {
 
 static void autonestbox_cycle(color_ostream &out) {
     // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
+    Core::getInstance().getPluginManager()->resetUpdateSchedule(plugin_name);
 
     DEBUG(cycle,out).print("running autonestbox cycle\n");
 
@@ -10,9 +10,7 @@
 #include "modules/Persistence.h"
 #include "modules/World.h"
 
-#include "df/block_burrow.h"
 #include "df/burrow.h"
-#include "df/map_block.h"
 #include "df/plotinfost.h"
 #include "df/tile_designation.h"
 #include "df/unit.h"
@@ -260,71 +258,6 @@ static df::burrow* get_burrow(lua_State *L, int idx) {
     return burrow;
 }
 
-static void copyTiles(df::burrow *target, df::burrow *source, bool enable) {
-    CHECK_NULL_POINTER(target);
-    CHECK_NULL_POINTER(source);
-
-    if (source == target) {
-        if (!enable)
-            Burrows::clearTiles(target);
-        return;
-    }
-
-    vector<df::map_block*> pvec;
-    Burrows::listBlocks(&pvec, source);
-
-    for (auto block : pvec) {
-        auto smask = Burrows::getBlockMask(source, block);
-        if (!smask)
-            continue;
-
-        auto tmask = Burrows::getBlockMask(target, block, enable);
-        if (!tmask)
-            continue;
-
-        if (enable) {
-            for (int j = 0; j < 16; j++)
-                tmask->tile_bitmask[j] |= smask->tile_bitmask[j];
-        } else {
-            for (int j = 0; j < 16; j++)
-                tmask->tile_bitmask[j] &= ~smask->tile_bitmask[j];
-
-            if (!tmask->has_assignments())
-                Burrows::deleteBlockMask(target, block, tmask);
-        }
-    }
-}
-
-static void setTilesByDesignation(df::burrow *target, df::tile_designation d_mask,
-                                  df::tile_designation d_value, bool enable) {
-    CHECK_NULL_POINTER(target);
-
-    auto &blocks = world->map.map_blocks;
-
-    for (auto block : blocks) {
-        df::block_burrow *mask = NULL;
-
-        for (int x = 0; x < 16; x++) {
-            for (int y = 0; y < 16; y++) {
-                if ((block->designation[x][y].whole & d_mask.whole) != d_value.whole)
-                    continue;
-
-                if (!mask)
-                    mask = Burrows::getBlockMask(target, block, enable);
-                if (!mask)
-                    goto next_block;
-
-                mask->setassignment(x, y, enable);
-            }
-        }
-
-        if (mask && !enable && !mask->has_assignments())
-            Burrows::deleteBlockMask(target, block, mask);
-
-    next_block:;
-    }
-}
-
 static bool setTilesByKeyword(df::burrow *target, std::string name, bool enable) {
     CHECK_NULL_POINTER(target);
 
@@ -350,7 +283,7 @@ static bool setTilesByKeyword(df::burrow *target, std::string name, bool enable)
     else
         return false;
 
-    setTilesByDesignation(target, mask, value, enable);
+    Burrows::setTilesByDesignation(target, mask, value, enable);
     return true;
 }
 
@@ -400,8 +333,12 @@ static void tiles_set_add_remove(lua_State *L, bool do_set, bool enable) {
     lua_pushnil(L);   // first key
     while (lua_next(L, 2)) {
         if (!lua_isstring(L, -1) || !setTilesByKeyword(target, luaL_checkstring(L, -1), enable)) {
-            if (auto burrow = get_burrow(L, -1))
-                copyTiles(target, burrow, enable);
+            if (auto burrow = get_burrow(L, -1)) {
+                if (enable)
+                    Burrows::unionTiles(target, burrow);
+                else
+                    Burrows::subtractTiles(target, burrow);
+            }
         }
         lua_pop(L, 1);  // remove value, leave key
     }
@@ -447,14 +384,7 @@ static void box_fill(lua_State *L, bool enable) {
         return;
     }
 
-    for (int32_t z = pos_start.z; z <= pos_end.z; ++z) {
-        for (int32_t y = pos_start.y; y <= pos_end.y; ++y) {
-            for (int32_t x = pos_start.x; x <= pos_end.x; ++x) {
-                df::coord pos(x, y, z);
-                Burrows::setAssignedTile(burrow, pos, enable);
-            }
-        }
-    }
+    Burrows::setTilesInBox(burrow, pos_start, pos_end, enable);
 }
 
 static int burrow_tiles_box_add(lua_State *L) {
@@ -0,0 +1,650 @@
+// Microbenchmarks for core data structures
+
+#include "Console.h"
+#include "Export.h"
+#include "PluginManager.h"
+#include "TileTypes.h"
+#include "TimerWheel.h"
+
+#include "modules/BlockMasks.h"
+#include "modules/Connectivity.h"
+#include "modules/MapCache.h"
+#include "modules/Maps.h"
+
+#include "df/map_block.h"
+#include "df/world.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+using namespace DFHack;
+
+DFHACK_PLUGIN("benchmark");
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void print_result(color_ostream &out, const char *name, const char *phase, uint64_t ns, size_t ops) {
+    out.print("  %-10s %-28s %10.3f ms %10.1f ns/op\n", name, phase,
+              ns / 1000000.0, ops ? double(ns) / ops : 0.0);
+}
+
+/////////////////////////////////////////////////////
+// timers: EventManager / dfhack.timeout scheduling
+//
+
+static const int32_t TIMER_START = 1000;
+static const int32_t TIMER_MAX_DELAY = 10000;
+static const int32_t TIMER_RUN_TICKS = 20000;
+
+// the workload: schedule count timers, cancel half of them, then run the
+// clock forward one tick at a time, rescheduling every timer that fires
+// (which is what repeat-util does)
+struct TimerWorkload {
+    vector<int32_t> initial_delays;
+    vector<size_t> cancel_order;
+    vector<int32_t> repeat_delays;
+
+    TimerWorkload(size_t count) {
+        std::mt19937 rng(4321);
+        std::uniform_int_distribution<int32_t> delay(1, TIMER_MAX_DELAY);
+        for (size_t i = 0; i < count; ++i)
+            initial_delays.push_back(delay(rng));
+        for (size_t i = 0; i < count; ++i)
+            cancel_order.push_back(i);
+        std::shuffle(cancel_order.begin(), cancel_order.end(), rng);
+        cancel_order.resize(count / 2);
+        for (size_t i = 0; i < 4096; ++i)
+            repeat_delays.push_back(delay(rng));
+    }
+};
+
+static void bench_multimap_timers(color_ostream &out, const TimerWorkload &work) {
+    std::multimap<int32_t, int> queue;
+    size_t count = work.initial_delays.size();
+    vector<int32_t> due(count);
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < count; ++i) {
+        due[i] = TIMER_START + work.initial_delays[i];
+        queue.emplace(due[i], i);
+    }
+    print_result(out, "multimap", "schedule", now_ns() - start, count);
+
+    // cancelling by value, as EventManager::unregister did
+    start = now_ns();
+    for (size_t i : work.cancel_order) {
+        for (auto it = queue.find(due[i]); it != queue.end() && it->first == due[i]; ++it) {
+            if (size_t(it->second) == i) {
+                queue.erase(it);
+                break;
+            }
+        }
+    }
+    print_result(out, "multimap", "cancel", now_ns() - start, work.cancel_order.size());
+
+    size_t fired = 0;
+    size_t next_delay = 0;
+    start = now_ns();
+    for (int32_t tick = TIMER_START; tick < TIMER_START + TIMER_RUN_TICKS; ++tick) {
+        while (!queue.empty() && queue.begin()->first <= tick) {
+            int id = queue.begin()->second;
+            queue.erase(queue.begin());
+            ++fired;
+            queue.emplace(tick + work.repeat_delays[next_delay++ & 4095], id);
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    print_result(out, "multimap", "advance (per tick)", elapsed, TIMER_RUN_TICKS);
+    print_result(out, "multimap", "advance (per fired timer)", elapsed, fired);
+}
+
+static void bench_wheel_timers(color_ostream &out, const TimerWorkload &work) {
+    typedef TimerWheel<int> Wheel;
+    Wheel wheel(TIMER_START);
+    size_t count = work.initial_delays.size();
+    vector<Wheel::handle_t> handles(count);
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < count; ++i)
+        handles[i] = wheel.schedule(TIMER_START + work.initial_delays[i], i);
+    print_result(out, "wheel", "schedule", now_ns() - start, count);
+
+    start = now_ns();
+    for (size_t i : work.cancel_order)
+        wheel.cancel(handles[i]);
+    print_result(out, "wheel", "cancel", now_ns() - start, work.cancel_order.size());
+
+    size_t fired = 0;
+    size_t next_delay = 0;
+    start = now_ns();
+    for (int32_t tick = TIMER_START; tick < TIMER_START + TIMER_RUN_TICKS; ++tick) {
+        wheel.advance(tick, [&](Wheel::handle_t, int id) {
+            ++fired;
+            wheel.schedule(tick + work.repeat_delays[next_delay++ & 4095], id);
+        });
+    }
+    uint64_t elapsed = now_ns() - start;
+    print_result(out, "wheel", "advance (per tick)", elapsed, TIMER_RUN_TICKS);
+    print_result(out, "wheel", "advance (per fired timer)", elapsed, fired);
+}
+
+static command_result bench_timers(color_ostream &out, vector<string> &parameters) {
+    size_t count = 20000;
+    if (parameters.size() > 1)
+        count = strtoul(parameters[1].c_str(), NULL, 10);
+    if (!count)
+        return CR_WRONG_USAGE;
+
+    out.print("timers: %zu pending timers, delays of 1-%d ticks, %d ticks simulated\n",
+              count, TIMER_MAX_DELAY, TIMER_RUN_TICKS);
+    TimerWorkload work(count);
+    bench_multimap_timers(out, work);
+    bench_wheel_timers(out, work);
+    return CR_OK;
+}
+
+/////////////////////////////////////////////////////
+// mapcache: MapExtras::MapCache tile accessors over the whole map
+//
+
+using MapExtras::Block;
+using MapExtras::MapCache;
+
+// visits every tile of the map. in row order, consecutive tiles are in the
+// same block 15 times out of 16; in block-strided order every access goes to
+// a different block than the one before.
+template<typename F>
+static size_t sweep_map(MapCache &mc, bool strided, F fn) {
+    int32_t xmax = mc.maxTileX(), ymax = mc.maxTileY(), zmax = mc.maxZ();
+    size_t ops = 0;
+    for (int32_t z = 0; z < zmax; ++z) {
+        if (!strided) {
+            for (int32_t y = 0; y < ymax; ++y)
+                for (int32_t x = 0; x < xmax; ++x, ++ops)
+                    fn(df::coord(x, y, z));
+            continue;
+        }
+        for (int32_t dy = 0; dy < 16; ++dy)
+            for (int32_t dx = 0; dx < 16; ++dx)
+                for (int32_t by = dy; by < ymax; by += 16)
+                    for (int32_t bx = dx; bx < xmax; bx += 16, ++ops)
+                        fn(df::coord(bx, by, z));
+    }
+    return ops;
+}
+
+static command_result bench_mapcache(color_ostream &out, vector<string> &parameters) {
+    if (!Maps::IsValid()) {
+        out.printerr("benchmark mapcache needs a loaded map\n");
+        return CR_FAILURE;
+    }
+
+    MapCache mc;
+    out.print("mapcache: %u x %u x %u tiles\n", mc.maxTileX(), mc.maxTileY(), mc.maxZ());
+
+    // the first sweep loads every block, so later sweeps measure lookups only
+    uint64_t start = now_ns();
+    size_t ops = sweep_map(mc, false, [&](df::coord pos) { mc.BlockAtTile(pos); });
+    print_result(out, "mapcache", "load blocks", now_ns() - start, ops);
+
+    // the old implementation kept the blocks in a std::map keyed by block
+    // coordinate; this reproduces its lookup over the same blocks
+    std::map<df::coord, Block *> tree;
+    sweep_map(mc, false, [&](df::coord pos) {
+        df::coord bpos(pos.x >> 4, pos.y >> 4, pos.z);
+        if (!tree.count(bpos))
+            tree[bpos] = mc.BlockAt(bpos);
+    });
+
+    for (bool strided : {false, true}) {
+        const char *order = strided ? "tiletypeAt (block strided)" : "tiletypeAt (row order)";
+        size_t tree_sum = 0, cache_sum = 0;
+
+        start = now_ns();
+        ops = sweep_map(mc, strided, [&](df::coord pos) {
+            auto it = tree.find(df::coord(pos.x >> 4, pos.y >> 4, pos.z));
+            if (it != tree.end() && it->second)
+                tree_sum += it->second->tiletypeAt(pos);
+        });
+        print_result(out, "std::map", order, now_ns() - start, ops);
+
+        start = now_ns();
+        ops = sweep_map(mc, strided, [&](df::coord pos) { cache_sum += mc.tiletypeAt(pos); });
+        print_result(out, "mapcache", order, now_ns() - start, ops);
+
+        if (tree_sum != cache_sum)
+            out.printerr("  checksum mismatch: %zu != %zu\n", tree_sum, cache_sum);
+    }
+    return CR_OK;
+}
+
+/////////////////////////////////////////////////////
+// cuboid: cuboid / Maps iteration over the whole map
+//
+
+static command_result bench_cuboid(color_ostream &out, vector<string> &parameters) {
+    if (!Maps::IsValid()) {
+        out.printerr("benchmark cuboid needs a loaded map\n");
+        return CR_FAILURE;
+    }
+
+    int32_t xmax, ymax, zmax;
+    Maps::getTileSize(xmax, ymax, zmax);
+    cuboid bounds(0, 0, 0, xmax - 1, ymax - 1, zmax - 1);
+    size_t tiles = size_t(xmax) * ymax * zmax;
+    out.print("cuboid: %d x %d x %d tiles\n", xmax, ymax, zmax);
+
+    // plain coordinate iteration, with a trivial callback
+    size_t sum = 0;
+    uint64_t start = now_ns();
+    bounds.forCoord([&](df::coord pos) { sum += pos.x; return true; });
+    print_result(out, "function", "forCoord", now_ns() - start, tiles);
+
+    size_t inline_sum = 0;
+    start = now_ns();
+    bounds.forEachCoord([&](df::coord pos) { inline_sum += pos.x; return true; });
+    print_result(out, "template", "forEachCoord", now_ns() - start, tiles);
+    if (sum != inline_sum)
+        out.printerr("  checksum mismatch: %zu != %zu\n", sum, inline_sum);
+
+    // per-block tile access: count the hidden tiles
+    size_t hidden = 0;
+    start = now_ns();
+    bounds.forBlock([&](df::map_block *block, cuboid intersect) {
+        intersect.forCoord([&](df::coord pos) {
+            hidden += block->designation[pos.x&15][pos.y&15].bits.hidden;
+            return true;
+        });
+        return true;
+    });
+    print_result(out, "function", "forBlock + forCoord", now_ns() - start, tiles);
+
+    size_t mask_hidden = 0;
+    start = now_ns();
+    bounds.forBlockMask([&](df::map_block *block, const df::tile_bitmask &mask) {
+        Maps::forMaskTiles(mask, [&](int tx, int ty) {
+            mask_hidden += block->designation[tx][ty].bits.hidden;
+        });
+        return true;
+    });
+    print_result(out, "template", "forBlockMask + forMaskTiles", now_ns() - start, tiles);
+    if (hidden != mask_hidden)
+        out.printerr("  checksum mismatch: %zu != %zu\n", hidden, mask_hidden);
+    return CR_OK;
+}
+
+/////////////////////////////////////////////////////
+// blockmasks: whole-block tile classification
+//
+
+static command_result bench_blockmasks(color_ostream &out, vector<string> &parameters) {
+    if (!Maps::IsValid()) {
+        out.printerr("benchmark blockmasks needs a loaded map\n");
+        return CR_FAILURE;
+    }
+
+    auto &blocks = df::global::world->map.map_blocks;
+    size_t tiles = blocks.size() * 256;
+    out.print("blockmasks: %zu blocks\n", blocks.size());
+
+    // the "is anything in this block" test that remotefortressreader used to
+    // do tile by tile
+    size_t count = 0;
+    uint64_t start = now_ns();
+    for (auto block : blocks) {
+        for (int x = 0; x < 16; x++) {
+            for (int y = 0; y < 16; y++) {
+                auto basic = tileShapeBasic(tileShape(block->tiletype[x][y]));
+                if ((basic != df::tiletype_shape_basic::None && basic != df::tiletype_shape_basic::Open)
+                        || block->designation[x][y].bits.flow_size > 0
+                        || block->occupancy[x][y].bits.building > 0)
+                    ++count;
+            }
+        }
+    }
+    print_result(out, "per tile", "non-air tiles", now_ns() - start, tiles);
+
+    size_t mask_count = 0;
+    start = now_ns();
+    for (auto block : blocks) {
+        auto mask = BlockMasks::nonEmpty(block);
+        mask |= BlockMasks::liquid(block);
+        mask |= BlockMasks::building(block);
+        mask_count += BlockMasks::count(mask);
+    }
+    print_result(out, "blockmasks", "non-air tiles", now_ns() - start, tiles);
+    if (count != mask_count)
+        out.printerr("  checksum mismatch: %zu != %zu\n", count, mask_count);
+
+    count = 0;
+    start = now_ns();
+    for (auto block : blocks)
+        for (int x = 0; x < 16; x++)
+            for (int y = 0; y < 16; y++)
+                count += block->designation[x][y].bits.hidden;
+    print_result(out, "per tile", "hidden tiles", now_ns() - start, tiles);
+
+    mask_count = 0;
+    start = now_ns();
+    for (auto block : blocks)
+        mask_count += BlockMasks::count(BlockMasks::hidden(block));
+    print_result(out, "blockmasks", "hidden tiles", now_ns() - start, tiles);
+    if (count != mask_count)
+        out.printerr("  checksum mismatch: %zu != %zu\n", count, mask_count);
+    return CR_OK;
+}
+
+/////////////////////////////////////////////////////
+// tiletypes: findTileType lookups while painting
+//
+
+static const int PAINT_SIZE_X = 200;
+static const int PAINT_SIZE_Y = 200;
+static const int PAINT_SIZE_Z = 10;
+
+// findTileType as it was before the lookup index: a scan over the whole enum
+static df::tiletype linear_find_tiletype(df::tiletype_shape tshape, df::tiletype_material tmat, df::tiletype_variant tvar, df::tiletype_special tspecial, TileDirection tdir) {
+    FOR_ENUM_ITEMS(tiletype, tt) {
+        if (tshape != tiletype_shape::NONE && tshape != tileShape(tt))
+            continue;
+        if (tmat != tiletype_material::NONE && tmat != tileMaterial(tt))
+            continue;
+        if (tvar != tiletype_variant::NONE && tvar != tileVariant(tt) && tileVariant(tt) != tiletype_variant::NONE)
+            continue;
+        if (tspecial != tiletype_special::NONE && tspecial != tileSpecial(tt) && tileSpecial(tt) != tiletype_special::NONE)
+            continue;
+        if (tdir && tdir != tileDirection(tt))
+            continue;
+        return tt;
+    }
+    return tiletype::Void;
+}
+
+// resolves the tiletype that the tiletypes painter would write over each
+// source tile when painting the given shape, keeping the source's material
+// and special (see paintTileProcessing in plugins/tiletypes.cpp)
+template<typename F>
+static size_t paint(const vector<df::tiletype> &sources, df::tiletype_shape shape, F find) {
+    size_t checksum = 0;
+    for (auto source : sources) {
+        auto material = tileMaterial(source);
+        auto special = tileSpecial(source);
+        TileDirection direction = tileDirection(source);
+        if (!(material == tiletype_material::RIVER || shape == tiletype_shape::BROOK_BED || special == tiletype_special::TRACK || (shape == tiletype_shape::WALL && (material == tiletype_material::CONSTRUCTION || special == tiletype_special::SMOOTH))))
+            direction.whole = 0;
+        checksum = checksum * 31 + find(shape, material, tiletype_variant::NONE, special, direction);
+    }
+    return checksum;
+}
+
+static command_result bench_tiletypes(color_ostream &out, vector<string> &parameters) {
+    // the source tiles come from the middle z-levels of the loaded map if
+    // there is one,
+    // otherwise the area is filled with every tiletype in turn
+    vector<df::tiletype> sources;
+    sources.reserve(PAINT_SIZE_X * PAINT_SIZE_Y * PAINT_SIZE_Z);
+    vector<df::tiletype> all;
+    FOR_ENUM_ITEMS(tiletype, tt) {
+        if (tileMaterial(tt) != tiletype_material::NONE)
+            all.push_back(tt);
+    }
+    uint32_t x_max = 0, y_max = 0, z_max = 0;
+    if (Maps::IsValid())
+        Maps::getTileSize(x_max, y_max, z_max);
+    for (int z = 0; z < PAINT_SIZE_Z; z++) {
+        for (int y = 0; y < PAINT_SIZE_Y; y++) {
+            for (int x = 0; x < PAINT_SIZE_X; x++) {
+                df::tiletype *tt = NULL;
+                int map_z = z + z_max / 2;
+                if (x < (int)x_max && y < (int)y_max && map_z < (int)z_max)
+                    tt = Maps::getTileType(x, y, map_z);
+                sources.push_back(tt ? *tt : all[sources.size() % all.size()]);
+            }
+        }
+    }
+    out.print("tiletypes: painting %dx%dx%d tiles (%s)\n", PAINT_SIZE_X, PAINT_SIZE_Y,
+              PAINT_SIZE_Z, x_max ? "from the loaded map" : "synthetic");
+
+    const df::tiletype_shape shapes[] = {
+        tiletype_shape::FLOOR, tiletype_shape::WALL, tiletype_shape::RAMP
+    };
+    for (auto shape : shapes) {
+        string phase = "paint " + enum_item_key(shape);
+
+        uint64_t start = now_ns();
+        size_t linear = paint(sources, shape, linear_find_tiletype);
+        print_result(out, "linear", phase.c_str(), now_ns() - start, sources.size());
+
+        start = now_ns();
+        size_t indexed = paint(sources, shape, findTileType);
+        print_result(out, "indexed", phase.c_str(), now_ns() - start, sources.size());
+
+        if (linear != indexed)
+            out.printerr("  checksum mismatch: %zu != %zu\n", linear, indexed);
+    }
+    return CR_OK;
+}
+
+/////////////////////////////////////////////////////
+// connectivity
+//
+
+static const size_t REACH_PAIRS = 100000;
+
+static command_result bench_connectivity(color_ostream &out, vector<string> &parameters) {
+    if (!Maps::IsValid()) {
+        out.printerr("benchmark connectivity needs a loaded map\n");
+        return CR_FAILURE;
+    }
+
+    // the first query builds the graph, or checks the map for changes if it
+    // was built on an earlier tick
+    uint64_t start = now_ns();
+    Connectivity::getComponent(df::coord(0, 0, 0));
+    print_result(out, "graph", "first query", now_ns() - start, 1);
+
+    std::mt19937 rng(1234);
+    uint32_t x_max, y_max, z_max;
+    Maps::getTileSize(x_max, y_max, z_max);
+    vector<df::coord> walkable;
+    for (size_t tries = 0; walkable.size() < 10000 && tries < 10000000; tries++) {
+        df::coord pos(rng() % x_max, rng() % y_max, rng() % z_max);
+        if (Maps::getWalkableGroup(pos))
+            walkable.push_back(pos);
+    }
+    if (walkable.empty()) {
+        out.printerr("benchmark connectivity found no walkable tiles\n");
+        return CR_FAILURE;
+    }
+    vector<std::pair<df::coord, df::coord>> pairs;
+    for (size_t i = 0; i < REACH_PAIRS; i++)
+        pairs.emplace_back(walkable[rng() % walkable.size()], walkable[rng() % walkable.size()]);
+
+    size_t df_reachable = 0, reachable = 0, wagon_reachable = 0, disagree = 0;
+    start = now_ns();
+    for (auto &pair : pairs)
+        df_reachable += Maps::canWalkBetween(pair.first, pair.second);
+    print_result(out, "df groups", "canWalkBetween", now_ns() - start, pairs.size());
+
+    start = now_ns();
+    for (auto &pair : pairs)
+        reachable += Connectivity::canReach(pair.first, pair.second);
+    print_result(out, "graph", "canReach (walker)", now_ns() - start, pairs.size());
+
+    start = now_ns();
+    for (auto &pair : pairs)
+        wagon_reachable += Connectivity::canReach(pair.first, pair.second, Connectivity::WAGON);
+    print_result(out, "graph", "canReach (wagon)", now_ns() - start, pairs.size());
+
+    for (auto &pair : pairs)
+        disagree += Maps::canWalkBetween(pair.first, pair.second) != Connectivity::canReach(pair.first, pair.second);
+    out.print("  reachable pairs: %zu by DF groups, %zu by walker, %zu by wagon; %zu disagree\n",
+              df_reachable, reachable, wagon_reachable, disagree);
+    return CR_OK;
+}
+
+/////////////////////////////////////////////////////
+// pathfind
+//
+
+static const size_t PATH_PAIRS = 100;
+
+// breadth first search over single tiles, the way plugins and scripts search
+// today; returns the number of steps, or -1 if there is no path
+static int tile_search(const Maps::PathMover &mover, df::coord from, df::coord to) {
+    std::unordered_map<df::coord, int> dist;
+    std::deque<df::coord> queue;
+    dist[from] = 0;
+    queue.push_back(from);
+    while (!queue.empty()) {
+        df::coord pos = queue.front();
+        queue.pop_front();
+        int d = dist[pos];
+        if (pos == to)
+            return d;
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    df::coord next(pos.x + dx, pos.y + dy, pos.z + dz);
+                    if ((!dx && !dy && !dz) || dist.count(next) || !Maps::isValidTilePos(next))
+                        continue;
+                    if (!mover.canStand(next) || !mover.canStep(pos, next))
+                        continue;
+                    dist[next] = d + 1;
+                    queue.push_back(next);
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+static command_result bench_pathfind(color_ostream &out, vector<string> &parameters) {
+    if (!Maps::IsValid()) {
+        out.printerr("benchmark pathfind needs a loaded map\n");
+        return CR_FAILURE;
+    }
+
+    // pairs of walkable tiles that are connected, so that no search is cut
+    // short by the connectivity check
+    std::mt19937 rng(1234);
+    uint32_t x_max, y_max, z_max;
+    Maps::getTileSize(x_max, y_max, z_max);
+    vector<df::coord> walkable;
+    for (size_t tries = 0; walkable.size() < 2000 && tries < 10000000; tries++) {
+        df::coord pos(rng() % x_max, rng() % y_max, rng() % z_max);
+        if (Maps::getWalkableGroup(pos))
+            walkable.push_back(pos);
+    }
+    vector<std::pair<df::coord, df::coord>> pairs;
+    for (size_t tries = 0; !walkable.empty() && pairs.size() < PATH_PAIRS && tries < 100000; tries++) {
+        df::coord a = walkable[rng() % walkable.size()], b = walkable[rng() % walkable.size()];
+        if (Connectivity::canReach(a, b))
+            pairs.emplace_back(a, b);
+    }
+    if (pairs.empty()) {
+        out.printerr("benchmark pathfind found no connected tiles\n");
+        return CR_FAILURE;
+    }
+    out.print("pathfind: %zu connected pairs of walkable tiles\n", pairs.size());
+
+    auto mover = Maps::PathMover::walker();
+    vector<df::coord> path;
+    size_t hpa_steps = 0, tile_steps = 0, failed = 0;
+    const char *phases[] = { "findPath (first pass)", "findPath (second pass)" };
+    for (auto phase : phases) {
+        hpa_steps = failed = 0;
+        uint64_t start = now_ns();
+        for (auto &pair : pairs) {
+            if (Maps::findPath(pair.first, pair.second, path, mover))
+                hpa_steps += path.size() - 1;
+            else
+                ++failed;
+        }
+        print_result(out, "hpa*", phase, now_ns() - start, pairs.size());
+    }
+
+    uint64_t start = now_ns();
+    for (auto &pair : pairs) {
+        int steps = tile_search(mover, pair.first, pair.second);
+        if (steps > 0)
+            tile_steps += steps;
+    }
+    print_result(out, "tile bfs", "search", now_ns() - start, pairs.size());
+
+    out.print("  total steps: %zu by hpa*, %zu shortest; %zu paths not found\n",
+              hpa_steps, tile_steps, failed);
+    return CR_OK;
+}
+
+/////////////////////////////////////////////////////
+// command dispatch
+//
+
+static command_result do_command(color_ostream &out, vector<string> &parameters) {
+    if (parameters.empty())
+        return CR_WRONG_USAGE;
+    if (parameters[0] == "timers")
+        return bench_timers(out, parameters);
+    if (parameters[0] == "mapcache")
+        return bench_mapcache(out, parameters);
+    if (parameters[0] == "cuboid")
+        return bench_cuboid(out, parameters);
+    if (parameters[0] == "blockmasks")
+        return bench_blockmasks(out, parameters);
+    if (parameters[0] == "tiletypes")
+        return bench_tiletypes(out, parameters);
+    if (parameters[0] == "connectivity")
+        return bench_connectivity(out, parameters);
+    if (parameters[0] == "pathfind")
+        return bench_pathfind(out, parameters);
+    return CR_WRONG_USAGE;
+}
+
+DFhackCExport command_result plugin_init(color_ostream &out, vector<PluginCommand> &commands) {
+    commands.push_back(PluginCommand(
+        "benchmark",
+        "Run core data structure microbenchmarks.",
+        do_command,
+        false,
+        false,
+        "benchmark timers [<count>]\n"
+        "    Compare the timer wheel used by EventManager and dfhack.timeout\n"
+        "    with a std::multimap at <count> (default 20000) pending timers.\n"
+        "benchmark mapcache\n"
+        "    Sweep every tile of the loaded map through MapExtras::MapCache and\n"
+        "    compare with block lookups through a std::map.\n"
+        "benchmark cuboid\n"
+        "    Iterate over every tile of the loaded map with the std::function\n"
+        "    based cuboid iterators and with the inlined template iterators.\n"
+        "benchmark blockmasks\n"
+        "    Classify every tile of the loaded map one tile at a time and with\n"
+        "    the whole-block BlockMasks kernels.\n"
+        "benchmark tiletypes\n"
+        "    Resolve the tiletypes for painting a 200x200x10 area with a linear\n"
+        "    scan over the tiletype enum and with the findTileType index.\n"
+        "benchmark connectivity\n"
+        "    Answer reachability between random walkable tiles with DF's\n"
+        "    walkability groups and with the Connectivity region graph.\n"
+        "benchmark pathfind\n"
+        "    Find paths between random connected tiles with Maps::findPath,\n"
+        "    cold and cached, and with a breadth first search over tiles.\n"));
+    return CR_OK;
+}
+
+DFhackCExport command_result plugin_shutdown(color_ostream &out) {
+    return CR_OK;
+}
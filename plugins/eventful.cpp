@@ -105,6 +105,16 @@ DEFINE_LUA_EVENT_NH_1(onReport, int32_t);
 DEFINE_LUA_EVENT_NH_3(onUnitAttack, int32_t, int32_t, int32_t);
 DEFINE_LUA_EVENT_NH_0(onUnload);
 DEFINE_LUA_EVENT_NH_6(onInteraction, std::string, std::string, int32_t, int32_t, int32_t, int32_t);
+//batched event manager events
+DEFINE_LUA_EVENT_NH_1(onBuildingCreatedDestroyedBatch, const std::vector<int32_t> &);
+DEFINE_LUA_EVENT_NH_1(onJobInitiatedBatch, const std::vector<df::job*> &);
+DEFINE_LUA_EVENT_NH_1(onJobStartedBatch, const std::vector<df::job*> &);
+DEFINE_LUA_EVENT_NH_1(onJobCompletedBatch, const std::vector<df::job*> &);
+DEFINE_LUA_EVENT_NH_1(onUnitNewActiveBatch, const std::vector<int32_t> &);
+DEFINE_LUA_EVENT_NH_1(onUnitDeathBatch, const std::vector<int32_t> &);
+DEFINE_LUA_EVENT_NH_1(onItemCreatedBatch, const std::vector<int32_t> &);
+DEFINE_LUA_EVENT_NH_1(onConstructionCreatedDestroyedBatch, const std::vector<df::construction*> &);
+DEFINE_LUA_EVENT_NH_1(onReportBatch, const std::vector<int32_t> &);
 
 DFHACK_PLUGIN_LUA_EVENTS {
     DFHACK_LUA_EVENT(onWorkshopFillSidebarMenu),
@@ -132,6 +142,16 @@ DFHACK_PLUGIN_LUA_EVENTS {
     DFHACK_LUA_EVENT(onUnitAttack),
     DFHACK_LUA_EVENT(onUnload),
     DFHACK_LUA_EVENT(onInteraction),
+    /*  batched event manager events */
+    DFHACK_LUA_EVENT(onBuildingCreatedDestroyedBatch),
+    DFHACK_LUA_EVENT(onConstructionCreatedDestroyedBatch),
+    DFHACK_LUA_EVENT(onJobInitiatedBatch),
+    DFHACK_LUA_EVENT(onJobStartedBatch),
+    DFHACK_LUA_EVENT(onJobCompletedBatch),
+    DFHACK_LUA_EVENT(onUnitNewActiveBatch),
+    DFHACK_LUA_EVENT(onUnitDeathBatch),
+    DFHACK_LUA_EVENT(onItemCreatedBatch),
+    DFHACK_LUA_EVENT(onReportBatch),
     DFHACK_LUA_END
 };
 
@@ -274,6 +294,103 @@ std::array<handler_t,EventManager::EventType::EVENT_MAX> compileEventHandlerArra
 }
 static std::array<handler_t,EventManager::EventType::EVENT_MAX> eventHandlers;
 
+// batched events: each Lua handler gets a single list with all the objects
+// found by one check instead of being called once per object
+
+static std::vector<int32_t> batch_ids;
+static std::vector<df::job*> batch_jobs;
+static std::vector<df::construction*> batch_constructions;
+
+static const std::vector<int32_t> &batch_to_ids(const std::vector<void*>& args) {
+    batch_ids.clear();
+    for (void *arg : args)
+        batch_ids.push_back((int32_t)(intptr_t)arg);
+    return batch_ids;
+}
+template<typename T>
+static const std::vector<T*> &batch_to_ptrs(std::vector<T*> &ptrs, const std::vector<void*>& args) {
+    ptrs.clear();
+    for (void *arg : args)
+        ptrs.push_back(reinterpret_cast<T*>(arg));
+    return ptrs;
+}
+
+static void ev_mng_jobInitiatedBatch(color_ostream& out, const std::vector<void*>& args) {
+    onJobInitiatedBatch(out, batch_to_ptrs(batch_jobs, args));
+}
+static void ev_mng_jobStartedBatch(color_ostream& out, const std::vector<void*>& args) {
+    onJobStartedBatch(out, batch_to_ptrs(batch_jobs, args));
+}
+static void ev_mng_jobCompletedBatch(color_ostream& out, const std::vector<void*>& args) {
+    onJobCompletedBatch(out, batch_to_ptrs(batch_jobs, args));
+}
+static void ev_mng_unitNewActiveBatch(color_ostream& out, const std::vector<void*>& args) {
+    onUnitNewActiveBatch(out, batch_to_ids(args));
+}
+static void ev_mng_unitDeathBatch(color_ostream& out, const std::vector<void*>& args) {
+    onUnitDeathBatch(out, batch_to_ids(args));
+}
+static void ev_mng_itemCreateBatch(color_ostream& out, const std::vector<void*>& args) {
+    onItemCreatedBatch(out, batch_to_ids(args));
+}
+static void ev_mng_buildingBatch(color_ostream& out, const std::vector<void*>& args) {
+    onBuildingCreatedDestroyedBatch(out, batch_to_ids(args));
+}
+static void ev_mng_constructionBatch(color_ostream& out, const std::vector<void*>& args) {
+    onConstructionCreatedDestroyedBatch(out, batch_to_ptrs(batch_constructions, args));
+}
+static void ev_mng_reportBatch(color_ostream& out, const std::vector<void*>& args) {
+    onReportBatch(out, batch_to_ids(args));
+}
+
+std::vector<int> enabledBatchEvents(EventManager::EventType::EVENT_MAX,-1);
+typedef void (*batch_handler_t) (color_ostream&,const std::vector<void*>&);
+
+// event types without a batched Lua event return nullptr
+batch_handler_t getBatchManager(EventType t) {
+    switch (t) {
+        case JOB_INITIATED:
+            return ev_mng_jobInitiatedBatch;
+        case JOB_STARTED:
+            return ev_mng_jobStartedBatch;
+        case JOB_COMPLETED:
+            return ev_mng_jobCompletedBatch;
+        case UNIT_NEW_ACTIVE:
+            return ev_mng_unitNewActiveBatch;
+        case UNIT_DEATH:
+            return ev_mng_unitDeathBatch;
+        case ITEM_CREATED:
+            return ev_mng_itemCreateBatch;
+        case BUILDING:
+            return ev_mng_buildingBatch;
+        case CONSTRUCTION:
+            return ev_mng_constructionBatch;
+        case REPORT:
+            return ev_mng_reportBatch;
+        case TICK:
+        case SYNDROME:
+        case INVASION:
+        case INVENTORY_CHANGE:
+        case UNIT_ATTACK:
+        case UNLOAD:
+        case INTERACTION:
+        case EVENT_MAX:
+            return nullptr;
+    }
+    return nullptr;
+}
+
+std::array<batch_handler_t,EventManager::EventType::EVENT_MAX> compileBatchHandlerArray() {
+    std::array<batch_handler_t, EventManager::EventType::EVENT_MAX> managers{};
+    auto t = (EventManager::EventType::EventType) 0;
+    while (t < EventManager::EventType::EVENT_MAX) {
+        managers[t] = getBatchManager(t);
+        t = (EventManager::EventType::EventType) int(t + 1);
+    }
+    return managers;
+}
+static std::array<batch_handler_t,EventManager::EventType::EVENT_MAX> batchEventHandlers;
+
 static void enableEvent(int evType,int freq)
 {
     if (freq < 0)
@@ -292,8 +409,29 @@ static void enableEvent(int evType,int freq)
     EventManager::registerListener(typeToEnable,EventManager::EventHandler(plugin_self,fun_ptr,freq));
     enabledEventManagerEvents[typeToEnable] = freq;
 }
+
+static void enableBatchEvent(int evType,int freq)
+{
+    if (freq < 0)
+        return;
+    CHECK_INVALID_ARGUMENT(evType >= 0 && evType < EventManager::EventType::EVENT_MAX &&
+                           batchEventHandlers[evType]);
+    EventManager::BatchEventHandler::callback_t fun_ptr = batchEventHandlers[evType];
+    EventManager::EventType::EventType typeToEnable=static_cast<EventManager::EventType::EventType>(evType);
+
+    int oldFreq = enabledBatchEvents[typeToEnable];
+    if (oldFreq != -1) {
+        if (freq >= oldFreq)
+            return;
+        EventManager::unregister(typeToEnable,EventManager::BatchEventHandler(plugin_self,fun_ptr,oldFreq));
+    }
+    EventManager::registerBatchListener(typeToEnable,EventManager::BatchEventHandler(plugin_self,fun_ptr,freq));
+    enabledBatchEvents[typeToEnable] = freq;
+}
+
 DFHACK_PLUGIN_LUA_FUNCTIONS{
     DFHACK_LUA_FUNCTION(enableEvent),
+    DFHACK_LUA_FUNCTION(enableBatchEvent),
     DFHACK_LUA_END
 };
 struct workshop_hook : df::building_workshopst{
@@ -507,6 +645,7 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
 DFhackCExport command_result plugin_init ( color_ostream &out, std::vector <PluginCommand> &commands)
 {
     eventHandlers = compileEventHandlerArray();
+    batchEventHandlers = compileBatchHandlerArray();
     if (Core::getInstance().isWorldLoaded())
         plugin_onstatechange(out, SC_WORLD_LOADED);
     enable_hooks(true);
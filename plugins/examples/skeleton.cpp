@@ -155,7 +155,9 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
 
 // Whatever you put here will be done in each game tick/frame. Don't abuse it.
 // Note that if the plugin implements the enabled API, this function is only called
-// if the plugin is enabled.
+// if the plugin is enabled. If your plugin only needs to do work periodically,
+// declare a cadence with DFHACK_PLUGIN_UPDATE_CADENCE(ticks, flags) so the core
+// only calls this function on the ticks that you need.
 DFhackCExport command_result plugin_onupdate (color_ostream &out) {
     DEBUG(onupdate,out).print(
         "onupdate called (run 'debugfilter set info skeleton onupdate' to stop"
@@ -138,7 +138,7 @@ void doInfiniteSky(color_ostream& out, int32_t howMany) {
         0, 0, world->map.z_count_block - 1,
         world->map.x_count_block - 1, world->map.y_count_block - 1, world->map.z_count_block - 1);
 
-    last_air_layer.forCoord([&](df::coord bpos) {
+    last_air_layer.forEachCoord([&](df::coord bpos) {
         // Allocate a new block column and copy over data from the old
         df::map_block **blockColumn =
             new df::map_block *[z_count_block + howMany];
@@ -89,7 +89,7 @@ static void remove_stockpile_config(color_ostream& out, int stockpile_number) {
 }
 
 static const int32_t CYCLE_TICKS = 601;
-static int32_t cycle_timestamp = 0; // world->frame_counter at last cycle
+DFHACK_PLUGIN_UPDATE_CADENCE(CYCLE_TICKS, DFHack::PU_FORTRESS_ONLY);
 
 static command_result do_command(color_ostream &out, vector<string> &parameters);
 static void do_cycle(color_ostream& out,
@@ -162,7 +162,6 @@ static void migrate_old_keys(color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_load_site_data(color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentSiteData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -189,11 +188,7 @@ DFhackCExport command_result plugin_load_site_data(color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (!Core::getInstance().isMapLoaded() || !World::isFortressMode())
-        return CR_OK;
-    if (world->frame_counter - cycle_timestamp >= CYCLE_TICKS) {
-        logistics_cycle(out, true);
-    }
+    logistics_cycle(out, true);
     return CR_OK;
 }
 
@@ -544,7 +539,7 @@ static void do_cycle(color_ostream& out,
         int32_t& dump_count, int32_t& train_count,
         int32_t& forbid_count, int32_t& claim_count) {
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
-    cycle_timestamp = world->frame_counter;
+    Core::getInstance().getPluginManager()->resetUpdateSchedule(plugin_name);
 
     ProcessorStats melt_stats, trade_stats, dump_stats, train_stats, forbid_stats, claim_stats;
     unordered_map<df::building_stockpilest *, PersistentDataItem> cache;
@@ -432,8 +432,9 @@ local function detect_frame_change(widget, fn)
     local frame = widget.frame
     local w, h = frame.w, frame.h
     local now_ms = dfhack.getTickCount()
+    local now_ns = dfhack.internal.getTimestampNs()
     local ret = fn()
-    record_widget_runtime(widget.name, now_ms)
+    record_widget_runtime(widget.name, now_ms, now_ns)
     if w ~= frame.w or h ~= frame.h then
         widget:updateLayout()
     end
@@ -0,0 +1,126 @@
+// Saves the loaded map to a columnar snapshot file and compares snapshots
+
+#include "Console.h"
+#include "Export.h"
+#include "PluginManager.h"
+
+#include "modules/MapSnapshot.h"
+#include "modules/Maps.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+using namespace DFHack;
+
+DFHACK_PLUGIN("mapsnapshot");
+
+static command_result do_command(color_ostream &out, vector<string> &parameters);
+
+DFhackCExport command_result plugin_init(color_ostream &out, vector<PluginCommand> &commands) {
+    commands.push_back(PluginCommand(
+        "mapsnapshot",
+        "Save the map to a columnar snapshot file, or compare two snapshots.",
+        do_command));
+    return CR_OK;
+}
+
+DFhackCExport command_result plugin_shutdown(color_ostream &out) {
+    return CR_OK;
+}
+
+static command_result save(color_ostream &out, const string &path, const MapSnapshot::Options &options) {
+    if (!Maps::IsValid()) {
+        out.printerr("Map is not available!\n");
+        return CR_FAILURE;
+    }
+    auto start = std::chrono::steady_clock::now();
+    string error;
+    if (!MapSnapshot::save(path, options, &error)) {
+        out.printerr("%s\n", error.c_str());
+        return CR_FAILURE;
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    out.print("Saved the map to %s in %lld ms.\n", path.c_str(), (long long)ms);
+    return CR_OK;
+}
+
+static command_result info(color_ostream &out, const string &path) {
+    MapSnapshot::Snapshot snapshot;
+    string error;
+    if (!snapshot.open(path, &error)) {
+        out.printerr("%s\n", error.c_str());
+        return CR_FAILURE;
+    }
+    auto &header = snapshot.header();
+    out.print("%s: version %u, map of %dx%dx%d blocks at region (%d, %d, %d), %u blocks stored\n",
+              path.c_str(), header.version, header.x_count_block, header.y_count_block, header.z_count_block,
+              header.region_x, header.region_y, header.region_z, header.block_count);
+    for (size_t i = 0; i < snapshot.columnCount(); i++) {
+        auto &column = snapshot.column(int(i));
+        auto chunks = snapshot.chunks(int(i));
+        uint64_t stored = 0, raw = 0;
+        for (uint32_t c = 0; c < column.chunk_count; c++) {
+            stored += chunks[c].stored_size;
+            raw += chunks[c].raw_size;
+        }
+        out.print("  %-20.32s %-7s %2u bytes x %10llu  %10llu bytes stored (%5.1f%%)\n",
+                  column.name, column.kind == MapSnapshot::TILES ? "tiles" : "records", column.elem_size,
+                  (unsigned long long)column.count, (unsigned long long)stored,
+                  raw ? 100.0 * stored / raw : 100.0);
+    }
+    return CR_OK;
+}
+
+static command_result diff(color_ostream &out, const string &path_a, const string &path_b) {
+    MapSnapshot::Snapshot a, b;
+    string error;
+    if (!a.open(path_a, &error) || !b.open(path_b, &error)) {
+        out.printerr("%s\n", error.c_str());
+        return CR_FAILURE;
+    }
+    vector<MapSnapshot::ColumnDiff> columns;
+    vector<MapSnapshot::TableDiff> tables;
+    if (!MapSnapshot::diff(a, b, columns, tables, &error)) {
+        out.printerr("%s\n", error.c_str());
+        return CR_FAILURE;
+    }
+    out.print("Changes from %s to %s:\n", path_a.c_str(), path_b.c_str());
+    for (auto &column : columns)
+        out.print("  %-20s %10llu tiles in %8llu blocks\n", column.name.c_str(),
+                  (unsigned long long)column.changed_tiles, (unsigned long long)column.changed_blocks);
+    for (auto &table : tables)
+        out.print("  %-20s %10llu added, %llu removed, %llu changed\n", table.name.c_str(),
+                  (unsigned long long)table.added, (unsigned long long)table.removed,
+                  (unsigned long long)table.changed);
+    return CR_OK;
+}
+
+static command_result do_command(color_ostream &out, vector<string> &parameters) {
+    if (parameters.size() < 2)
+        return CR_WRONG_USAGE;
+    const string &mode = parameters[0];
+
+    if (mode == "save") {
+        MapSnapshot::Options options;
+        for (size_t i = 2; i < parameters.size(); i++) {
+            if (parameters[i] == "--raw")
+                options.compress = false;
+            else if (parameters[i] == "--level" && i + 1 < parameters.size())
+                options.level = std::max(0, std::min(9, atoi(parameters[++i].c_str())));
+            else
+                return CR_WRONG_USAGE;
+        }
+        return save(out, parameters[1], options);
+    }
+    if (mode == "info" && parameters.size() == 2)
+        return info(out, parameters[1]);
+    if (mode == "diff" && parameters.size() == 3)
+        return diff(out, parameters[1], parameters[2]);
+    return CR_WRONG_USAGE;
+}
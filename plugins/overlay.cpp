@@ -229,9 +229,11 @@ DFhackCExport command_result plugin_onupdate (color_ostream &out) {
     return CR_OK;
 }
 
-static void record_widget_runtime(string name, uint32_t start_ms) {
+static void record_widget_runtime(string name, uint32_t start_ms, uint64_t start_ns) {
     auto & counters = Core::getInstance().perf_counters;
     counters.incCounter(counters.overlay_per_widget[name.c_str()], start_ms);
+    if (start_ns)
+        counters.addFrameTime(counters.frame_per_widget[name], start_ns);
 }
 
 DFHACK_PLUGIN_LUA_FUNCTIONS {
@@ -8,6 +8,7 @@
 #include "MiscUtils.h"
 #include "DataDefs.h"
 
+#include "modules/BlockMasks.h"
 #include "modules/Gui.h"
 #include "modules/MapCache.h"
 
@@ -670,6 +671,12 @@ static command_result map_prospector(color_ostream &con,
                     continue;
                 }
 
+                // Skip blocks where every tile is hidden
+                if (!options.hidden && BlockMasks::isFull(BlockMasks::hidden(b->getRaw())))
+                {
+                    continue;
+                }
+
                 // Find features
                 b->GetGlobalFeature(&blockFeatureGlobal);
                 b->GetLocalFeature(&blockFeatureLocal);
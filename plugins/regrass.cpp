@@ -389,12 +389,11 @@ int regrass_cuboid(color_ostream &out, const regrass_options &options, const cub
         bounds.x_min, bounds.x_max, bounds.y_min, bounds.y_max, bounds.z_min, bounds.z_max);
 
     int count = 0;
-    bounds.forBlock([&](df::map_block *block, cuboid intersect) {
+    bounds.forBlockMask([&](df::map_block *block, const df::tile_bitmask &mask) {
         DEBUG(log, out).print("Cuboid regrass block at (%d, %d, %d)\n",
             block->map_pos.x, block->map_pos.y, block->map_pos.z);
-        intersect.forCoord([&](df::coord pos) {
-            count += regrass_tile(out, options, block, pos.x&15, pos.y&15);
-            return true;
+        Maps::forMaskTiles(mask, [&](int tx, int ty) {
+            count += regrass_tile(out, options, block, tx, ty);
         });
         return true;
     });
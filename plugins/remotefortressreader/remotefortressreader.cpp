@@ -2,6 +2,7 @@
 #define RFR_VERSION "0.21.0"
 
 #include <cstdio>
+#include <memory>
 #include <time.h>
 #include <vector>
 
@@ -21,7 +22,9 @@
 #include "modules/Gui.h"
 #include "modules/Items.h"
 #include "modules/Job.h"
+#include "modules/BlockMasks.h"
 #include "modules/MapCache.h"
+#include "modules/MapJournal.h"
 #include "modules/Maps.h"
 #include "modules/Materials.h"
 #include "modules/DFSDL.h"
@@ -182,6 +185,9 @@ static command_result GetGameValidity(color_ostream &stream, const EmptyMessage
 
 void CopyBlock(df::map_block * DfBlock, RemoteFortressReader::MapBlock * NetBlock, MapExtras::MapCache * MC, DFCoord pos);
 
+// kept between GetBlockList calls so that unchanged blocks are not decoded again
+static std::unique_ptr<MapExtras::MapCache> blockCache;
+
 const char* growth_locations[] = {
     "TWIGS",
     "LIGHT_BRANCHES",
@@ -295,6 +301,14 @@ DFhackCExport command_result plugin_shutdown(color_ostream &out)
     // You *MUST* kill all threads you created before this returns.
     // If everything fails, just return CR_FAILURE. Your plugin will be
     // in a zombie state, but things won't crash.
+    blockCache.reset();
+    return CR_OK;
+}
+
+DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_change_event event)
+{
+    if (event == SC_MAP_UNLOADED)
+        blockCache.reset();
     return CR_OK;
 }
 
@@ -647,96 +661,42 @@ void CopyMat(RemoteFortressReader::MatPair * mat, int type, int index)
 
 }
 
-std::map<DFCoord, uint16_t> hashes;
+// the map journal generation of each block when it was last sent
+std::map<DFCoord, uint32_t> tiletypeGenerations;
+std::map<DFCoord, uint32_t> designationGenerations;
+std::map<DFCoord, uint32_t> buildingGenerations;
+std::map<DFCoord, uint32_t> spatterGenerations;
 
-bool IsTiletypeChanged(DFCoord pos)
+static bool IsBlockChanged(std::map<DFCoord, uint32_t> &generations, DFCoord pos, uint32_t aspects)
 {
-    uint16_t hash;
-    df::map_block * block = Maps::getBlock(pos);
-    if (block)
-        hash = fletcher16((uint8_t*)(block->tiletype), 16 * 16 * (sizeof(df::enums::tiletype::tiletype)));
-    else
-        hash = 0;
-    if (hashes[pos] != hash)
+    uint32_t generation = MapJournal::getBlockGeneration(pos, aspects);
+    uint32_t &sent = generations[pos];
+    if (sent != generation)
     {
-        hashes[pos] = hash;
+        sent = generation;
         return true;
     }
     return false;
 }
 
-std::map<DFCoord, uint16_t> waterHashes;
+bool IsTiletypeChanged(DFCoord pos)
+{
+    return IsBlockChanged(tiletypeGenerations, pos, MapJournal::TILETYPES);
+}
 
 bool IsDesignationChanged(DFCoord pos)
 {
-    uint16_t hash;
-    df::map_block * block = Maps::getBlock(pos);
-    if (block)
-        hash = fletcher16((uint8_t*)(block->designation), 16 * 16 * (sizeof(df::tile_designation)));
-    else
-        hash = 0;
-    if (waterHashes[pos] != hash)
-    {
-        waterHashes[pos] = hash;
-        return true;
-    }
-    return false;
+    return IsBlockChanged(designationGenerations, pos, MapJournal::DESIGNATIONS | MapJournal::LIQUIDS);
 }
 
-std::map<DFCoord, uint8_t> buildingHashes;
-
 bool IsBuildingChanged(DFCoord pos)
 {
-    df::map_block * block = Maps::getBlock(pos);
-    bool changed = false;
-    for (int x = 0; x < 16; x++)
-        for (int y = 0; y < 16; y++)
-        {
-            auto bld = block->occupancy[x][y].bits.building;
-            if (buildingHashes[pos] != bld)
-            {
-                buildingHashes[pos] = bld;
-                changed = true;
-            }
-        }
-    return changed;
+    return IsBlockChanged(buildingGenerations, pos, MapJournal::BUILDINGS);
 }
 
-std::map<DFCoord, uint16_t> spatterHashes;
-
 bool IsspatterChanged(DFCoord pos)
 {
-    df::map_block * block = Maps::getBlock(pos);
-    std::vector<df::block_square_event_material_spatterst *> materials;
-#if DF_VERSION_INT > 34011
-    std::vector<df::block_square_event_item_spatterst *> items;
-    if (!Maps::SortBlockEvents(block, NULL, NULL, &materials, NULL, NULL, NULL, &items))
-        return false;
-#else
-    if (!Maps::SortBlockEvents(block, NULL, NULL, &materials, NULL, NULL))
-        return false;
-#endif
-
-    uint16_t hash = 0;
-
-    for (size_t i = 0; i < materials.size(); i++)
-    {
-        auto mat = materials[i];
-        hash ^= fletcher16((uint8_t*)mat, sizeof(df::block_square_event_material_spatterst));
-    }
-#if DF_VERSION_INT > 34011
-    for (size_t i = 0; i < items.size(); i++)
-    {
-        auto item = items[i];
-        hash ^= fletcher16((uint8_t*)item, sizeof(df::block_square_event_item_spatterst));
-    }
-#endif
-    if (spatterHashes[pos] != hash)
-    {
-        spatterHashes[pos] = hash;
-        return true;
-    }
-    return false;
+    return IsBlockChanged(spatterGenerations, pos, MapJournal::SPATTER);
 }
 
 std::map<int, uint16_t> itemHashes;
@@ -785,10 +745,10 @@ void engravingIsNotNew(int index)
 
 static command_result ResetMapHashes(color_ostream &stream, const EmptyMessage *in)
 {
-    hashes.clear();
-    waterHashes.clear();
-    buildingHashes.clear();
-    spatterHashes.clear();
+    tiletypeGenerations.clear();
+    designationGenerations.clear();
+    buildingGenerations.clear();
+    spatterGenerations.clear();
     itemHashes.clear();
     engravingHashes.clear();
     return CR_OK;
@@ -1380,7 +1340,13 @@ static command_result GetBlockList(color_ostream &stream, const BlockRequest *in
     DFHack::Maps::getPosition(x, y, z);
     out->set_map_x(x);
     out->set_map_y(y);
-    MapExtras::MapCache MC;
+    if (!blockCache || !blockCache->revalidate())
+    {
+        blockCache.reset(new MapExtras::MapCache());
+        // makes the new cache record what its blocks were decoded from
+        blockCache->revalidate();
+    }
+    MapExtras::MapCache &MC = *blockCache;
     int center_x = (in->min_x() + in->max_x()) / 2;
     int center_y = (in->min_y() + in->max_y()) / 2;
 
@@ -1421,20 +1387,9 @@ static command_result GetBlockList(color_ostream &stream, const BlockRequest *in
                 df::map_block * block = DFHack::Maps::getBlock(pos);
                 if (block != NULL)
                 {
-                    bool nonAir = false;
-                    for (int xxx = 0; xxx < 16; xxx++)
-                        for (int yyy = 0; yyy < 16; yyy++)
-                        {
-                            if ((DFHack::tileShapeBasic(DFHack::tileShape(block->tiletype[xxx][yyy])) != df::tiletype_shape_basic::None &&
-                                DFHack::tileShapeBasic(DFHack::tileShape(block->tiletype[xxx][yyy])) != df::tiletype_shape_basic::Open)
-                                || block->designation[xxx][yyy].bits.flow_size > 0
-                                || block->occupancy[xxx][yyy].bits.building > 0)
-                            {
-                                nonAir = true;
-                                goto ItsAir;
-                            }
-                        }
-                ItsAir:
+                    bool nonAir = !BlockMasks::isEmpty(BlockMasks::nonEmpty(block))
+                        || !BlockMasks::isEmpty(BlockMasks::liquid(block))
+                        || !BlockMasks::isEmpty(BlockMasks::building(block));
                     if (block->flows.size() > 0)
                         nonAir = true;
                     if (nonAir || firstBlock)
@@ -1557,7 +1512,6 @@ static command_result GetBlockList(color_ostream &stream, const BlockRequest *in
         ConvertDFCoord(wave->dest.x, wave->dest.y, wave->z, netWave->mutable_dest());
         ConvertDFCoord(wave->cur.x, wave->cur.y, wave->z, netWave->mutable_pos());
     }
-    MC.trash();
     return CR_OK;
 }
 
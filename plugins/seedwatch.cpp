@@ -12,14 +12,10 @@
 
 #include "modules/Items.h"
 #include "modules/Kitchen.h"
-#include "modules/Maps.h"
 #include "modules/Persistence.h"
-#include "modules/Units.h"
 #include "modules/World.h"
 
 #include "df/item.h"
-#include "df/item_flags.h"
-#include "df/items_other_id.h"
 #include "df/plant_raw.h"
 #include "df/world.h"
 
@@ -101,7 +97,7 @@ static bool validate_seed_config(color_ostream& out, PersistentDataItem c)
 }
 
 static const int32_t CYCLE_TICKS = 1229;
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+DFHACK_PLUGIN_UPDATE_CADENCE(CYCLE_TICKS, 0);
 
 static command_result do_command(color_ostream &out, vector<string> &parameters);
 static void do_cycle(color_ostream &out, int32_t *num_enabled_seeds = NULL, int32_t *num_disabled_seeds = NULL);
@@ -181,7 +177,6 @@ DFhackCExport command_result plugin_load_world_data (color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_load_site_data (color_ostream &out) {
-    cycle_timestamp = 0;
 
     watched_seeds.clear();
     vector<PersistentDataItem> seed_configs;
@@ -220,16 +215,14 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
 }
 
 DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (world->frame_counter - cycle_timestamp >= CYCLE_TICKS) {
-        int32_t num_enabled_seeds, num_disabled_seeds;
-        do_cycle(out, &num_enabled_seeds, &num_disabled_seeds);
-        if (0 < num_enabled_seeds)
-            out.print("%s: enabled %d seed types for cooking\n",
-                    plugin_name, num_enabled_seeds);
-        if (0 < num_disabled_seeds)
-            out.print("%s: protected %d seed types from cooking\n",
-                    plugin_name, num_disabled_seeds);
-    }
+    int32_t num_enabled_seeds, num_disabled_seeds;
+    do_cycle(out, &num_enabled_seeds, &num_disabled_seeds);
+    if (0 < num_enabled_seeds)
+        out.print("%s: enabled %d seed types for cooking\n",
+                plugin_name, num_enabled_seeds);
+    if (0 < num_disabled_seeds)
+        out.print("%s: protected %d seed types from cooking\n",
+                plugin_name, num_disabled_seeds);
     return CR_OK;
 }
 
@@ -254,52 +247,24 @@ static command_result do_command(color_ostream &out, vector<string> &parameters)
 // cycle logic
 //
 
-struct BadFlags {
-    uint32_t whole;
-
-    BadFlags() {
-        df::item_flags flags;
-        #define F(x) flags.bits.x = true;
-        F(dump); F(forbid); F(garbage_collect);
-        F(hostile); F(on_fire); F(rotten); F(trader);
-        F(in_building); F(construction); F(artifact);
-        F(in_job); F(owned); F(removed);
-        F(encased); F(spider_web);
-        #undef F
-        whole = flags.whole;
-    }
-};
-
-static bool is_accessible_item(df::item *item, const vector<df::unit *> &citizens) {
-    const df::coord pos = Items::getPosition(item);
-    for (auto &unit : citizens) {
-        if (Maps::canWalkBetween(Units::getPosition(unit), pos))
-            return true;
-    }
-    return false;
-}
-
 static void scan_seeds(color_ostream &out, unordered_map<int32_t, int32_t> *accessible_counts,
         unordered_map<int32_t, int32_t> *inaccessible_counts = NULL) {
-    static const BadFlags bad_flags;
-
-    vector<df::unit *> citizens;
-    Units::getCitizens(citizens, true);
+    auto census = Items::getCensus();
 
-    for (auto &item : world->items.other[items_other_id::SEEDS]) {
-        MaterialInfo mat(item);
-        if (mat.plant->index < 0 || !mat.isPlant())
+    for (auto &entry : census->entries) {
+        if (entry.first.type != item_type::SEEDS)
+            continue;
+        MaterialInfo mat(entry.first.mat_type, entry.first.mat_index);
+        if (!mat.isPlant() || mat.plant->index < 0)
             continue;
         auto plant = df::plant_raw::find(mat.plant->index);
         if (!plant || plant->flags.is_set(df::enums::plant_raw_flags::TREE))
             continue;
-        if ((bad_flags.whole & item->flags.whole) || !is_accessible_item(item, citizens)) {
-            if (inaccessible_counts)
-                ++(*inaccessible_counts)[mat.plant->index];
-        } else {
-            if (accessible_counts)
-                ++(*accessible_counts)[mat.plant->index];
-        }
+        auto &counts = entry.second;
+        if (inaccessible_counts)
+            (*inaccessible_counts)[mat.plant->index] += counts.all.items - counts.accessible.items;
+        if (accessible_counts)
+            (*accessible_counts)[mat.plant->index] += counts.accessible.items;
     }
 }
 
@@ -307,7 +272,7 @@ static void do_cycle(color_ostream &out, int32_t *num_enabled_seed_types, int32_
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
 
     // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
+    Core::getInstance().getPluginManager()->resetUpdateSchedule(plugin_name);
 
     if (num_enabled_seed_types)
         *num_enabled_seed_types = 0;